@@ -0,0 +1,298 @@
+/**
+ * MicroBench - Minimal Google Benchmark-style harness
+ *
+ * Enough of the Google Benchmark API shape to write the data-path
+ * microbenchmarks without another dependency:
+ *
+ *   static void BM_Parse(microbench::State& state) {
+ *       std::string body = makeBody(state.range());
+ *       for (auto _ : state) microbench::doNotOptimize(parse(body));
+ *       state.setItemsProcessed(state.iterations());
+ *   }
+ *   MICROBENCH(BM_Parse, 10, 1000, 100000);
+ *
+ * Each benchmark runs once per argument. The iteration count grows until a
+ * run takes at least --min-time seconds (default 0.2), and that run is
+ * reported. Work outside the loop is not timed. The console table goes to
+ * stdout, or with --json a document in Google Benchmark's JSON layout
+ * (context plus one entry per run), so its compare tools can read it.
+ * --filter=TEXT runs only benchmarks whose name contains TEXT.
+ */
+
+#pragma once
+
+#include "JsonBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace microbench {
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+class State
+{
+public:
+    State(int64_t argument, uint64_t iterationCount) : arg(argument), maxIterations(iterationCount) {}
+
+    int64_t range() const { return arg; }
+    uint64_t iterations() const { return maxIterations; }
+
+    void setItemsProcessed(uint64_t items) { itemsProcessed = items; }
+    void setBytesProcessed(uint64_t bytes) { bytesProcessed = bytes; }
+
+    // Excludes setup inside the loop (e.g. refilling a queue) from the time
+    void pauseTiming() {
+        pausedAt = std::chrono::steady_clock::now();
+        pausedCpuAt = std::clock();
+    }
+    void resumeTiming() {
+        excludedNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - pausedAt).count();
+        excludedCpu += std::clock() - pausedCpuAt;
+    }
+
+    // for (auto _ : state) runs the body iterations() times; the clock
+    // starts at begin() and stops when the loop ends
+    // A user-provided destructor keeps `auto _` from warning as set-but-unused
+    struct Iteration {
+        ~Iteration() {}
+    };
+    class Iterator
+    {
+    public:
+        Iterator(State* owner, uint64_t remainingCount) : state(owner), remaining(remainingCount) {}
+        Iteration operator*() const { return {}; }
+        Iterator& operator++() {
+            remaining--;
+            return *this;
+        }
+        bool operator!=(const Iterator&) {
+            if (remaining != 0) return true;
+            state->stop();
+            return false;
+        }
+
+    private:
+        State* state;
+        uint64_t remaining;
+    };
+
+    Iterator begin() {
+        startedCpuAt = std::clock();
+        startedAt = std::chrono::steady_clock::now();
+        return Iterator(this, maxIterations);
+    }
+    Iterator end() { return Iterator(this, 0); }
+
+    int64_t elapsedNs() const { return elapsed - excludedNs; }
+    double cpuNs() const {
+        return (double)(cpuElapsed - excludedCpu) * 1e9 / (double)CLOCKS_PER_SEC;
+    }
+    uint64_t items() const { return itemsProcessed; }
+    uint64_t bytes() const { return bytesProcessed; }
+
+private:
+    void stop() {
+        elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - startedAt).count();
+        cpuElapsed = std::clock() - startedCpuAt;
+    }
+
+    int64_t arg;
+    uint64_t maxIterations;
+    uint64_t itemsProcessed = 0;
+    uint64_t bytesProcessed = 0;
+    std::chrono::steady_clock::time_point startedAt, pausedAt;
+    std::clock_t startedCpuAt = 0, pausedCpuAt = 0, cpuElapsed = 0, excludedCpu = 0;
+    int64_t elapsed = 0;
+    int64_t excludedNs = 0;
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State&)> function;
+    std::vector<int64_t> arguments;   // Empty: run once with range() == 0
+};
+
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registrar {
+    Registrar(const char* name, std::function<void(State&)> function, std::vector<int64_t> arguments) {
+        registry().push_back({name, std::move(function), std::move(arguments)});
+    }
+};
+
+#define MICROBENCH_CONCAT_(a, b) a##b
+#define MICROBENCH_CONCAT(a, b) MICROBENCH_CONCAT_(a, b)
+#define MICROBENCH(function, ...) \
+    static ::microbench::Registrar MICROBENCH_CONCAT(microbenchRegistrar, __LINE__)(#function, function, {__VA_ARGS__})
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double realNs;   // Per iteration
+    double cpuNs;
+    double itemsPerSecond;
+    double bytesPerSecond;
+};
+
+// Locale-independent fixed-point text for JSON and the table
+inline std::string formatFixed(double value, int decimals) {
+    if (!std::isfinite(value) || value < 0) value = 0;
+    uint64_t scale = 1;
+    for (int i = 0; i < decimals; i++) scale *= 10;
+    uint64_t scaled = (uint64_t)std::llround(value * (double)scale);
+    std::string text = std::to_string(scaled / scale);
+    if (decimals > 0) {
+        std::string fraction = std::to_string(scaled % scale);
+        text += '.' + std::string((size_t)decimals - fraction.size(), '0') + fraction;
+    }
+    return text;
+}
+
+inline std::string formatRate(double perSecond, const char* unit) {
+    const char* prefixes[] = {"", "k", "M", "G", "T"};
+    size_t prefix = 0;
+    while (perSecond >= 1000.0 && prefix + 1 < sizeof(prefixes) / sizeof(prefixes[0])) {
+        perSecond /= 1000.0;
+        prefix++;
+    }
+    return formatFixed(perSecond, 2) + prefixes[prefix] + unit;
+}
+
+inline Result runOne(const Benchmark& benchmark, int64_t argument, bool hasArgument, double minTimeSec) {
+    uint64_t iterations = 1;
+    while (true) {
+        State state(argument, iterations);
+        benchmark.function(state);
+        double seconds = (double)state.elapsedNs() / 1e9;
+        bool last = seconds >= minTimeSec || iterations >= 1000000000ULL;
+        if (last) {
+            double secondsOrTiny = std::max(seconds, 1e-9);
+            return {hasArgument ? benchmark.name + "/" + std::to_string(argument) : benchmark.name,
+                    iterations,
+                    (double)state.elapsedNs() / (double)iterations,
+                    state.cpuNs() / (double)iterations,
+                    state.items() ? (double)state.items() / secondsOrTiny : 0.0,
+                    state.bytes() ? (double)state.bytes() / secondsOrTiny : 0.0};
+        }
+        // Aim 40% past the minimum, growing at most 10x per step, as Google Benchmark does
+        double multiplier = seconds > 0 ? minTimeSec * 1.4 / seconds : 10.0;
+        uint64_t next = (uint64_t)((double)iterations * std::min(std::max(multiplier, 1.0), 10.0));
+        iterations = std::max(next, iterations + 1);
+    }
+}
+
+inline std::string resultsJson(const std::vector<Result>& results, const char* executable) {
+    std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    JsonBuilder json;
+    json.startObject()
+        .key("context").startObject()
+            .key("date").value(date)
+            .key("executable").value(executable)
+            .key("num_cpus").value((int)std::thread::hardware_concurrency())
+#ifdef NDEBUG
+            .key("library_build_type").value("release")
+#else
+            .key("library_build_type").value("debug")
+#endif
+        .endObject()
+        .key("benchmarks").startArray();
+    for (const auto& result : results) {
+        std::string realTime = formatFixed(result.realNs, 3);
+        std::string cpuTime = formatFixed(result.cpuNs, 3);
+        json.startObject()
+            .key("name").value(result.name)
+            .key("run_name").value(result.name)
+            .key("run_type").value("iteration")
+            .key("iterations").value(result.iterations)
+            .key("real_time").rawValue(realTime.data(), realTime.size())
+            .key("cpu_time").rawValue(cpuTime.data(), cpuTime.size())
+            .key("time_unit").value("ns");
+        if (result.itemsPerSecond > 0) {
+            std::string items = formatFixed(result.itemsPerSecond, 1);
+            json.key("items_per_second").rawValue(items.data(), items.size());
+        }
+        if (result.bytesPerSecond > 0) {
+            std::string bytes = formatFixed(result.bytesPerSecond, 1);
+            json.key("bytes_per_second").rawValue(bytes.data(), bytes.size());
+        }
+        json.endObject();
+    }
+    json.endArray().endObject();
+    return json.toString();
+}
+
+// Parses --filter=, --min-time= and --json, runs the registry and prints
+// the results; returns the process exit code
+inline int runAll(int argc, char* argv[]) {
+    std::string filter;
+    double minTimeSec = 0.2;
+    bool jsonOutput = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(9);
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            minTimeSec = std::max(0.0, std::atof(arg.c_str() + 11));
+        } else if (arg == "--json") {
+            jsonOutput = true;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    if (!jsonOutput) {
+        std::printf("%-52s %14s %12s %12s %12s\n", "Benchmark", "Time", "Iterations", "Items", "Bytes");
+    }
+    for (const auto& benchmark : registry()) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) continue;
+        std::vector<int64_t> arguments = benchmark.arguments;
+        bool hasArgument = !arguments.empty();
+        if (!hasArgument) arguments.push_back(0);
+        for (int64_t argument : arguments) {
+            results.push_back(runOne(benchmark, argument, hasArgument, minTimeSec));
+            const Result& result = results.back();
+            if (!jsonOutput) {
+                std::printf("%-52s %11s ns %12llu %12s %12s\n", result.name.c_str(),
+                            formatFixed(result.realNs, 1).c_str(), (unsigned long long)result.iterations,
+                            result.itemsPerSecond > 0 ? formatRate(result.itemsPerSecond, "/s").c_str() : "",
+                            result.bytesPerSecond > 0 ? formatRate(result.bytesPerSecond, "B/s").c_str() : "");
+                std::fflush(stdout);
+            }
+        }
+    }
+    // stdio rather than std::cout, which a benchmark binary may redirect
+    if (jsonOutput) std::printf("%s\n", resultsJson(results, argv[0]).c_str());
+    return 0;
+}
+
+} // namespace microbench
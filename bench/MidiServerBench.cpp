@@ -0,0 +1,655 @@
+/**
+ * MidiServerBench - End-to-end benchmark of the MIDI HTTP Server
+ *
+ * Runs two servers in this process, A and B, each with its own routes file in
+ * a temporary directory, and measures what clients see:
+ * - local route: a virtual input on A routed to a virtual output on A
+ * - remote routes: a virtual input on A routed to a virtual output on B, over
+ *   HTTP and over a midi+tcp stream
+ * - HTTP: POST /virtual/:id/send round trips, and how long a waiting long
+ *   poll takes to answer once a message arrives
+ * - SysEx reassembly in MidiPort's input callback
+ * - resident memory while routes carry traffic for a while
+ *
+ * Messages enter with VirtualMidiPort::injectMessage, as if from the OS, and
+ * are timed when the OS hands them back: each virtual output is opened as an
+ * input device (loopback). Where the OS doesn't list a process's own virtual
+ * ports, the output port's queue is read instead; "capture" in the results
+ * says which. Every message is a poly aftertouch whose channel, key and value
+ * encode a sequence number, so arrivals are matched without extra state.
+ *
+ * Prints one JSON document on stdout; server logs go to stderr.
+ */
+
+#include "MidiHttpServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// 4 bits of channel, 7 of key, 7 of value
+constexpr uint32_t sequenceSpace = 1u << 18;
+constexpr size_t warmupMessages = 50;
+
+struct BenchOptions {
+    int port = 17700;                   // A, B and B's stream listener use port, port+1, port+2
+    size_t messages = 2000;             // Per latency run
+    size_t rate = 1000;                 // Messages per second in latency and memory runs
+    size_t burst = 20000;               // Per throughput run, injected back to back
+    size_t pollRounds = 200;
+    size_t sysexBytes = 4096;
+    size_t sysexFragmentBytes = 256;
+    size_t sysexMessages = 20000;
+    size_t memorySeconds = 10;
+    bool loopback = true;
+    bool remoteBatching = false;
+    std::string outputPath;             // Empty: stdout
+};
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+MidiPacket encodeSequence(uint32_t sequence) {
+    uint8_t bytes[3] = {(uint8_t)(0xA0 | ((sequence >> 14) & 0x0F)),
+                        (uint8_t)((sequence >> 7) & 0x7F),
+                        (uint8_t)(sequence & 0x7F)};
+    return MidiPacket(bytes, sizeof(bytes));
+}
+
+bool decodeSequence(const uint8_t* data, size_t size, uint32_t& sequence) {
+    if (size != 3 || (data[0] & 0xF0) != 0xA0) return false;
+    sequence = ((uint32_t)(data[0] & 0x0F) << 14) | ((uint32_t)data[1] << 7) | data[2];
+    return true;
+}
+
+// Arrival time of each sequence number; written by the capture thread
+class ArrivalRecorder
+{
+public:
+    ArrivalRecorder() : arrivals(sequenceSpace) { reset(); }
+
+    void reset() {
+        for (auto& arrival : arrivals) arrival.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_release);
+    }
+
+    // Duplicates keep their first arrival
+    void record(const uint8_t* data, size_t size) {
+        uint32_t sequence;
+        if (!decodeSequence(data, size, sequence)) return;
+        int64_t expected = 0;
+        if (arrivals[sequence].compare_exchange_strong(expected, nowNs(), std::memory_order_relaxed)) {
+            count.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    size_t received() const { return count.load(std::memory_order_acquire); }
+
+    int64_t arrivalNs(uint32_t sequence) const { return arrivals[sequence].load(std::memory_order_relaxed); }
+
+    // Returns false once nothing has arrived for idleTimeout (the rest is lost)
+    bool waitFor(size_t expected, std::chrono::milliseconds idleTimeout) {
+        size_t last = received();
+        auto deadline = Clock::now() + idleTimeout;
+        while (last < expected) {
+            if (Clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            size_t current = received();
+            if (current != last) deadline = Clock::now() + idleTimeout;
+            last = current;
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::atomic<int64_t>> arrivals;
+    std::atomic<size_t> count{0};
+};
+
+// Feeds a recorder with what a virtual output emits: through the OS when the
+// output is listed as an input device, otherwise from the port's queue
+class OutputCapture : public juce::MidiInputCallback
+{
+public:
+    OutputCapture(ArrivalRecorder& arrivalRecorder) : recorder(arrivalRecorder) {}
+
+    ~OutputCapture() override {
+        if (input) input->stop();
+        running = false;
+        if (queueThread.joinable()) queueThread.join();
+    }
+
+    bool openLoopback(const std::string& deviceName) {
+        // The OS may list a new virtual port a little later
+        for (int attempt = 0; attempt < 10; attempt++) {
+            for (const auto& device : juce::MidiInput::getAvailableDevices()) {
+                if (device.name.toStdString() == deviceName) {
+                    input = juce::MidiInput::openDevice(device.identifier, this);
+                    if (!input) return false;
+                    input->start();
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return false;
+    }
+
+    void readQueue(std::shared_ptr<VirtualMidiPort> port) {
+        queueThread = std::thread([this, port]() {
+            while (running) {
+                if (!port->waitForMessages(std::chrono::milliseconds(100))) continue;
+                for (const auto& message : port->getMessages()) recorder.record(message.data(), message.size());
+            }
+        });
+    }
+
+    void handleIncomingMidiMessage(juce::MidiInput*, const juce::MidiMessage& message) override {
+        recorder.record(message.getRawData(), (size_t)message.getRawDataSize());
+    }
+
+private:
+    ArrivalRecorder& recorder;
+    std::unique_ptr<juce::MidiInput> input;
+    std::thread queueThread;
+    std::atomic<bool> running{true};
+};
+
+// One virtual output and what arrives at it
+struct RouteProbe {
+    std::string name;                   // Result key
+    std::shared_ptr<VirtualMidiPort> input;
+    ArrivalRecorder recorder;
+    std::unique_ptr<OutputCapture> capture;
+};
+
+void appendLatencyJson(JsonBuilder& json, std::vector<int64_t> samplesNs, size_t lost) {
+    std::sort(samplesNs.begin(), samplesNs.end());
+    auto micros = [](int64_t ns) { return (uint64_t)((std::max<int64_t>(ns, 0) + 500) / 1000); };
+    auto percentile = [&](double p) -> uint64_t {
+        if (samplesNs.empty()) return 0;
+        size_t rank = (size_t)std::ceil(p / 100.0 * (double)samplesNs.size());
+        return micros(samplesNs[std::min(samplesNs.size(), std::max<size_t>(rank, 1)) - 1]);
+    };
+    int64_t sum = 0;
+    for (int64_t sample : samplesNs) sum += sample;
+    json.startObject()
+        .key("count").value((uint64_t)samplesNs.size())
+        .key("lost").value((uint64_t)lost)
+        .key("mean").value(samplesNs.empty() ? (uint64_t)0 : micros(sum / (int64_t)samplesNs.size()))
+        .key("p50").value(percentile(50.0))
+        .key("p90").value(percentile(90.0))
+        .key("p99").value(percentile(99.0))
+        .key("p999").value(percentile(99.9))
+        .key("max").value(samplesNs.empty() ? (uint64_t)0 : micros(samplesNs.back()))
+        .endObject();
+}
+
+uint64_t perSecond(uint64_t count, int64_t elapsedNs) {
+    return elapsedNs > 0 ? (uint64_t)((double)count * 1e9 / (double)elapsedNs) : 0;
+}
+
+// Paced injection, one message per 1/rate s, then latency of each arrival
+void runLatency(RouteProbe& probe, const BenchOptions& options, JsonBuilder& json) {
+    size_t count = std::min<size_t>(options.messages, sequenceSpace);
+    std::vector<int64_t> sentNs(count);
+    auto interval = std::chrono::nanoseconds(1000000000LL / (int64_t)std::max<size_t>(options.rate, 1));
+
+    probe.recorder.reset();
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; i++) {
+        std::this_thread::sleep_until(start + interval * (int64_t)i);
+        sentNs[i] = nowNs();
+        probe.input->injectMessage(encodeSequence((uint32_t)i));
+    }
+    probe.recorder.waitFor(count, std::chrono::milliseconds(1000));
+
+    std::vector<int64_t> samples;
+    samples.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        int64_t arrival = probe.recorder.arrivalNs((uint32_t)i);
+        if (arrival != 0) samples.push_back(arrival - sentNs[i]);
+    }
+    json.key("latencyUs");
+    appendLatencyJson(json, samples, count - samples.size());
+}
+
+// Back-to-back injection; rate is measured to the last arrival
+void runThroughput(RouteProbe& probe, const BenchOptions& options, JsonBuilder& json) {
+    size_t count = std::min<size_t>(options.burst, sequenceSpace);
+    probe.recorder.reset();
+    int64_t startNs = nowNs();
+    for (size_t i = 0; i < count; i++) probe.input->injectMessage(encodeSequence((uint32_t)i));
+    int64_t injectedNs = nowNs();
+    probe.recorder.waitFor(count, std::chrono::milliseconds(1000));
+
+    int64_t lastNs = startNs;
+    for (size_t i = 0; i < count; i++) lastNs = std::max(lastNs, probe.recorder.arrivalNs((uint32_t)i));
+    size_t received = probe.recorder.received();
+    json.key("throughput").startObject()
+        .key("messages").value((uint64_t)count)
+        .key("received").value((uint64_t)received)
+        .key("injectUs").value((uint64_t)((injectedNs - startNs) / 1000))
+        .key("elapsedUs").value((uint64_t)((lastNs - startNs) / 1000))
+        .key("messagesPerSec").value(perSecond(received, lastNs - startNs))
+        .endObject();
+}
+
+void runRoute(RouteProbe& probe, const BenchOptions& options, JsonBuilder& json) {
+    // Connections to B and the OS ports are set up by the first messages
+    probe.recorder.reset();
+    for (size_t i = 0; i < warmupMessages; i++) probe.input->injectMessage(encodeSequence((uint32_t)i));
+    bool warm = probe.recorder.waitFor(warmupMessages, std::chrono::milliseconds(5000));
+    if (!warm) {
+        std::cerr << "[MidiServerBench] " << probe.name << ": only " << probe.recorder.received()
+                  << " of " << warmupMessages << " warm-up messages arrived" << std::endl;
+    }
+
+    std::cerr << "[MidiServerBench] " << probe.name << ": latency" << std::endl;
+    json.key(probe.name).startObject();
+    runLatency(probe, options, json);
+    std::cerr << "[MidiServerBench] " << probe.name << ": throughput" << std::endl;
+    runThroughput(probe, options, json);
+    json.endObject();
+}
+
+void runHttp(MidiHttpServer& server, const BenchOptions& options, JsonBuilder& json) {
+    std::cerr << "[MidiServerBench] http: send and poll" << std::endl;
+    httplib::Client client("127.0.0.1", options.port);
+    client.set_keep_alive(true);
+    client.set_tcp_nodelay(true);
+    const std::string body("\xBF\x50\x00", 3);
+
+    std::vector<int64_t> sendSamples;
+    size_t sendErrors = 0;
+    for (size_t i = 0; i < options.messages; i++) {
+        int64_t startNs = nowNs();
+        auto res = client.Post("/virtual/bench-out/send", body, "application/octet-stream");
+        if (res && res->status == 200) {
+            sendSamples.push_back(nowNs() - startNs);
+        } else {
+            sendErrors++;
+        }
+    }
+
+    // A long poll is given time to reach the server and block before the
+    // message is injected; a poll that returns early isn't counted
+    auto port = server.findVirtualPort("bench-poll");
+    httplib::Client pollClient("127.0.0.1", options.port);
+    pollClient.set_keep_alive(true);
+    pollClient.set_tcp_nodelay(true);
+    std::vector<int64_t> pollSamples;
+    size_t pollMisses = 0;
+    for (size_t i = 0; port && i < options.pollRounds; i++) {
+        auto answered = std::async(std::launch::async, [&pollClient]() {
+            auto res = pollClient.Get("/virtual/bench-poll/messages?timeout=1000");
+            return (res && res->status == 200) ? nowNs() : (int64_t)0;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        int64_t injectedNs = nowNs();
+        port->injectMessage(encodeSequence((uint32_t)i));
+        int64_t answeredNs = answered.get();
+        if (answeredNs > injectedNs) {
+            pollSamples.push_back(answeredNs - injectedNs);
+        } else {
+            pollMisses++;
+        }
+    }
+
+    json.key("http").startObject().key("sendUs");
+    appendLatencyJson(json, sendSamples, sendErrors);
+    json.key("pollWakeUs");
+    appendLatencyJson(json, pollSamples, pollMisses);
+    json.endObject();
+}
+
+// Feeds MidiPort's input callback with each SysEx split into fragments, as
+// some drivers deliver them
+void runSysEx(const BenchOptions& options, JsonBuilder& json) {
+    std::cerr << "[MidiServerBench] sysex: reassembly" << std::endl;
+    MidiQueueConfig queueConfig;
+    queueConfig.capacity = 4096;
+    queueConfig.maxSysExBytes = 256 * 1024 * 1024;
+    MidiPort port("bench-sysex", "bench-sysex", true, queueConfig);
+
+    size_t size = std::max<size_t>(options.sysexBytes, 3);
+    size_t fragmentBytes = std::max<size_t>(options.sysexFragmentBytes, 1);
+    std::vector<uint8_t> sysex(size);
+    sysex.front() = 0xF0;
+    sysex[1] = 0x7D;  // Non-commercial manufacturer id
+    for (size_t i = 2; i + 1 < size; i++) sysex[i] = (uint8_t)(i & 0x7F);
+    sysex.back() = 0xF7;
+
+    std::vector<juce::MidiMessage> fragments;
+    for (size_t offset = 0; offset < size; offset += fragmentBytes) {
+        size_t length = std::min(fragmentBytes, size - offset);
+        fragments.emplace_back(sysex.data() + offset, (int)length, 0.0);
+    }
+
+    size_t completed = 0;
+    uint64_t completedBytes = 0;
+    auto drain = [&]() {
+        for (const auto& message : port.getMessages()) {
+            completed++;
+            completedBytes += message.size();
+        }
+    };
+    int64_t startNs = nowNs();
+    for (size_t i = 0; i < options.sysexMessages; i++) {
+        for (const auto& fragment : fragments) port.handleIncomingMidiMessage(nullptr, fragment);
+        if (i % 256 == 255) drain();
+    }
+    drain();
+    int64_t elapsedNs = nowNs() - startNs;
+
+    json.key("sysex").startObject()
+        .key("messageBytes").value((uint64_t)size)
+        .key("fragmentBytes").value((uint64_t)fragmentBytes)
+        .key("fragments").value((uint64_t)fragments.size())
+        .key("messages").value((uint64_t)options.sysexMessages)
+        .key("completed").value((uint64_t)completed)
+        .key("elapsedUs").value((uint64_t)(elapsedNs / 1000))
+        .key("messagesPerSec").value(perSecond(completed, elapsedNs))
+        .key("bytesPerSec").value(perSecond(completedBytes, elapsedNs))
+        .endObject();
+}
+
+uint64_t residentKb() {
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return (uint64_t)info.resident_size / 1024;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return (uint64_t)counters.WorkingSetSize / 1024;
+#else
+    std::ifstream statm("/proc/self/statm");
+    uint64_t sizePages = 0, residentPages = 0;
+    if (!(statm >> sizePages >> residentPages)) return 0;
+    return residentPages * (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+#endif
+}
+
+// Keeps every route busy at the latency rate and samples RSS once a second
+void runMemory(const std::vector<RouteProbe*>& probes, const BenchOptions& options, JsonBuilder& json) {
+    std::cerr << "[MidiServerBench] memory: " << options.memorySeconds << " s" << std::endl;
+    auto interval = std::chrono::nanoseconds(1000000000LL / (int64_t)std::max<size_t>(options.rate, 1));
+    uint64_t startKb = residentKb();
+    uint64_t peakKb = startKb;
+    uint64_t injected = 0;
+    std::vector<uint64_t> samples;
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(options.memorySeconds);
+    auto nextSample = start + std::chrono::seconds(1);
+    for (uint64_t i = 0; Clock::now() < end; i++) {
+        std::this_thread::sleep_until(start + interval * (int64_t)i);
+        MidiPacket message = encodeSequence((uint32_t)(i % sequenceSpace));
+        for (auto* probe : probes) probe->input->injectMessage(message);
+        injected += probes.size();
+        if (Clock::now() >= nextSample) {
+            samples.push_back(residentKb());
+            peakKb = std::max(peakKb, samples.back());
+            nextSample += std::chrono::seconds(1);
+        }
+    }
+    uint64_t endKb = residentKb();
+    peakKb = std::max(peakKb, endKb);
+
+    json.key("memory").startObject()
+        .key("seconds").value((uint64_t)options.memorySeconds)
+        .key("messages").value(injected)
+        .key("rssStartKb").value(startKb)
+        .key("rssEndKb").value(endKb)
+        .key("rssPeakKb").value(peakKb)
+        .key("growthKb").value((int)((int64_t)endKb - (int64_t)startKb))
+        .key("rssSamplesKb").startArray();
+    for (uint64_t sample : samples) json.arrayValue((int)sample);
+    json.endArray().endObject();
+}
+
+bool request(httplib::Client& client, const std::string& path, const std::string& body) {
+    auto res = client.Post(path, body, "application/json");
+    if (res && (res->status == 200 || res->status == 201) &&
+        res->body.find("\"success\":false") == std::string::npos) {
+        return true;
+    }
+    std::cerr << "[MidiServerBench] POST " << path << " failed: "
+              << (res ? std::to_string(res->status) + " " + res->body : httplib::to_string(res.error()))
+              << std::endl;
+    return false;
+}
+
+bool waitForHealth(int port) {
+    httplib::Client client("127.0.0.1", port);
+    for (int attempt = 0; attempt < 100; attempt++) {
+        auto res = client.Get("/health");
+        if (res && res->status == 200) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    std::cerr << "[MidiServerBench] Server on port " << port << " did not start" << std::endl;
+    return false;
+}
+
+// "bench-remote-out" -> "midi-server-bench remote-out", as the OS lists it
+std::string deviceNameFor(const std::string& virtualId) {
+    return "midi-server-bench " + virtualId.substr(6);
+}
+
+std::string virtualPortBody(const std::string& virtualId, bool isInput) {
+    JsonBuilder json;
+    json.startObject().key("name").value(deviceNameFor(virtualId)).key("type").value(isInput ? "input" : "output");
+    // Room for a whole burst when the queue is what's measured
+    if (!isInput) json.key("queueCapacity").value(65536);
+    json.endObject();
+    return json.toString();
+}
+
+std::string routeBody(const std::string& sourceId, const std::string& destinationUrl,
+                      const std::string& destinationId) {
+    JsonBuilder json;
+    json.startObject()
+        .key("source").startObject()
+            .key("serverUrl").value("local").key("portId").value("virtual:" + sourceId).key("portName").value(sourceId)
+        .endObject()
+        .key("destination").startObject()
+            .key("serverUrl").value(destinationUrl).key("portId").value("virtual:" + destinationId)
+            .key("portName").value(destinationId)
+        .endObject()
+        .endObject();
+    return json.toString();
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options) {
+    auto number = [](const std::string& arg, size_t prefix) {
+        return (size_t)std::max(0LL, std::atoll(arg.c_str() + prefix));
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--port=", 0) == 0) {
+            options.port = std::clamp(std::atoi(arg.c_str() + 7), 1, 65533);
+        } else if (arg.rfind("--messages=", 0) == 0) {
+            options.messages = number(arg, 11);
+        } else if (arg.rfind("--rate=", 0) == 0) {
+            options.rate = number(arg, 7);
+        } else if (arg.rfind("--burst=", 0) == 0) {
+            options.burst = number(arg, 8);
+        } else if (arg.rfind("--poll-rounds=", 0) == 0) {
+            options.pollRounds = number(arg, 14);
+        } else if (arg.rfind("--sysex-bytes=", 0) == 0) {
+            options.sysexBytes = number(arg, 14);
+        } else if (arg.rfind("--sysex-fragment-bytes=", 0) == 0) {
+            options.sysexFragmentBytes = number(arg, 23);
+        } else if (arg.rfind("--sysex-messages=", 0) == 0) {
+            options.sysexMessages = number(arg, 17);
+        } else if (arg.rfind("--memory-seconds=", 0) == 0) {
+            options.memorySeconds = number(arg, 17);
+        } else if (arg == "--capture=queue") {
+            options.loopback = false;
+        } else if (arg == "--capture=loopback") {
+            options.loopback = true;
+        } else if (arg == "--remote-batching") {
+            options.remoteBatching = true;
+        } else if (arg.rfind("--output=", 0) == 0) {
+            options.outputPath = arg.substr(9);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    //   midi-server-bench [--port=N] [--messages=N] [--rate=N] [--burst=N]
+    //                     [--poll-rounds=N] [--sysex-bytes=N] [--sysex-fragment-bytes=N]
+    //                     [--sysex-messages=N] [--memory-seconds=N]
+    //                     [--capture=loopback|queue] [--remote-batching] [--output=FILE]
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    // Server logs would interleave with the results otherwise
+    std::streambuf* resultsBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    juce::ScopedJuceInitialiser_GUI juceInit;
+
+    auto workDir = std::filesystem::temp_directory_path() /
+                   ("midi-server-bench-" + std::to_string(Clock::now().time_since_epoch().count()));
+    HttpServerConfig httpConfig;
+    httpConfig.host = "127.0.0.1";
+
+    auto serverA = std::make_unique<MidiHttpServer>(options.port, (workDir / "a" / "routes.json").string());
+    auto serverB = std::make_unique<MidiHttpServer>(options.port + 1, (workDir / "b" / "routes.json").string());
+    RemoteForwarderConfig remoteConfig;
+    remoteConfig.batching = options.remoteBatching;
+    serverA->setRemoteForwarderConfig(remoteConfig);
+    serverA->setHttpConfig(httpConfig);
+    serverB->setHttpConfig(httpConfig);
+    serverB->setStreamPort(options.port + 2);
+    serverA->startServer();
+    serverB->startServer();
+
+    bool ready = waitForHealth(options.port) && waitForHealth(options.port + 1);
+    httplib::Client clientA("127.0.0.1", options.port);
+    httplib::Client clientB("127.0.0.1", options.port + 1);
+    std::string urlB = "http://127.0.0.1:" + std::to_string(options.port + 1);
+    std::string streamB = "midi+tcp://127.0.0.1:" + std::to_string(options.port + 2);
+    ready = ready &&
+        request(clientA, "/virtual/bench-in", virtualPortBody("bench-in", true)) &&
+        request(clientA, "/virtual/bench-out", virtualPortBody("bench-out", false)) &&
+        request(clientA, "/virtual/bench-remote-in", virtualPortBody("bench-remote-in", true)) &&
+        request(clientA, "/virtual/bench-stream-in", virtualPortBody("bench-stream-in", true)) &&
+        request(clientA, "/virtual/bench-poll", virtualPortBody("bench-poll", true)) &&
+        request(clientB, "/virtual/bench-remote-out", virtualPortBody("bench-remote-out", false)) &&
+        request(clientB, "/virtual/bench-stream-out", virtualPortBody("bench-stream-out", false)) &&
+        request(clientA, "/routes", routeBody("bench-in", "local", "bench-out")) &&
+        request(clientA, "/routes", routeBody("bench-remote-in", urlB, "bench-remote-out")) &&
+        request(clientA, "/routes", routeBody("bench-stream-in", streamB, "bench-stream-out"));
+
+    // Probes are set up before any results are written, since falling back
+    // to queue capture for one of them changes the "capture" field
+    struct ProbeSpec { const char* name; MidiHttpServer* outputServer; const char* input; const char* output; };
+    const ProbeSpec specs[] = {
+        {"localRoute", serverA.get(), "bench-in", "bench-out"},
+        {"remoteHttpRoute", serverB.get(), "bench-remote-in", "bench-remote-out"},
+        {"remoteStreamRoute", serverB.get(), "bench-stream-in", "bench-stream-out"},
+    };
+    std::vector<std::unique_ptr<RouteProbe>> probes;
+    bool allLoopback = options.loopback;
+    for (const auto& spec : specs) {
+        if (!ready) break;
+        auto probe = std::make_unique<RouteProbe>();
+        probe->name = spec.name;
+        probe->input = serverA->findVirtualPort(spec.input);
+        auto output = spec.outputServer->findVirtualPort(spec.output);
+        if (!probe->input || !output) {
+            ready = false;
+            break;
+        }
+        probe->capture = std::make_unique<OutputCapture>(probe->recorder);
+        std::string deviceName = deviceNameFor(spec.output);
+        if (!options.loopback || !probe->capture->openLoopback(deviceName)) {
+            if (options.loopback) {
+                std::cerr << "[MidiServerBench] " << deviceName
+                          << " is not listed as an input device; reading its queue instead" << std::endl;
+            }
+            probe->capture->readQueue(output);
+            allLoopback = false;
+        }
+        probes.push_back(std::move(probe));
+    }
+
+    int exitCode = 1;
+    std::string results;
+    if (ready) {
+        JsonBuilder json;
+        json.startObject()
+            .key("benchmark").value("midi-server-bench")
+            .key("capture").value(allLoopback ? "loopback" : "queue")
+            .key("options").startObject()
+                .key("messages").value((uint64_t)options.messages)
+                .key("rate").value((uint64_t)options.rate)
+                .key("burst").value((uint64_t)options.burst)
+                .key("remoteBatching").value(options.remoteBatching)
+            .endObject();
+        for (auto& probe : probes) runRoute(*probe, options, json);
+        runHttp(*serverA, options, json);
+        runSysEx(options, json);
+        std::vector<RouteProbe*> busy;
+        for (auto& probe : probes) busy.push_back(probe.get());
+        runMemory(busy, options, json);
+        json.endObject();
+        results = json.toString();
+    }
+
+    // Shutdown logs too stay off stdout
+    probes.clear();
+    serverA->stopServer();
+    serverB->stopServer();
+    serverA.reset();
+    serverB.reset();
+    std::cout.rdbuf(resultsBuffer);
+    if (!results.empty()) {
+        if (options.outputPath.empty()) {
+            std::cout << results << std::endl;
+            exitCode = 0;
+        } else {
+            std::ofstream out(options.outputPath);
+            out << results << std::endl;
+            exitCode = out ? 0 : 1;
+        }
+    }
+    std::error_code ignored;
+    std::filesystem::remove_all(workDir, ignored);
+    return exitCode;
+}
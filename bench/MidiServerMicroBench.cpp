@@ -0,0 +1,274 @@
+/**
+ * MidiServerMicroBench - Microbenchmarks of the data-path building blocks
+ *
+ * Links only midi-server-core (no JUCE), so each piece is timed on its own:
+ * - RouteManager: getRoutesForSource and forwardMessage with 10 to 10k routes,
+ *   and forwarding to remote routes
+ * - JsonBuilder: message arrays and SysEx as they appear in /messages bodies
+ * - MidiSendBody: /send and /inject bodies, JSON and octet-stream
+ * - Remote forwarding: parsing a route's serverUrl, and the path and JSON
+ *   body of a single-message POST
+ * - MidiSysExAssembler: SysEx delivered in 256-byte fragments
+ * - MidiBufferPool: payload copies in pooled buffers against new vectors
+ *
+ * Usage: midi-server-microbench [--filter=TEXT] [--min-time=S] [--json]
+ * Results go to stdout; RouteManager's logs go to stderr.
+ */
+
+#include "MicroBench.h"
+
+#include "JsonBuilder.h"
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+#include "MidiSendBody.h"
+#include "MidiSysExAssembler.h"
+#include "RemoteForwarder.h"
+#include "RouteManager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+// Sources the benchmark routes are spread over; a lookup matches 1/64 of them
+constexpr int64_t sourceCount = 64;
+
+std::filesystem::path& workDir() {
+    static std::filesystem::path dir = std::filesystem::temp_directory_path() /
+        ("midi-server-microbench-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    return dir;
+}
+
+// A RouteManager with `count` routes to serverUrl, its file in the work directory
+std::unique_ptr<RouteManager> makeRouteManager(int64_t count, const std::string& serverUrl = "local") {
+    // Each manager saves its routes on destruction; start without them
+    std::filesystem::path routesFile = workDir() / "routes.json";
+    std::error_code ignored;
+    std::filesystem::remove(routesFile, ignored);
+    auto manager = std::make_unique<RouteManager>(routesFile.string());
+    std::vector<MidiRoute> routes((size_t)count);
+    for (int64_t i = 0; i < count; i++) {
+        MidiRoute& route = routes[(size_t)i];
+        route.id = "route-" + std::to_string(i);
+        route.source = {"local", "input-" + std::to_string(i % sourceCount), "Input"};
+        route.destination = {serverUrl, "output-" + std::to_string(i), "Output"};
+    }
+    manager->applyRoutes(routes, {});
+    return manager;
+}
+
+std::vector<uint8_t> makeSysEx(size_t size) {
+    std::vector<uint8_t> bytes(std::max<size_t>(size, 3));
+    bytes.front() = 0xF0;
+    bytes[1] = 0x7D;  // Non-commercial manufacturer id
+    for (size_t i = 2; i + 1 < bytes.size(); i++) bytes[i] = (uint8_t)(i & 0x7F);
+    bytes.back() = 0xF7;
+    return bytes;
+}
+
+// A note on for 3 bytes, otherwise a SysEx of that size
+MidiPacket makeMessage(int64_t size) {
+    if (size <= 3) {
+        const uint8_t noteOn[] = {0x90, 0x3C, 0x7F};
+        return MidiPacket(noteOn, sizeof(noteOn));
+    }
+    return MidiPacket(makeSysEx((size_t)size));
+}
+
+void BM_RouteManager_getRoutesForSource(microbench::State& state) {
+    auto manager = makeRouteManager(state.range());
+    for (auto _ : state) microbench::doNotOptimize(manager->getRoutesForSource("input-0"));
+    state.setItemsProcessed(state.iterations());
+}
+MICROBENCH(BM_RouteManager_getRoutesForSource, 10, 100, 1000, 10000);
+
+// The MIDI-thread path: dispatch table lookup and one local send per match
+void BM_RouteManager_forwardMessage(microbench::State& state) {
+    auto manager = makeRouteManager(state.range());
+    std::atomic<uint64_t> delivered{0};
+    manager->setLocalMessageForwarder([&delivered](const std::string&, const MidiPacket&) {
+        delivered.fetch_add(1, std::memory_order_relaxed);
+    });
+    MidiPacket message = makeMessage(3);
+    for (auto _ : state) manager->forwardMessage("input-0", message);
+    state.setItemsProcessed(state.iterations());
+}
+MICROBENCH(BM_RouteManager_forwardMessage, 10, 100, 1000, 10000);
+
+// The MIDI-thread side of remote routes: the enqueue on the host's
+// forwarder. Nothing listens on the discard port, so the worker's sends fail
+// and its breaker opens; the bounded queue drops the oldest messages.
+void BM_RouteManager_forwardRemote(microbench::State& state) {
+    auto manager = makeRouteManager(state.range(), "http://127.0.0.1:9");
+    MidiPacket message = makeMessage(3);
+    for (auto _ : state) manager->forwardMessage("input-0", message);
+    state.setItemsProcessed(state.iterations() * (uint64_t)((state.range() + sourceCount - 1) / sourceCount));
+}
+MICROBENCH(BM_RouteManager_forwardRemote, 64, 1024);
+
+// {"messages":[[144,60,127],...]} as in a /messages response
+void BM_JsonBuilder_messageArray(microbench::State& state) {
+    std::vector<MidiPacket> messages((size_t)state.range(), makeMessage(3));
+    JsonBuilder json;
+    for (auto _ : state) {
+        json.clear();
+        json.startObject().key("messages").startArray();
+        for (const auto& message : messages) json.byteArray(message.data(), message.size());
+        json.endArray().endObject();
+        microbench::doNotOptimize(json.str());
+    }
+    state.setItemsProcessed(state.iterations() * (uint64_t)state.range());
+    state.setBytesProcessed(state.iterations() * json.size());
+}
+MICROBENCH(BM_JsonBuilder_messageArray, 10, 100, 1000, 10000);
+
+void BM_JsonBuilder_sysexBytes(microbench::State& state) {
+    std::vector<uint8_t> sysex = makeSysEx((size_t)state.range());
+    JsonBuilder json;
+    for (auto _ : state) {
+        json.clear();
+        json.byteArray(sysex.data(), sysex.size());
+        microbench::doNotOptimize(json.str());
+    }
+    state.setBytesProcessed(state.iterations() * sysex.size());
+}
+MICROBENCH(BM_JsonBuilder_sysexBytes, 256, 4096, 65536, 1048576);
+
+void BM_JsonBuilder_sysexHex(microbench::State& state) {
+    std::vector<uint8_t> sysex = makeSysEx((size_t)state.range());
+    JsonBuilder json;
+    for (auto _ : state) {
+        json.clear();
+        json.hexValue(sysex.data(), sysex.size());
+        microbench::doNotOptimize(json.str());
+    }
+    state.setBytesProcessed(state.iterations() * sysex.size());
+}
+MICROBENCH(BM_JsonBuilder_sysexHex, 256, 4096, 65536, 1048576);
+
+// {"message":[...]} with a message of range() bytes
+void BM_SendBody_json(microbench::State& state) {
+    MidiPacket source = makeMessage(state.range());
+    JsonBuilder json;
+    json.startObject().key("message").byteArray(source.data(), source.size()).endObject();
+    const std::string body = json.toString();
+    const std::string contentType = "application/json";
+    MidiPacket message;
+    std::string error;
+    for (auto _ : state) {
+        bool parsed = MidiSendBody::parse(contentType, body, message, error);
+        microbench::doNotOptimize(parsed);
+        microbench::doNotOptimize(message);
+    }
+    state.setItemsProcessed(state.iterations());
+    state.setBytesProcessed(state.iterations() * body.size());
+}
+MICROBENCH(BM_SendBody_json, 3, 256, 4096, 65536);
+
+void BM_SendBody_octetStream(microbench::State& state) {
+    MidiPacket source = makeMessage(state.range());
+    const std::string body(reinterpret_cast<const char*>(source.data()), source.size());
+    const std::string contentType = "application/octet-stream";
+    MidiPacket message;
+    std::string error;
+    for (auto _ : state) {
+        bool parsed = MidiSendBody::parse(contentType, body, message, error);
+        microbench::doNotOptimize(parsed);
+        microbench::doNotOptimize(message);
+    }
+    state.setItemsProcessed(state.iterations());
+    state.setBytesProcessed(state.iterations() * body.size());
+}
+MICROBENCH(BM_SendBody_octetStream, 3, 256, 4096, 65536);
+
+// Done once per remote route, when it is added or loaded
+void BM_Remote_parseUrl(microbench::State& state) {
+    const std::string url = state.range() == 0 ? "http://192.168.1.20:7777" : "midi+tcp://192.168.1.20:7778";
+    std::string host;
+    int port = 0;
+    RemoteTransport transport;
+    for (auto _ : state) {
+        bool parsed = RouteManager::parseRemoteUrl(url, host, port, transport);
+        microbench::doNotOptimize(parsed);
+        microbench::doNotOptimize(host);
+        microbench::doNotOptimize(port);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+MICROBENCH(BM_Remote_parseUrl, 0, 1);
+
+// Path and body of one unbatched POST from the forwarder
+void BM_Remote_jsonBody(microbench::State& state) {
+    MidiPacket message = makeMessage(state.range());
+    const std::string portId = "virtual:synth";
+    for (auto _ : state) {
+        std::string path = RemoteForwarder::sendPath(portId);
+        std::string body = RemoteForwarder::jsonBody(message);
+        microbench::doNotOptimize(path);
+        microbench::doNotOptimize(body);
+    }
+    state.setItemsProcessed(state.iterations());
+    state.setBytesProcessed(state.iterations() * message.size());
+}
+MICROBENCH(BM_Remote_jsonBody, 3, 256, 4096, 65536);
+
+// A SysEx of range() bytes in 256-byte fragments; range() 3 is a note on
+void BM_SysExAssembler_fragments(microbench::State& state) {
+    std::vector<uint8_t> bytes = state.range() <= 3 ? std::vector<uint8_t>{0x90, 0x3C, 0x7F}
+                                                    : makeSysEx((size_t)state.range());
+    constexpr size_t fragmentBytes = 256;
+    MidiSysExAssembler assembler;
+    MidiPacket completed;
+    for (auto _ : state) {
+        for (size_t offset = 0; offset < bytes.size(); offset += fragmentBytes) {
+            size_t length = std::min(fragmentBytes, bytes.size() - offset);
+            if (assembler.feed(bytes.data() + offset, length, completed)) microbench::doNotOptimize(completed);
+        }
+    }
+    state.setItemsProcessed(state.iterations());
+    state.setBytesProcessed(state.iterations() * bytes.size());
+}
+MICROBENCH(BM_SysExAssembler_fragments, 3, 256, 4096, 65536);
+
+// An N-byte payload copied into a packet that is then released, as a
+// decoded batch or /send body is once delivered
+void BM_Packet_heapCopy(microbench::State& state) {
+    std::vector<uint8_t> bytes = makeSysEx((size_t)state.range());
+    for (auto _ : state) {
+        MidiPacket packet(bytes.data(), bytes.size());
+        microbench::doNotOptimize(packet);
+    }
+    state.setBytesProcessed(state.iterations() * bytes.size());
+}
+MICROBENCH(BM_Packet_heapCopy, 256, 4096, 65536);
+
+void BM_Packet_pooledCopy(microbench::State& state) {
+    std::vector<uint8_t> bytes = makeSysEx((size_t)state.range());
+    MidiBufferPool& pool = *MidiBufferPool::shared();
+    for (auto _ : state) {
+        MidiPacket packet = pool.copy(bytes.data(), bytes.size());
+        microbench::doNotOptimize(packet);
+    }
+    state.setBytesProcessed(state.iterations() * bytes.size());
+}
+MICROBENCH(BM_Packet_pooledCopy, 256, 4096, 65536);
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Route logs would interleave with the results otherwise
+    std::cout.rdbuf(std::cerr.rdbuf());
+    int exitCode = microbench::runAll(argc, argv);
+    std::error_code ignored;
+    std::filesystem::remove_all(workDir(), ignored);
+    return exitCode;
+}
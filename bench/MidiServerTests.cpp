@@ -0,0 +1,1064 @@
+/**
+ * MidiServerTests - Checks of the JUCE-free core
+ *
+ * Links only midi-server-core (no JUCE, ALSA or CoreMIDI), like the
+ * microbenchmarks next to it. Covered:
+ * - MidiWireFormat: versions 1-3 round trips, running status, malformed bodies
+ * - RouteFilter: JSON, each pipeline stage, packets without a status byte
+ * - MidiSysExAssembler: fragments, the size cap, abandoned and interrupted
+ *   SysEx, real-time pass-through, the memory budget, streaming
+ * - JsonReader and RouteManager::parseRemoteUrl
+ * - Fixed bugs: queue capacity clamp, port option validation (queue, output
+ *   and SysEx settings), stream acks, HTTP error statuses from remote servers,
+ *   far-off timestamps, the version 1 fallback of streams and batches, an
+ *   unparsable routes file, fan-out lanes (bounded, ordered), local socket
+ *   path checks, partial SysEx packets and where SysEx fragments are routed
+ *
+ * Usage: midi-server-tests [--filter=TEXT]
+ * Exits non-zero if any check fails; failures go to stdout with file:line.
+ * Component logs go to stderr.
+ */
+
+#include "JsonBuilder.h"
+#include "JsonReader.h"
+#include "MidiFanOut.h"
+#include "MidiLocalTransport.h"
+#include "MidiMemory.h"
+#include "MidiMessageQueue.h"
+#include "MidiPacket.h"
+#include "MidiPortOptions.h"
+#include "MidiScheduler.h"
+#include "MidiStreamTransport.h"
+#include "MidiSysExAssembler.h"
+#include "MidiWireFormat.h"
+#include "RemoteForwarder.h"
+#include "RouteFilter.h"
+#include "RouteManager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+std::vector<TestCase>& registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+bool registerTest(const char* name, void (*run)()) {
+    registry().push_back({name, run});
+    return true;
+}
+
+int failedChecks = 0;
+
+bool check(bool passed, const char* expression, const char* file, int line) {
+    if (!passed) {
+        std::printf("  FAILED %s:%d: %s\n", file, line, expression);
+        failedChecks++;
+    }
+    return passed;
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+#define TEST(name)                                                    \
+    void name();                                                      \
+    const bool name##Registered = registerTest(#name, name);          \
+    void name()
+
+using Bytes = std::vector<uint8_t>;
+
+Bytes bytesOf(const MidiPacket& packet) { return packet.toVector(); }
+
+MidiPacket packetOf(const Bytes& bytes) {
+    return MidiBufferPool::shared()->copy(bytes.data(), bytes.size());
+}
+
+// Polls until done() or timeoutMs passes; returns done()
+bool waitFor(const std::function<bool()>& done, int timeoutMs = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+std::filesystem::path& workDir() {
+    static std::filesystem::path dir = std::filesystem::temp_directory_path() /
+        ("midi-server-tests-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    return dir;
+}
+
+std::string workFile(const std::string& name) {
+    std::filesystem::create_directories(workDir());
+    std::filesystem::path path = workDir() / name;
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+    return path.string();
+}
+
+// ---------------------------------------------------------------------------
+// MidiWireFormat
+
+struct DecodedMessage {
+    std::string portId;
+    Bytes bytes;
+    int64_t timestampUs;
+
+    bool operator==(const DecodedMessage& other) const {
+        return portId == other.portId && bytes == other.bytes && timestampUs == other.timestampUs;
+    }
+};
+
+bool decodeAll(const std::string& body, std::vector<DecodedMessage>& out) {
+    out.clear();
+    return MidiBatchDecoder::decode(body, [&](const std::string& portId, const MidiPacket& packet, int64_t ts) {
+        out.push_back({portId, bytesOf(packet), ts});
+    });
+}
+
+std::string encodeAll(const std::vector<DecodedMessage>& messages, bool timestamped, bool runningStatus) {
+    MidiBatchEncoder encoder;
+    encoder.reset(timestamped, runningStatus);
+    for (const auto& message : messages) encoder.add(message.portId, packetOf(message.bytes), message.timestampUs);
+    return encoder.finish();
+}
+
+const std::vector<DecodedMessage> batchMessages = {
+    {"out-a", {0x90, 0x3C, 0x64}, 0},
+    {"out-a", {0x90, 0x3E, 0x64}, 0},     // Same status: sent without it
+    {"out-a", {0xF8}, 0},                 // Real-time: keeps running status
+    {"out-a", {0x90, 0x40, 0x64}, 0},
+    {"out-a", {0xF0, 0x7E, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0xF7}, 0},
+    {"out-a", {0x90, 0x41, 0x64}, 0},     // After SysEx: status sent again
+    {"out-a", {0xB0, 0x07, 0x7F}, 0},
+    {"out-a", {0xB0, 0x07, 0x00}, 0},
+    {"out-a", {0xC0, 0x05}, 0},
+    {"out-b", {0xB0, 0x07, 0x00}, 0},     // New group: status sent again
+    {"out-a", {0xB0, 0x07, 0x01}, 0},     // Back to out-a: a group of its own
+};
+
+TEST(wireFormatVersion1RoundTrip) {
+    std::string body = encodeAll(batchMessages, false, false);
+    CHECK(body.compare(0, 4, "MIDB") == 0);
+    CHECK((uint8_t)body[4] == MidiBatchEncoder::version);
+    std::vector<DecodedMessage> decoded;
+    CHECK(decodeAll(body, decoded));
+    CHECK(decoded == batchMessages);
+}
+
+TEST(wireFormatVersion2Timestamps) {
+    std::vector<DecodedMessage> messages = batchMessages;
+    int64_t timestamps[] = {1700000000000000, 1700000000000500, 1700000000000100, 0, 5, 1800000000000000,
+                            1800000000000000, 1, 2, 3, 4};
+    for (size_t i = 0; i < messages.size(); i++) messages[i].timestampUs = timestamps[i];
+    std::string body = encodeAll(messages, true, false);
+    CHECK((uint8_t)body[4] == MidiBatchEncoder::timestampedVersion);
+    std::vector<DecodedMessage> decoded;
+    CHECK(decodeAll(body, decoded));
+    CHECK(decoded == messages);
+}
+
+TEST(wireFormatVersion3RunningStatus) {
+    std::string plain = encodeAll(batchMessages, false, false);
+    std::string compact = encodeAll(batchMessages, false, true);
+    CHECK((uint8_t)compact[4] == MidiBatchEncoder::flagsVersion);
+    CHECK((uint8_t)compact[5] == MidiBatchEncoder::runningStatusFlag);
+    // 0x90 3E, 0x90 40 and the first 0xB0 07 00 go without status; the last
+    // message starts a new group
+    CHECK(compact.size() + 3 == plain.size());
+    std::vector<DecodedMessage> decoded;
+    CHECK(decodeAll(compact, decoded));
+    CHECK(decoded == batchMessages);
+
+    std::vector<DecodedMessage> messages = batchMessages;
+    for (size_t i = 0; i < messages.size(); i++) messages[i].timestampUs = 1700000000000000 + (int64_t)i * 250;
+    std::string both = encodeAll(messages, true, true);
+    CHECK((uint8_t)both[5] == (MidiBatchEncoder::runningStatusFlag | MidiBatchEncoder::timestampsFlag));
+    CHECK(decodeAll(both, decoded));
+    CHECK(decoded == messages);
+}
+
+TEST(wireFormatRejectsMalformedBodies) {
+    std::vector<DecodedMessage> decoded;
+    std::string body = encodeAll(batchMessages, false, false);
+    CHECK(!decodeAll(body.substr(0, body.size() - 1), decoded));   // Truncated message
+    CHECK(!decodeAll("MIDX" + body.substr(4), decoded));
+    CHECK(!decodeAll(std::string("MIDB\x04\x00", 6), decoded));      // Unknown version
+    CHECK(!decodeAll(std::string("MIDB\x03\x04", 6), decoded));      // Unknown flag
+    CHECK(decodeAll(std::string("MIDB\x01\x00", 6), decoded) && decoded.empty());
+
+    // Running-status data bytes with no status in effect, or too many of them
+    CHECK(!decodeAll(std::string("MIDB\x03\x02\x01" "a" "\x01\x02\x3C\x64", 10), decoded));
+    CHECK(!decodeAll(std::string("MIDB\x03\x02\x01" "a" "\x02\x03\x90\x3C\x64\x03\x3C\x64\x01", 15), decoded));
+    CHECK(decoded.size() == 1);   // Messages before the error were delivered
+
+    // Zigzag deltas summing to a negative time
+    CHECK(!decodeAll(std::string("MIDB\x02\x00\x01" "a" "\x01\x01\xF8\x01", 10), decoded));
+}
+
+// ---------------------------------------------------------------------------
+// RouteFilter
+
+bool readFilter(const std::string& json, RouteFilter& filter, std::string& error) {
+    JsonReader reader(json);
+    return filter.read(reader, error) && reader.finish();
+}
+
+bool runFilter(const RouteFilterPipeline& pipeline, const Bytes& in, Bytes& out) {
+    MidiPacket result;
+    if (!pipeline.process(packetOf(in), result)) return false;
+    out = bytesOf(result);
+    return true;
+}
+
+TEST(routeFilterPassThrough) {
+    RouteFilterPipeline pipeline{RouteFilter()};
+    CHECK(pipeline.isPassThrough());
+    Bytes out;
+    CHECK(runFilter(pipeline, {0x95, 0x3C, 0x64}, out) && out == Bytes({0x95, 0x3C, 0x64}));
+    CHECK(runFilter(pipeline, {0xF8}, out) && out == Bytes({0xF8}));
+
+    // Packets without a status byte (injected or forwarded) have no kind
+    CHECK(!runFilter(pipeline, {0x3C, 0x64}, out));
+    CHECK(!runFilter(pipeline, {0x00}, out));
+    CHECK(!runFilter(pipeline, {}, out));
+}
+
+TEST(routeFilterStages) {
+    RouteFilter filter;
+    std::string error;
+    CHECK(readFilter(R"({"channels":[2],"transpose":12,"channelMap":{"2":5},"ccMap":{"7":11},)"
+                     R"("dropTypes":["clock"],"unknown":[1,{"a":null}]})", filter, error));
+    CHECK(error.empty());
+    RouteFilterPipeline pipeline(filter);
+    CHECK(!pipeline.isPassThrough());
+
+    Bytes out;
+    CHECK(!runFilter(pipeline, {0x90, 0x3C, 0x64}, out));                        // Channel 1
+    CHECK(runFilter(pipeline, {0x91, 0x3C, 0x64}, out) && out == Bytes({0x94, 0x48, 0x64}));
+    CHECK(!runFilter(pipeline, {0x91, 0x7A, 0x40}, out));                        // Transposed past 127
+    CHECK(runFilter(pipeline, {0xB1, 0x07, 0x40}, out) && out == Bytes({0xB4, 0x0B, 0x40}));
+    CHECK(runFilter(pipeline, {0xB1, 0x08, 0x40}, out) && out == Bytes({0xB4, 0x08, 0x40}));
+    CHECK(!runFilter(pipeline, {0xF8}, out));
+    CHECK(runFilter(pipeline, {0xFA}, out) && out == Bytes({0xFA}));
+
+    // SysEx keeps its shared payload
+    Bytes sysex(64, 0x11);
+    sysex.front() = 0xF0;
+    sysex.back() = 0xF7;
+    MidiPacket in = packetOf(sysex), result;
+    CHECK(pipeline.process(in, result) && result.isShared() && result.data() == in.data());
+}
+
+TEST(routeFilterVelocityAndNoteOff) {
+    RouteFilter filter;
+    std::string error;
+    CHECK(readFilter(R"({"types":["noteOff"]})", filter, error));
+    RouteFilterPipeline noteOffs(filter);
+    Bytes out;
+    CHECK(runFilter(noteOffs, {0x90, 0x3C, 0x00}, out));   // Note-on with velocity 0
+    CHECK(runFilter(noteOffs, {0x80, 0x3C, 0x40}, out));
+    CHECK(!runFilter(noteOffs, {0x90, 0x3C, 0x64}, out));
+
+    CHECK(readFilter(R"({"velocity":{"min":100,"max":100}})", filter, error));
+    RouteFilterPipeline fixed(filter);
+    CHECK(runFilter(fixed, {0x90, 0x3C, 0x01}, out) && out[2] == 100);
+    CHECK(runFilter(fixed, {0x90, 0x3C, 0x7F}, out) && out[2] == 100);
+    CHECK(runFilter(fixed, {0x90, 0x3C, 0x00}, out) && out[2] == 0);   // Still a note-off
+}
+
+TEST(routeFilterJson) {
+    RouteFilter filter;
+    std::string error;
+    CHECK(!readFilter(R"({"channels":[17]})", filter, error) && !error.empty());
+    CHECK(!readFilter(R"({"noteRange":[60,40]})", filter, error) && !error.empty());
+    CHECK(!readFilter(R"({"types":["bogus"]})", filter, error) && !error.empty());
+    CHECK(!readFilter(R"({"transpose":1.5})", filter, error));
+
+    CHECK(readFilter(R"({"channels":[1,10],"noteRange":[36,84],"transpose":-3,"ccMap":{"1":74},)"
+                     R"("velocity":{"curve":50,"min":20,"max":110},"dropTypes":["activeSensing"]})", filter, error));
+    JsonBuilder json;
+    filter.write(json);
+    RouteFilter copy;
+    CHECK(readFilter(json.toString(), copy, error));
+    CHECK(copy == filter);
+
+    JsonBuilder empty;
+    RouteFilter().write(empty);
+    CHECK(empty.toString() == "{}");
+}
+
+// ---------------------------------------------------------------------------
+// MidiSysExAssembler
+
+struct ChunkLog {
+    std::vector<Bytes> chunks;
+    void operator()(const MidiPacket& chunk) { chunks.push_back(bytesOf(chunk)); }
+};
+
+bool feedBytes(MidiSysExAssembler& assembler, const Bytes& bytes, Bytes& completed) {
+    MidiPacket packet;
+    if (!assembler.feed(bytes.data(), bytes.size(), packet)) return false;
+    completed = bytesOf(packet);
+    return true;
+}
+
+TEST(sysexJoinsFragments) {
+    MidiSysExAssembler assembler;
+    Bytes out;
+    CHECK(!feedBytes(assembler, {0xF0, 0x01, 0x02}, out));
+    CHECK(assembler.isBuffering());
+    CHECK(assembler.isSysExFragment((const uint8_t*)"\x03", 1));
+    CHECK(!feedBytes(assembler, {0x03, 0x04}, out));
+    CHECK(feedBytes(assembler, {0x05, 0xF7}, out) && out == Bytes({0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0xF7}));
+    CHECK(!assembler.isBuffering());
+    CHECK(feedBytes(assembler, {0x90, 0x3C, 0x64}, out) && out == Bytes({0x90, 0x3C, 0x64}));
+    CHECK(assembler.getStats().completed == 1);
+}
+
+TEST(sysexCapDiscardsRest) {
+    MidiSysExConfig config;
+    config.maxMessageBytes = 8;
+    MidiSysExAssembler assembler(config);
+    Bytes out;
+    CHECK(!feedBytes(assembler, {0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06}, out));
+    CHECK(!feedBytes(assembler, {0x07, 0x08}, out));      // Past the cap
+    CHECK(!feedBytes(assembler, {0x09, 0xF7}, out));      // Rest skipped, nothing completes
+    CHECK(assembler.getStats().discardedOversize == 1);
+    CHECK(feedBytes(assembler, {0xF0, 0x01, 0xF7}, out) && out == Bytes({0xF0, 0x01, 0xF7}));
+    CHECK(assembler.getStats().completed == 1);
+}
+
+TEST(sysexAbandonedAndInterrupted) {
+    MidiSysExAssembler assembler;
+    Bytes out;
+    CHECK(!feedBytes(assembler, {0xF0, 0x01}, out));
+    CHECK(feedBytes(assembler, {0xF0, 0x02, 0xF7}, out) && out == Bytes({0xF0, 0x02, 0xF7}));
+    CHECK(assembler.getStats().discardedIncomplete == 1);
+
+    CHECK(!feedBytes(assembler, {0xF0, 0x01}, out));
+    CHECK(feedBytes(assembler, {0x90, 0x3C, 0x64}, out) && out == Bytes({0x90, 0x3C, 0x64}));
+    CHECK(!assembler.isBuffering());
+    CHECK(assembler.getStats().discardedIncomplete == 2);
+
+    CHECK(!feedBytes(assembler, {0xF0, 0x01}, out));
+    assembler.reset();
+    CHECK(!assembler.isBuffering());
+    CHECK(feedBytes(assembler, {0x3C}, out) && out == Bytes({0x3C}));   // No SysEx open to continue
+}
+
+TEST(sysexRealtimePassesThrough) {
+    MidiSysExAssembler assembler;
+    Bytes out;
+    CHECK(!feedBytes(assembler, {0xF0, 0x01}, out));
+    CHECK(feedBytes(assembler, {0xF8}, out) && out == Bytes({0xF8}));
+    CHECK(assembler.isBuffering());
+    CHECK(feedBytes(assembler, {0x02, 0xF7}, out) && out == Bytes({0xF0, 0x01, 0x02, 0xF7}));
+    CHECK(assembler.getStats().discardedIncomplete == 0);
+}
+
+TEST(sysexMemoryBudget) {
+    MidiMemoryBudget budget;
+    budget.setLimit(4);
+    MidiMemoryAccount account(budget);
+    {
+        MidiSysExAssembler assembler(MidiSysExConfig(), &account);
+        Bytes out;
+        CHECK(!feedBytes(assembler, {0xF0, 0x01, 0x02}, out));
+        CHECK(account.getStats().bufferedBytes == 3);
+        CHECK(!feedBytes(assembler, {0x03, 0x04}, out));   // 5 bytes: over the limit
+        CHECK(!feedBytes(assembler, {0xF7}, out));
+        CHECK(assembler.getStats().discardedOverBudget == 1);
+        CHECK(account.getStats().bufferedBytes == 0);
+
+        CHECK(!feedBytes(assembler, {0xF0, 0x01}, out));
+    }
+    CHECK(account.getStats().bufferedBytes == 0);   // Released with the assembler
+    CHECK(budget.getStats().bufferedBytes == 0);
+}
+
+TEST(sysexStreamingPartialReports) {
+    MidiSysExConfig config;
+    config.streaming = true;
+    config.maxMessageBytes = 8;
+    MidiSysExAssembler assembler(config);
+    ChunkLog log;
+    MidiPacket out;
+    MidiInputPart part;
+
+    // JUCE's concatenator: all bytes so far, then the whole message
+    const uint8_t message[] = {0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0xF7};
+    assembler.receivePartial(message, 3, log);
+    assembler.receivePartial(message, 5, log);
+    uint8_t clock = 0xF8;
+    CHECK(assembler.receive(&clock, 1, out, part, log) && part == MidiInputPart::Message);
+    CHECK(assembler.receive(message, sizeof(message), out, part, log));
+    CHECK(part == MidiInputPart::StreamedSysEx && bytesOf(out) == Bytes(message, message + sizeof(message)));
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02}, {0x03, 0x04}, {0x05, 0xF7}}));
+
+    // Past the cap: destinations get a closing 0xF7, the queue nothing
+    log.chunks.clear();
+    const uint8_t big[] = {0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xF7};
+    assembler.receivePartial(big, 4, log);
+    assembler.receivePartial(big, 9, log);
+    assembler.receivePartial(big, 10, log);
+    CHECK(!assembler.receive(big, sizeof(big), out, part, log));
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02, 0x03}, {0xF7}}));
+
+    // Cut off by another status byte
+    log.chunks.clear();
+    uint64_t incomplete = assembler.getStats().discardedIncomplete;
+    assembler.receivePartial(message, 3, log);
+    const uint8_t note[] = {0x90, 0x3C, 0x01};
+    CHECK(assembler.receive(note, sizeof(note), out, part, log) && part == MidiInputPart::Message);
+    CHECK(bytesOf(out) == Bytes(note, note + sizeof(note)));
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02}, {0xF7}}));
+    CHECK(assembler.getStats().discardedIncomplete == incomplete + 1);
+
+    // A new SysEx reported before the last one completed
+    log.chunks.clear();
+    const uint8_t other[] = {0xF0, 0x7F, 0xF7};
+    assembler.receivePartial(message, 5, log);
+    assembler.receivePartial(other, 2, log);
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02, 0x03, 0x04}, {0xF7}, {0xF0, 0x7F}}));
+    CHECK(assembler.getStats().discardedIncomplete == incomplete + 2);
+    CHECK(assembler.receive(other, sizeof(other), out, part, log) && part == MidiInputPart::StreamedSysEx);
+}
+
+TEST(sysexStreamingFragments) {
+    MidiSysExConfig config;
+    config.streaming = true;
+    config.maxMessageBytes = 8;
+    MidiSysExAssembler assembler(config);
+    ChunkLog log;
+    MidiPacket out;
+    MidiInputPart part;
+
+    const uint8_t first[] = {0xF0, 0x01, 0x02}, middle[] = {0x03, 0x04}, last[] = {0x05, 0xF7};
+    CHECK(!assembler.receive(first, sizeof(first), out, part, log));
+    CHECK(!assembler.receive(middle, sizeof(middle), out, part, log));
+    CHECK(assembler.receive(last, sizeof(last), out, part, log) && part == MidiInputPart::StreamedSysEx);
+    CHECK(bytesOf(out) == Bytes({0xF0, 0x01, 0x02, 0x03, 0x04, 0x05, 0xF7}));
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02}, {0x03, 0x04}, {0x05, 0xF7}}));
+
+    log.chunks.clear();
+    const uint8_t tooLong[] = {0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+    CHECK(!assembler.receive(first, sizeof(first), out, part, log));
+    CHECK(!assembler.receive(tooLong, sizeof(tooLong), out, part, log));
+    CHECK(!assembler.receive(last, sizeof(last), out, part, log));
+    CHECK(log.chunks == std::vector<Bytes>({{0xF0, 0x01, 0x02}, {0xF7}}));
+
+    // A whole SysEx in one callback isn't streamed
+    log.chunks.clear();
+    const uint8_t whole[] = {0xF0, 0x01, 0xF7};
+    CHECK(assembler.receive(whole, sizeof(whole), out, part, log) && part == MidiInputPart::Message);
+    CHECK(log.chunks.empty());
+    CHECK(assembler.getStats().streamedChunks == 4);
+}
+
+// ---------------------------------------------------------------------------
+// JsonReader
+
+TEST(jsonReaderValues) {
+    JsonReader reader(R"( {"name":"a\"b\\c\n\u00e9\ud83c\udfb9", "n":-42, "big":9223372036854775807,)"
+                      R"( "on":true, "none":null, "list":[1, [2, {"x":[]}], "s"], "bytes":[0,127,255],)"
+                      R"( "esc\u0061ped":1} )");
+    std::string name;
+    long long n = 0, big = 0, escaped = 0;
+    bool on = false, none = false;
+    std::vector<uint8_t> bytes;
+    bool parsed = reader.readObject([&](std::string_view key) {
+        if (key == "name") return reader.readString(name);
+        if (key == "n") return reader.readInteger(n);
+        if (key == "big") return reader.readInteger(big);
+        if (key == "on") return reader.readBool(on);
+        if (key == "none") return none = reader.readNull();
+        if (key == "bytes") return reader.readByteArray([&](uint8_t byte) { bytes.push_back(byte); });
+        if (key == "escaped") return reader.readInteger(escaped);
+        return reader.skipValue();
+    }) && reader.finish();
+    CHECK(parsed);
+    CHECK(name == "a\"b\\c\n\xC3\xA9\xF0\x9F\x8E\xB9");
+    CHECK(n == -42 && big == INT64_MAX && on && none && escaped == 1);
+    CHECK(bytes == Bytes({0, 127, 255}));
+}
+
+TEST(jsonReaderErrors) {
+    auto fails = [](const std::string& json, const std::function<bool(JsonReader&)>& read) {
+        JsonReader reader(json);
+        bool ok = read(reader) && reader.finish();
+        return !ok && reader.hasError() && reader.error().find("at offset") != std::string::npos;
+    };
+    auto skip = [](JsonReader& reader) { return reader.skipValue(); };
+    long long value;
+    CHECK(fails("{\"a\":1,}", skip));
+    CHECK(fails("[1 2]", skip));
+    CHECK(fails("\"open", skip));
+    CHECK(fails("\"tab\there\"", skip));
+    CHECK(fails("\"\\x\"", skip));
+    CHECK(fails("\"\\ud83c\"", skip));   // High surrogate alone
+    CHECK(fails("{} {}", skip));
+    CHECK(fails(std::string(100, '[') + std::string(100, ']'), skip));
+    CHECK(fails("9223372036854775808", [&](JsonReader& r) { return r.readInteger(value); }));
+    CHECK(fails("1.5", [&](JsonReader& r) { return r.readInteger(value); }));
+    CHECK(fails("[1,256]", [](JsonReader& r) { return r.readByteArray([](uint8_t) {}); }));
+    CHECK(fails("[1,-1]", [](JsonReader& r) { return r.readByteArray([](uint8_t) {}); }));
+
+    JsonReader reader("[1, x]");
+    CHECK(!reader.skipValue());
+    CHECK(reader.error() == "expected a value at offset 4");
+}
+
+// ---------------------------------------------------------------------------
+// RouteManager::parseRemoteUrl
+
+TEST(parseRemoteUrl) {
+    std::string host;
+    int port = 0;
+    RemoteTransport transport;
+    CHECK(RouteManager::parseRemoteUrl("http://studio.local:8080", host, port, transport));
+    CHECK(host == "studio.local" && port == 8080 && transport == RemoteTransport::Http);
+    CHECK(RouteManager::parseRemoteUrl("http://10.0.0.2", host, port, transport));
+    CHECK(host == "10.0.0.2" && port == 80);
+    CHECK(RouteManager::parseRemoteUrl("http://10.0.0.2:9000/midi", host, port, transport));
+    CHECK(host == "10.0.0.2" && port == 9000);
+    CHECK(RouteManager::parseRemoteUrl("http://host/a:b", host, port, transport));
+    CHECK(host == "host" && port == 80);
+    CHECK(RouteManager::parseRemoteUrl("midi+tcp://10.0.0.2:7000", host, port, transport));
+    CHECK(host == "10.0.0.2" && port == 7000 && transport == RemoteTransport::Stream);
+    CHECK(RouteManager::parseRemoteUrl("host:65535", host, port, transport));
+    CHECK(host == "host" && port == 65535 && transport == RemoteTransport::Http);
+
+    for (const char* bad : {"", "http://", "http://:80", "http://host:", "http://host:0", "http://host:65536",
+                            "http://host:12x", "http://host:-1", "midi+tcp://:7000"}) {
+        if (!CHECK(!RouteManager::parseRemoteUrl(bad, host, port, transport))) std::printf("    url: %s\n", bad);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Fixed bugs
+
+TEST(queueCapacityIsClamped) {
+    MidiQueueConfig config;
+    config.capacity = 100000000;
+    MidiMessageQueue huge(config);
+    CHECK(huge.getStats().capacity == MidiQueueConfig::maxCapacity);
+
+    config.capacity = 1000;
+    MidiMessageQueue rounded(config);
+    CHECK(rounded.getStats().capacity == 1024);
+}
+
+TEST(portQueueOptionsAreValidated) {
+    MidiPortOptions options;
+    std::string error;
+    CHECK(options.read("", error));
+    CHECK(options.queue.capacity == MidiQueueConfig().capacity);
+
+    CHECK(options.read("{\"name\":\"x\", \"queueCapacity\" : 64,\n \"overflowPolicy\" :\"report\","
+                       " \"maxSysExBytes\": 1024}", error));
+    CHECK(options.queue.capacity == 64);
+    CHECK(options.queue.overflowPolicy == QueueOverflowPolicy::Report);
+    CHECK(options.queue.maxSysExBytes == 1024);
+
+    // Only top-level keys are options
+    MidiPortOptions nested;
+    CHECK(nested.read("{\"meta\":{\"queueCapacity\":8,\"overflowPolicy\":\"bogus\"}}", error));
+    CHECK(nested.queue.capacity == MidiQueueConfig().capacity);
+
+    for (const char* bad : {"{\"queueCapacity\":-5}", "{\"queueCapacity\":0}", "{\"queueCapacity\":1.5}",
+                            "{\"queueCapacity\":\"64\"}", "{\"queueCapacity\":65537}",
+                            "{\"maxSysExBytes\":-1}", "{\"maxSysExBytes\":268435457}",
+                            "{\"overflowPolicy\":\"drop-oldst\"}", "{\"overflowPolicy\":1}",
+                            "{\"queueCapacity\":64", "queueCapacity=64"}) {
+        MidiPortOptions rejected;
+        error.clear();
+        if (!CHECK(!rejected.read(bad, error) && !error.empty())) std::printf("    body: %s\n", bad);
+    }
+    CHECK(!options.read("{\"overflowPolicy\":\"drop-oldst\"}", error));
+    CHECK(error.find("overflowPolicy") != std::string::npos);
+    CHECK(!options.read("{\"queueCapacity\":65537}", error));
+    CHECK(error == "queueCapacity must be at most 65536");
+}
+
+TEST(portOutputOptionsAreValidated) {
+    MidiPortOptions options;
+    std::string error;
+    CHECK(options.read("{\"asyncOutput\" : true, \"sysexChunkBytes\":0, \"sysexChunkDelayUs\": 1000000}", error));
+    CHECK(options.output.async);
+    CHECK(options.output.sysexChunkBytes == 0);
+    CHECK(options.output.sysexChunkDelay == MidiOutputConfig::maxSysExChunkDelay);
+
+    for (const char* bad : {"{\"asyncOutput\":1}", "{\"asyncOutput\":\"true\"}", "{\"asyncOutput\":truthy}",
+                            "{\"sysexChunkBytes\":-1}", "{\"sysexChunkDelayUs\":-1}",
+                            "{\"sysexChunkDelayUs\":1000001}", "{\"sysexChunkDelayUs\":9223372036854775807}"}) {
+        MidiPortOptions rejected;
+        error.clear();
+        if (!CHECK(!rejected.read(bad, error) && !error.empty())) std::printf("    body: %s\n", bad);
+    }
+}
+
+std::string batchOf(const std::string& portId, const Bytes& message, size_t count = 1) {
+    MidiBatchEncoder encoder;
+    for (size_t i = 0; i < count; i++) encoder.add(portId, packetOf(message));
+    return encoder.finish();
+}
+
+TEST(streamAcksOnlyDecodedFrames) {
+    std::atomic<int> delivered{0};
+    MidiStreamServer server([&](const std::string&, const MidiPacket&, int64_t) { delivered++; });
+    int port = server.start("127.0.0.1", 0);
+    CHECK(port > 0);
+    if (port <= 0) return;
+
+    MidiStreamClient client("127.0.0.1", port);
+    std::string note = batchOf("out", {0x90, 0x3C, 0x64});
+    // Acks are read when a frame is written; malformed frames read them
+    // without being acked themselves
+    auto readAcks = [&] { return client.sendFrame("not a batch", 0); };
+    CHECK(client.sendFrame(note, 1));
+    CHECK(waitFor([&] { return readAcks() && client.getLastAcked() == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(readAcks());
+    CHECK(client.getLastAcked() == 1);
+    CHECK(delivered == 1);
+
+    // The connection stays up
+    CHECK(client.sendFrame(note, 1));
+    uint64_t frame = client.getFramesSent();
+    CHECK(waitFor([&] { return readAcks() && client.getLastAcked() == frame; }));
+    CHECK(delivered == 2);
+    CHECK(client.takeMessagesLost() == 0);
+    server.stop();
+}
+
+TEST(remoteErrorStatusesAreFailures) {
+    httplib::Server server;
+    std::atomic<int> requests{0};
+    server.Post(R"(/.*)", [&](const httplib::Request&, httplib::Response& res) {
+        requests++;
+        res.status = 500;
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    std::thread serverThread([&] { server.listen_after_bind(); });
+    {
+        RemoteForwarder forwarder("127.0.0.1", port);
+        auto destination = RemoteForwarder::makeDestination("out");
+        uint8_t note[] = {0x90, 0x3C, 0x64};
+        forwarder.send(destination, MidiPacket(note, 3));
+        CHECK(waitFor([&] { return forwarder.getStats().messagesFailed == 1; }));
+        CHECK(requests >= 1);
+        CHECK(forwarder.getStats().messagesSent == 0);
+    }
+    server.stop();
+    serverThread.join();
+}
+
+TEST(farOffTimestampsAreRefused) {
+    MidiScheduler::Clock::time_point due;
+    int64_t now = MidiScheduler::unixMicrosNow();
+    CHECK(MidiScheduler::fromUnixMicros(now + 1000000, due));
+    auto ahead = due - MidiScheduler::Clock::now();
+    CHECK(ahead > std::chrono::milliseconds(900) && ahead <= std::chrono::milliseconds(1000));
+
+    // Would overflow the nanosecond clock and wrap into the past
+    CHECK(!MidiScheduler::fromUnixMicros(INT64_MAX, due));
+    CHECK(!MidiScheduler::fromUnixMicros(now + 3600LL * 1000000, due));
+    CHECK(!MidiScheduler::fromUnixMicros(1, due));
+}
+
+// A receiver that drops version 2 connections after their first frame,
+// without acking it, and acks the first frame of a version 1 connection
+// before closing
+class FakeStreamReceiver
+{
+public:
+    FakeStreamReceiver() {
+        listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listenSocket, (sockaddr*)&address, length) == 0 && listen(listenSocket, 4) == 0 &&
+            getsockname(listenSocket, (sockaddr*)&address, &length) == 0) {
+            port = ntohs(address.sin_port);
+        }
+        thread = std::thread([this] { run(); });
+    }
+
+    ~FakeStreamReceiver() {
+        running = false;
+        thread.join();
+        httplib::detail::close_socket(listenSocket);
+    }
+
+    std::vector<int> helloVersions() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return versions;
+    }
+
+    int port = 0;
+
+private:
+    void run() {
+        while (running) {
+            if (!midistream::waitSocket(listenSocket, false, 20)) continue;
+            socket_t sock = accept(listenSocket, nullptr, nullptr);
+            if (sock == INVALID_SOCKET) continue;
+            uint8_t hello[5];
+            if (midistream::recvAll(sock, hello, sizeof(hello), running)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    versions.push_back(hello[4]);
+                }
+                readOneFrame(sock, hello[4] == 1);
+            }
+            httplib::detail::close_socket(sock);
+        }
+    }
+
+    void readOneFrame(socket_t sock, bool ack) {
+        uint8_t header[midistream::frameHeaderSize];
+        if (!midistream::recvAll(sock, header, sizeof(header), running)) return;
+        std::string payload(midistream::getU32(header), '\0');
+        if (!payload.empty() && !midistream::recvAll(sock, (uint8_t*)&payload[0], payload.size(), running)) return;
+        if (!ack) return;
+        midistream::sendAll(sock, header + 4, 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));   // Let the ack arrive before the close
+    }
+
+    socket_t listenSocket = INVALID_SOCKET;
+    std::atomic<bool> running{true};
+    std::thread thread;
+    std::mutex mutex;
+    std::vector<int> versions;
+};
+
+TEST(streamFallsBackPerConnection) {
+    FakeStreamReceiver receiver;
+    CHECK(receiver.port > 0);
+    if (receiver.port <= 0) return;
+    MidiStreamClient client("127.0.0.1", receiver.port);
+    std::string notes = batchOf("out", {0x90, 0x3C, 0x64}, 3);
+    auto retryAfterReconnectDelay = [] { std::this_thread::sleep_for(std::chrono::milliseconds(1100)); };
+
+    // Version 2: dropped before the first ack. Frames written carrying no
+    // messages notice the close without adding to the count.
+    CHECK(client.acceptsRunningStatus());
+    CHECK(client.sendFrame(notes, 3));
+    CHECK(waitFor([&] { return receiver.helloVersions().size() == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    client.sendFrame("", 0);
+    client.sendFrame("", 0);
+    CHECK(client.takeMessagesLost() == 3);
+    CHECK(!client.acceptsRunningStatus());
+
+    // Version 1 hello, acked before the close: the next connection tries version 2 again
+    retryAfterReconnectDelay();
+    CHECK(client.sendFrame(notes, 3));
+    CHECK(waitFor([&] { return receiver.helloVersions().size() == 2; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    client.sendFrame("", 0);
+    client.sendFrame("", 0);
+    CHECK(client.takeMessagesLost() == 0);
+    CHECK(client.acceptsRunningStatus());
+
+    retryAfterReconnectDelay();
+    client.sendFrame(notes, 3);
+    CHECK(waitFor([&] { return receiver.helloVersions().size() == 3; }));
+    CHECK(receiver.helloVersions() == std::vector<int>({2, 1, 2}));
+}
+
+TEST(remoteRunningStatusFallback) {
+    // An older receiver: version 3 batches are a 400
+    httplib::Server server;
+    std::atomic<int> batches{0}, version3{0}, received{0};
+    server.Post("/batch", [&](const httplib::Request& req, httplib::Response& res) {
+        batches++;
+        if ((uint8_t)req.body[4] == MidiBatchEncoder::flagsVersion) {
+            version3++;
+            res.status = 400;
+            return;
+        }
+        MidiBatchDecoder::decode(req.body, [&](const std::string&, const MidiPacket&, int64_t) { received++; });
+        res.status = 200;
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    std::thread serverThread([&] { server.listen_after_bind(); });
+    {
+        RemoteForwarderConfig config;
+        config.batching = true;
+        config.maxBatchLatency = std::chrono::microseconds(20000);
+        RemoteForwarder forwarder("127.0.0.1", port, config);
+        auto destination = RemoteForwarder::makeDestination("out");
+        uint8_t note[] = {0x90, 0x3C, 0x64};
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < 5; i++) forwarder.send(destination, MidiPacket(note, 3));
+            CHECK(waitFor([&] { return received == (round + 1) * 5; }));
+        }
+        CHECK(version3 == 1);   // Retried as version 1; later batches stay on it for a while
+        CHECK(waitFor([&] { return forwarder.getStats().messagesSent == 15; }));
+        CHECK(forwarder.getStats().messagesFailed == 0);
+    }
+    server.stop();
+    serverThread.join();
+}
+
+TEST(unparsableRoutesFileLoadsNothing) {
+    const std::string route = "{\"id\":\"r1\",\"source\":{\"serverUrl\":\"local\",\"portId\":\"in\"},"
+                              "\"destination\":{\"serverUrl\":\"local\",\"portId\":\"out\"}}";
+    std::string path = workFile("broken-routes.json");
+    std::ofstream(path) << "{\"routes\":[" << route << ",{\"id\":";
+    {
+        RouteManager manager(path);
+        CHECK(manager.getAllRoutes().empty());
+    }
+    CHECK(std::filesystem::exists(path + ".invalid"));
+
+    std::ofstream(path) << "{\"routes\":[" << route << "]}";
+    RouteManager manager(path);
+    CHECK(manager.getAllRoutes().size() == 1);
+}
+
+struct FanOutSink {
+    std::mutex mutex;
+    std::vector<int> received;
+};
+
+TEST(fanOutLaneIsBoundedAndOrdered) {
+    std::atomic<bool> entered{false}, release{false};
+    MidiFanOut<FanOutSink> fanOut(1, [&](FanOutSink& sink, const MidiPacket& packet,
+                                        std::chrono::steady_clock::time_point, bool) {
+        entered = true;
+        while (!release) std::this_thread::yield();
+        std::lock_guard<std::mutex> lock(sink.mutex);
+        sink.received.push_back(packet[1]);
+    }, 4);
+    auto sink = std::make_shared<FanOutSink>();
+    auto submit = [&](int value) {
+        uint8_t note[] = {0x90, (uint8_t)value, 0x40};
+        return fanOut.submit(0, sink, MidiPacket(note, 3), std::chrono::steady_clock::now(),
+                             MidiFanOut<FanOutSink>::noGroup);
+    };
+
+    CHECK(submit(0));
+    CHECK(waitFor([&] { return entered.load(); }));
+    for (int i = 1; i <= 4; i++) CHECK(submit(i));
+    CHECK(!submit(5));   // Ring full: dropped, not grown
+    release = true;
+    CHECK(waitFor([&] { return fanOut.getStats().delivered == 5; }));
+    CHECK(fanOut.getStats().dropped == 1);
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    CHECK(sink->received == std::vector<int>({0, 1, 2, 3, 4}));
+}
+
+MidiRoute localRoute(const std::string& id, const std::string& source, const std::string& destination) {
+    MidiRoute route;
+    route.id = id;
+    route.source = {"local", source, source};
+    route.destination = {"local", destination, destination};
+    return route;
+}
+
+TEST(routeOrderSurvivesFanOutChanges) {
+    RouteManager manager(workFile("order-routes.json"));
+    manager.setFanOutThreads(2);
+    std::mutex mutex;
+    std::vector<int> received;
+    manager.setLocalMessageForwarder([&](const std::string& destPortId, const MidiPacket& packet) {
+        if (destPortId != "out-0") return;
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(packet[1] << 7 | packet[2]);
+    });
+    std::vector<MidiRoute> routes = {localRoute("r0", "in", "out-0")};
+    manager.applyRoutes(routes, {});
+
+    // A second destination comes and goes, moving the source across the
+    // fan-out threshold while messages are in flight
+    const int messageCount = 4000;
+    for (int i = 0; i < messageCount; i++) {
+        if (i % 400 == 100) {
+            std::vector<MidiRoute> second = {localRoute("r1", "in", "out-1")};
+            manager.applyRoutes(second, {});
+        } else if (i % 400 == 300) {
+            std::vector<MidiRoute> none;
+            manager.applyRoutes(none, {"r1"});
+        }
+        uint8_t cc[] = {0xB0, (uint8_t)(i >> 7), (uint8_t)(i & 0x7F)};
+        manager.forwardMessage("in", MidiPacket(cc, 3));
+        if (i % 64 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    waitFor([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !received.empty() && received.back() == messageCount - 1;
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(!received.empty());
+    bool ordered = true;
+    for (size_t i = 1; i < received.size(); i++) ordered = ordered && received[i] > received[i - 1];
+    CHECK(ordered);
+}
+
+#ifndef _WIN32
+TEST(localSocketPathChecks) {
+    auto noMessages = [](const std::string&, const MidiPacket&, int64_t) {};
+    auto noSources = [](const std::string&, MidiLocalSource&) { return false; };
+
+    // Something that isn't a socket (a mistyped routes.json, say) is left alone
+    std::string file = workFile("not-a-socket");
+    std::ofstream(file) << "[]";
+    {
+        MidiLocalServer server(noMessages, noSources);
+        std::string error;
+        CHECK(!server.start(file, error) && !error.empty());
+    }
+    CHECK(std::filesystem::is_regular_file(file));
+
+    std::string path = workFile("local.sock");
+    {
+        MidiLocalServer server(noMessages, noSources);
+        std::string error;
+        CHECK(server.start(path, error));
+        struct stat info;
+        CHECK(lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode) && (info.st_mode & 077) == 0);
+
+        MidiLocalServer second(noMessages, noSources);
+        CHECK(!second.start(path, error));   // In use by the first
+        server.stop();
+    }
+
+    // A socket left behind by a server that is gone is replaced
+    MidiLocalServer server(noMessages, noSources);
+    std::string error;
+    CHECK(server.start(path, error));
+    server.stop();
+}
+#endif
+
+TEST(portSysExOptionsAreValidated) {
+    MidiPortOptions options;
+    std::string error;
+    CHECK(options.read("{\"maxSysExMessageBytes\" : 65536, \"sysexStreaming\" :true}", error));
+    CHECK(options.sysex.maxMessageBytes == 65536);
+    CHECK(options.sysex.streaming);
+
+    MidiPortOptions nested;
+    CHECK(nested.read("{\"meta\":{\"sysexStreaming\":true,\"maxSysExMessageBytes\":-1}}", error));
+    CHECK(!nested.sysex.streaming);
+
+    for (const char* bad : {"{\"sysexStreaming\":1}", "{\"sysexStreaming\":null}",
+                            "{\"maxSysExMessageBytes\":-1}", "{\"maxSysExMessageBytes\":0}",
+                            "{\"maxSysExMessageBytes\":268435457}"}) {
+        MidiPortOptions rejected;
+        error.clear();
+        if (!CHECK(!rejected.read(bad, error) && !error.empty())) std::printf("    body: %s\n", bad);
+    }
+}
+
+TEST(partialSysExPackets) {
+    CHECK(packetOf({0xF0, 0x01, 0x02}).isPartialSysEx());
+    CHECK(packetOf({0x01, 0x02}).isPartialSysEx());
+    CHECK(packetOf({0x01, 0x02, 0xF7}).isPartialSysEx());
+    CHECK(packetOf({0xF7}).isPartialSysEx());
+    CHECK(!packetOf({0xF0, 0x01, 0xF7}).isPartialSysEx());   // Whole
+    CHECK(!packetOf({0x90, 0x3C, 0x64}).isPartialSysEx());
+    CHECK(!packetOf({0x01, 0xF7, 0x02}).isPartialSysEx());
+    CHECK(!packetOf({0xF0, 0x01, 0x90}).isPartialSysEx());
+    CHECK(!MidiPacket().isPartialSysEx());
+}
+
+TEST(sysexFragmentsOnlyWhereOutputsTakeThem) {
+    for (size_t threads : {0, 2}) {
+        RouteManager manager(workFile("fragment-routes.json"));
+        manager.setFanOutThreads(threads);
+        std::mutex mutex;
+        std::vector<std::pair<std::string, Bytes>> messages, fragments;
+        manager.setLocalMessageForwarder([&](const std::string& destPortId, const MidiPacket& packet) {
+            std::lock_guard<std::mutex> lock(mutex);
+            messages.push_back({destPortId, bytesOf(packet)});
+        });
+        manager.setLocalFragmentForwarder([&](const std::string& destPortId, const MidiPacket& packet) {
+            std::lock_guard<std::mutex> lock(mutex);
+            fragments.push_back({destPortId, bytesOf(packet)});
+        });
+        std::vector<MidiRoute> routes = {localRoute("plain", "in", "out-plain"),
+                                         localRoute("filtered", "in", "out-filtered")};
+        routes[1].filter.transpose = 2;
+        manager.applyRoutes(routes, {});
+
+        const Bytes first = {0xF0, 0x01, 0x02}, last = {0x03, 0xF7}, whole = {0xF0, 0x01, 0x02, 0x03, 0xF7};
+        manager.forwardMessage("in", packetOf(first), MidiInputPart::SysExChunk);
+        manager.forwardMessage("in", packetOf(last), MidiInputPart::SysExChunk);
+        manager.forwardMessage("in", packetOf(whole), MidiInputPart::StreamedSysEx);
+
+        size_t expectedMessages = midiOutputTakesSysExInPieces ? 1 : 2;
+        size_t expectedFragments = midiOutputTakesSysExInPieces ? 2 : 0;
+        CHECK(waitFor([&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return messages.size() == expectedMessages && fragments.size() == expectedFragments;
+        }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));   // Nothing more arrives
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(messages.size() == expectedMessages && fragments.size() == expectedFragments);
+        for (const auto& [port, bytes] : messages) CHECK(bytes == whole);
+        if (midiOutputTakesSysExInPieces) {
+            CHECK(messages[0].first == "out-filtered");
+            CHECK(fragments[0].second == first && fragments[1].second == last);
+            CHECK(fragments[0].first == "out-plain" && fragments[1].first == "out-plain");
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(9);
+        } else {
+            std::fprintf(stderr, "Usage: %s [--filter=TEXT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int run = 0, failedTests = 0;
+    for (const auto& test : registry()) {
+        if (!filter.empty() && std::string(test.name).find(filter) == std::string::npos) continue;
+        int before = failedChecks;
+        std::printf("%s\n", test.name);
+        std::fflush(stdout);
+        test.run();
+        run++;
+        if (failedChecks != before) failedTests++;
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove_all(workDir(), ignored);
+
+    std::printf("%d of %d tests passed\n", run - failedTests, run);
+    return failedTests == 0 ? 0 : 1;
+}
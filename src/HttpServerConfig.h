@@ -0,0 +1,78 @@
+/**
+ * HttpServerConfig - Thread pool, keep-alive and limits of the HTTP API
+ *
+ * httplib serves each connection on one pool thread for as long as the
+ * connection lives: idle keep-alive time, a long poll, or an SSE stream for
+ * hours. With a single pool, a few dashboard streams were enough to leave
+ * /health waiting. The pool is therefore sized workerThreads +
+ * subscriptionThreads, and HttpSubscriptionLimiter admits at most
+ * subscriptionThreads long-lived requests at a time. Extra ones get a 503,
+ * so workerThreads always stay free for short requests.
+ *
+ * No httplib dependency; MidiHttpServer applies the settings.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct HttpServerConfig {
+    std::string host = "0.0.0.0";           // Interface to bind, for HTTP and the stream listener
+    size_t workerThreads = 0;               // Short requests; 0 = httplib's default (>= 8)
+    size_t subscriptionThreads = 8;         // Long polls and streams; 0 = share workerThreads
+    size_t keepAliveMaxCount = 100;         // Requests per connection before it is closed
+    int keepAliveTimeoutSec = 5;            // Idle time before a kept-alive connection is closed
+    bool tcpNoDelay = true;                 // Headers and body are separate writes; Nagle would hold the body
+    size_t maxBodyBytes = 64 * 1024 * 1024; // Any request; larger bodies get 413
+    size_t maxSendBodyBytes = 0;            // Send, send-batch, inject and /batch; 0 = maxBodyBytes
+};
+
+struct HttpSubscriptionStats {
+    size_t limit;       // 0 = not limited
+    size_t active;
+    uint64_t rejected;
+};
+
+class HttpSubscriptionLimiter
+{
+public:
+    // Holds one slot while alive; a long poll keeps it on its stack, a
+    // stream in its content provider
+    using Slot = std::shared_ptr<HttpSubscriptionLimiter>;
+
+    explicit HttpSubscriptionLimiter(size_t maxActive = 0) : limit(maxActive) {}
+
+    HttpSubscriptionLimiter(const HttpSubscriptionLimiter&) = delete;
+    HttpSubscriptionLimiter& operator=(const HttpSubscriptionLimiter&) = delete;
+
+    // Set before the server starts
+    void setLimit(size_t maxActive) { limit = maxActive; }
+
+    // Returns an empty Slot and counts a rejection when every slot is taken
+    Slot tryAcquire() {
+        size_t current = active.load(std::memory_order_relaxed);
+        do {
+            if (limit != 0 && current >= limit) {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        } while (!active.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+        // Doesn't own the limiter: the deleter only gives the slot back
+        return Slot(this, [](HttpSubscriptionLimiter* owner) {
+            owner->active.fetch_sub(1, std::memory_order_relaxed);
+        });
+    }
+
+    HttpSubscriptionStats getStats() const {
+        return {limit, active.load(std::memory_order_relaxed), rejected.load(std::memory_order_relaxed)};
+    }
+
+private:
+    size_t limit;
+    std::atomic<size_t> active{0};
+    std::atomic<uint64_t> rejected{0};
+};
@@ -3,84 +3,254 @@
  *
  * Lightweight JSON builder for HTTP responses.
  * No external dependencies - uses only standard library.
+ *
+ * Appends straight into a std::string (no stringstream or locale). Strings
+ * are escaped, and MIDI byte arrays use a precomputed decimal table, so a
+ * large SysEx dump costs one memcpy per byte plus a comma. A builder can be
+ * reserve()d up front and clear()ed for reuse without releasing its buffer.
  */
 
 #pragma once
 
-#include <sstream>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 class JsonBuilder
 {
 public:
+    JsonBuilder() = default;
+    explicit JsonBuilder(size_t reserveBytes) { buffer.reserve(reserveBytes); }
+
     JsonBuilder& startObject() {
-        if (!firstItem) ss << ",";
-        ss << "{";
+        separator();
+        buffer += '{';
         firstItem = true;
         return *this;
     }
 
     JsonBuilder& endObject() {
-        ss << "}";
+        buffer += '}';
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& startArray() {
-        if (!firstItem) ss << ",";
-        ss << "[";
+        separator();
+        buffer += '[';
         firstItem = true;
         return *this;
     }
 
     JsonBuilder& endArray() {
-        ss << "]";
+        buffer += ']';
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& key(const std::string& k) {
-        if (!firstItem) ss << ",";
-        ss << "\"" << k << "\":";
+        separator();
+        appendString(k.data(), k.size());
+        buffer += ':';
         firstItem = true;
         return *this;
     }
 
     JsonBuilder& value(const std::string& v) {
-        ss << "\"" << v << "\"";
+        appendString(v.data(), v.size());
+        firstItem = false;
+        return *this;
+    }
+
+    // Without this overload string literals and e.what() would bind to bool
+    JsonBuilder& value(const char* v) {
+        appendString(v, std::char_traits<char>::length(v));
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& value(bool b) {
-        ss << (b ? "true" : "false");
+        buffer += b ? "true" : "false";
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& value(int i) {
-        ss << i;
+        appendNumber(i);
+        firstItem = false;
+        return *this;
+    }
+
+    JsonBuilder& value(uint64_t u) {
+        appendNumber(u);
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& arrayValue(const std::string& v) {
-        if (!firstItem) ss << ",";
-        ss << "\"" << v << "\"";
+        separator();
+        appendString(v.data(), v.size());
         firstItem = false;
         return *this;
     }
 
     JsonBuilder& arrayValue(int i) {
-        if (!firstItem) ss << ",";
-        ss << i;
+        separator();
+        appendNumber(i);
+        firstItem = false;
+        return *this;
+    }
+
+    // Appends [b0,b1,...] for a MIDI message
+    JsonBuilder& byteArray(const uint8_t* data, size_t size) {
+        separator();
+        buffer += '[';
+        for (size_t i = 0; i < size; i++) {
+            if (i > 0) buffer += ',';
+            const ByteText& text = byteText(data[i]);
+            buffer.append(text.chars, text.length);
+        }
+        buffer += ']';
+        firstItem = false;
+        return *this;
+    }
+
+    // Appends "f0417f..." - 2 characters per byte instead of up to 4
+    JsonBuilder& hexValue(const uint8_t* data, size_t size) {
+        static const char digits[] = "0123456789abcdef";
+        separator();
+        buffer += '"';
+        size_t start = buffer.size();
+        buffer.resize(start + size * 2);
+        for (size_t i = 0; i < size; i++) {
+            buffer[start + i * 2] = digits[data[i] >> 4];
+            buffer[start + i * 2 + 1] = digits[data[i] & 0x0F];
+        }
+        buffer += '"';
         firstItem = false;
         return *this;
     }
 
-    std::string toString() { return ss.str(); }
+    // Appends standard padded base64 - 4 characters per 3 bytes
+    JsonBuilder& base64Value(const uint8_t* data, size_t size) {
+        static const char alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        separator();
+        buffer += '"';
+        size_t i = 0;
+        for (; i + 2 < size; i += 3) {
+            uint32_t n = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+            buffer += alphabet[(n >> 18) & 63];
+            buffer += alphabet[(n >> 12) & 63];
+            buffer += alphabet[(n >> 6) & 63];
+            buffer += alphabet[n & 63];
+        }
+        if (i < size) {
+            uint32_t n = (uint32_t)data[i] << 16;
+            if (i + 1 < size) n |= (uint32_t)data[i + 1] << 8;
+            buffer += alphabet[(n >> 18) & 63];
+            buffer += alphabet[(n >> 12) & 63];
+            buffer += i + 1 < size ? alphabet[(n >> 6) & 63] : '=';
+            buffer += '=';
+        }
+        buffer += '"';
+        firstItem = false;
+        return *this;
+    }
+
+    // Appends an already encoded value (e.g. a formatted decimal) after key()
+    // or in an array
+    JsonBuilder& rawValue(const char* text, size_t length) {
+        separator();
+        buffer.append(text, length);
+        firstItem = false;
+        return *this;
+    }
+
+    // Appends text verbatim, e.g. SSE framing around a JSON document
+    JsonBuilder& raw(const char* text, size_t length) {
+        buffer.append(text, length);
+        return *this;
+    }
+
+    void reserve(size_t bytes) { buffer.reserve(bytes); }
+
+    // Empties the builder but keeps its capacity
+    void clear() {
+        buffer.clear();
+        firstItem = true;
+    }
+
+    size_t size() const { return buffer.size(); }
+
+    const std::string& str() const { return buffer; }
+
+    // Moves the result out; the builder is left empty
+    std::string release() {
+        std::string result = std::move(buffer);
+        clear();
+        return result;
+    }
+
+    std::string toString() const { return buffer; }
 
 private:
-    std::stringstream ss;
+    struct ByteText {
+        char chars[3];
+        uint8_t length;
+    };
+
+    static const ByteText& byteText(uint8_t byte) {
+        static const struct Table {
+            ByteText entries[256];
+            Table() {
+                for (int i = 0; i < 256; i++) {
+                    auto result = std::to_chars(entries[i].chars, entries[i].chars + 3, i);
+                    entries[i].length = (uint8_t)(result.ptr - entries[i].chars);
+                }
+            }
+        } table;
+        return table.entries[byte];
+    }
+
+    void separator() {
+        if (!firstItem) buffer += ',';
+    }
+
+    template <typename T>
+    void appendNumber(T number) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), number);
+        buffer.append(digits, (size_t)(result.ptr - digits));
+    }
+
+    void appendString(const char* s, size_t length) {
+        static const char hex[] = "0123456789abcdef";
+        buffer += '"';
+        size_t runStart = 0;
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = (unsigned char)s[i];
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+            buffer.append(s + runStart, i - runStart);
+            runStart = i + 1;
+            switch (c) {
+                case '"': buffer += "\\\""; break;
+                case '\\': buffer += "\\\\"; break;
+                case '\n': buffer += "\\n"; break;
+                case '\r': buffer += "\\r"; break;
+                case '\t': buffer += "\\t"; break;
+                default:
+                    buffer += "\\u00";
+                    buffer += hex[c >> 4];
+                    buffer += hex[c & 0x0F];
+            }
+        }
+        buffer.append(s + runStart, length - runStart);
+        buffer += '"';
+    }
+
+    std::string buffer;
     bool firstItem = true;
 };
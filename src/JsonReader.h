@@ -0,0 +1,332 @@
+/**
+ * JsonReader - Single-pass pull parser for request bodies
+ *
+ * Counterpart to JsonBuilder. The reader walks the text once with a cursor;
+ * callers pull values in the order they appear and skip what they don't
+ * need. Nothing is tokenized or copied up front:
+ * - Object keys are handed out as string_views into the body (a key is only
+ *   copied if it contains escapes)
+ * - Byte arrays are parsed digit by digit straight into the caller's sink,
+ *   so a SysEx dump becomes a MIDI buffer without any per-byte temporaries
+ *
+ * Any JSON whitespace is accepted between tokens. On a syntax or type error
+ * every read returns false and error() describes what was expected and where.
+ *
+ * No external dependencies - uses only standard library.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class JsonReader
+{
+public:
+    explicit JsonReader(std::string_view json) : text(json) {}
+
+    // Reads an object, calling onMember(std::string_view key) for each member
+    // with the cursor on its value. The callback must consume the value
+    // (read... or skipValue) and return false to abort.
+    template <typename OnMember>
+    bool readObject(OnMember&& onMember) {
+        if (!consume('{', "'{'")) return false;
+        if (peek() == '}') return consume('}', "'}'");
+        while (true) {
+            std::string_view name;
+            if (!readKey(name)) return false;
+            if (!consume(':', "':'")) return false;
+            if (!onMember(name)) return fail("a valid value");
+            if (failed) return false;
+            if (peek() == ',') {
+                pos++;
+                continue;
+            }
+            return consume('}', "',' or '}'");
+        }
+    }
+
+    // Reads an array, calling onElement() with the cursor on each element. The
+    // callback must consume the element and return false to abort.
+    template <typename OnElement>
+    bool readArray(OnElement&& onElement) {
+        if (!consume('[', "'['")) return false;
+        if (peek() == ']') return consume(']', "']'");
+        while (true) {
+            if (!onElement()) return fail("a valid value");
+            if (failed) return false;
+            if (peek() == ',') {
+                pos++;
+                continue;
+            }
+            return consume(']', "',' or ']'");
+        }
+    }
+
+    // Reads an array of integers 0-255, calling onByte(uint8_t) for each
+    template <typename OnByte>
+    bool readByteArray(OnByte&& onByte) {
+        if (!consume('[', "'['")) return false;
+        if (peek() == ']') return consume(']', "']'");
+        while (true) {
+            skipWhitespace();
+            unsigned value = 0;
+            size_t digits = 0;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9' && digits < 4) {
+                value = value * 10 + (unsigned)(text[pos] - '0');
+                pos++;
+                digits++;
+            }
+            if (digits == 0 || value > 255 || isNumberChar(peekRaw())) {
+                return fail("a byte value (0-255)");
+            }
+            onByte((uint8_t)value);
+            if (peek() == ',') {
+                pos++;
+                continue;
+            }
+            return consume(']', "',' or ']'");
+        }
+    }
+
+    bool readString(std::string& out) {
+        out.clear();
+        if (!consume('"', "a string")) return false;
+        size_t runStart = pos;
+        while (pos < text.size()) {
+            char c = text[pos];
+            if (c == '"') {
+                out.append(text.data() + runStart, pos - runStart);
+                pos++;
+                return true;
+            }
+            if ((unsigned char)c < 0x20) return fail("a closing '\"'");
+            if (c == '\\') {
+                out.append(text.data() + runStart, pos - runStart);
+                if (!readEscape(out)) return false;
+                runStart = pos;
+                continue;
+            }
+            pos++;
+        }
+        return fail("a closing '\"'");
+    }
+
+    bool readBool(bool& out) {
+        skipWhitespace();
+        if (matchLiteral("true")) {
+            out = true;
+            return true;
+        }
+        if (matchLiteral("false")) {
+            out = false;
+            return true;
+        }
+        return fail("true or false");
+    }
+
+    // Whole numbers only; fractions and exponents are rejected
+    bool readInteger(long long& out) {
+        skipWhitespace();
+        bool negative = peekRaw() == '-';
+        if (negative) pos++;
+        size_t start = pos;
+        unsigned long long magnitude = 0;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            if (magnitude > (unsigned long long)INT64_MAX / 10) return fail("an integer in range");
+            magnitude = magnitude * 10 + (unsigned)(text[pos] - '0');
+            pos++;
+        }
+        if (pos == start || isNumberChar(peekRaw())) return fail("an integer");
+        if (magnitude > (unsigned long long)INT64_MAX) return fail("an integer in range");
+        out = negative ? -(long long)magnitude : (long long)magnitude;
+        return true;
+    }
+
+    // True (and consumed) if the next value is null
+    bool readNull() {
+        skipWhitespace();
+        return matchLiteral("null");
+    }
+
+    // First character of the next value without consuming it: '{', '[', '"', ...
+    // ('\0' at end of input)
+    char peekValue() { return peek(); }
+
+    // Consumes any value, including nested objects and arrays
+    bool skipValue() { return skipValue(0); }
+
+    // Call after the top-level value: only whitespace may follow
+    bool finish() {
+        skipWhitespace();
+        return pos == text.size() || fail("end of input");
+    }
+
+    bool hasError() const { return failed; }
+
+    // e.g. "expected ',' or ']' at offset 17"
+    const std::string& error() const { return errorMessage; }
+
+private:
+    static constexpr int maxDepth = 64;
+
+    char peek() {
+        skipWhitespace();
+        return peekRaw();
+    }
+
+    char peekRaw() const { return pos < text.size() ? text[pos] : '\0'; }
+
+    static bool isNumberChar(char c) {
+        return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '-' || c == '+';
+    }
+
+    void skipWhitespace() {
+        while (pos < text.size() &&
+               (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool consume(char expected, const char* description) {
+        if (peek() != expected) return fail(description);
+        pos++;
+        return true;
+    }
+
+    bool matchLiteral(std::string_view literal) {
+        if (text.compare(pos, literal.size(), literal) != 0) return false;
+        pos += literal.size();
+        return true;
+    }
+
+    bool fail(const char* expected) {
+        if (!failed) {
+            failed = true;
+            errorMessage = std::string("expected ") + expected + " at offset " + std::to_string(pos);
+        }
+        return false;
+    }
+
+    // Keys without escapes are returned in place; others are decoded into keyBuffer
+    bool readKey(std::string_view& out) {
+        if (!consume('"', "a key string")) return false;
+        size_t start = pos;
+        while (pos < text.size() && text[pos] != '"' && text[pos] != '\\' &&
+               (unsigned char)text[pos] >= 0x20) {
+            pos++;
+        }
+        if (peekRaw() == '"') {
+            out = text.substr(start, pos - start);
+            pos++;
+            return true;
+        }
+        pos = start - 1;
+        if (!readString(keyBuffer)) return false;
+        out = keyBuffer;
+        return true;
+    }
+
+    // Cursor is on the backslash; appends the decoded character as UTF-8
+    bool readEscape(std::string& out) {
+        pos++;
+        char c = peekRaw();
+        pos++;
+        switch (c) {
+            case '"': out += '"'; return true;
+            case '\\': out += '\\'; return true;
+            case '/': out += '/'; return true;
+            case 'b': out += '\b'; return true;
+            case 'f': out += '\f'; return true;
+            case 'n': out += '\n'; return true;
+            case 'r': out += '\r'; return true;
+            case 't': out += '\t'; return true;
+            case 'u': break;
+            default: pos--; return fail("a valid escape");
+        }
+
+        uint32_t codePoint;
+        if (!readHex4(codePoint)) return false;
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+            uint32_t low;
+            if (!matchLiteral("\\u") || !readHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                return fail("a low surrogate escape");
+            }
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        if (codePoint < 0x80) {
+            out += (char)codePoint;
+        } else if (codePoint < 0x800) {
+            out += (char)(0xC0 | (codePoint >> 6));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += (char)(0xE0 | (codePoint >> 12));
+            out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        } else {
+            out += (char)(0xF0 | (codePoint >> 18));
+            out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        }
+        return true;
+    }
+
+    bool readHex4(uint32_t& out) {
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = peekRaw();
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') digit = (uint32_t)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') digit = (uint32_t)(c - 'A' + 10);
+            else return fail("4 hex digits");
+            out = out << 4 | digit;
+            pos++;
+        }
+        return true;
+    }
+
+    bool skipValue(int depth) {
+        if (depth > maxDepth) return fail("less deeply nested input");
+        switch (peek()) {
+            case '{':
+                return readObject([&](std::string_view) { return skipValue(depth + 1); });
+            case '[':
+                return readArray([&] { return skipValue(depth + 1); });
+            case '"':
+                return readString(scratch);
+            case 't':
+            case 'f': {
+                bool ignored;
+                return readBool(ignored);
+            }
+            case 'n':
+                return readNull() || fail("a value");
+            default:
+                return skipNumber();
+        }
+    }
+
+    bool skipNumber() {
+        size_t start = pos;
+        if (peekRaw() == '-') pos++;
+        size_t digitsStart = pos;
+        while (pos < text.size() && isNumberChar(text[pos])) pos++;
+        if (pos == digitsStart) {
+            pos = start;
+            return fail("a value");
+        }
+        return true;
+    }
+
+    std::string_view text;
+    size_t pos = 0;
+    bool failed = false;
+    std::string errorMessage;
+    std::string keyBuffer;
+    std::string scratch;
+};
@@ -0,0 +1,173 @@
+/**
+ * Metrics - Lock-free counters and latency histograms for GET /metrics
+ *
+ * Everything here is safe to update from the MIDI thread: recording is a
+ * few relaxed atomic increments, with no locks or allocation. Readers take
+ * snapshots that may be slightly inconsistent across counters, which is fine
+ * for monitoring.
+ *
+ * LatencyHistogram uses HDR-style log-linear buckets: exact below 16 µs,
+ * then 8 sub-buckets per power of two (at most 12.5% relative error) up to
+ * about 9.5 hours.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+
+class LatencyHistogram
+{
+public:
+    static constexpr size_t linearBuckets = 16;
+    static constexpr size_t subBuckets = 8;
+    static constexpr size_t maxExponent = 35;
+    static constexpr size_t bucketCount = linearBuckets + (maxExponent - 3) * subBuckets;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t sumMicros = 0;
+        uint64_t maxMicros = 0;
+        std::array<uint64_t, bucketCount> buckets{};
+
+        double meanMicros() const { return count ? (double)sumMicros / (double)count : 0.0; }
+
+        // Highest value in the bucket containing the given percentile (0-100)
+        uint64_t valueAtPercentile(double percentile) const {
+            if (count == 0) return 0;
+            uint64_t target = (uint64_t)((percentile / 100.0) * (double)count + 0.5);
+            if (target == 0) target = 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucketCount; i++) {
+                seen += buckets[i];
+                if (seen >= target) {
+                    uint64_t upper = bucketUpperBound(i);
+                    return upper < maxMicros ? upper : maxMicros;
+                }
+            }
+            return maxMicros;
+        }
+    };
+
+    void record(uint64_t micros) {
+        buckets[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+        sumMicros.fetch_add(micros, std::memory_order_relaxed);
+        uint64_t previous = maxMicros.load(std::memory_order_relaxed);
+        while (micros > previous &&
+               !maxMicros.compare_exchange_weak(previous, micros, std::memory_order_relaxed)) {}
+    }
+
+    void recordSince(std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (size_t i = 0; i < bucketCount; i++) {
+            result.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            result.count += result.buckets[i];
+        }
+        result.sumMicros = sumMicros.load(std::memory_order_relaxed);
+        result.maxMicros = maxMicros.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    static size_t bucketIndex(uint64_t value) {
+        if (value < linearBuckets) return (size_t)value;
+        if (value >> (maxExponent + 1)) return bucketCount - 1;
+        size_t exponent = 4;  // Highest set bit; portable across compilers
+        while (value >> (exponent + 1)) exponent++;
+        size_t sub = (size_t)(value >> (exponent - 3)) - subBuckets;
+        return linearBuckets + (exponent - 4) * subBuckets + sub;
+    }
+
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < linearBuckets) return index;
+        size_t exponent = (index - linearBuckets) / subBuckets + 4;
+        uint64_t sub = (index - linearBuckets) % subBuckets;
+        return ((subBuckets + sub + 1) << (exponent - 3)) - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+    std::atomic<uint64_t> sumMicros{0};
+    std::atomic<uint64_t> maxMicros{0};
+};
+
+// Traffic through one port, updated from MIDI callbacks and senders
+struct PortMetrics {
+    std::atomic<uint64_t> messagesIn{0};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> messagesOut{0};
+    std::atomic<uint64_t> bytesOut{0};
+
+    void recordIn(size_t bytes) {
+        messagesIn.fetch_add(1, std::memory_order_relaxed);
+        bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void recordOut(size_t bytes) {
+        messagesOut.fetch_add(1, std::memory_order_relaxed);
+        bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * PrometheusWriter - Builds the Prometheus text exposition format (0.0.4)
+ */
+class PrometheusWriter
+{
+public:
+    static constexpr const char* contentType = "text/plain; version=0.0.4";
+
+    void family(const std::string& name, const std::string& type, const std::string& help) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+    }
+
+    // labels: preformatted with label(), e.g. label("port", id)
+    template <typename T>
+    void sample(const std::string& name, const std::string& labels, T value) {
+        out << name;
+        if (!labels.empty()) out << "{" << labels << "}";
+        out << " " << value << "\n";
+    }
+
+    // Emits count/sum and quantiles of a histogram as a Prometheus summary
+    void summary(const std::string& name, const std::string& labels,
+                 const LatencyHistogram::Snapshot& snapshot) {
+        static const std::pair<const char*, double> quantiles[] = {
+            {"0.5", 50.0}, {"0.9", 90.0}, {"0.99", 99.0}, {"0.999", 99.9}};
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        for (const auto& [quantile, percentile] : quantiles) {
+            sample(name, prefix + "quantile=\"" + quantile + "\"", snapshot.valueAtPercentile(percentile));
+        }
+        sample(name + "_sum", labels, snapshot.sumMicros);
+        sample(name + "_count", labels, snapshot.count);
+    }
+
+    static std::string label(const std::string& key, const std::string& value) {
+        std::string result = key + "=\"";
+        for (char c : value) {
+            switch (c) {
+                case '\\': result += "\\\\"; break;
+                case '"': result += "\\\""; break;
+                case '\n': result += "\\n"; break;
+                default: result += c;
+            }
+        }
+        return result + "\"";
+    }
+
+    std::string toString() const { return out.str(); }
+
+private:
+    std::ostringstream out;
+};
@@ -0,0 +1,164 @@
+/**
+ * MidiDeviceRegistry - Cached MIDI device enumeration
+ *
+ * Enumerating devices is slow on systems with many interfaces, and GET /ports,
+ * every port open and every startup route used to do it again. The registry
+ * keeps one immutable snapshot of the input and output device lists, indexed
+ * by name and by identifier, published with an atomic shared_ptr swap like
+ * PortRegistry. Readers never lock; the snapshot is only rebuilt after an OS
+ * device-change notification (juce::MidiDeviceListConnection) or an explicit
+ * invalidate(), and concurrent readers of a stale snapshot share one rebuild.
+ */
+
+#pragma once
+
+#include <juce_audio_devices/juce_audio_devices.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct MidiDeviceEntry {
+    std::string name;
+    std::string identifier;
+};
+
+// One direction's devices in enumeration order, with O(1) lookups
+class MidiDeviceList
+{
+public:
+    MidiDeviceList() = default;
+
+    explicit MidiDeviceList(const juce::Array<juce::MidiDeviceInfo>& infos) {
+        devices.reserve((size_t)infos.size());
+        for (const auto& info : infos) {
+            size_t index = devices.size();
+            devices.push_back({info.name.toStdString(), info.identifier.toStdString()});
+            // Duplicate names keep the first device, as the old linear scan did
+            byName.emplace(devices.back().name, index);
+            byIdentifier.emplace(devices.back().identifier, index);
+        }
+    }
+
+    const std::vector<MidiDeviceEntry>& all() const { return devices; }
+
+    const MidiDeviceEntry* findByName(const std::string& name) const {
+        auto it = byName.find(name);
+        return it == byName.end() ? nullptr : &devices[it->second];
+    }
+
+    const MidiDeviceEntry* findByIdentifier(const std::string& identifier) const {
+        auto it = byIdentifier.find(identifier);
+        return it == byIdentifier.end() ? nullptr : &devices[it->second];
+    }
+
+    // Resolves a port name from the API: exact identifier, then exact name,
+    // then the first device whose name contains it (clients have always been
+    // able to pass a partial name). Only the last step is a scan.
+    const MidiDeviceEntry* resolve(const std::string& nameOrIdentifier) const {
+        if (nameOrIdentifier.empty()) return nullptr;
+        if (auto device = findByIdentifier(nameOrIdentifier)) return device;
+        if (auto device = findByName(nameOrIdentifier)) return device;
+        for (const auto& device : devices) {
+            if (device.name.find(nameOrIdentifier) != std::string::npos) return &device;
+        }
+        return nullptr;
+    }
+
+    // Every device resolve() could pick, best first: the exact identifier
+    // alone, else the exact name followed by the other partial matches. A
+    // port that can't open its first match (busy, say) tries the next.
+    std::vector<const MidiDeviceEntry*> resolveAll(const std::string& nameOrIdentifier) const {
+        std::vector<const MidiDeviceEntry*> matches;
+        if (nameOrIdentifier.empty()) return matches;
+        if (auto device = findByIdentifier(nameOrIdentifier)) {
+            matches.push_back(device);
+            return matches;
+        }
+        const MidiDeviceEntry* exact = findByName(nameOrIdentifier);
+        if (exact) matches.push_back(exact);
+        for (const auto& device : devices) {
+            if (&device != exact && device.name.find(nameOrIdentifier) != std::string::npos) {
+                matches.push_back(&device);
+            }
+        }
+        return matches;
+    }
+
+private:
+    std::vector<MidiDeviceEntry> devices;
+    std::unordered_map<std::string, size_t> byName;
+    std::unordered_map<std::string, size_t> byIdentifier;
+};
+
+struct MidiDeviceSnapshot {
+    MidiDeviceList inputs;
+    MidiDeviceList outputs;
+    uint64_t generation = 0;  // Incremented by every enumeration
+
+    const MidiDeviceList& forDirection(bool isInput) const { return isInput ? inputs : outputs; }
+};
+
+class MidiDeviceRegistry
+{
+public:
+    using SnapshotPtr = std::shared_ptr<const MidiDeviceSnapshot>;
+
+    MidiDeviceRegistry() : current(std::make_shared<const MidiDeviceSnapshot>()) {}
+
+    MidiDeviceRegistry(const MidiDeviceRegistry&) = delete;
+    MidiDeviceRegistry& operator=(const MidiDeviceRegistry&) = delete;
+
+    // Current device lists; enumerates first if the cache is stale. Lock-free
+    // once the cache is fresh.
+    SnapshotPtr snapshot() {
+        if (stale.load(std::memory_order_acquire)) refresh();
+        return std::atomic_load_explicit(&current, std::memory_order_acquire);
+    }
+
+    // Marks the cache stale; the next snapshot() re-enumerates. Safe from any thread.
+    void invalidate() { stale.store(true, std::memory_order_release); }
+
+    // Subscribes to OS device-change notifications; onChange, if set, runs
+    // after each invalidation. JUCE delivers them on the message thread, so
+    // this and stopListening() must be called there and the process must run
+    // the JUCE dispatch loop.
+    void startListening(std::function<void()> onChange = nullptr) {
+        connection = juce::MidiDeviceListConnection::make([this, onChange = std::move(onChange)] {
+            invalidate();
+            if (onChange) onChange();
+        });
+    }
+
+    void stopListening() { connection.reset(); }
+
+    uint64_t getEnumerationCount() const { return enumerations.load(std::memory_order_relaxed); }
+
+private:
+    void refresh() {
+        std::lock_guard<std::mutex> lock(refreshMutex);
+        // Another reader may have rebuilt the snapshot while we waited
+        if (!stale.load(std::memory_order_acquire)) return;
+        // Cleared before enumerating so a change reported meanwhile triggers another pass
+        stale.store(false, std::memory_order_release);
+
+        auto next = std::make_shared<MidiDeviceSnapshot>();
+        next->inputs = MidiDeviceList(juce::MidiInput::getAvailableDevices());
+        next->outputs = MidiDeviceList(juce::MidiOutput::getAvailableDevices());
+        next->generation = enumerations.fetch_add(1, std::memory_order_relaxed) + 1;
+        std::atomic_store_explicit(&current, SnapshotPtr(std::move(next)),
+                                   std::memory_order_release);
+    }
+
+    // Only accessed through std::atomic_load/atomic_store
+    SnapshotPtr current;
+    std::atomic<bool> stale{true};
+    std::atomic<uint64_t> enumerations{0};
+    std::mutex refreshMutex;  // Serializes enumerations, never held by readers of a fresh cache
+    juce::MidiDeviceListConnection connection;
+};
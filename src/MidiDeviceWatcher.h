@@ -0,0 +1,157 @@
+/**
+ * MidiDeviceWatcher - Reacts to MIDI devices being plugged in and unplugged
+ *
+ * Subscribes to the OS device-change notifications through MidiDeviceRegistry
+ * (CoreMIDI setup notifications, the ALSA sequencer announce port, WinRT
+ * device watchers - whatever JUCE uses on the platform). Each notification
+ * wakes one thread, which re-enumerates once, diffs the new device lists
+ * against the previous ones by identifier and hands the added and removed
+ * devices to the handler. Reopening ports can take a while per device, so it
+ * happens on this thread rather than the message thread.
+ *
+ * The thread sleeps on a condition variable without a timeout: nothing runs
+ * while no device changes. Notifications that arrive while the handler runs
+ * are folded into one more pass.
+ */
+
+#pragma once
+
+#include "MidiDeviceRegistry.h"
+
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct MidiDeviceChanges {
+    std::vector<MidiDeviceEntry> addedInputs;
+    std::vector<MidiDeviceEntry> removedInputs;
+    std::vector<MidiDeviceEntry> addedOutputs;
+    std::vector<MidiDeviceEntry> removedOutputs;
+
+    bool empty() const {
+        return addedInputs.empty() && removedInputs.empty() &&
+               addedOutputs.empty() && removedOutputs.empty();
+    }
+
+    bool wasAdded(bool isInput, const std::string& identifier) const {
+        return contains(isInput ? addedInputs : addedOutputs, identifier);
+    }
+
+    bool wasRemoved(bool isInput, const std::string& identifier) const {
+        return contains(isInput ? removedInputs : removedOutputs, identifier);
+    }
+
+    // Devices present in `after` but not in `before`, matched by identifier
+    static std::vector<MidiDeviceEntry> difference(const MidiDeviceList& after,
+                                                   const MidiDeviceList& before) {
+        std::vector<MidiDeviceEntry> result;
+        for (const auto& device : after.all()) {
+            if (!before.findByIdentifier(device.identifier)) result.push_back(device);
+        }
+        return result;
+    }
+
+    static MidiDeviceChanges between(const MidiDeviceSnapshot& before,
+                                     const MidiDeviceSnapshot& after) {
+        MidiDeviceChanges changes;
+        changes.addedInputs = difference(after.inputs, before.inputs);
+        changes.removedInputs = difference(before.inputs, after.inputs);
+        changes.addedOutputs = difference(after.outputs, before.outputs);
+        changes.removedOutputs = difference(before.outputs, after.outputs);
+        return changes;
+    }
+
+private:
+    static bool contains(const std::vector<MidiDeviceEntry>& devices, const std::string& identifier) {
+        for (const auto& device : devices) {
+            if (device.identifier == identifier) return true;
+        }
+        return false;
+    }
+};
+
+class MidiDeviceWatcher
+{
+public:
+    // Called on the watcher thread with the new device lists
+    using ChangeHandler = std::function<void(const MidiDeviceSnapshot& devices,
+                                             const MidiDeviceChanges& changes)>;
+
+    MidiDeviceWatcher(MidiDeviceRegistry& deviceRegistry, ChangeHandler changeHandler)
+        : registry(deviceRegistry), handler(std::move(changeHandler)) {}
+
+    ~MidiDeviceWatcher() { stop(); }
+
+    MidiDeviceWatcher(const MidiDeviceWatcher&) = delete;
+    MidiDeviceWatcher& operator=(const MidiDeviceWatcher&) = delete;
+
+    // Takes the current device lists as the baseline and subscribes to
+    // notifications. Must be called on the JUCE message thread.
+    void start() {
+        if (workerThread.joinable()) return;
+        previous = registry.snapshot();
+        running = true;
+        workerThread = std::thread([this]() { run(); });
+        registry.startListening([this] { notifyChanged(); });
+    }
+
+    // Must be called on the JUCE message thread, like start()
+    void stop() {
+        if (!workerThread.joinable()) return;
+        registry.stopListening();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_one();
+        workerThread.join();
+    }
+
+    // Safe from any thread; also usable to force a rescan
+    void notifyChanged() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+        }
+        cv.notify_one();
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this] { return pending || !running; });
+            if (!running) return;
+            pending = false;
+            lock.unlock();
+
+            registry.invalidate();
+            auto current = registry.snapshot();
+            auto changes = MidiDeviceChanges::between(*previous, *current);
+            previous = current;
+            if (!changes.empty()) {
+                std::cout << "[DeviceWatcher] Devices changed: +"
+                          << changes.addedInputs.size() << "/-" << changes.removedInputs.size()
+                          << " inputs, +" << changes.addedOutputs.size() << "/-"
+                          << changes.removedOutputs.size() << " outputs" << std::endl;
+                handler(*current, changes);
+            }
+
+            lock.lock();
+        }
+    }
+
+    MidiDeviceRegistry& registry;
+    ChangeHandler handler;
+    MidiDeviceRegistry::SnapshotPtr previous;  // Only touched by start() and the worker
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool pending = false;
+    bool running = false;
+    std::thread workerThread;
+};
@@ -0,0 +1,232 @@
+/**
+ * MidiFanOut - Delivers one message to many local destinations in parallel
+ *
+ * A source routed to many outputs would otherwise send to each of them in
+ * turn on its MIDI input thread, so the last destination always waits for
+ * every blocking send before it. With fan-out the input thread only queues
+ * the deliveries; a small set of lanes sends them concurrently.
+ *
+ * Each lane is one thread draining its own FIFO, a ring of job slots
+ * allocated up front, so queueing on the input thread never allocates
+ * (targets and packets are reference-counted copies). RouteManager gives every
+ * destination a fixed lane, so messages to one destination are sent in the
+ * order they arrived; deliberately not work-stealing, which would let two
+ * threads send to the same port out of order.
+ *
+ * The spread of a fan-out (last delivery minus first delivery of the same
+ * message) is recorded in a histogram. Groups are tracked in a fixed ring so
+ * the input thread doesn't allocate; a fan-out that finds its slot still in
+ * use (more than groupSlots fan-outs in flight) is delivered but not measured.
+ *
+ * No JUCE dependency: targets are handed to the deliver callback.
+ */
+
+#pragma once
+
+#include "Metrics.h"
+#include "MidiPacket.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct MidiFanOutStats {
+    size_t lanes;
+    size_t pending;
+    uint64_t delivered;
+    uint64_t dropped;
+    uint64_t groups;
+    LatencyHistogram::Snapshot spread;
+};
+
+template <typename Target>
+class MidiFanOut
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on a lane thread for each queued delivery; sysexFragment as
+    // given to submit()
+    using DeliverFunction = std::function<void(Target& target, const MidiPacket& packet,
+                                               Clock::time_point capturedAt, bool sysexFragment)>;
+
+    static constexpr size_t groupSlots = 1024;
+    static constexpr size_t noGroup = std::numeric_limits<size_t>::max();
+
+    MidiFanOut(size_t laneCount, DeliverFunction deliverFn, size_t maxPendingPerLane = 4096)
+        : deliver(std::move(deliverFn)), maxPending(maxPendingPerLane ? maxPendingPerLane : 1) {
+        for (size_t i = 0; i < (laneCount ? laneCount : 1); i++) {
+            lanes.push_back(std::make_unique<Lane>(maxPending));
+        }
+        for (auto& lane : lanes) {
+            Lane* owned = lane.get();
+            lane->thread = std::thread([this, owned]() { runLane(*owned); });
+        }
+    }
+
+    // Pending deliveries are discarded
+    ~MidiFanOut() {
+        for (auto& lane : lanes) {
+            {
+                std::lock_guard<std::mutex> lock(lane->mutex);
+                lane->running = false;
+            }
+            lane->cv.notify_one();
+        }
+        for (auto& lane : lanes) {
+            if (lane->thread.joinable()) lane->thread.join();
+        }
+    }
+
+    MidiFanOut(const MidiFanOut&) = delete;
+    MidiFanOut& operator=(const MidiFanOut&) = delete;
+
+    size_t laneCount() const { return lanes.size(); }
+
+    // Starts measuring a fan-out of `count` deliveries. Every one of them
+    // must be either submitted with the returned group or skipped.
+    size_t beginGroup(size_t count) {
+        if (count < 2) return noGroup;
+        size_t slot = nextGroup.fetch_add(1, std::memory_order_relaxed) % groupSlots;
+        Group& group = groups[slot];
+        uint32_t expected = 0;
+        if (!group.remaining.compare_exchange_strong(expected, claimed, std::memory_order_acquire)) {
+            return noGroup;
+        }
+        group.firstDoneUs.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+        group.lastDoneUs.store(-1, std::memory_order_relaxed);
+        group.remaining.store((uint32_t)count, std::memory_order_release);
+        groupCount.fetch_add(1, std::memory_order_relaxed);
+        return slot;
+    }
+
+    // Thread-safe. Queues a delivery on the given lane (taken modulo the lane
+    // count). sysexFragment marks one piece of a streamed SysEx. Returns
+    // false and counts a drop if the lane is full.
+    bool submit(size_t lane, std::shared_ptr<Target> target, const MidiPacket& packet,
+                Clock::time_point capturedAt, size_t group, bool sysexFragment = false) {
+        Lane& owner = *lanes[lane % lanes.size()];
+        {
+            std::lock_guard<std::mutex> lock(owner.mutex);
+            if (owner.count == owner.slots.size()) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                skip(group);
+                return false;
+            }
+            Job& job = owner.slots[(owner.head + owner.count) % owner.slots.size()];
+            job.target = std::move(target);
+            job.packet = packet;
+            job.capturedAt = capturedAt;
+            job.group = group;
+            job.sysexFragment = sysexFragment;
+            owner.count++;
+        }
+        owner.cv.notify_one();
+        return true;
+    }
+
+    // A delivery of the group that won't happen (e.g. dropped by a route filter)
+    void skip(size_t group) { finish(group); }
+
+    MidiFanOutStats getStats() const {
+        MidiFanOutStats stats{lanes.size(), 0, 0, 0, 0, {}};
+        for (const auto& lane : lanes) {
+            std::lock_guard<std::mutex> lock(lane->mutex);
+            stats.pending += lane->count;
+        }
+        stats.delivered = delivered.load(std::memory_order_relaxed);
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+        stats.groups = groupCount.load(std::memory_order_relaxed);
+        stats.spread = spread.snapshot();
+        return stats;
+    }
+
+private:
+    struct Job {
+        std::shared_ptr<Target> target;
+        MidiPacket packet;
+        Clock::time_point capturedAt;
+        size_t group = noGroup;
+        bool sysexFragment = false;
+    };
+
+    struct Lane {
+        explicit Lane(size_t capacity) : slots(capacity) {}
+
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Job> slots;   // Ring of count jobs starting at head
+        size_t head = 0;
+        size_t count = 0;
+        bool running = true;
+        std::thread thread;
+    };
+
+    // Completion times are microseconds after capture; remaining counts the
+    // deliveries still outstanding (claimed while the slot is being reset)
+    struct Group {
+        std::atomic<uint32_t> remaining{0};
+        std::atomic<int64_t> firstDoneUs{0};
+        std::atomic<int64_t> lastDoneUs{0};
+    };
+    static constexpr uint32_t claimed = std::numeric_limits<uint32_t>::max();
+
+    void runLane(Lane& lane) {
+        std::unique_lock<std::mutex> lock(lane.mutex);
+        while (true) {
+            lane.cv.wait(lock, [&lane] { return !lane.running || lane.count > 0; });
+            if (!lane.running) return;
+            Job job = std::move(lane.slots[lane.head]);
+            lane.slots[lane.head] = Job();   // Drop the slot's references now, not when it is reused
+            lane.head = (lane.head + 1) % lane.slots.size();
+            lane.count--;
+            lock.unlock();
+
+            deliver(*job.target, job.packet, job.capturedAt, job.sysexFragment);
+            delivered.fetch_add(1, std::memory_order_relaxed);
+            if (job.group != noGroup) {
+                int64_t doneUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                    Clock::now() - job.capturedAt).count();
+                Group& group = groups[job.group];
+                int64_t first = group.firstDoneUs.load(std::memory_order_relaxed);
+                while (doneUs < first &&
+                       !group.firstDoneUs.compare_exchange_weak(first, doneUs, std::memory_order_relaxed)) {}
+                int64_t last = group.lastDoneUs.load(std::memory_order_relaxed);
+                while (doneUs > last &&
+                       !group.lastDoneUs.compare_exchange_weak(last, doneUs, std::memory_order_relaxed)) {}
+                finish(job.group);
+            }
+
+            lock.lock();
+        }
+    }
+
+    // The last delivery of a group records its spread and frees the slot
+    void finish(size_t slot) {
+        if (slot == noGroup) return;
+        Group& group = groups[slot];
+        if (group.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        int64_t first = group.firstDoneUs.load(std::memory_order_relaxed);
+        int64_t last = group.lastDoneUs.load(std::memory_order_relaxed);
+        if (last >= first) spread.record((uint64_t)(last - first));
+    }
+
+    DeliverFunction deliver;
+    size_t maxPending;
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::array<Group, groupSlots> groups;
+    std::atomic<size_t> nextGroup{0};
+    std::atomic<uint64_t> groupCount{0};
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> dropped{0};
+    LatencyHistogram spread;
+};
@@ -1,931 +1,102 @@
 /**
- * MidiHttpServer - HTTP-to-MIDI bridge server
+ * MidiHttpServer - Command-line entry point
  *
- * Provides a robust HTTP API for applications to proxy MIDI operations
- * through JUCE, avoiding the limitations of platform MIDI libraries.
- *
- * Uses cpp-httplib for the HTTP server with a thread pool.
+ * Parses the options, starts a MidiHttpServer (see MidiHttpServer.h) and
+ * runs the JUCE message loop until SIGINT or SIGTERM.
  */
 
-#include <juce_core/juce_core.h>
-#include <juce_events/juce_events.h>
-#include <juce_audio_devices/juce_audio_devices.h>
-
-#include "httplib.h"
-#include "JsonBuilder.h"
-#include "MidiPort.h"
-#include "VirtualMidiPort.h"
-#include "RouteManager.h"
+#include "MidiHttpServer.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
-#include <map>
-#include <memory>
-#include <mutex>
-#include <sstream>
 #include <string>
 #include <thread>
 
 //==============================================================================
-// HTTP Server class
-class MidiHttpServer
-{
-public:
-    explicit MidiHttpServer(int port) : serverPort(port), routeManager() {
-        // Set up local message forwarder for RouteManager
-        routeManager.setLocalMessageForwarder([this](const std::string& destPortId,
-                                                      const std::vector<uint8_t>& data) {
-            forwardToLocalDestination(destPortId, data);
-        });
-    }
-
-    ~MidiHttpServer() {
-        stopServer();
-    }
-
-    // Forward a message to a local destination port (used by RouteManager for local routes)
-    void forwardToLocalDestination(const std::string& destPortId,
-                                    const std::vector<uint8_t>& data) {
-        std::lock_guard<std::mutex> lock(portsMutex);
-
-        // Check if it's a virtual port
-        if (destPortId.rfind("virtual:", 0) == 0) {
-            std::string virtualId = destPortId.substr(8);
-            auto it = virtualPorts.find(virtualId);
-            if (it != virtualPorts.end()) {
-                it->second->sendMessage(data);
-            } else {
-                std::cerr << "[RouteManager] Virtual destination not found: "
-                          << virtualId << std::endl;
-            }
-            return;
-        }
-
-        // Check physical ports
-        auto it = ports.find(destPortId);
-        if (it != ports.end()) {
-            it->second->sendMessage(data);
-        } else {
-            std::cerr << "[RouteManager] Destination port not found: "
-                      << destPortId << std::endl;
-        }
-    }
-
-    void startServer() {
-        // Auto-open ports referenced by any routes persisted from last run.
-        // Retry after delays: CoreMIDI sometimes doesn't enumerate all devices immediately.
-        autoOpenPortsForAllRoutes();
-        retryThreadRunning = true;
-        retryThread = std::thread([this]() {
-            // Wait 2s, retry if not cancelled
-            std::unique_lock<std::mutex> lock(retryMutex);
-            retryCV.wait_for(lock, std::chrono::seconds(2), [this] { return !retryThreadRunning.load(); });
-            if (!retryThreadRunning) return;
-            lock.unlock();
-            autoOpenPortsForAllRoutes();
-
-            // Wait 5s more, retry if not cancelled
-            lock.lock();
-            retryCV.wait_for(lock, std::chrono::seconds(5), [this] { return !retryThreadRunning.load(); });
-            if (!retryThreadRunning) return;
-            lock.unlock();
-            autoOpenPortsForAllRoutes();
-        });
-
-        server = std::make_unique<httplib::Server>();
-
-        // Add CORS headers to all responses
-        server->set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
-            res.set_header("Access-Control-Allow-Origin", "*");
-            res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
-            res.set_header("Access-Control-Allow-Headers", "Content-Type");
-        });
-
-        // Handle CORS preflight requests
-        server->Options(".*", [](const httplib::Request&, httplib::Response& res) {
-            res.status = 204;
-        });
-
-        // Health check endpoint
-        server->Get("/health", [this](const httplib::Request&, httplib::Response& res) {
-            JsonBuilder json;
-            json.startObject().key("status").value(std::string("ok")).endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // List available MIDI ports
-        server->Get("/ports", [this](const httplib::Request&, httplib::Response& res) {
-            JsonBuilder json;
-            json.startObject();
-
-            json.key("inputs").startArray();
-            auto inputs = juce::MidiInput::getAvailableDevices();
-            for (const auto& device : inputs) {
-                json.arrayValue(device.name.toStdString());
-            }
-            json.endArray();
-
-            json.key("outputs").startArray();
-            auto outputs = juce::MidiOutput::getAvailableDevices();
-            for (const auto& device : outputs) {
-                json.arrayValue(device.name.toStdString());
-            }
-            json.endArray();
-
-            json.endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Open a MIDI port
-        server->Post("/port/:portId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            try {
-                // Parse JSON body (simple parsing)
-                std::string name, type;
-
-                size_t namePos = req.body.find("\"name\":\"");
-                if (namePos != std::string::npos) {
-                    namePos += 8;
-                    size_t endPos = req.body.find("\"", namePos);
-                    name = req.body.substr(namePos, endPos - namePos);
-                }
-
-                size_t typePos = req.body.find("\"type\":\"");
-                if (typePos != std::string::npos) {
-                    typePos += 8;
-                    size_t endPos = req.body.find("\"", typePos);
-                    type = req.body.substr(typePos, endPos - typePos);
-                }
-
-                bool isInput = (type == "input");
-                auto port = std::make_unique<MidiPort>(portId, name, isInput);
-
-                // Set up routing callback for input ports
-                if (isInput) {
-                    port->setMessageCallback([this](const std::string& srcPortId,
-                                                    const std::vector<uint8_t>& data) {
-                        routeManager.forwardMessage(srcPortId, data);
-                    });
-                }
-
-                bool success = port->open();
-
-                if (success) {
-                    std::lock_guard<std::mutex> lock(portsMutex);
-                    ports[portId] = std::move(port);
-                }
-
-                JsonBuilder json;
-                json.startObject().key("success").value(success).endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // Close a MIDI port
-        server->Delete("/port/:portId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            bool success = ports.erase(portId) > 0;
-
-            JsonBuilder json;
-            json.startObject().key("success").value(success).endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Send MIDI message
-        server->Post("/port/:portId/send", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            auto it = ports.find(portId);
-            if (it == ports.end()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Port not found")).endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            try {
-                // Parse message array from JSON
-                std::vector<uint8_t> message;
-                size_t msgPos = req.body.find("\"message\":[");
-                if (msgPos != std::string::npos) {
-                    msgPos += 11;
-                    size_t endPos = req.body.find("]", msgPos);
-                    std::string msgStr = req.body.substr(msgPos, endPos - msgPos);
-
-                    std::istringstream iss(msgStr);
-                    std::string token;
-                    while (std::getline(iss, token, ',')) {
-                        if (!token.empty()) {
-                            message.push_back((uint8_t)std::stoi(token));
-                        }
-                    }
-                }
-
-                // Validate message before sending
-                if (message.empty()) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Invalid MIDI message: empty message"))
-                        .key("success").value(false)
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    std::cerr << "Rejected empty MIDI message\n";
-                    return;
-                }
-
-                // Reject incomplete SysEx (single 0xF0 byte)
-                if (message.size() == 1 && message[0] == 0xF0) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Invalid MIDI message: incomplete SysEx (0xF0 without 0xF7)"))
-                        .key("success").value(false)
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    std::cerr << "Rejected incomplete SysEx (single 0xF0)\n";
-                    return;
-                }
-
-                it->second->sendMessage(message);
-
-                JsonBuilder json;
-                json.startObject().key("success").value(true).endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // Get queued incoming messages
-        server->Get("/port/:portId/messages", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            auto it = ports.find(portId);
-            if (it == ports.end()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Port not found")).endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            auto messages = it->second->getMessages();
-
-            JsonBuilder json;
-            json.startObject().key("messages").startArray();
-
-            for (const auto& msg : messages) {
-                json.startArray();
-                for (uint8_t byte : msg) {
-                    json.arrayValue((int)byte);
-                }
-                json.endArray();
-            }
-
-            json.endArray().endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        //==============================================================================
-        // Virtual MIDI port endpoints (for testing)
-        //==============================================================================
-
-        // List virtual ports
-        server->Get("/virtual", [this](const httplib::Request&, httplib::Response& res) {
-            std::lock_guard<std::mutex> lock(portsMutex);
-
-            JsonBuilder json;
-            json.startObject();
-
-            json.key("inputs").startArray();
-            for (const auto& [id, port] : virtualPorts) {
-                if (port->isInput()) {
-                    json.arrayValue(id);
-                }
-            }
-            json.endArray();
-
-            json.key("outputs").startArray();
-            for (const auto& [id, port] : virtualPorts) {
-                if (!port->isInput()) {
-                    json.arrayValue(id);
-                }
-            }
-            json.endArray();
-
-            json.endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Create a virtual port
-        server->Post("/virtual/:portId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            try {
-                // Parse JSON body
-                std::string name, type;
-
-                size_t namePos = req.body.find("\"name\":\"");
-                if (namePos != std::string::npos) {
-                    namePos += 8;
-                    size_t endPos = req.body.find("\"", namePos);
-                    name = req.body.substr(namePos, endPos - namePos);
-                } else {
-                    name = portId; // Use portId as name if not specified
-                }
-
-                size_t typePos = req.body.find("\"type\":\"");
-                if (typePos != std::string::npos) {
-                    typePos += 8;
-                    size_t endPos = req.body.find("\"", typePos);
-                    type = req.body.substr(typePos, endPos - typePos);
-                }
-
-                bool isInput = (type == "input");
-                std::string fullPortId = "virtual:" + portId;
-                auto port = std::make_unique<VirtualMidiPort>(fullPortId, name, isInput);
-
-                // Set up routing callback for input ports
-                if (isInput) {
-                    port->setMessageCallback([this](const std::string& srcPortId,
-                                                    const std::vector<uint8_t>& data) {
-                        routeManager.forwardMessage(srcPortId, data);
-                    });
-                }
-
-                bool success = port->open();
-
-                if (success) {
-                    std::lock_guard<std::mutex> lock(portsMutex);
-                    virtualPorts[portId] = std::move(port);
-                }
-
-                JsonBuilder json;
-                json.startObject()
-                    .key("success").value(success)
-                    .key("name").value(name)
-                    .key("type").value(type)
-                    .endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // Delete a virtual port
-        server->Delete("/virtual/:portId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            bool success = virtualPorts.erase(portId) > 0;
-
-            JsonBuilder json;
-            json.startObject().key("success").value(success).endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Inject a message into a virtual input port (for testing)
-        server->Post("/virtual/:portId/inject", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            auto it = virtualPorts.find(portId);
-            if (it == virtualPorts.end()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            if (!it->second->isInput()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Can only inject into input ports")).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            try {
-                // Parse message array from JSON
-                std::vector<uint8_t> message;
-                size_t msgPos = req.body.find("\"message\":[");
-                if (msgPos != std::string::npos) {
-                    msgPos += 11;
-                    size_t endPos = req.body.find("]", msgPos);
-                    std::string msgStr = req.body.substr(msgPos, endPos - msgPos);
-
-                    std::istringstream iss(msgStr);
-                    std::string token;
-                    while (std::getline(iss, token, ',')) {
-                        if (!token.empty()) {
-                            message.push_back((uint8_t)std::stoi(token));
-                        }
-                    }
-                }
-
-                if (message.empty()) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Empty message"))
-                        .key("success").value(false)
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    return;
-                }
-
-                it->second->injectMessage(message);
-
-                JsonBuilder json;
-                json.startObject().key("success").value(true).endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // Get messages from a virtual port's queue
-        server->Get("/virtual/:portId/messages", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            auto it = virtualPorts.find(portId);
-            if (it == virtualPorts.end()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            auto messages = it->second->getMessages();
-
-            JsonBuilder json;
-            json.startObject().key("messages").startArray();
-
-            for (const auto& msg : messages) {
-                json.startArray();
-                for (uint8_t byte : msg) {
-                    json.arrayValue((int)byte);
-                }
-                json.endArray();
-            }
+// Set from the signal handler, read by the thread that stops the message loop;
+// a lock-free atomic is safe for both
+static std::atomic<bool> stopRequested{false};
 
-            json.endArray().endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Send through a virtual output port
-        server->Post("/virtual/:portId/send", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string portId = req.path_params.at("portId");
-
-            std::lock_guard<std::mutex> lock(portsMutex);
-            auto it = virtualPorts.find(portId);
-            if (it == virtualPorts.end()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            if (it->second->isInput()) {
-                JsonBuilder json;
-                json.startObject().key("error").value(std::string("Can only send from output ports")).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            try {
-                // Parse message array from JSON
-                std::vector<uint8_t> message;
-                size_t msgPos = req.body.find("\"message\":[");
-                if (msgPos != std::string::npos) {
-                    msgPos += 11;
-                    size_t endPos = req.body.find("]", msgPos);
-                    std::string msgStr = req.body.substr(msgPos, endPos - msgPos);
-
-                    std::istringstream iss(msgStr);
-                    std::string token;
-                    while (std::getline(iss, token, ',')) {
-                        if (!token.empty()) {
-                            message.push_back((uint8_t)std::stoi(token));
-                        }
-                    }
-                }
-
-                if (message.empty()) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Empty message"))
-                        .key("success").value(false)
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    return;
-                }
-
-                it->second->sendMessage(message);
-
-                JsonBuilder json;
-                json.startObject().key("success").value(true).endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        //==============================================================================
-        // Route management endpoints
-        //==============================================================================
-
-        // GET /routes - List all routes
-        server->Get("/routes", [this](const httplib::Request&, httplib::Response& res) {
-            auto routes = routeManager.getAllRoutes();
-
-            JsonBuilder json;
-            json.startObject().key("routes").startArray();
-
-            for (const auto& route : routes) {
-                json.startObject()
-                    .key("id").value(route.id)
-                    .key("enabled").value(route.enabled)
-                    .key("source").startObject()
-                        .key("serverUrl").value(route.source.serverUrl)
-                        .key("portId").value(route.source.portId)
-                        .key("portName").value(route.source.portName)
-                    .endObject()
-                    .key("destination").startObject()
-                        .key("serverUrl").value(route.destination.serverUrl)
-                        .key("portId").value(route.destination.portId)
-                        .key("portName").value(route.destination.portName)
-                    .endObject()
-                    .key("status").startObject()
-                        .key("routeId").value(route.id)
-                        .key("status").value(route.enabled ? std::string("active") : std::string("disabled"))
-                        .key("messagesRouted").value((int)route.messagesForwarded)
-                    .endObject()
-                .endObject();
-            }
-
-            json.endArray().endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // POST /routes - Create a new route
-        server->Post("/routes", [this](const httplib::Request& req, httplib::Response& res) {
-            try {
-                // Parse JSON body - expecting source and destination endpoint objects
-                RouteEndpoint source, destination;
-                bool enabled = true;
-
-                // Parse source endpoint
-                size_t sourceStart = req.body.find("\"source\"");
-                if (sourceStart != std::string::npos) {
-                    source.serverUrl = extractNestedJsonString(req.body, sourceStart, "serverUrl");
-                    source.portId = extractNestedJsonString(req.body, sourceStart, "portId");
-                    source.portName = extractNestedJsonString(req.body, sourceStart, "portName");
-                }
-
-                // Parse destination endpoint
-                size_t destStart = req.body.find("\"destination\"");
-                if (destStart != std::string::npos) {
-                    destination.serverUrl = extractNestedJsonString(req.body, destStart, "serverUrl");
-                    destination.portId = extractNestedJsonString(req.body, destStart, "portId");
-                    destination.portName = extractNestedJsonString(req.body, destStart, "portName");
-                }
-
-                // Parse enabled (optional, defaults to true)
-                size_t enabledPos = req.body.find("\"enabled\":");
-                if (enabledPos != std::string::npos) {
-                    enabledPos += 10;
-                    while (enabledPos < req.body.length() &&
-                           (req.body[enabledPos] == ' ' || req.body[enabledPos] == '\t')) {
-                        enabledPos++;
-                    }
-                    enabled = (req.body.substr(enabledPos, 4) == "true");
-                }
-
-                // Parse id (optional, allows pre-specified ID for cross-server replication)
-                std::string prespecifiedId;
-                size_t idPos = req.body.find("\"id\":\"");
-                if (idPos != std::string::npos) {
-                    idPos += 6;
-                    size_t idEnd = req.body.find("\"", idPos);
-                    if (idEnd != std::string::npos) {
-                        prespecifiedId = req.body.substr(idPos, idEnd - idPos);
-                    }
-                }
-
-                if (source.portId.empty() || destination.portId.empty()) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Missing source.portId or destination.portId"))
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    return;
-                }
-
-                std::string routeId = routeManager.addRoute(source, destination, enabled, prespecifiedId);
-
-                // Auto-open any local physical ports the route references
-                autoOpenPortsForRoute(source, destination);
-
-                JsonBuilder json;
-                json.startObject()
-                    .key("route").startObject()
-                        .key("id").value(routeId)
-                        .key("enabled").value(enabled)
-                        .key("source").startObject()
-                            .key("serverUrl").value(source.serverUrl)
-                            .key("portId").value(source.portId)
-                            .key("portName").value(source.portName)
-                        .endObject()
-                        .key("destination").startObject()
-                            .key("serverUrl").value(destination.serverUrl)
-                            .key("portId").value(destination.portId)
-                            .key("portName").value(destination.portName)
-                        .endObject()
-                    .endObject()
-                .endObject();
-                res.status = 201;
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // PUT /routes/:routeId - Update a route (enable/disable)
-        server->Put("/routes/:routeId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string routeId = req.path_params.at("routeId");
-
-            try {
-                // Parse enabled field
-                size_t enabledPos = req.body.find("\"enabled\":");
-                if (enabledPos == std::string::npos) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Missing enabled field"))
-                        .endObject();
-                    res.status = 400;
-                    res.set_content(json.toString(), "application/json");
-                    return;
-                }
-
-                enabledPos += 10;
-                while (enabledPos < req.body.length() &&
-                       (req.body[enabledPos] == ' ' || req.body[enabledPos] == '\t')) {
-                    enabledPos++;
-                }
-                bool enabled = (req.body.substr(enabledPos, 4) == "true");
-
-                bool success = routeManager.setRouteEnabled(routeId, enabled);
-                if (!success) {
-                    JsonBuilder json;
-                    json.startObject()
-                        .key("error").value(std::string("Route not found"))
-                        .endObject();
-                    res.status = 404;
-                    res.set_content(json.toString(), "application/json");
-                    return;
-                }
-
-                JsonBuilder json;
-                json.startObject()
-                    .key("success").value(true)
-                    .key("routeId").value(routeId)
-                    .key("enabled").value(enabled)
-                    .endObject();
-                res.set_content(json.toString(), "application/json");
-            } catch (const std::exception& e) {
-                JsonBuilder json;
-                json.startObject().key("error").value(e.what()).endObject();
-                res.status = 400;
-                res.set_content(json.toString(), "application/json");
-            }
-        });
-
-        // DELETE /routes/:routeId - Delete a route
-        server->Delete("/routes/:routeId", [this](const httplib::Request& req, httplib::Response& res) {
-            std::string routeId = req.path_params.at("routeId");
-
-            bool success = routeManager.removeRoute(routeId);
-            if (!success) {
-                JsonBuilder json;
-                json.startObject()
-                    .key("error").value(std::string("Route not found"))
-                    .endObject();
-                res.status = 404;
-                res.set_content(json.toString(), "application/json");
-                return;
-            }
-
-            JsonBuilder json;
-            json.startObject().key("success").value(true).endObject();
-            res.set_content(json.toString(), "application/json");
-        });
-
-        // Start server in a separate thread
-        serverThread = std::thread([this]() {
-            if (serverPort == 0) {
-                // Let OS assign an available port
-                int actualPort = server->bind_to_any_port("0.0.0.0");
-                serverPort = actualPort;
-                // Print in parseable format for ProcessManager
-                std::cout << "MIDI_SERVER_PORT=" << actualPort << std::endl;
-                std::cout << "HTTP Server listening on port " << actualPort << std::endl;
-                server->listen_after_bind();
-            } else {
-                std::cout << "MIDI_SERVER_PORT=" << serverPort << std::endl;
-                std::cout << "HTTP Server listening on port " << serverPort << std::endl;
-                server->listen("0.0.0.0", serverPort);
-            }
-        });
-    }
-
-    void stopServer() {
-        // Signal and join retry thread before destroying anything it touches
-        {
-            std::lock_guard<std::mutex> lock(retryMutex);
-            retryThreadRunning = false;
-        }
-        retryCV.notify_all();
-        if (retryThread.joinable()) {
-            retryThread.join();
-        }
-
-        if (server) {
-            server->stop();
-        }
-        if (serverThread.joinable()) {
-            serverThread.join();
-        }
-
-        std::lock_guard<std::mutex> lock(portsMutex);
-        ports.clear();
-        virtualPorts.clear();
-    }
-
-private:
-    int serverPort;
-    std::unique_ptr<httplib::Server> server;
-    std::thread serverThread;
-    std::thread retryThread;
-    std::atomic<bool> retryThreadRunning{false};
-    std::mutex retryMutex;
-    std::condition_variable retryCV;
-    std::map<std::string, std::unique_ptr<MidiPort>> ports;
-    std::map<std::string, std::unique_ptr<VirtualMidiPort>> virtualPorts;
-    std::mutex portsMutex;
-    RouteManager routeManager;
-
-    // Returns true if serverUrl refers to this server instance:
-    // either the "local" sentinel or an absolute URL pointing to our own port.
-    bool isSelf(const std::string& serverUrl) const {
-        if (serverUrl.empty() || serverUrl == "local") return true;
-        // Check if the URL's port component matches ours
-        size_t colonPos = serverUrl.rfind(':');
-        if (colonPos != std::string::npos) {
-            try {
-                int urlPort = std::stoi(serverUrl.substr(colonPos + 1));
-                if (urlPort == serverPort) return true;
-            } catch (...) {}
-        }
-        return false;
-    }
-
-    // Returns true if the endpoint is a local physical port (not virtual, not remote)
-    bool isLocalPhysical(const std::string& serverUrl, const std::string& portId) const {
-        return isSelf(serverUrl) && portId.rfind("virtual:", 0) == std::string::npos;
-    }
-
-    // Ensures a local physical port is open, opening it if needed.
-    // isInput is inferred from portId prefix ("input-" = true, "output-" = false).
-    void ensureLocalPortOpen(const std::string& portId, const std::string& portName) {
-        {
-            std::lock_guard<std::mutex> lock(portsMutex);
-            if (ports.find(portId) != ports.end()) return;
-        }
-
-        bool isInput = (portId.rfind("input-", 0) == 0);
-        auto port = std::make_unique<MidiPort>(portId, portName, isInput);
-
-        if (isInput) {
-            port->setMessageCallback([this](const std::string& srcPortId,
-                                            const std::vector<uint8_t>& data) {
-                routeManager.forwardMessage(srcPortId, data);
-            });
-        }
-
-        bool success = port->open();
-        if (success) {
-            std::lock_guard<std::mutex> lock(portsMutex);
-            ports[portId] = std::move(port);
-            std::cout << "[MidiHttpServer] Auto-opened " << (isInput ? "input" : "output")
-                      << " port: " << portName << std::endl;
-        } else {
-            std::cerr << "[MidiHttpServer] Failed to auto-open port: "
-                      << portName << std::endl;
-        }
-    }
-
-    // Auto-opens any local physical ports referenced by a route's endpoints.
-    void autoOpenPortsForRoute(const RouteEndpoint& source, const RouteEndpoint& destination) {
-        if (isLocalPhysical(source.serverUrl, source.portId) && !source.portName.empty()) {
-            ensureLocalPortOpen(source.portId, source.portName);
-        }
-        if (isLocalPhysical(destination.serverUrl, destination.portId) && !destination.portName.empty()) {
-            ensureLocalPortOpen(destination.portId, destination.portName);
-        }
-    }
-
-    // Auto-opens ports for all persisted routes (called at startup).
-    void autoOpenPortsForAllRoutes() {
-        auto routes = routeManager.getAllRoutes();
-        for (const auto& route : routes) {
-            autoOpenPortsForRoute(route.source, route.destination);
-        }
-    }
-
-    // Helper to extract a string value from a nested JSON object (static — no server state needed)
-    static std::string extractNestedJsonString(const std::string& json,
-                                                size_t objectStart,
-                                                const std::string& key) {
-        // Find the opening brace after objectStart
-        size_t braceStart = json.find('{', objectStart);
-        if (braceStart == std::string::npos) return "";
-
-        // Find matching closing brace
-        int braceCount = 1;
-        size_t braceEnd = braceStart + 1;
-        while (braceEnd < json.length() && braceCount > 0) {
-            if (json[braceEnd] == '{') braceCount++;
-            else if (json[braceEnd] == '}') braceCount--;
-            braceEnd++;
-        }
-        if (braceCount != 0) return "";
-
-        std::string objStr = json.substr(braceStart, braceEnd - braceStart);
-
-        // Find the key within this object
-        std::string searchKey = "\"" + key + "\":";
-        size_t keyPos = objStr.find(searchKey);
-        if (keyPos == std::string::npos) {
-            searchKey = "\"" + key + "\": ";
-            keyPos = objStr.find(searchKey);
-            if (keyPos == std::string::npos) return "";
-        }
-
-        size_t valueStart = objStr.find('"', keyPos + searchKey.length());
-        if (valueStart == std::string::npos) return "";
-
-        size_t valueEnd = objStr.find('"', valueStart + 1);
-        if (valueEnd == std::string::npos) return "";
-
-        return objStr.substr(valueStart + 1, valueEnd - valueStart - 1);
-    }
-};
+static void onStopSignal(int) {
+    stopRequested.store(true);
+}
 
-//==============================================================================
 int main(int argc, char* argv[])
 {
-    // Parse port from command line
+    // Parse port and options from command line:
+    //   MidiHttpServer [port] [--remote-batching] [--max-batch-latency-us=N]
+    //                  [--stream-port=N] [--async-output]
+    //                  [--sysex-chunk-bytes=N] [--sysex-chunk-delay-us=N]
+    //                  [--max-sysex-message-bytes=N] [--sysex-streaming]
+    //                  [--max-buffered-bytes=N]
+    //                  [--native-thru] [--fanout-threads=N]
+    //                  [--host=ADDR] [--http-threads=N] [--subscription-threads=N]
+    //                  [--keep-alive-max=N] [--keep-alive-timeout=S] [--no-tcp-nodelay]
+    //                  [--max-body-bytes=N] [--max-send-bytes=N] [--local-socket=PATH]
     int port = 7777;
-    if (argc > 1) {
-        port = std::atoi(argv[1]);
+    int streamPort = -1;
+    RemoteForwarderConfig remoteConfig;
+    MidiOutputConfig outputConfig;
+    MidiSysExConfig sysexConfig;
+    size_t maxBufferedBytes = MidiMemoryBudget::defaultLimitBytes;
+    bool nativeThru = false;
+    size_t fanOutThreads = 0;
+    HttpServerConfig httpConfig;
+    std::string localSocketPath;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--remote-batching") {
+            remoteConfig.batching = true;
+        } else if (arg.rfind("--max-batch-latency-us=", 0) == 0) {
+            remoteConfig.maxBatchLatency = std::chrono::microseconds(std::atoll(arg.c_str() + 23));
+        } else if (arg.rfind("--stream-port=", 0) == 0) {
+            streamPort = std::atoi(arg.c_str() + 14);
+        } else if (arg == "--async-output") {
+            outputConfig.async = true;
+        } else if (arg.rfind("--sysex-chunk-bytes=", 0) == 0) {
+            outputConfig.sysexChunkBytes = (size_t)std::atoll(arg.c_str() + 20);
+        } else if (arg.rfind("--sysex-chunk-delay-us=", 0) == 0) {
+            outputConfig.sysexChunkDelay = std::chrono::microseconds(
+                std::clamp(std::atoll(arg.c_str() + 23), 0LL, (long long)MidiOutputConfig::maxSysExChunkDelay.count()));
+        } else if (arg.rfind("--max-sysex-message-bytes=", 0) == 0) {
+            sysexConfig.maxMessageBytes = (size_t)std::clamp(std::atoll(arg.c_str() + 26), 1LL,
+                                                             (long long)MidiSysExConfig::maxMessageBytesLimit);
+        } else if (arg == "--sysex-streaming") {
+            sysexConfig.streaming = true;
+        } else if (arg.rfind("--max-buffered-bytes=", 0) == 0) {
+            maxBufferedBytes = (size_t)std::max(0LL, std::atoll(arg.c_str() + 21));
+        } else if (arg == "--native-thru") {
+            nativeThru = true;
+        } else if (arg.rfind("--fanout-threads=", 0) == 0) {
+            fanOutThreads = (size_t)std::clamp(std::atoi(arg.c_str() + 17), 0, 64);
+        } else if (arg.rfind("--host=", 0) == 0) {
+            httpConfig.host = arg.substr(7);
+        } else if (arg.rfind("--http-threads=", 0) == 0) {
+            httpConfig.workerThreads = (size_t)std::clamp(std::atoi(arg.c_str() + 15), 0, 256);
+        } else if (arg.rfind("--subscription-threads=", 0) == 0) {
+            httpConfig.subscriptionThreads = (size_t)std::clamp(std::atoi(arg.c_str() + 23), 0, 1024);
+        } else if (arg.rfind("--keep-alive-max=", 0) == 0) {
+            httpConfig.keepAliveMaxCount = (size_t)std::max(1, std::atoi(arg.c_str() + 17));
+        } else if (arg.rfind("--keep-alive-timeout=", 0) == 0) {
+            httpConfig.keepAliveTimeoutSec = std::max(0, std::atoi(arg.c_str() + 21));
+        } else if (arg == "--no-tcp-nodelay") {
+            httpConfig.tcpNoDelay = false;
+        } else if (arg.rfind("--max-body-bytes=", 0) == 0) {
+            httpConfig.maxBodyBytes = (size_t)std::max(1LL, std::atoll(arg.c_str() + 17));
+        } else if (arg.rfind("--max-send-bytes=", 0) == 0) {
+            httpConfig.maxSendBodyBytes = (size_t)std::max(0LL, std::atoll(arg.c_str() + 17));
+        } else if (arg.rfind("--local-socket=", 0) == 0) {
+            localSocketPath = arg.substr(15);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        } else {
+            port = std::atoi(arg.c_str());
+        }
     }
 
     // Initialize JUCE
@@ -936,14 +107,36 @@ int main(int argc, char* argv[])
     std::cout << "Starting server on port " << port << "..." << std::endl;
 
     MidiHttpServer server(port);
+    server.setRemoteForwarderConfig(remoteConfig);
+    server.setStreamPort(streamPort);
+    server.setOutputDefaults(outputConfig);
+    server.setSysExDefaults(sysexConfig);
+    server.setMemoryLimit(maxBufferedBytes);
+    server.setNativeThru(nativeThru);
+    server.setFanOutThreads(fanOutThreads);
+    server.setHttpConfig(httpConfig);
+    server.setLocalSocketPath(localSocketPath);
     server.startServer();
 
     std::cout << "Server running. Press Ctrl+C to stop..." << std::endl;
 
-    // Run until interrupted
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
+    // Run until interrupted, then shut down cleanly so debounced route edits
+    // and route counters reach routes.json
+    std::signal(SIGINT, onStopSignal);
+    std::signal(SIGTERM, onStopSignal);
+
+    // The main thread runs the JUCE message loop so MIDI device-change
+    // notifications are delivered; a watcher ends it once a signal arrives
+    std::thread stopWatcher([] {
+        while (!stopRequested.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        juce::MessageManager::getInstance()->stopDispatchLoop();
+    });
+    juce::MessageManager::getInstance()->runDispatchLoop();
+    stopWatcher.join();
 
+    std::cout << "Stopping server..." << std::endl;
+    server.stopServer();
     return 0;
 }
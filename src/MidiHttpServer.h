@@ -0,0 +1,2102 @@
+/**
+ * MidiHttpServer - HTTP-to-MIDI bridge server
+ *
+ * Provides a robust HTTP API for applications to proxy MIDI operations
+ * through JUCE, avoiding the limitations of platform MIDI libraries.
+ *
+ * Uses cpp-httplib for the HTTP server with a thread pool; see
+ * HttpServerConfig for how long polls and streams get threads of their own.
+ */
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+#include <juce_audio_devices/juce_audio_devices.h>
+
+#include "httplib.h"
+#include "HttpServerConfig.h"
+#include "JsonBuilder.h"
+#include "JsonReader.h"
+#include "Metrics.h"
+#include "MidiDeviceRegistry.h"
+#include "MidiDeviceWatcher.h"
+#include "MidiLocalTransport.h"
+#include "MidiMemory.h"
+#include "MidiPort.h"
+#include "MidiPortOptions.h"
+#include "MidiScheduler.h"
+#include "MidiSendBody.h"
+#include "MidiStreamTransport.h"
+#include "MidiWireFormat.h"
+#include "NativeMidiThru.h"
+#include "PortRegistry.h"
+#include "VirtualMidiPort.h"
+#include "RouteManager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//==============================================================================
+// HTTP Server class
+class MidiHttpServer
+{
+public:
+    // routesPath overrides ~/.config/.../routes.json (e.g. for the benchmark)
+    explicit MidiHttpServer(int port, const std::string& routesPath = "")
+        : serverPort(port), routeManager(routesPath) {
+        // Set up local message forwarder for RouteManager
+        routeManager.setLocalMessageForwarder([this](const std::string& destPortId,
+                                                      const MidiPacket& data) {
+            forwardToLocalDestination(destPortId, data);
+        });
+        routeManager.setLocalFragmentForwarder([this](const std::string& destPortId,
+                                                       const MidiPacket& data) {
+            forwardToLocalDestination(destPortId, data, true);
+        });
+        routeManager.setLocalMessageScheduler([this](std::chrono::steady_clock::time_point due,
+                                                     const std::string& destPortId,
+                                                     const MidiPacket& data) {
+            scheduler.schedule(due, destPortId, data);
+        });
+    }
+
+    ~MidiHttpServer() {
+        stopServer();
+    }
+
+    void setRemoteForwarderConfig(const RemoteForwarderConfig& config) {
+        routeManager.setRemoteForwarderConfig(config);
+    }
+
+    // Port for the midi+tcp:// stream listener; -1 (default) disables it, 0 picks any
+    void setStreamPort(int port) { streamPort = port; }
+
+    // Unix domain socket for local clients (see MidiLocalTransport); empty (default) disables it
+    void setLocalSocketPath(const std::string& path) { localSocketPath = path; }
+
+    // Output settings for physical output ports; POST /port/:id can override them
+    void setOutputDefaults(const MidiOutputConfig& config) { outputDefaults = config; }
+
+    // SysEx reassembly settings for input ports; POST /port/:id and /virtual/:id can override them
+    void setSysExDefaults(const MidiSysExConfig& config) { sysexDefaults = config; }
+
+    // Cap on the payload bytes buffered by all ports and forwarders together (0 = no limit)
+    void setMemoryLimit(size_t bytes) { MidiMemoryBudget::global().setLimit(bytes); }
+
+    // Let the OS deliver local device-to-device routes that need no transform
+    // (see NativeMidiThru); takes effect in startServer()
+    void setNativeThru(bool enabled) { nativeThruEnabled = enabled; }
+
+    // Parallel delivery to the local destinations of one source (0 = inline)
+    void setFanOutThreads(size_t threads) { routeManager.setFanOutThreads(threads); }
+
+    // Bind address, thread pools, keep-alive and body limits; takes effect in startServer()
+    void setHttpConfig(const HttpServerConfig& config) { httpConfig = config; }
+
+    // An open virtual port by id (without the "virtual:" prefix), for callers
+    // in the same process that inject without HTTP; nullptr if none
+    std::shared_ptr<VirtualMidiPort> findVirtualPort(const std::string& virtualId) {
+        return virtualPorts.find(virtualId);
+    }
+
+    // Forward a message to a local destination port (used by RouteManager for
+    // local routes and by POST /batch). Returns false if the port isn't open
+    // or refused the message. sysexFragment: one piece of a streamed SysEx
+    // (RouteManager only), sent with sendFragment.
+    // Lock-free lookup; the send itself only takes the destination's send lock.
+    bool forwardToLocalDestination(const std::string& destPortId,
+                                    const MidiPacket& data,
+                                    bool sysexFragment = false) {
+        // Check if it's a virtual port
+        if (destPortId.rfind("virtual:", 0) == 0) {
+            std::string virtualId = destPortId.substr(8);
+            if (auto port = virtualPorts.find(virtualId)) {
+                return sysexFragment ? port->sendFragment(data) : port->sendMessage(data);
+            }
+            std::cerr << "[RouteManager] Virtual destination not found: "
+                      << virtualId << std::endl;
+            return false;
+        }
+
+        // Check physical ports
+        if (auto port = ports.find(destPortId)) {
+            return sysexFragment ? port->sendFragment(data) : port->sendMessage(data);
+        }
+        std::cerr << "[RouteManager] Destination port not found: "
+                  << destPortId << std::endl;
+        return false;
+    }
+
+    // Delivery for messages from other servers: timestampUs (Unix epoch µs,
+    // set by fixed-latency routes) hands the message to the scheduler
+    bool deliverOrSchedule(const std::string& destPortId, const MidiPacket& data,
+                           int64_t timestampUs) {
+        if (timestampUs == 0) return forwardToLocalDestination(destPortId, data);
+        return scheduler.scheduleAt(timestampUs, destPortId, data);
+    }
+
+    // Must be called on the JUCE message thread (device-change notifications
+    // are subscribed here and delivered there)
+    void startServer() {
+        // Auto-open ports referenced by any routes persisted from last run.
+        // Devices that show up later (CoreMIDI sometimes enumerates late, or
+        // an interface is plugged in) are picked up by the device watcher.
+        deviceWatcher.start();
+        autoOpenPortsForAllRoutes();
+
+        if (nativeThruEnabled && !NativeMidiThru::isSupported()) {
+            std::cerr << "[MidiHttpServer] Native thru is not available on this platform" << std::endl;
+        } else if (nativeThruEnabled) {
+            routeManager.setNativeThruResolver([this](const MidiRoute& route, std::string& sourceIdentifier,
+                                                      std::string& destinationIdentifier) {
+                return resolveNativeThru(route, sourceIdentifier, destinationIdentifier);
+            }, [this](const std::string& sourceIdentifier, const std::string& destinationIdentifier,
+                      std::string& error) {
+                return nativeThru.connect(sourceIdentifier, destinationIdentifier, error);
+            });
+            std::cout << "[MidiHttpServer] Native thru enabled (" << NativeMidiThru::backendName() << ")"
+                      << std::endl;
+        }
+
+        server = std::make_unique<httplib::Server>();
+
+        size_t workerThreads = httpConfig.workerThreads ? httpConfig.workerThreads
+                                                        : (size_t)CPPHTTPLIB_THREAD_POOL_COUNT;
+        size_t poolThreads = workerThreads + httpConfig.subscriptionThreads;
+        subscriptions.setLimit(httpConfig.subscriptionThreads);
+        server->new_task_queue = [poolThreads] { return new httplib::ThreadPool(poolThreads); };
+        server->set_keep_alive_max_count(httpConfig.keepAliveMaxCount);
+        server->set_keep_alive_timeout(httpConfig.keepAliveTimeoutSec);
+        server->set_tcp_nodelay(httpConfig.tcpNoDelay);
+        server->set_payload_max_length(httpConfig.maxBodyBytes);
+        std::cout << "[MidiHttpServer] HTTP threads: " << workerThreads << " workers + "
+                  << httpConfig.subscriptionThreads << " for long polls and streams" << std::endl;
+
+        // Add CORS headers to all responses
+        server->set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
+            res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        });
+
+        // Handle CORS preflight requests
+        server->Options(".*", [](const httplib::Request&, httplib::Response& res) {
+            res.status = 204;
+        });
+
+        // Health check endpoint
+        server->Get("/health", [this](const httplib::Request&, httplib::Response& res) {
+            JsonBuilder json;
+            json.startObject().key("status").value(std::string("ok")).endObject();
+            sendJson(res, json);
+        });
+
+        // List available MIDI ports (cached until the OS reports a device change)
+        server->Get("/ports", [this](const httplib::Request&, httplib::Response& res) {
+            auto devices = deviceRegistry.snapshot();
+            JsonBuilder json;
+            json.startObject();
+
+            json.key("inputs").startArray();
+            for (const auto& device : devices->inputs.all()) {
+                json.arrayValue(device.name);
+            }
+            json.endArray();
+
+            json.key("outputs").startArray();
+            for (const auto& device : devices->outputs.all()) {
+                json.arrayValue(device.name);
+            }
+            json.endArray();
+
+            json.endObject();
+            sendJson(res, json);
+        });
+
+        // Open a MIDI port
+        server->Post("/port/:portId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            try {
+                // Parse JSON body (simple parsing)
+                std::string name, type;
+
+                size_t namePos = req.body.find("\"name\":\"");
+                if (namePos != std::string::npos) {
+                    namePos += 8;
+                    size_t endPos = req.body.find("\"", namePos);
+                    name = req.body.substr(namePos, endPos - namePos);
+                }
+
+                size_t typePos = req.body.find("\"type\":\"");
+                if (typePos != std::string::npos) {
+                    typePos += 8;
+                    size_t endPos = req.body.find("\"", typePos);
+                    type = req.body.substr(typePos, endPos - typePos);
+                }
+
+                bool isInput = (type == "input");
+                MidiPortOptions options = defaultPortOptions();
+                std::string configError;
+                if (!options.read(req.body, configError)) {
+                    sendErrorResponse(res, 400, configError);
+                    return;
+                }
+                auto port = std::make_shared<MidiPort>(portId, name, isInput, options.queue,
+                                                       options.output, options.sysex);
+
+                // Set up routing callback for input ports
+                if (isInput) {
+                    port->setMessageCallback([this](const std::string& srcPortId,
+                                                    const MidiPacket& data, MidiInputPart part) {
+                        routeManager.forwardMessage(srcPortId, data, part);
+                    });
+                }
+
+                // A device the cache doesn't know yet (plugged in before its
+                // change notification arrived) gets one fresh enumeration
+                auto devices = deviceRegistry.snapshot();
+                if (!devices->forDirection(isInput).resolve(name)) {
+                    deviceRegistry.invalidate();
+                    devices = deviceRegistry.snapshot();
+                }
+                bool success = port->open(*devices);
+
+                if (success) {
+                    // Reopening an id replaces the old port; release its pollers
+                    if (auto previous = ports.insert(portId, std::move(port))) {
+                        previous->interruptWaiters();
+                    }
+                    // An async output takes its routes off the native path
+                    routeManager.refreshNativeThru();
+                }
+
+                JsonBuilder json;
+                json.startObject().key("success").value(success).endObject();
+                sendJson(res, json);
+            } catch (const std::exception& e) {
+                JsonBuilder json;
+                json.startObject().key("error").value(e.what()).endObject();
+                res.status = 400;
+                sendJson(res, json);
+            }
+        });
+
+        // Close a MIDI port
+        server->Delete("/port/:portId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            // Unpublish first; in-flight sends keep the port alive until they return
+            auto removed = ports.erase(portId);
+            bool success = removed != nullptr;
+            if (success) {
+                removed->interruptWaiters();
+            }
+
+            JsonBuilder json;
+            json.startObject().key("success").value(success).endObject();
+            sendJson(res, json);
+        });
+
+        // Send MIDI message
+        server->Post("/port/:portId/send", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = ports.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+            if (port->isInput()) {
+                sendErrorResponse(res, 400, "Can only send to output ports");
+                return;
+            }
+
+            try {
+                MidiPacket message;
+                std::string parseError;
+                int64_t timestampUs = 0;
+                if (!parseMessageBody(req, message, parseError, &timestampUs)) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value("Invalid message body: " + parseError)
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    return;
+                }
+
+                // Validate message before sending
+                if (message.empty()) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value(std::string("Invalid MIDI message: empty message"))
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    std::cerr << "Rejected empty MIDI message\n";
+                    return;
+                }
+
+                // Reject incomplete SysEx (single 0xF0 byte)
+                if (message.size() == 1 && message[0] == 0xF0) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value(std::string("Invalid MIDI message: incomplete SysEx (0xF0 without 0xF7)"))
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    std::cerr << "Rejected incomplete SysEx (single 0xF0)\n";
+                    return;
+                }
+
+                if (const char* problem = messageProblem(message)) {
+                    sendErrorResponse(res, 400, std::string("Invalid MIDI message: ") + problem);
+                    return;
+                }
+
+                if (timestampUs != 0) {
+                    if (!scheduleSend(res, portId, message, timestampUs)) return;
+                } else if (!port->sendMessage(message)) {
+                    sendErrorResponse(res, 503, notAcceptedError);
+                    return;
+                }
+
+                JsonBuilder json;
+                json.startObject().key("success").value(true).endObject();
+                sendJson(res, json);
+            } catch (const std::exception& e) {
+                JsonBuilder json;
+                json.startObject().key("error").value(e.what()).endObject();
+                res.status = 400;
+                sendJson(res, json);
+            }
+        }));
+
+        // Send many messages under one port lookup:
+        // {"messages":[[144,60,127],{"message":[128,60,0],"offsetMs":500}]}
+        server->Post("/port/:portId/send-batch", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = ports.find(portId);
+            if (!port) {
+                sendErrorResponse(res, 404, "Port not found");
+                return;
+            }
+            if (port->isInput()) {
+                sendErrorResponse(res, 400, "Can only send to output ports");
+                return;
+            }
+
+            std::vector<BatchMessage> batch;
+            std::string parseError;
+            if (!parseSendBatch(req.body, portId, batch, parseError)) {
+                sendErrorResponse(res, 400, "Invalid batch: " + parseError);
+                return;
+            }
+
+            sendBatchResult(res, sendBatch(batch, [&](const BatchMessage& entry) {
+                return port->sendMessage(entry.message);
+            }));
+        }));
+
+        // Get queued incoming messages
+        server->Get("/port/:portId/messages", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = ports.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            respondWithMessages(*port, req, res);
+        });
+
+        // Stream incoming messages as Server-Sent Events
+        server->Get("/port/:portId/stream", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = ports.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            streamMessages(port, req, res);
+        });
+
+        // Get queue depth and dropped-message counters for a port
+        server->Get("/port/:portId/queue", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = ports.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            if (port->isAsyncOutput()) {
+                MidiOutputStats output = port->getOutputStats();
+                res.set_content(queueStatsJson(port->getQueueStats(), &output), "application/json");
+            } else if (port->isInput()) {
+                MidiSysExStats sysex = port->getSysExStats();
+                res.set_content(queueStatsJson(port->getQueueStats(), nullptr, &sysex), "application/json");
+            } else {
+                res.set_content(queueStatsJson(port->getQueueStats()), "application/json");
+            }
+        });
+
+        //==============================================================================
+        // Virtual MIDI port endpoints (for testing)
+        //==============================================================================
+
+        // List virtual ports; answers If-None-Match with 304 while none were created or deleted
+        server->Get("/virtual", [this](const httplib::Request& req, httplib::Response& res) {
+            uint64_t version = virtualPorts.version();
+            std::string etag = versionEtag(version);
+            res.set_header("ETag", etag);
+            if (etagMatches(req, etag)) {
+                res.status = 304;
+                return;
+            }
+            auto openPorts = virtualPorts.snapshot();
+
+            JsonBuilder json;
+            json.startObject();
+            json.key("version").value(version);
+
+            json.key("inputs").startArray();
+            for (const auto& [id, port] : *openPorts) {
+                if (port->isInput()) {
+                    json.arrayValue(id);
+                }
+            }
+            json.endArray();
+
+            json.key("outputs").startArray();
+            for (const auto& [id, port] : *openPorts) {
+                if (!port->isInput()) {
+                    json.arrayValue(id);
+                }
+            }
+            json.endArray();
+
+            json.endObject();
+            sendJson(res, json);
+        });
+
+        // Create a virtual port
+        server->Post("/virtual/:portId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            try {
+                // Parse JSON body
+                std::string name, type;
+
+                size_t namePos = req.body.find("\"name\":\"");
+                if (namePos != std::string::npos) {
+                    namePos += 8;
+                    size_t endPos = req.body.find("\"", namePos);
+                    name = req.body.substr(namePos, endPos - namePos);
+                } else {
+                    name = portId; // Use portId as name if not specified
+                }
+
+                size_t typePos = req.body.find("\"type\":\"");
+                if (typePos != std::string::npos) {
+                    typePos += 8;
+                    size_t endPos = req.body.find("\"", typePos);
+                    type = req.body.substr(typePos, endPos - typePos);
+                }
+
+                bool isInput = (type == "input");
+                std::string fullPortId = "virtual:" + portId;
+                MidiPortOptions options = defaultPortOptions();
+                std::string configError;
+                if (!options.read(req.body, configError)) {
+                    sendErrorResponse(res, 400, configError);
+                    return;
+                }
+                auto port = std::make_shared<VirtualMidiPort>(fullPortId, name, isInput,
+                                                              options.queue, options.sysex);
+
+                // Set up routing callback for input ports
+                if (isInput) {
+                    port->setMessageCallback([this](const std::string& srcPortId,
+                                                    const MidiPacket& data, MidiInputPart part) {
+                        routeManager.forwardMessage(srcPortId, data, part);
+                    });
+                }
+
+                bool success = port->open();
+
+                if (success) {
+                    // Reopening an id replaces the old port; release its pollers
+                    if (auto previous = virtualPorts.insert(portId, std::move(port))) {
+                        previous->interruptWaiters();
+                    }
+                }
+
+                JsonBuilder json;
+                json.startObject()
+                    .key("success").value(success)
+                    .key("name").value(name)
+                    .key("type").value(type)
+                    .endObject();
+                sendJson(res, json);
+            } catch (const std::exception& e) {
+                JsonBuilder json;
+                json.startObject().key("error").value(e.what()).endObject();
+                res.status = 400;
+                sendJson(res, json);
+            }
+        });
+
+        // Delete a virtual port
+        server->Delete("/virtual/:portId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            // Unpublish first; in-flight sends keep the port alive until they return
+            auto removed = virtualPorts.erase(portId);
+            bool success = removed != nullptr;
+            if (success) {
+                removed->interruptWaiters();
+            }
+
+            JsonBuilder json;
+            json.startObject().key("success").value(success).endObject();
+            sendJson(res, json);
+        });
+
+        // Inject a message into a virtual input port (for testing)
+        server->Post("/virtual/:portId/inject", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            if (!port->isInput()) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Can only inject into input ports")).endObject();
+                res.status = 400;
+                sendJson(res, json);
+                return;
+            }
+
+            try {
+                MidiPacket message;
+                std::string parseError;
+                if (!parseMessageBody(req, message, parseError)) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value("Invalid message body: " + parseError)
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    return;
+                }
+
+                if (message.empty()) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value(std::string("Empty message"))
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    return;
+                }
+
+                port->injectMessage(message);
+
+                JsonBuilder json;
+                json.startObject().key("success").value(true).endObject();
+                sendJson(res, json);
+            } catch (const std::exception& e) {
+                JsonBuilder json;
+                json.startObject().key("error").value(e.what()).endObject();
+                res.status = 400;
+                sendJson(res, json);
+            }
+        }));
+
+        // Get messages from a virtual port's queue
+        server->Get("/virtual/:portId/messages", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            respondWithMessages(*port, req, res);
+        });
+
+        // Stream incoming messages as Server-Sent Events
+        server->Get("/virtual/:portId/stream", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            streamMessages(port, req, res);
+        });
+
+        // Get queue depth and dropped-message counters for a virtual port
+        server->Get("/virtual/:portId/queue", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            if (port->isInput()) {
+                MidiSysExStats sysex = port->getSysExStats();
+                res.set_content(queueStatsJson(port->getQueueStats(), nullptr, &sysex), "application/json");
+            } else {
+                res.set_content(queueStatsJson(port->getQueueStats()), "application/json");
+            }
+        });
+
+        // Send through a virtual output port
+        server->Post("/virtual/:portId/send", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Virtual port not found")).endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            if (port->isInput()) {
+                JsonBuilder json;
+                json.startObject().key("error").value(std::string("Can only send from output ports")).endObject();
+                res.status = 400;
+                sendJson(res, json);
+                return;
+            }
+
+            try {
+                MidiPacket message;
+                std::string parseError;
+                int64_t timestampUs = 0;
+                if (!parseMessageBody(req, message, parseError, &timestampUs)) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value("Invalid message body: " + parseError)
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    return;
+                }
+
+                if (message.empty()) {
+                    JsonBuilder json;
+                    json.startObject()
+                        .key("error").value(std::string("Empty message"))
+                        .key("success").value(false)
+                        .endObject();
+                    res.status = 400;
+                    sendJson(res, json);
+                    return;
+                }
+
+                if (const char* problem = messageProblem(message)) {
+                    sendErrorResponse(res, 400, std::string("Invalid MIDI message: ") + problem);
+                    return;
+                }
+
+                if (timestampUs != 0) {
+                    if (!scheduleSend(res, "virtual:" + portId, message, timestampUs)) return;
+                } else if (!port->sendMessage(message)) {
+                    sendErrorResponse(res, 503, notAcceptedError);
+                    return;
+                }
+
+                JsonBuilder json;
+                json.startObject().key("success").value(true).endObject();
+                sendJson(res, json);
+            } catch (const std::exception& e) {
+                JsonBuilder json;
+                json.startObject().key("error").value(e.what()).endObject();
+                res.status = 400;
+                sendJson(res, json);
+            }
+        }));
+
+        server->Post("/virtual/:portId/send-batch", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::string portId = req.path_params.at("portId");
+
+            auto port = virtualPorts.find(portId);
+            if (!port) {
+                sendErrorResponse(res, 404, "Virtual port not found");
+                return;
+            }
+            if (port->isInput()) {
+                sendErrorResponse(res, 400, "Can only send from output ports");
+                return;
+            }
+
+            std::vector<BatchMessage> batch;
+            std::string parseError;
+            if (!parseSendBatch(req.body, "virtual:" + portId, batch, parseError)) {
+                sendErrorResponse(res, 400, "Invalid batch: " + parseError);
+                return;
+            }
+
+            sendBatchResult(res, sendBatch(batch, [&](const BatchMessage& entry) {
+                return port->sendMessage(entry.message);
+            }));
+        }));
+
+        // POST /send-batch - Messages for several output ports in one request.
+        // Each message names its "port" like a route endpoint: a physical port
+        // id or "virtual:<id>". All ports are resolved before anything is sent.
+        server->Post("/send-batch", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            std::vector<BatchMessage> batch;
+            std::string parseError;
+            if (!parseSendBatch(req.body, "", batch, parseError)) {
+                sendErrorResponse(res, 400, "Invalid batch: " + parseError);
+                return;
+            }
+
+            struct Target {
+                std::shared_ptr<MidiPort> port;
+                std::shared_ptr<VirtualMidiPort> virtualPort;
+            };
+            std::map<std::string, Target> targets;
+            for (const BatchMessage& entry : batch) {
+                if (targets.count(entry.portId)) continue;
+                Target target;
+                if (entry.portId.rfind("virtual:", 0) == 0) {
+                    target.virtualPort = virtualPorts.find(entry.portId.substr(8));
+                } else {
+                    target.port = ports.find(entry.portId);
+                }
+                if (!target.port && !target.virtualPort) {
+                    sendErrorResponse(res, 404, "Port not found: " + entry.portId);
+                    return;
+                }
+                if (target.port ? target.port->isInput() : target.virtualPort->isInput()) {
+                    sendErrorResponse(res, 400, "Not an output port: " + entry.portId);
+                    return;
+                }
+                targets.emplace(entry.portId, std::move(target));
+            }
+
+            sendBatchResult(res, sendBatch(batch, [&](const BatchMessage& entry) {
+                const Target& target = targets.at(entry.portId);
+                return target.port ? target.port->sendMessage(entry.message)
+                                   : target.virtualPort->sendMessage(entry.message);
+            }));
+        }));
+
+        // POST /batch - Bulk receive endpoint for remote route forwarding.
+        // Body is a MidiWireFormat batch (application/x-midi-batch); each message
+        // is delivered to its local destination port in order.
+        server->Post("/batch", limitSendBody([this](const httplib::Request& req, httplib::Response& res) {
+            int delivered = 0;
+            int failed = 0;
+            bool valid = MidiBatchDecoder::decode(req.body, [&](const std::string& portId,
+                                                                 const MidiPacket& packet,
+                                                                 int64_t timestampUs) {
+                if (deliverOrSchedule(portId, packet, timestampUs)) delivered++;
+                else failed++;
+            });
+
+            JsonBuilder json;
+            json.startObject()
+                .key("success").value(valid)
+                .key("delivered").value(delivered)
+                .key("failed").value(failed);
+            if (!valid) {
+                json.key("error").value(std::string("Malformed batch body"));
+                res.status = 400;
+            }
+            json.endObject();
+            sendJson(res, json);
+        }));
+
+        //==============================================================================
+        // Route management endpoints
+        //==============================================================================
+
+        // GET /routes - List all routes with their counters. With ?since=<version>,
+        // only the routes changed after that config version and the ids removed,
+        // without counters; If-None-Match is answered with 304 while nothing changed.
+        server->Get("/routes", [this](const httplib::Request& req, httplib::Response& res) {
+            if (!req.has_param("since")) {
+                uint64_t version = routeManager.getConfigVersion();
+                auto routes = routeManager.getAllRoutes();
+
+                JsonBuilder json;
+                json.startObject().key("version").value(version).key("routes").startArray();
+                for (const auto& route : routes) appendRouteJson(json, route, true);
+                json.endArray().endObject();
+                sendJson(res, json);
+                return;
+            }
+
+            std::string sinceText = req.get_param_value("since");
+            char* end = nullptr;
+            uint64_t since = std::strtoull(sinceText.c_str(), &end, 10);
+            if (sinceText.empty() || *end != '\0') {
+                sendErrorResponse(res, 400, "Invalid since: " + sinceText);
+                return;
+            }
+            std::string etag = versionEtag(routeManager.getConfigVersion());
+            if (etagMatches(req, etag)) {
+                res.set_header("ETag", etag);
+                res.status = 304;
+                return;
+            }
+
+            auto changes = routeManager.getRouteChanges(since);
+            JsonBuilder json;
+            json.startObject()
+                .key("version").value(changes.version)
+                .key("since").value(since)
+                .key("full").value(changes.full)
+                .key("routes").startArray();
+            for (const auto& route : changes.routes) appendRouteJson(json, route, true, false);
+            json.endArray().key("removed").startArray();
+            for (const auto& id : changes.removed) json.arrayValue(id);
+            json.endArray().endObject();
+            res.set_header("ETag", versionEtag(changes.version));
+            sendJson(res, json);
+        });
+
+        // GET /routes/stats - Just the per-route counters, for frequent polling
+        server->Get("/routes/stats", [this](const httplib::Request&, httplib::Response& res) {
+            uint64_t version = routeManager.getConfigVersion();
+            auto routes = routeManager.getRouteMetrics();
+
+            JsonBuilder json;
+            json.startObject().key("version").value(version).key("routes").startArray();
+            for (const auto& route : routes) {
+                json.startObject()
+                    .key("id").value(route.routeId)
+                    .key("messagesRouted").value(route.messagesForwarded)
+                    .key("messagesFiltered").value(route.messagesFiltered)
+                    .key("bytesRouted").value(route.bytesForwarded)
+                    .endObject();
+            }
+            json.endArray().endObject();
+            sendJson(res, json);
+        });
+
+        // POST /routes - Create a new route (or replace the one with the same id)
+        server->Post("/routes", [this](const httplib::Request& req, httplib::Response& res) {
+            // Expecting source and destination endpoint objects, plus optional
+            // enabled, id (pre-specified for cross-server replication),
+            // delivery (remote destinations only), latencyMs and filter
+            MidiRoute route;
+            std::string error;
+            JsonReader reader(req.body);
+            if (!RouteManager::readRoute(reader, route, error) || !reader.finish()) {
+                sendErrorResponse(res, 400, error.empty() ? "Invalid route body: " + reader.error() : error);
+                return;
+            }
+
+            route.id = routeManager.addRoute(route);
+
+            // Auto-open any local physical ports the route references
+            autoOpenPortsForRoute(route.source, route.destination);
+
+            JsonBuilder json;
+            json.startObject().key("route");
+            appendRouteJson(json, route, false);
+            json.endObject();
+            res.status = 201;
+            sendJson(res, json);
+        });
+
+        // POST /routes/bulk - Add/replace and remove many routes in one transaction
+        server->Post("/routes/bulk", [this](const httplib::Request& req, httplib::Response& res) {
+            applyRouteList(req, res, false);
+        });
+
+        // PUT /routes - Replace the whole route set in one transaction
+        server->Put("/routes", [this](const httplib::Request& req, httplib::Response& res) {
+            applyRouteList(req, res, true);
+        });
+
+        // PUT /routes/:routeId - Update a route (enable/disable)
+        server->Put("/routes/:routeId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string routeId = req.path_params.at("routeId");
+
+            bool enabled = false;
+            bool hasEnabled = false;
+            JsonReader reader(req.body);
+            bool parsed = reader.readObject([&](std::string_view key) {
+                if (key != "enabled") return reader.skipValue();
+                hasEnabled = true;
+                return reader.readBool(enabled);
+            }) && reader.finish();
+            if (!parsed) {
+                sendErrorResponse(res, 400, "Invalid route body: " + reader.error());
+                return;
+            }
+            if (!hasEnabled) {
+                sendErrorResponse(res, 400, "Missing enabled field");
+                return;
+            }
+
+            if (!routeManager.setRouteEnabled(routeId, enabled)) {
+                sendErrorResponse(res, 404, "Route not found");
+                return;
+            }
+
+            JsonBuilder json;
+            json.startObject()
+                .key("success").value(true)
+                .key("routeId").value(routeId)
+                .key("enabled").value(enabled)
+                .endObject();
+            sendJson(res, json);
+        });
+
+        // DELETE /routes/:routeId - Delete a route
+        server->Delete("/routes/:routeId", [this](const httplib::Request& req, httplib::Response& res) {
+            std::string routeId = req.path_params.at("routeId");
+
+            bool success = routeManager.removeRoute(routeId);
+            if (!success) {
+                JsonBuilder json;
+                json.startObject()
+                    .key("error").value(std::string("Route not found"))
+                    .endObject();
+                res.status = 404;
+                sendJson(res, json);
+                return;
+            }
+
+            JsonBuilder json;
+            json.startObject().key("success").value(true).endObject();
+            sendJson(res, json);
+        });
+
+        // GET /metrics - Port, route and forwarder instrumentation.
+        // Prometheus text format by default; JSON with ?format=json or Accept: application/json
+        server->Get("/metrics", [this](const httplib::Request& req, httplib::Response& res) {
+            bool json = req.get_param_value("format") == "json" ||
+                        req.get_header_value("Accept").find("application/json") != std::string::npos;
+            if (json) {
+                res.set_content(metricsJson(), "application/json");
+            } else {
+                res.set_content(metricsPrometheus(), PrometheusWriter::contentType);
+            }
+        });
+
+        // GET /forwarders - Queue and circuit breaker state per remote host
+        server->Get("/forwarders", [this](const httplib::Request&, httplib::Response& res) {
+            auto forwarders = routeManager.getForwarderStats();
+
+            JsonBuilder json;
+            json.startObject().key("forwarders").startArray();
+
+            for (const auto& stats : forwarders) {
+                json.startObject()
+                    .key("target").value(stats.target)
+                    .key("queueDepth").value((uint64_t)stats.queueDepth)
+                    .key("queuedSysExBytes").value((uint64_t)stats.queuedSysExBytes)
+                    .key("sent").value(stats.messagesSent)
+                    .key("failed").value(stats.messagesFailed)
+                    .key("droppedOverflow").value(stats.droppedOverflow)
+                    .key("droppedOverBudget").value(stats.droppedOverBudget)
+                    .key("droppedStale").value(stats.droppedStale)
+                    .key("coalesced").value(stats.coalesced)
+                    .key("breaker").value(std::string(circuitBreakerStateName(stats.breakerState)))
+                    .key("consecutiveFailures").value(stats.consecutiveFailures)
+                .endObject();
+            }
+
+            json.endArray().endObject();
+            sendJson(res, json);
+        });
+
+        // GET /memory - Buffered bytes per port and forwarder, the global cap
+        // and the payload buffer pool
+        server->Get("/memory", [this](const httplib::Request&, httplib::Response& res) {
+            JsonBuilder json;
+            appendMemoryJson(json);
+            sendJson(res, json);
+        });
+
+        // Stream listener for midi+tcp:// routes from other servers
+        if (streamPort >= 0) {
+            streamServer = std::make_unique<MidiStreamServer>(
+                [this](const std::string& portId, const MidiPacket& packet, int64_t timestampUs) {
+                    deliverOrSchedule(portId, packet, timestampUs);
+                });
+            int boundPort = streamServer->start(httpConfig.host, streamPort);
+            if (boundPort < 0) {
+                std::cerr << "Failed to start stream listener on port " << streamPort << std::endl;
+                streamServer.reset();
+            } else {
+                std::cout << "MIDI_STREAM_PORT=" << boundPort << std::endl;
+            }
+        }
+
+        // Binary IPC for clients on this machine; same delivery as the stream listener
+        if (!localSocketPath.empty()) {
+            localServer = std::make_unique<MidiLocalServer>(
+                [this](const std::string& portId, const MidiPacket& packet, int64_t timestampUs) {
+                    deliverOrSchedule(portId, packet, timestampUs);
+                },
+                [this](const std::string& portId, MidiLocalSource& source) {
+                    return resolveLocalSource(portId, source);
+                });
+            std::string error;
+            if (!localServer->start(localSocketPath, error)) {
+                std::cerr << "Failed to start local socket: " << error << std::endl;
+                localServer.reset();
+            } else {
+                std::cout << "MIDI_LOCAL_SOCKET=" << localSocketPath << std::endl;
+            }
+        }
+
+        // Start server in a separate thread
+        serverThread = std::thread([this]() {
+            if (serverPort == 0) {
+                // Let OS assign an available port
+                int actualPort = server->bind_to_any_port(httpConfig.host);
+                serverPort = actualPort;
+                // Print in parseable format for ProcessManager
+                std::cout << "MIDI_SERVER_PORT=" << actualPort << std::endl;
+                std::cout << "HTTP Server listening on " << httpConfig.host << ":" << actualPort << std::endl;
+                server->listen_after_bind();
+            } else {
+                std::cout << "MIDI_SERVER_PORT=" << serverPort << std::endl;
+                std::cout << "HTTP Server listening on " << httpConfig.host << ":" << serverPort << std::endl;
+                if (!server->listen(httpConfig.host, serverPort)) {
+                    std::cerr << "Failed to listen on " << httpConfig.host << ":" << serverPort << std::endl;
+                }
+            }
+        });
+    }
+
+    // Must be called on the JUCE message thread, like startServer()
+    void stopServer() {
+        // Join the watcher before tearing down the ports it reopens
+        deviceWatcher.stop();
+
+        // Release long-poll/stream handlers so the worker pool can drain
+        for (auto& [id, port] : *ports.snapshot()) port->interruptWaiters();
+        for (auto& [id, port] : *virtualPorts.snapshot()) port->interruptWaiters();
+
+        if (server) {
+            server->stop();
+        }
+        if (serverThread.joinable()) {
+            serverThread.join();
+        }
+        streamServer.reset();
+        localServer.reset();
+
+        // Keep route counters for the next run
+        routeManager.saveToDisk();
+
+        ports.clear();
+        virtualPorts.clear();
+    }
+
+private:
+    int serverPort;
+    HttpServerConfig httpConfig;
+    HttpSubscriptionLimiter subscriptions;   // Outlives server, whose streams hold slots
+    std::unique_ptr<httplib::Server> server;
+    std::thread serverThread;
+    int streamPort = -1;
+    std::unique_ptr<MidiStreamServer> streamServer;
+    std::string localSocketPath;
+    std::unique_ptr<MidiLocalServer> localServer;
+    MidiOutputConfig outputDefaults;
+    MidiSysExConfig sysexDefaults;
+    static constexpr size_t maxConcurrentPortOpens = 8;
+    bool nativeThruEnabled = false;
+    NativeMidiThru nativeThru;   // Declared before routeManager, which holds its links
+    MidiDeviceRegistry deviceRegistry;
+    // Open ports, looked up without locking; handlers hold the returned
+    // shared_ptr while sending or waiting, so closing never blocks them
+    PortRegistry<MidiPort> ports;
+    PortRegistry<VirtualMidiPort> virtualPorts;
+    // Timestamped sends and fixed-latency routes; released by port id
+    MidiScheduler scheduler{[this](const std::string& portId, const MidiPacket& packet) {
+        forwardToLocalDestination(portId, packet);
+    }};
+    RouteManager routeManager;
+    MidiDeviceWatcher deviceWatcher{deviceRegistry, [this](const MidiDeviceSnapshot& devices,
+                                                           const MidiDeviceChanges& changes) {
+        onDevicesChanged(devices, changes);
+    }};
+
+    // Returns true if serverUrl refers to this server instance:
+    // either the "local" sentinel or an absolute URL pointing to our own port.
+    bool isSelf(const std::string& serverUrl) const {
+        if (serverUrl.empty() || serverUrl == "local") return true;
+        // Check if the URL's port component matches ours
+        size_t colonPos = serverUrl.rfind(':');
+        if (colonPos != std::string::npos) {
+            try {
+                int urlPort = std::stoi(serverUrl.substr(colonPos + 1));
+                if (urlPort == serverPort) return true;
+            } catch (...) {}
+        }
+        return false;
+    }
+
+    // Returns true if the endpoint is a local physical port (not virtual, not remote)
+    bool isLocalPhysical(const std::string& serverUrl, const std::string& portId) const {
+        return isSelf(serverUrl) && portId.rfind("virtual:", 0) == std::string::npos;
+    }
+
+    // Ensures a local physical port is open, opening it if needed.
+    // isInput is inferred from portId prefix ("input-" = true, "output-" = false).
+    void ensureLocalPortOpen(const std::string& portId, const std::string& portName,
+                             const MidiDeviceSnapshot& devices) {
+        if (ports.contains(portId)) return;
+
+        bool isInput = (portId.rfind("input-", 0) == 0);
+        auto port = std::make_shared<MidiPort>(portId, portName, isInput,
+                                               MidiQueueConfig(), outputDefaults, sysexDefaults);
+
+        if (isInput) {
+            port->setMessageCallback([this](const std::string& srcPortId,
+                                            const MidiPacket& data, MidiInputPart part) {
+                routeManager.forwardMessage(srcPortId, data, part);
+            });
+        }
+
+        bool success = port->open(devices);
+        if (success) {
+            // A concurrent open may have won; keep its port and drop ours
+            if (ports.insertIfAbsent(portId, std::move(port))) {
+                std::cout << "[MidiHttpServer] Auto-opened " << (isInput ? "input" : "output")
+                          << " port: " << portName << std::endl;
+            }
+        } else {
+            std::cerr << "[MidiHttpServer] Failed to auto-open port: "
+                      << portName << std::endl;
+        }
+    }
+
+    // Auto-opens any local physical ports referenced by a route's endpoints.
+    void autoOpenPortsForRoute(const RouteEndpoint& source, const RouteEndpoint& destination) {
+        auto devices = deviceRegistry.snapshot();
+        if (isLocalPhysical(source.serverUrl, source.portId) && !source.portName.empty()) {
+            ensureLocalPortOpen(source.portId, source.portName, *devices);
+        }
+        if (isLocalPhysical(destination.serverUrl, destination.portId) && !destination.portName.empty()) {
+            ensureLocalPortOpen(destination.portId, destination.portName, *devices);
+        }
+    }
+
+    // Auto-opens ports for all persisted routes (at startup, or with `added`
+    // only those whose device just appeared). Each closed port is opened
+    // once however many routes share it, and opens run on up to
+    // maxConcurrentPortOpens threads since drivers can take tens of
+    // milliseconds per device.
+    void autoOpenPortsForAllRoutes(const MidiDeviceChanges* added = nullptr) {
+        auto devices = deviceRegistry.snapshot();
+        std::map<std::string, std::string> pending;  // portId -> portName
+        auto collect = [&](const RouteEndpoint& endpoint) {
+            if (!isLocalPhysical(endpoint.serverUrl, endpoint.portId) || endpoint.portName.empty() ||
+                ports.contains(endpoint.portId)) {
+                return;
+            }
+            if (added) {
+                bool isInput = (endpoint.portId.rfind("input-", 0) == 0);
+                auto device = devices->forDirection(isInput).resolve(endpoint.portName);
+                if (!device || !added->wasAdded(isInput, device->identifier)) return;
+            }
+            pending.emplace(endpoint.portId, endpoint.portName);
+        };
+        for (const auto& route : routeManager.getAllRoutes()) {
+            collect(route.source);
+            collect(route.destination);
+        }
+        if (pending.empty()) return;
+
+        auto started = std::chrono::steady_clock::now();
+        std::vector<std::pair<std::string, std::string>> jobs(pending.begin(), pending.end());
+        std::atomic<size_t> nextJob{0};
+        auto worker = [&] {
+            for (size_t i = nextJob++; i < jobs.size(); i = nextJob++) {
+                ensureLocalPortOpen(jobs[i].first, jobs[i].second, *devices);
+            }
+        };
+
+        std::vector<std::thread> helpers;
+        size_t threadCount = std::min(jobs.size(), maxConcurrentPortOpens);
+        for (size_t t = 1; t < threadCount; t++) helpers.emplace_back(worker);
+        worker();
+        for (auto& helper : helpers) helper.join();
+
+        auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        std::cout << "[MidiHttpServer] Route ports: tried " << jobs.size() << " on "
+                  << threadCount << " thread(s) in " << elapsedMs << " ms" << std::endl;
+    }
+
+    // Device watcher handler (watcher thread). Only ports whose device came
+    // or went are touched: a port whose device disappeared is disconnected
+    // but stays open under its id, keeping its queue, pollers and routing
+    // callback, and resumes when a device matching its name is back. Route
+    // ports that never opened are opened once their device appears.
+    void onDevicesChanged(const MidiDeviceSnapshot& devices, const MidiDeviceChanges& changes) {
+        for (const auto& [id, port] : *ports.snapshot()) {
+            if (port->isConnected() &&
+                changes.wasRemoved(port->isInput(), port->getDeviceIdentifier())) {
+                port->disconnect();
+                std::cout << "[MidiHttpServer] Device removed, port disconnected: " << id << std::endl;
+            }
+            if (!port->isConnected() &&
+                devices.forDirection(port->isInput()).resolve(port->getPortName()) &&
+                port->reconnect(devices)) {
+                std::cout << "[MidiHttpServer] Port reconnected: " << id << std::endl;
+            }
+        }
+        autoOpenPortsForAllRoutes(&changes);
+        routeManager.refreshNativeThru();
+    }
+
+    // Native thru resolver (called by RouteManager with its routes lock held):
+    // routes from a local input device to a local output device whose
+    // devices are present. Async outputs stay on the dispatch path, which
+    // applies their SysEx pacing and realtime priority.
+    bool resolveNativeThru(const MidiRoute& route, std::string& sourceIdentifier,
+                           std::string& destinationIdentifier) {
+        if (!isLocalPhysical(route.source.serverUrl, route.source.portId) ||
+            !isLocalPhysical(route.destination.serverUrl, route.destination.portId) ||
+            route.source.portId.rfind("input-", 0) != 0 ||
+            route.destination.portId.rfind("output-", 0) != 0) {
+            return false;
+        }
+        auto destinationPort = ports.find(route.destination.portId);
+        if (destinationPort ? destinationPort->isAsyncOutput() : outputDefaults.async) return false;
+
+        auto devices = deviceRegistry.snapshot();
+        auto source = devices->inputs.resolve(route.source.portName);
+        auto destination = devices->outputs.resolve(route.destination.portName);
+        if (!source || !destination) return false;
+        sourceIdentifier = source->identifier;
+        destinationIdentifier = destination->identifier;
+        return true;
+    }
+
+    // Body of POST /routes/bulk and PUT /routes:
+    //   {"routes": [route, ...], "remove": ["routeId", ...]}
+    // remove is only accepted by bulk; replaceAll drops every unlisted route,
+    // so it needs the routes key ({"routes": []} to clear them all).
+    // Nothing is applied unless every route is valid.
+    void applyRouteList(const httplib::Request& req, httplib::Response& res, bool replaceAll) {
+        std::vector<MidiRoute> routes;
+        std::vector<std::string> removeIds;
+        bool hasRoutes = false;
+        std::string error;
+        JsonReader reader(req.body);
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key == "routes") {
+                hasRoutes = true;
+                return reader.readArray([&] {
+                    MidiRoute route;
+                    std::string routeError;
+                    if (RouteManager::readRoute(reader, route, routeError)) {
+                        routes.push_back(std::move(route));
+                        return true;
+                    }
+                    if (!routeError.empty() && error.empty()) {
+                        error = "routes[" + std::to_string(routes.size()) + "]: " + routeError;
+                    }
+                    return !routeError.empty();
+                });
+            }
+            if (key == "remove" && !replaceAll) {
+                return reader.readArray([&] {
+                    std::string id;
+                    if (!reader.readString(id)) return false;
+                    removeIds.push_back(std::move(id));
+                    return true;
+                });
+            }
+            return reader.skipValue();
+        }) && reader.finish();
+
+        if (!parsed) {
+            sendErrorResponse(res, 400, "Invalid routes body: " + reader.error());
+            return;
+        }
+        if (!error.empty()) {
+            sendErrorResponse(res, 400, error);
+            return;
+        }
+        if (replaceAll && !hasRoutes) {
+            sendErrorResponse(res, 400, "Missing routes field");
+            return;
+        }
+
+        size_t removed = routeManager.applyRoutes(routes, removeIds, replaceAll);
+        for (const auto& route : routes) autoOpenPortsForRoute(route.source, route.destination);
+
+        JsonBuilder json;
+        json.startObject()
+            .key("success").value(true)
+            .key("removed").value((uint64_t)removed)
+            .key("routes").startArray();
+        for (const auto& route : routes) appendRouteJson(json, route, false);
+        json.endArray().endObject();
+        sendJson(res, json);
+    }
+
+    // withStatus: include the live "status" object (GET /routes)
+    // withCounters = false leaves messagesRouted out of the status, e.g. for
+    // versioned listings that must not change while the config doesn't
+    static void appendRouteJson(JsonBuilder& json, const MidiRoute& route, bool withStatus,
+                                bool withCounters = true) {
+        json.startObject()
+            .key("id").value(route.id)
+            .key("enabled").value(route.enabled)
+            .key("source").startObject()
+                .key("serverUrl").value(route.source.serverUrl)
+                .key("portId").value(route.source.portId)
+                .key("portName").value(route.source.portName)
+            .endObject()
+            .key("destination").startObject()
+                .key("serverUrl").value(route.destination.serverUrl)
+                .key("portId").value(route.destination.portId)
+                .key("portName").value(route.destination.portName)
+            .endObject()
+            .key("delivery").startObject()
+                .key("maxAgeMs").value((uint64_t)route.delivery.maxAgeMs)
+                .key("coalesce").value(route.delivery.coalesce)
+            .endObject()
+            .key("latencyMs").value((uint64_t)route.latencyMs)
+            .key("filter");
+        route.filter.write(json);
+        if (withStatus) {
+            json.key("status").startObject()
+                .key("routeId").value(route.id)
+                .key("status").value(route.enabled ? std::string("active") : std::string("disabled"));
+            if (withCounters) json.key("messagesRouted").value((int)route.messagesForwarded);
+            json.key("native").value(route.native).endObject();
+        }
+        json.endObject();
+    }
+
+    // How message payloads are written: [144,60,127] (default), "903c7f" or "kDx/"
+    enum class PayloadEncoding { Array, Hex, Base64 };
+
+    static PayloadEncoding parsePayloadEncoding(const httplib::Request& req) {
+        std::string encoding = req.get_param_value("encoding");
+        if (encoding == "hex") return PayloadEncoding::Hex;
+        if (encoding == "base64") return PayloadEncoding::Base64;
+        return PayloadEncoding::Array;
+    }
+
+    static size_t estimateMessagesJsonSize(const std::vector<MidiPacket>& messages) {
+        size_t bytes = 64;
+        for (const auto& msg : messages) bytes += msg.size() * 4 + 4;
+        return bytes;
+    }
+
+    static void appendMessagesJson(JsonBuilder& json, const std::vector<MidiPacket>& messages,
+                                   PayloadEncoding encoding = PayloadEncoding::Array) {
+        json.key("messages").startArray();
+        for (const auto& msg : messages) {
+            switch (encoding) {
+                case PayloadEncoding::Array: json.byteArray(msg.data(), msg.size()); break;
+                case PayloadEncoding::Hex: json.hexValue(msg.data(), msg.size()); break;
+                case PayloadEncoding::Base64: json.base64Value(msg.data(), msg.size()); break;
+            }
+        }
+        json.endArray();
+    }
+
+    // Sends a built JSON body. Small bodies are moved into the response
+    // (set_content would copy them); large ones are handed to httplib's
+    // content provider and written straight from the builder's buffer.
+    static void sendJson(httplib::Response& res, JsonBuilder& json) {
+        static constexpr size_t streamThreshold = 64 * 1024;
+        if (json.size() < streamThreshold) {
+            res.body = json.release();
+            res.set_header("Content-Type", "application/json");
+            return;
+        }
+        auto body = std::make_shared<std::string>(json.release());
+        res.set_content_provider(body->size(), "application/json",
+            [body](size_t offset, size_t length, httplib::DataSink& sink) {
+                return sink.write(body->data() + offset, std::min(length, body->size() - offset));
+            });
+    }
+
+    // A port a local socket client watches: "virtual:<id>" or an open port id.
+    // The source holds the port, so it stays valid after the port is closed.
+    bool resolveLocalSource(const std::string& portId, MidiLocalSource& source) {
+        if (portId.rfind("virtual:", 0) == 0) {
+            auto port = virtualPorts.find(portId.substr(8));
+            if (!port) return false;
+            bindLocalSource(port, source);
+            return true;
+        }
+        auto port = ports.find(portId);
+        if (!port) return false;
+        bindLocalSource(port, source);
+        return true;
+    }
+
+    template <typename Port>
+    static void bindLocalSource(const std::shared_ptr<Port>& port, MidiLocalSource& source) {
+        source.waitForMessages = [port](std::chrono::milliseconds timeout) { return port->waitForMessages(timeout); };
+        source.getMessages = [port] { return port->getMessages(); };
+        source.isInterrupted = [port] { return port->isInterrupted(); };
+    }
+
+    // Wraps a send handler so bodies over maxSendBodyBytes get 413. The
+    // body has been read by then; maxBodyBytes bounds that.
+    httplib::Server::Handler limitSendBody(httplib::Server::Handler handler) {
+        return [this, handler = std::move(handler)](const httplib::Request& req, httplib::Response& res) {
+            size_t limit = httpConfig.maxSendBodyBytes;
+            if (limit != 0 && req.body.size() > limit) {
+                sendErrorResponse(res, 413, "Body exceeds " + std::to_string(limit) + " bytes");
+                return;
+            }
+            handler(req, res);
+        };
+    }
+
+    // A slot for a long poll or stream, or an empty one after answering 503
+    HttpSubscriptionLimiter::Slot acquireSubscription(httplib::Response& res) {
+        auto slot = subscriptions.tryAcquire();
+        if (!slot) {
+            res.set_header("Retry-After", "1");
+            sendErrorResponse(res, 503, "Too many long polls and streams (limit " +
+                                        std::to_string(httpConfig.subscriptionThreads) + ")");
+        }
+        return slot;
+    }
+
+    // Body of GET /port/:id/messages and /virtual/:id/messages. With
+    // ?timeout=ms the request long-polls: it blocks until a message arrives
+    // (or the timeout, capped at 30s, elapses) instead of returning empty.
+    template <typename Port>
+    void respondWithMessages(Port& port, const httplib::Request& req, httplib::Response& res) {
+        HttpSubscriptionLimiter::Slot slot;
+        if (req.has_param("timeout")) {
+            long long timeoutMs = std::atoll(req.get_param_value("timeout").c_str());
+            timeoutMs = std::max(0LL, std::min(timeoutMs, 30000LL));
+            if (timeoutMs > 0 && !(slot = acquireSubscription(res))) return;
+            port.waitForMessages(std::chrono::milliseconds(timeoutMs));
+        }
+
+        auto messages = port.getMessages();
+
+        JsonBuilder json(estimateMessagesJsonSize(messages));
+        json.startObject();
+        appendMessagesJson(json, messages, parsePayloadEncoding(req));
+        if (port.getOverflowPolicy() == QueueOverflowPolicy::Report) {
+            json.key("dropped").value(port.takeDroppedSinceLastPoll());
+        }
+        json.endObject();
+        sendJson(res, json);
+    }
+
+    // Body of GET /port/:id/stream and /virtual/:id/stream: an SSE stream with
+    // one event per wake-up carrying everything queued since the last event.
+    // The stream consumes the port queue, like polling does.
+    // The event buffer is reused for the lifetime of the stream.
+    template <typename Port>
+    void streamMessages(std::shared_ptr<Port> port, const httplib::Request& req,
+                        httplib::Response& res) {
+        auto slot = acquireSubscription(res);
+        if (!slot) return;
+        PayloadEncoding encoding = parsePayloadEncoding(req);
+        auto event = std::make_shared<JsonBuilder>(4096);
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [port, encoding, event, slot](size_t, httplib::DataSink& sink) {
+                // Checks the client every second, so one that went away gives
+                // its slot back promptly instead of at the next keepalive
+                bool ready = false;
+                for (int second = 0; second < 15 && !ready; second++) {
+                    ready = port->waitForMessages(std::chrono::seconds(1));
+                    if (!ready && (port->isInterrupted() || !sink.is_writable())) break;
+                }
+                if (!ready && port->isInterrupted()) {
+                    sink.done();
+                    return true;
+                }
+                if (!ready && !sink.is_writable()) return false;
+
+                if (!ready) {
+                    static const char keepalive[] = ": keepalive\n\n";
+                    return sink.write(keepalive, sizeof(keepalive) - 1);
+                }
+
+                auto messages = port->getMessages();
+                event->clear();
+                event->reserve(estimateMessagesJsonSize(messages) + 8);
+                event->raw("data: ", 6).startObject();
+                appendMessagesJson(*event, messages, encoding);
+                if (port->getOverflowPolicy() == QueueOverflowPolicy::Report) {
+                    event->key("dropped").value(port->takeDroppedSinceLastPoll());
+                }
+                event->endObject().raw("\n\n", 2);
+                return sink.write(event->str().data(), event->size());
+            });
+    }
+
+    struct PortMetricsRow {
+        std::string id;
+        bool isVirtual;
+        bool isInput;
+        bool connected;
+        uint64_t messagesIn, bytesIn, messagesOut, bytesOut;
+        MidiQueueStats queue;
+        MidiMemoryStats memory;
+    };
+
+    template <typename Port>
+    static void collectPortMetrics(const PortRegistry<Port>& registry, const std::string& idPrefix,
+                                   bool isVirtual, std::vector<PortMetricsRow>& rows) {
+        for (const auto& [id, port] : *registry.snapshot()) {
+            const PortMetrics& metrics = port->getMetrics();
+            rows.push_back({idPrefix + id, isVirtual, port->isInput(), port->isConnected(),
+                            metrics.messagesIn.load(std::memory_order_relaxed),
+                            metrics.bytesIn.load(std::memory_order_relaxed),
+                            metrics.messagesOut.load(std::memory_order_relaxed),
+                            metrics.bytesOut.load(std::memory_order_relaxed),
+                            port->getQueueStats(), port->getMemoryStats()});
+        }
+    }
+
+    std::vector<PortMetricsRow> collectAllPortMetrics() const {
+        std::vector<PortMetricsRow> rows;
+        collectPortMetrics(ports, "", false, rows);
+        collectPortMetrics(virtualPorts, "virtual:", true, rows);
+        return rows;
+    }
+
+    static void appendHistogramJson(JsonBuilder& json, const LatencyHistogram::Snapshot& snapshot) {
+        json.startObject()
+            .key("count").value(snapshot.count)
+            .key("mean").value((uint64_t)(snapshot.meanMicros() + 0.5))
+            .key("p50").value(snapshot.valueAtPercentile(50.0))
+            .key("p90").value(snapshot.valueAtPercentile(90.0))
+            .key("p99").value(snapshot.valueAtPercentile(99.0))
+            .key("p999").value(snapshot.valueAtPercentile(99.9))
+            .key("max").value(snapshot.maxMicros)
+            .endObject();
+    }
+
+    static void appendMemoryStatsJson(JsonBuilder& json, const MidiMemoryStats& stats) {
+        json.key("bufferedBytes").value((uint64_t)stats.bufferedBytes)
+            .key("peakBytes").value((uint64_t)stats.peakBytes)
+            .key("rejected").value(stats.rejected);
+    }
+
+    // Body of GET /memory; ports and forwarders holding the most come first
+    void appendMemoryJson(JsonBuilder& json) {
+        MidiMemoryBudget& budget = MidiMemoryBudget::global();
+        json.startObject().key("limitBytes").value((uint64_t)budget.getLimit());
+        appendMemoryStatsJson(json, budget.getStats());
+
+        MidiBufferPool::Stats pool = MidiBufferPool::shared()->getStats();
+        json.key("pool").startObject()
+            .key("buffers").value((uint64_t)pool.pooledBuffers)
+            .key("bytes").value((uint64_t)pool.pooledBytes)
+            .key("reused").value(pool.reused)
+            .key("allocated").value(pool.allocated)
+            .endObject();
+
+        auto portRows = collectAllPortMetrics();
+        std::sort(portRows.begin(), portRows.end(), [](const PortMetricsRow& a, const PortMetricsRow& b) {
+            return a.memory.bufferedBytes > b.memory.bufferedBytes;
+        });
+        json.key("ports").startArray();
+        for (const auto& row : portRows) {
+            json.startObject()
+                .key("id").value(row.id)
+                .key("virtual").value(row.isVirtual)
+                .key("direction").value(std::string(row.isInput ? "input" : "output"));
+            appendMemoryStatsJson(json, row.memory);
+            json.key("reservedBytes").value((uint64_t)row.queue.reservedBytes).endObject();
+        }
+        json.endArray();
+
+        auto forwarderRows = routeManager.getForwarderStats();
+        std::sort(forwarderRows.begin(), forwarderRows.end(),
+                  [](const RemoteForwarderStats& a, const RemoteForwarderStats& b) {
+                      return a.memory.bufferedBytes > b.memory.bufferedBytes;
+                  });
+        json.key("forwarders").startArray();
+        for (const auto& stats : forwarderRows) {
+            json.startObject().key("target").value(stats.target);
+            appendMemoryStatsJson(json, stats.memory);
+            json.endObject();
+        }
+        json.endArray().endObject();
+    }
+
+    std::string metricsJson() {
+        JsonBuilder json;
+        json.startObject().key("ports").startArray();
+        for (const auto& row : collectAllPortMetrics()) {
+            json.startObject()
+                .key("id").value(row.id)
+                .key("virtual").value(row.isVirtual)
+                .key("direction").value(std::string(row.isInput ? "input" : "output"))
+                .key("connected").value(row.connected)
+                .key("messagesIn").value(row.messagesIn)
+                .key("bytesIn").value(row.bytesIn)
+                .key("messagesOut").value(row.messagesOut)
+                .key("bytesOut").value(row.bytesOut)
+                .key("queueDepth").value((uint64_t)row.queue.depth)
+                .key("dropped").value(row.queue.dropped)
+                .key("droppedSysEx").value(row.queue.droppedSysEx)
+                .endObject();
+        }
+        json.endArray();
+
+        json.key("routes").startArray();
+        for (const auto& route : routeManager.getRouteMetrics()) {
+            json.startObject()
+                .key("id").value(route.routeId)
+                .key("enabled").value(route.enabled)
+                .key("native").value(route.native)
+                .key("messages").value(route.messagesForwarded)
+                .key("filtered").value(route.messagesFiltered)
+                .key("bytes").value(route.bytesForwarded)
+                .key("latencyUs");
+            appendHistogramJson(json, route.latency);
+            json.endObject();
+        }
+        json.endArray();
+
+        json.key("forwarders").startArray();
+        for (const auto& stats : routeManager.getForwarderStats()) {
+            json.startObject()
+                .key("target").value(stats.target)
+                .key("queueDepth").value((uint64_t)stats.queueDepth)
+                .key("sent").value(stats.messagesSent)
+                .key("failed").value(stats.messagesFailed)
+                .key("droppedOverflow").value(stats.droppedOverflow)
+                .key("droppedStale").value(stats.droppedStale)
+                .key("coalesced").value(stats.coalesced)
+                .key("queueDelayUs");
+            appendHistogramJson(json, stats.queueDelay);
+            json.key("rttUs");
+            appendHistogramJson(json, stats.roundTrip);
+            json.endObject();
+        }
+        json.endArray();
+
+        MidiSchedulerStats schedulerStats = scheduler.getStats();
+        json.key("scheduler").startObject()
+            .key("pending").value((uint64_t)schedulerStats.pending)
+            .key("scheduled").value(schedulerStats.scheduled)
+            .key("released").value(schedulerStats.released)
+            .key("dropped").value(schedulerStats.dropped)
+            .key("latenessUs");
+        appendHistogramJson(json, schedulerStats.lateness);
+        json.endObject();
+
+        MidiFanOutStats fanOutStats = routeManager.getFanOutStats();
+        json.key("fanOut").startObject()
+            .key("lanes").value((uint64_t)fanOutStats.lanes)
+            .key("pending").value((uint64_t)fanOutStats.pending)
+            .key("delivered").value(fanOutStats.delivered)
+            .key("dropped").value(fanOutStats.dropped)
+            .key("fanOuts").value(fanOutStats.groups)
+            .key("spreadUs");
+        appendHistogramJson(json, fanOutStats.spread);
+        json.endObject();
+
+        HttpSubscriptionStats subscriptionStats = subscriptions.getStats();
+        json.key("http").startObject()
+            .key("subscriptionLimit").value((uint64_t)subscriptionStats.limit)
+            .key("subscriptions").value((uint64_t)subscriptionStats.active)
+            .key("subscriptionsRejected").value(subscriptionStats.rejected)
+            .endObject();
+
+        json.endObject();
+        return json.release();
+    }
+
+    std::string metricsPrometheus() {
+        PrometheusWriter out;
+
+        auto portRows = collectAllPortMetrics();
+        auto portLabels = [](const PortMetricsRow& row) {
+            return PrometheusWriter::label("port", row.id) + "," +
+                   PrometheusWriter::label("direction", row.isInput ? "input" : "output");
+        };
+        out.family("midi_port_connected", "gauge", "1 while the port's device is present");
+        for (const auto& row : portRows) out.sample("midi_port_connected", portLabels(row), (uint64_t)row.connected);
+        out.family("midi_port_messages_in_total", "counter", "MIDI messages received by the port");
+        for (const auto& row : portRows) out.sample("midi_port_messages_in_total", portLabels(row), row.messagesIn);
+        out.family("midi_port_bytes_in_total", "counter", "MIDI bytes received by the port");
+        for (const auto& row : portRows) out.sample("midi_port_bytes_in_total", portLabels(row), row.bytesIn);
+        out.family("midi_port_messages_out_total", "counter", "MIDI messages sent through the port");
+        for (const auto& row : portRows) out.sample("midi_port_messages_out_total", portLabels(row), row.messagesOut);
+        out.family("midi_port_bytes_out_total", "counter", "MIDI bytes sent through the port");
+        for (const auto& row : portRows) out.sample("midi_port_bytes_out_total", portLabels(row), row.bytesOut);
+        out.family("midi_port_queue_depth", "gauge", "Messages waiting in the port's polling queue");
+        for (const auto& row : portRows) out.sample("midi_port_queue_depth", portLabels(row), row.queue.depth);
+        out.family("midi_port_queue_dropped_total", "counter", "Messages dropped by the port's polling queue");
+        for (const auto& row : portRows) out.sample("midi_port_queue_dropped_total", portLabels(row), row.queue.dropped);
+        out.family("midi_port_buffered_bytes", "gauge", "Payload bytes held by the port's queues and SysEx assembly");
+        for (const auto& row : portRows) out.sample("midi_port_buffered_bytes", portLabels(row), row.memory.bufferedBytes);
+
+        auto routeRows = routeManager.getRouteMetrics();
+        auto routeLabel = [](const RouteMetricsSnapshot& route) {
+            return PrometheusWriter::label("route", route.routeId);
+        };
+        out.family("midi_route_messages_total", "counter", "Messages forwarded by the route");
+        for (const auto& route : routeRows) out.sample("midi_route_messages_total", routeLabel(route), route.messagesForwarded);
+        out.family("midi_route_filtered_total", "counter", "Messages dropped by the route's filter");
+        for (const auto& route : routeRows) out.sample("midi_route_filtered_total", routeLabel(route), route.messagesFiltered);
+        out.family("midi_route_bytes_total", "counter", "Bytes forwarded by the route");
+        for (const auto& route : routeRows) out.sample("midi_route_bytes_total", routeLabel(route), route.bytesForwarded);
+        out.family("midi_route_latency_microseconds", "summary", "Source callback to local send or remote enqueue");
+        for (const auto& route : routeRows) out.summary("midi_route_latency_microseconds", routeLabel(route), route.latency);
+
+        auto forwarderRows = routeManager.getForwarderStats();
+        auto targetLabel = [](const RemoteForwarderStats& stats) {
+            return PrometheusWriter::label("target", stats.target);
+        };
+        out.family("midi_forwarder_queue_depth", "gauge", "Messages waiting for a remote host");
+        for (const auto& stats : forwarderRows) out.sample("midi_forwarder_queue_depth", targetLabel(stats), stats.queueDepth);
+        out.family("midi_forwarder_buffered_bytes", "gauge", "Payload bytes waiting for a remote host");
+        for (const auto& stats : forwarderRows) {
+            out.sample("midi_forwarder_buffered_bytes", targetLabel(stats), stats.memory.bufferedBytes);
+        }
+        out.family("midi_forwarder_sent_total", "counter", "Messages delivered to a remote host");
+        for (const auto& stats : forwarderRows) out.sample("midi_forwarder_sent_total", targetLabel(stats), stats.messagesSent);
+        out.family("midi_forwarder_dropped_total", "counter", "Messages not delivered to a remote host");
+        for (const auto& stats : forwarderRows) {
+            std::string labels = targetLabel(stats) + ",";
+            out.sample("midi_forwarder_dropped_total", labels + "reason=\"failed\"", stats.messagesFailed);
+            out.sample("midi_forwarder_dropped_total", labels + "reason=\"overflow\"", stats.droppedOverflow);
+            out.sample("midi_forwarder_dropped_total", labels + "reason=\"memory\"", stats.droppedOverBudget);
+            out.sample("midi_forwarder_dropped_total", labels + "reason=\"stale\"", stats.droppedStale);
+        }
+        out.family("midi_forwarder_queue_delay_microseconds", "summary", "Time messages wait before a send attempt");
+        for (const auto& stats : forwarderRows) {
+            out.summary("midi_forwarder_queue_delay_microseconds", targetLabel(stats), stats.queueDelay);
+        }
+        out.family("midi_forwarder_rtt_microseconds", "summary", "HTTP forward request round-trip time");
+        for (const auto& stats : forwarderRows) {
+            out.summary("midi_forwarder_rtt_microseconds", targetLabel(stats), stats.roundTrip);
+        }
+
+        MidiSchedulerStats schedulerStats = scheduler.getStats();
+        out.family("midi_scheduler_pending", "gauge", "Timestamped messages waiting for their due time");
+        out.sample("midi_scheduler_pending", "", schedulerStats.pending);
+        out.family("midi_scheduler_released_total", "counter", "Timestamped messages released by the scheduler");
+        out.sample("midi_scheduler_released_total", "", schedulerStats.released);
+        out.family("midi_scheduler_dropped_total", "counter", "Timestamped messages refused (queue full or too far ahead)");
+        out.sample("midi_scheduler_dropped_total", "", schedulerStats.dropped);
+        out.family("midi_scheduler_lateness_microseconds", "summary", "Release time minus due time");
+        out.summary("midi_scheduler_lateness_microseconds", "", schedulerStats.lateness);
+
+        MidiFanOutStats fanOutStats = routeManager.getFanOutStats();
+        out.family("midi_fanout_pending", "gauge", "Deliveries waiting on fan-out lanes");
+        out.sample("midi_fanout_pending", "", fanOutStats.pending);
+        out.family("midi_fanout_delivered_total", "counter", "Deliveries sent by fan-out lanes");
+        out.sample("midi_fanout_delivered_total", "", fanOutStats.delivered);
+        out.family("midi_fanout_dropped_total", "counter", "Deliveries refused by a full fan-out lane");
+        out.sample("midi_fanout_dropped_total", "", fanOutStats.dropped);
+        out.family("midi_fanout_spread_microseconds", "summary",
+                   "Last minus first delivery of one message to several destinations");
+        out.summary("midi_fanout_spread_microseconds", "", fanOutStats.spread);
+
+        HttpSubscriptionStats subscriptionStats = subscriptions.getStats();
+        out.family("midi_http_subscriptions", "gauge", "Long polls and streams holding a server thread");
+        out.sample("midi_http_subscriptions", "", subscriptionStats.active);
+        out.family("midi_http_subscriptions_rejected_total", "counter",
+                   "Long polls and streams refused with 503 because every slot was taken");
+        out.sample("midi_http_subscriptions_rejected_total", "", subscriptionStats.rejected);
+
+        MidiMemoryStats memoryStats = MidiMemoryBudget::global().getStats();
+        out.family("midi_buffered_bytes", "gauge", "Payload bytes buffered by all ports and forwarders");
+        out.sample("midi_buffered_bytes", "", memoryStats.bufferedBytes);
+        out.family("midi_buffered_bytes_limit", "gauge", "Cap on midi_buffered_bytes (0 = no limit)");
+        out.sample("midi_buffered_bytes_limit", "", MidiMemoryBudget::global().getLimit());
+        out.family("midi_buffered_rejected_total", "counter", "Messages dropped because the cap was reached");
+        out.sample("midi_buffered_rejected_total", "", memoryStats.rejected);
+        MidiBufferPool::Stats poolStats = MidiBufferPool::shared()->getStats();
+        out.family("midi_buffer_pool_bytes", "gauge", "Capacity of the free payload buffers kept for reuse");
+        out.sample("midi_buffer_pool_bytes", "", poolStats.pooledBytes);
+
+        return out.toString();
+    }
+
+    // Settings for a port whose open body names none (see MidiPortOptions)
+    MidiPortOptions defaultPortOptions() const {
+        MidiPortOptions options;
+        options.output = outputDefaults;
+        options.sysex = sysexDefaults;
+        return options;
+    }
+
+    static std::string queueStatsJson(const MidiQueueStats& stats,
+                                      const MidiOutputStats* output = nullptr,
+                                      const MidiSysExStats* sysex = nullptr) {
+        JsonBuilder json;
+        json.startObject()
+            .key("depth").value((uint64_t)stats.depth)
+            .key("capacity").value((uint64_t)stats.capacity)
+            .key("sysexBytes").value((uint64_t)stats.sysexBytes)
+            .key("dropped").value(stats.dropped)
+            .key("droppedSysEx").value(stats.droppedSysEx)
+            .key("droppedOverBudget").value(stats.droppedOverBudget)
+            .key("overflowPolicy").value(std::string(overflowPolicyName(stats.overflowPolicy)));
+        if (output) {
+            json.key("output").startObject()
+                .key("pending").value((uint64_t)output->pendingMessages)
+                .key("pendingSysExBytes").value((uint64_t)output->pendingSysExBytes)
+                .key("sent").value(output->sent)
+                .key("dropped").value(output->dropped)
+                .endObject();
+        }
+        if (sysex) {
+            json.key("sysexInput").startObject()
+                .key("completed").value(sysex->completed)
+                .key("discardedOversize").value(sysex->discardedOversize)
+                .key("discardedIncomplete").value(sysex->discardedIncomplete)
+                .key("discardedOverBudget").value(sysex->discardedOverBudget)
+                .key("streamedChunks").value(sysex->streamedChunks)
+                .endObject();
+        }
+        json.endObject();
+        return json.release();
+    }
+
+    // Parses a /send or /inject body (see MidiSendBody)
+    static bool parseMessageBody(const httplib::Request& req, MidiPacket& message,
+                                 std::string& error, int64_t* timestampUs = nullptr) {
+        return MidiSendBody::parse(req.get_header_value("Content-Type"), req.body, message, error, timestampUs);
+    }
+
+    // Queues a timestamped send for its due time. Replies with an error and
+    // returns false if the timestamp is too far ahead or the scheduler is full.
+    bool scheduleSend(httplib::Response& res, const std::string& routePortId,
+                      const MidiPacket& message, int64_t timestampUs) {
+        MidiScheduler::Clock::time_point due;
+        if (!MidiScheduler::fromUnixMicros(timestampUs, due)) {
+            sendErrorResponse(res, 400, "timestampUs is more than 10 s from now");
+            return false;
+        }
+        if (!scheduler.schedule(due, routePortId, message)) {
+            sendErrorResponse(res, 503, "Scheduler queue full");
+            return false;
+        }
+        return true;
+    }
+
+    // Why a port's sendMessage would refuse message, or nullptr if it is a
+    // complete SysEx or a message of at most 3 bytes
+    static const char* messageProblem(const MidiPacket& message) {
+        if (message.empty()) return "empty message";
+        if (message.isSysEx() && message.back() != 0xF7) return "incomplete SysEx";
+        if (!message.isSysEx() && message.size() > 3) return "message longer than 3 bytes";
+        return nullptr;
+    }
+
+    static constexpr const char* notAcceptedError = "Port did not accept the message (disconnected or output queue full)";
+
+    // Same horizon as the scheduler
+    static constexpr long long maxBatchOffsetMs = MidiScheduler::maxScheduleAhead.count();
+
+    // One message of a send-batch request
+    struct BatchMessage {
+        MidiPacket message;
+        uint32_t offsetMs = 0;   // Delay after the request arrived
+        int64_t timestampUs = 0; // Absolute due time (Unix epoch µs); overrides offsetMs
+        std::string portId;      // Route-style id ("synth", "virtual:drums")
+        MidiScheduler::Clock::time_point due;
+    };
+
+    // Parses {"messages":[...]} where each element is a byte array or
+    // {"message":[...],"offsetMs":N,"timestampUs":N,"port":"id"}. Every message
+    // is validated up front so a bad batch is rejected before anything is sent.
+    // portId: the port of a per-port endpoint, or empty if each message names one
+    static bool parseSendBatch(const std::string& body, const std::string& portId,
+                               std::vector<BatchMessage>& batch, std::string& error) {
+        auto arrival = MidiScheduler::Clock::now();
+        JsonReader reader(body);
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key != "messages") return reader.skipValue();
+            return reader.readArray([&] {
+                BatchMessage entry;
+                if (reader.peekValue() == '[') {
+                    if (!MidiSendBody::readMessage(reader, entry.message)) return false;
+                } else if (!reader.readObject([&](std::string_view field) {
+                               if (field == "message") return MidiSendBody::readMessage(reader, entry.message);
+                               if (field == "port") return reader.readString(entry.portId);
+                               if (field == "offsetMs") {
+                                   long long offset = 0;
+                                   if (!reader.readInteger(offset)) return false;
+                                   if (offset < 0 || offset > maxBatchOffsetMs) return false;
+                                   entry.offsetMs = (uint32_t)offset;
+                                   return true;
+                               }
+                               if (field == "timestampUs") return MidiSendBody::readTimestamp(reader, entry.timestampUs);
+                               return reader.skipValue();
+                           })) {
+                    return false;
+                }
+                batch.push_back(std::move(entry));
+                return true;
+            });
+        }) && reader.finish();
+        if (!parsed) {
+            error = reader.error();
+            return false;
+        }
+
+        if (batch.empty()) {
+            error = "no messages";
+            return false;
+        }
+        for (size_t i = 0; i < batch.size(); i++) {
+            BatchMessage& entry = batch[i];
+            if (!portId.empty()) entry.portId = portId;
+            bool inRange = true;
+            if (entry.timestampUs != 0) inRange = MidiScheduler::fromUnixMicros(entry.timestampUs, entry.due);
+            else entry.due = arrival + std::chrono::milliseconds(entry.offsetMs);
+            const char* problem = messageProblem(entry.message);
+            if (!problem && entry.portId.empty()) problem = "missing port";
+            if (!problem && !inRange) problem = "timestamp more than 10 s from now";
+            if (problem) {
+                error = std::string(problem) + " at index " + std::to_string(i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    struct BatchResult {
+        uint64_t sent = 0;        // Sent by the request
+        uint64_t scheduled = 0;   // Handed to the scheduler for later
+        uint64_t dropped = 0;     // Scheduler queue full
+        uint64_t refused = 0;     // Not accepted by the port (disconnected, output queue full)
+    };
+
+    // Sends the messages that are already due in order, and hands the rest to
+    // the scheduler so the request doesn't wait for them. send returns
+    // whether the port accepted the message.
+    template <typename Send>
+    BatchResult sendBatch(std::vector<BatchMessage>& batch, Send&& send) {
+        std::stable_sort(batch.begin(), batch.end(), [](const BatchMessage& a, const BatchMessage& b) {
+            return a.due < b.due;
+        });
+        BatchResult result;
+        auto now = MidiScheduler::Clock::now();
+        for (const BatchMessage& entry : batch) {
+            if (entry.due <= now) {
+                if (send(entry)) result.sent++;
+                else result.refused++;
+            } else if (scheduler.schedule(entry.due, entry.portId, entry.message)) {
+                result.scheduled++;
+            } else {
+                result.dropped++;
+            }
+        }
+        return result;
+    }
+
+    static void sendBatchResult(httplib::Response& res, const BatchResult& result) {
+        JsonBuilder json;
+        json.startObject()
+            .key("success").value(result.dropped == 0 && result.refused == 0)
+            .key("sent").value(result.sent)
+            .key("scheduled").value(result.scheduled);
+        if (result.dropped > 0) json.key("dropped").value(result.dropped);
+        if (result.refused > 0) json.key("refused").value(result.refused);
+        json.endObject();
+        sendJson(res, json);
+    }
+
+    static std::string versionEtag(uint64_t version) {
+        return "\"" + std::to_string(version) + "\"";
+    }
+
+    // If-None-Match holds a list of ETags or "*"; a weak W/ prefix is ignored
+    static bool etagMatches(const httplib::Request& req, const std::string& etag) {
+        std::string header = req.get_header_value("If-None-Match");
+        size_t start = 0;
+        while (start < header.size()) {
+            size_t end = header.find(',', start);
+            if (end == std::string::npos) end = header.size();
+            size_t first = header.find_first_not_of(" \t", start);
+            size_t last = header.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end) {
+                std::string candidate = header.substr(first, last - first + 1);
+                if (candidate.compare(0, 2, "W/") == 0) candidate.erase(0, 2);
+                if (candidate == "*" || candidate == etag) return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    static void sendErrorResponse(httplib::Response& res, int status, const std::string& error) {
+        JsonBuilder json;
+        json.startObject().key("error").value(error).key("success").value(false).endObject();
+        res.status = status;
+        sendJson(res, json);
+    }
+};
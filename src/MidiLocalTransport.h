@@ -0,0 +1,365 @@
+/**
+ * MidiLocalTransport - Unix domain socket for clients on the same machine
+ *
+ * The dashboard and local plugins otherwise pay a loopback TCP round-trip
+ * and a JSON body per message. Here one connection carries pipelined binary
+ * frames both ways, using the MidiWireFormat batch body of POST /batch.
+ *
+ * Wire protocol (integers big-endian, as in MidiStreamTransport):
+ *   client -> server, once:  "MIDL" | version (1 byte)
+ *   then frames both ways:   type (1 byte) | u32 payloadLength | payload
+ *
+ *   client 'S'  MidiWireFormat batch to send, delivered like POST /batch:
+ *               "virtual:<id>" sends from a virtual port (as
+ *               /virtual/:id/send), other ids are open output ports, and
+ *               timestamped batches are scheduled
+ *   client 'W'  watch: payload is a port id ("virtual:<id>" or an open input
+ *               port); its incoming messages are pushed from now on. Like
+ *               /messages and /stream this consumes the port's queue.
+ *   client 'U'  stop watching the port id in the payload
+ *   server 'M'  MidiWireFormat batch of messages received by watched ports
+ *   server 'C'  a watched port was closed; payload is its id
+ *   server 'E'  error text for the client's last request (e.g. unknown port)
+ *
+ * No acknowledgements: a local stream socket doesn't lose or reorder frames.
+ *
+ * Each connection has a reader thread, plus one thread per watched port
+ * that sleeps on the port's queue. The socket file is created owner-only
+ * and removed on stop(); start() only ever replaces a socket, never another
+ * kind of file at the path. On Windows this uses AF_UNIX (Windows 10 1803+),
+ * which takes the same code path, instead of a named pipe.
+ */
+
+#pragma once
+
+#include "MidiStreamTransport.h"
+#include "MidiWireFormat.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <afunix.h>
+#else
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+namespace midilocal {
+
+constexpr const char* magic = "MIDL";
+constexpr uint8_t version = 1;
+constexpr size_t frameHeaderSize = 5;
+
+constexpr uint8_t sendFrame = 'S';
+constexpr uint8_t watchFrame = 'W';
+constexpr uint8_t unwatchFrame = 'U';
+constexpr uint8_t messagesFrame = 'M';
+constexpr uint8_t closedFrame = 'C';
+constexpr uint8_t errorFrame = 'E';
+
+} // namespace midilocal
+
+// A port a local client can watch; set up by the server for either port type
+struct MidiLocalSource {
+    std::function<bool(std::chrono::milliseconds)> waitForMessages;
+    std::function<std::vector<MidiPacket>()> getMessages;
+    std::function<bool()> isInterrupted;
+};
+
+class MidiLocalServer
+{
+public:
+    // Fills in source and returns true if portId names a watchable port
+    using SourceResolver = std::function<bool(const std::string& portId, MidiLocalSource& source)>;
+
+    MidiLocalServer(MidiBatchDecoder::MessageHandler messageHandler, SourceResolver sourceResolver)
+        : handler(std::move(messageHandler)), resolver(std::move(sourceResolver)) {}
+
+    ~MidiLocalServer() { stop(); }
+
+    MidiLocalServer(const MidiLocalServer&) = delete;
+    MidiLocalServer& operator=(const MidiLocalServer&) = delete;
+
+    // Binds the socket at path and starts accepting. A stale socket file from
+    // a previous run is replaced; a live one (another server), or anything at
+    // path that isn't a socket, is an error.
+    bool start(const std::string& path, std::string& error) {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            error = "Socket path must be 1 to " + std::to_string(sizeof(addr.sun_path) - 1) + " bytes";
+            return false;
+        }
+        std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+        socket_t probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe != INVALID_SOCKET) {
+            bool inUse = connect(probe, (const sockaddr*)&addr, sizeof(addr)) == 0;
+            httplib::detail::close_socket(probe);
+            if (inUse) {
+                error = "Another process is listening on " + path;
+                return false;
+            }
+        }
+        if (!isSocketOrMissing(path)) {
+            error = path + " exists and is not a socket";
+            return false;
+        }
+        std::remove(path.c_str());
+
+        socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s == INVALID_SOCKET) {
+            error = "socket() failed: " + lastSocketError();
+            return false;
+        }
+#ifndef _WIN32
+        // Created owner-only, so no other user can connect before we're set up
+        mode_t previousMask = umask(S_IRWXG | S_IRWXO);
+#endif
+        bool bound = bind(s, (const sockaddr*)&addr, sizeof(addr)) == 0;
+#ifndef _WIN32
+        umask(previousMask);
+#endif
+        if (!bound || listen(s, 8) != 0) {
+            error = "Cannot listen on " + path + ": " + lastSocketError();
+            httplib::detail::close_socket(s);
+            return false;
+        }
+        listenSocket = s;
+        socketPath = path;
+        running = true;
+        acceptThread = std::thread([this]() { acceptLoop(); });
+        return true;
+    }
+
+    void stop() {
+        running = false;
+        if (acceptThread.joinable()) acceptThread.join();
+        if (listenSocket != INVALID_SOCKET) {
+            httplib::detail::close_socket(listenSocket);
+            listenSocket = INVALID_SOCKET;
+            std::remove(socketPath.c_str());
+        }
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto& conn : connections) {
+            // Unblocks a watcher stuck writing to a client that stopped reading
+            shutdown(conn->sock, 2);
+            if (conn->thread.joinable()) conn->thread.join();
+            httplib::detail::close_socket(conn->sock);
+        }
+        connections.clear();
+    }
+
+    size_t getConnectionCount() {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        size_t open = 0;
+        for (auto& conn : connections) open += conn->finished ? 0 : 1;
+        return open;
+    }
+
+private:
+    static bool isSocketOrMissing(const std::string& path) {
+#ifdef _WIN32
+        // AF_UNIX socket files are reparse points
+        DWORD attributes = GetFileAttributesA(path.c_str());
+        return attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+#else
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0) return errno == ENOENT;
+        return S_ISSOCK(info.st_mode);
+#endif
+    }
+
+    // Winsock doesn't set errno
+    static std::string lastSocketError() {
+#ifdef _WIN32
+        return "error " + std::to_string(WSAGetLastError());
+#else
+        return std::strerror(errno);
+#endif
+    }
+
+    struct Watch {
+        std::thread thread;
+        std::atomic<bool> active{true};
+    };
+
+    struct Connection {
+        socket_t sock = INVALID_SOCKET;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+        std::mutex writeMutex;   // Frames from the reader and the watchers don't interleave
+        std::map<std::string, std::unique_ptr<Watch>> watches;   // Reader thread only
+    };
+
+    void acceptLoop() {
+        while (running) {
+            reapFinishedConnections();
+            if (!midistream::waitSocket(listenSocket, false, 200)) continue;
+
+            socket_t client = accept(listenSocket, nullptr, nullptr);
+            if (client == INVALID_SOCKET) continue;
+#ifdef SO_NOSIGPIPE
+            int one = 1;
+            setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.push_back(std::make_unique<Connection>());
+            Connection* conn = connections.back().get();
+            conn->sock = client;
+            // The socket is closed after the join, so stop() never shuts down a reused fd
+            conn->thread = std::thread([this, conn]() {
+                serveConnection(*conn);
+                conn->finished = true;
+            });
+        }
+    }
+
+    void reapFinishedConnections() {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto it = connections.begin(); it != connections.end();) {
+            if ((*it)->finished) {
+                (*it)->thread.join();
+                httplib::detail::close_socket((*it)->sock);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static bool writeFrame(Connection& conn, uint8_t type, const void* payload, size_t size) {
+        uint8_t header[midilocal::frameHeaderSize];
+        header[0] = type;
+        midistream::putU32(header + 1, (uint32_t)size);
+        std::lock_guard<std::mutex> lock(conn.writeMutex);
+        return midistream::sendAll(conn.sock, header, sizeof(header)) &&
+               midistream::sendAll(conn.sock, (const uint8_t*)payload, size);
+    }
+
+    static bool writeFrame(Connection& conn, uint8_t type, const std::string& payload) {
+        return writeFrame(conn, type, payload.data(), payload.size());
+    }
+
+    void serveConnection(Connection& conn) {
+        uint8_t hello[5];
+        // Closed before saying hello: most likely start() of another server probing the path
+        if (!midistream::recvAll(conn.sock, hello, sizeof(hello), running)) return;
+        if (std::memcmp(hello, midilocal::magic, 4) != 0 || hello[4] != midilocal::version) {
+            std::cerr << "[MidiLocal] Rejected connection with bad handshake" << std::endl;
+            return;
+        }
+
+        std::cout << "[MidiLocal] Client connected" << std::endl;
+        std::string payload;
+        uint8_t header[midilocal::frameHeaderSize];
+        while (midistream::recvAll(conn.sock, header, sizeof(header), running)) {
+            uint32_t length = midistream::getU32(header + 1);
+            if (length > midistream::maxFrameBytes) {
+                std::cerr << "[MidiLocal] Frame too large (" << length << " bytes)" << std::endl;
+                break;
+            }
+            payload.resize(length);
+            if (length > 0 && !midistream::recvAll(conn.sock, (uint8_t*)&payload[0], length, running)) break;
+
+            if (header[0] == midilocal::sendFrame) {
+                if (!MidiBatchDecoder::decode(payload, handler)) {
+                    writeFrame(conn, midilocal::errorFrame, std::string("Malformed batch"));
+                }
+            } else if (header[0] == midilocal::watchFrame) {
+                startWatch(conn, payload);
+            } else if (header[0] == midilocal::unwatchFrame) {
+                stopWatch(conn, payload);
+            } else {
+                writeFrame(conn, midilocal::errorFrame, "Unknown frame type " + std::to_string(header[0]));
+            }
+        }
+
+        // Wake any watcher blocked on a write, then wait for all of them
+        shutdown(conn.sock, 2);
+        for (auto& [portId, watch] : conn.watches) {
+            watch->active = false;
+            if (watch->thread.joinable()) watch->thread.join();
+        }
+        conn.watches.clear();
+        std::cout << "[MidiLocal] Client disconnected" << std::endl;
+    }
+
+    void startWatch(Connection& conn, const std::string& portId) {
+        auto existing = conn.watches.find(portId);
+        if (existing != conn.watches.end()) {
+            if (existing->second->active) return;
+            // Ended by itself (its port closed); replace it
+            existing->second->thread.join();
+            conn.watches.erase(existing);
+        }
+        MidiLocalSource source;
+        if (!resolver(portId, source)) {
+            writeFrame(conn, midilocal::errorFrame, "Port not found: " + portId);
+            return;
+        }
+        auto watch = std::make_unique<Watch>();
+        Watch* raw = watch.get();
+        watch->thread = std::thread([this, &conn, raw, portId, source]() {
+            runWatch(conn, *raw, portId, source);
+        });
+        conn.watches[portId] = std::move(watch);
+    }
+
+    void stopWatch(Connection& conn, const std::string& portId) {
+        auto it = conn.watches.find(portId);
+        if (it == conn.watches.end()) return;
+        it->second->active = false;
+        it->second->thread.join();
+        conn.watches.erase(it);
+    }
+
+    // One batch frame per wake-up with everything queued since the last one
+    void runWatch(Connection& conn, Watch& watch, const std::string& portId, const MidiLocalSource& source) {
+        MidiBatchEncoder batch;
+        while (watch.active && running) {
+            if (!source.waitForMessages(std::chrono::milliseconds(200))) {
+                if (source.isInterrupted()) {
+                    writeFrame(conn, midilocal::closedFrame, portId);
+                    break;
+                }
+                continue;
+            }
+            auto messages = source.getMessages();
+            if (messages.empty()) continue;
+            batch.reset();
+            for (const auto& message : messages) batch.add(portId, message);
+            if (!writeFrame(conn, midilocal::messagesFrame, batch.finish())) {
+                // The reader notices the broken socket and cleans up
+                shutdown(conn.sock, 2);
+                break;
+            }
+        }
+        watch.active = false;
+    }
+
+    MidiBatchDecoder::MessageHandler handler;
+    SourceResolver resolver;
+    std::string socketPath;
+    socket_t listenSocket = INVALID_SOCKET;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+    std::list<std::unique_ptr<Connection>> connections;
+    std::mutex connectionsMutex;
+};
@@ -0,0 +1,263 @@
+/**
+ * MidiMemory - Pooled message buffers and buffered-bytes accounting
+ *
+ * MidiBufferPool recycles the heap buffers behind shared MidiPacket payloads
+ * (SysEx reassembly, /send bodies, decoded batches). Free buffers are kept
+ * in power-of-two capacity classes, so a payload takes one that already fits
+ * instead of growing a fresh vector; a server receiving regular dumps for
+ * days reuses the same few buffers rather than fragmenting the heap.
+ *
+ * MidiMemoryAccount counts the bytes one owner (a port, a remote forwarder)
+ * holds in its queues and charges them to the process-wide MidiMemoryBudget.
+ * Once the budget's limit is reached tryCharge() fails, and the queue drops
+ * the message as it would on overflow.
+ *
+ * What is counted: shared payload bytes, the part that grows with message
+ * size. Short messages live inline in queue slots and entries, which each
+ * queue bounds by count, so they are never refused for memory. A payload
+ * held by several queues counts in each of them.
+ *
+ * No JUCE dependency.
+ */
+
+#pragma once
+
+#include "MidiPacket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct MidiMemoryStats {
+    size_t bufferedBytes;
+    size_t peakBytes;
+    uint64_t rejected;   // Charges refused because the budget's limit was reached
+};
+
+/**
+ * MidiMemoryBudget - Cap on the bytes buffered by all accounts together
+ */
+class MidiMemoryBudget
+{
+public:
+    static constexpr size_t defaultLimitBytes = 256 * 1024 * 1024;
+
+    static MidiMemoryBudget& global() {
+        static MidiMemoryBudget budget;
+        return budget;
+    }
+
+    // 0 = no limit
+    void setLimit(size_t bytes) { limit.store(bytes, std::memory_order_relaxed); }
+    size_t getLimit() const { return limit.load(std::memory_order_relaxed); }
+
+    bool tryCharge(size_t bytes) {
+        size_t max = limit.load(std::memory_order_relaxed);
+        size_t total = buffered.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        if (max != 0 && total > max) {
+            buffered.fetch_sub(bytes, std::memory_order_relaxed);
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        raisePeak(peak, total);
+        return true;
+    }
+
+    // Ignores the limit, for bytes that are already held (see MidiMemoryAccount::charge)
+    void charge(size_t bytes) {
+        raisePeak(peak, buffered.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+
+    void release(size_t bytes) { buffered.fetch_sub(bytes, std::memory_order_relaxed); }
+
+    MidiMemoryStats getStats() const {
+        return {buffered.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+                rejected.load(std::memory_order_relaxed)};
+    }
+
+    static void raisePeak(std::atomic<size_t>& peakBytes, size_t total) {
+        size_t seen = peakBytes.load(std::memory_order_relaxed);
+        while (total > seen && !peakBytes.compare_exchange_weak(seen, total, std::memory_order_relaxed)) {}
+    }
+
+private:
+    std::atomic<size_t> limit{defaultLimitBytes};
+    std::atomic<size_t> buffered{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<uint64_t> rejected{0};
+};
+
+/**
+ * MidiMemoryAccount - Bytes buffered by one port or forwarder
+ *
+ * Thread-safe. Whatever is still charged when the account is destroyed is
+ * given back to the budget, so an owner doesn't have to drain its queues.
+ */
+class MidiMemoryAccount
+{
+public:
+    explicit MidiMemoryAccount(MidiMemoryBudget& budgetRef = MidiMemoryBudget::global())
+        : budget(budgetRef) {}
+
+    ~MidiMemoryAccount() { budget.release(buffered.load(std::memory_order_relaxed)); }
+
+    MidiMemoryAccount(const MidiMemoryAccount&) = delete;
+    MidiMemoryAccount& operator=(const MidiMemoryAccount&) = delete;
+
+    // Heap bytes a queued packet keeps alive beyond its slot
+    static size_t payloadBytes(const MidiPacket& packet) { return packet.isShared() ? packet.size() : 0; }
+
+    // False, with nothing charged, if the budget's limit would be exceeded
+    bool tryCharge(size_t bytes) {
+        if (bytes == 0) return true;
+        if (!budget.tryCharge(bytes)) {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        MidiMemoryBudget::raisePeak(peak, buffered.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+        return true;
+    }
+
+    // Charges past the limit, e.g. a SysEx re-queued after a failed send:
+    // its bytes never left memory, so refusing it would only lose the message
+    void charge(size_t bytes) {
+        if (bytes == 0) return;
+        budget.charge(bytes);
+        MidiMemoryBudget::raisePeak(peak, buffered.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+
+    void release(size_t bytes) {
+        if (bytes == 0) return;
+        buffered.fetch_sub(bytes, std::memory_order_relaxed);
+        budget.release(bytes);
+    }
+
+    MidiMemoryStats getStats() const {
+        return {buffered.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+                rejected.load(std::memory_order_relaxed)};
+    }
+
+private:
+    MidiMemoryBudget& budget;
+    std::atomic<size_t> buffered{0};
+    std::atomic<size_t> peak{0};
+    std::atomic<uint64_t> rejected{0};
+};
+
+/**
+ * MidiBufferPool - Recycled payload buffers shared by all ports and transports
+ *
+ * Keeps at most maxPooledBuffers buffers and maxPooledBytes of capacity, so
+ * one huge dump doesn't stay pinned in the pool.
+ */
+class MidiBufferPool : public std::enable_shared_from_this<MidiBufferPool>
+{
+public:
+    static constexpr size_t maxPooledBuffers = 64;
+    static constexpr size_t maxPooledBytes = 16 * 1024 * 1024;
+    static constexpr size_t minBufferBytes = 64;   // Capacity class 0; smaller buffers aren't kept
+
+    struct Stats {
+        size_t pooledBuffers;
+        size_t pooledBytes;
+        uint64_t reused;      // acquire() served from the pool
+        uint64_t allocated;   // acquire() that needed a new buffer
+    };
+
+    // The process-wide pool; packets keep it alive until they are released
+    static std::shared_ptr<MidiBufferPool> shared() {
+        static std::shared_ptr<MidiBufferPool> pool = std::make_shared<MidiBufferPool>();
+        return pool;
+    }
+
+    // An empty buffer with room for at least minCapacity bytes, left over
+    // from an earlier message if one of that size is pooled
+    std::unique_ptr<std::vector<uint8_t>> acquire(size_t minCapacity = 0) {
+        size_t first = classFor(minCapacity);
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            for (size_t sizeClass = first; sizeClass < classCount; sizeClass++) {
+                auto& free = buffers[sizeClass];
+                if (free.empty()) continue;
+                auto buffer = std::move(free.back());
+                free.pop_back();
+                pooledBuffers--;
+                pooledBytes -= buffer->capacity();
+                reused++;
+                if (buffer->capacity() < minCapacity) buffer->reserve(minCapacity);
+                return buffer;
+            }
+            allocated++;
+        }
+        auto buffer = std::make_unique<std::vector<uint8_t>>();
+        buffer->reserve(std::max(minCapacity, classBytes(first)));
+        return buffer;
+    }
+
+    // A packet that owns buffer and returns it here when the last copy is
+    // released; short messages are stored inline and the buffer comes back now
+    MidiPacket adopt(std::unique_ptr<std::vector<uint8_t>> buffer) {
+        if (buffer->size() <= MidiPacket::inlineCapacity) {
+            MidiPacket packet(buffer->data(), buffer->size());
+            release(std::move(buffer));
+            return packet;
+        }
+        auto pool = shared_from_this();
+        std::shared_ptr<const std::vector<uint8_t>> storage(
+            buffer.release(), [pool](const std::vector<uint8_t>* bytes) {
+                pool->release(std::unique_ptr<std::vector<uint8_t>>(const_cast<std::vector<uint8_t>*>(bytes)));
+            });
+        return MidiPacket(std::move(storage));
+    }
+
+    // A packet holding a copy of bytes, in a pooled buffer if it doesn't fit inline
+    MidiPacket copy(const uint8_t* bytes, size_t size) {
+        if (size <= MidiPacket::inlineCapacity) return MidiPacket(bytes, size);
+        auto buffer = acquire(size);
+        buffer->assign(bytes, bytes + size);
+        return adopt(std::move(buffer));
+    }
+
+    void release(std::unique_ptr<std::vector<uint8_t>> buffer) {
+        size_t capacity = buffer->capacity();
+        if (capacity < minBufferBytes) return;
+        buffer->clear();
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (pooledBuffers >= maxPooledBuffers || pooledBytes + capacity > maxPooledBytes) return;
+        // Filed under the largest class it can serve in full
+        size_t sizeClass = classFor(capacity);
+        if (sizeClass > 0 && classBytes(sizeClass) > capacity) sizeClass--;
+        buffers[sizeClass].push_back(std::move(buffer));
+        pooledBuffers++;
+        pooledBytes += capacity;
+    }
+
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        return {pooledBuffers, pooledBytes, reused, allocated};
+    }
+
+private:
+    // 64 bytes up to 16 MB; bigger buffers share the last class
+    static constexpr size_t classCount = 19;
+
+    static size_t classBytes(size_t sizeClass) { return minBufferBytes << sizeClass; }
+
+    // Smallest class whose buffers hold bytes
+    static size_t classFor(size_t bytes) {
+        size_t sizeClass = 0;
+        while (sizeClass + 1 < classCount && classBytes(sizeClass) < bytes) sizeClass++;
+        return sizeClass;
+    }
+
+    std::mutex poolMutex;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> buffers[classCount];
+    size_t pooledBuffers = 0;
+    size_t pooledBytes = 0;
+    uint64_t reused = 0;
+    uint64_t allocated = 0;
+};
@@ -0,0 +1,299 @@
+/**
+ * MidiMessageQueue - Bounded lock-free queue for incoming MIDI messages
+ *
+ * Replaces the mutex-protected std::queue in MidiPort/VirtualMidiPort:
+ * - Fixed number of slots allocated up front; short messages stored inline
+ *   (MidiPacket), so queuing them never allocates
+ * - SysEx payloads stay in their shared MidiPacket storage, capped by total
+ *   pending bytes, and are charged to the owning port's MidiMemoryAccount
+ * - Configurable overflow policy with dropped-message counters
+ *
+ * The ring is a bounded MPMC queue (per-slot sequence numbers), so the MIDI
+ * callback, routing threads and HTTP pollers never share a lock. Several
+ * routes may feed one virtual output and several HTTP requests may poll one
+ * port, so single-producer/single-consumer is not assumed.
+ *
+ * Consumers may block in waitForMessages() (long-poll / streaming). Producers
+ * only touch the wait mutex when a consumer is actually waiting.
+ */
+
+#pragma once
+
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class QueueOverflowPolicy {
+    DropOldest,   // Discard the oldest queued message to make room
+    DropNewest,   // Discard the incoming message
+    Report        // Discard the incoming message and report drops on the next poll
+};
+
+struct MidiQueueConfig {
+    // Upper bounds for the settings clients may choose: slots are allocated
+    // up front, and SysEx bytes count against the server's memory
+    static constexpr size_t maxCapacity = 65536;
+    static constexpr size_t maxSysExBytesLimit = 256 * 1024 * 1024;
+
+    size_t capacity = 1024;                    // Slots; rounded up to a power of two
+    QueueOverflowPolicy overflowPolicy = QueueOverflowPolicy::DropOldest;
+    size_t maxSysExBytes = 4 * 1024 * 1024;   // Total SysEx bytes waiting in the queue
+};
+
+struct MidiQueueStats {
+    size_t depth;
+    size_t capacity;
+    size_t sysexBytes;
+    uint64_t dropped;         // All dropped messages, including SysEx
+    uint64_t droppedSysEx;    // SysEx dropped because maxSysExBytes was exceeded
+    uint64_t droppedOverBudget;   // SysEx dropped because the memory budget was exhausted
+    size_t reservedBytes;     // Slots allocated up front
+    QueueOverflowPolicy overflowPolicy;
+};
+
+inline const char* overflowPolicyName(QueueOverflowPolicy policy) {
+    switch (policy) {
+        case QueueOverflowPolicy::DropOldest: return "drop-oldest";
+        case QueueOverflowPolicy::DropNewest: return "drop-newest";
+        case QueueOverflowPolicy::Report: return "report";
+    }
+    return "drop-oldest";
+}
+
+inline bool parseOverflowPolicy(const std::string& name, QueueOverflowPolicy& policy) {
+    if (name == "drop-oldest") policy = QueueOverflowPolicy::DropOldest;
+    else if (name == "drop-newest") policy = QueueOverflowPolicy::DropNewest;
+    else if (name == "report") policy = QueueOverflowPolicy::Report;
+    else return false;
+    return true;
+}
+
+class MidiMessageQueue
+{
+public:
+    // account: charged for shared payloads while they are queued; nullptr = not counted
+    explicit MidiMessageQueue(const MidiQueueConfig& cfg = MidiQueueConfig(),
+                              MidiMemoryAccount* memoryAccount = nullptr)
+        : config(cfg), mask(roundUpToPowerOfTwo(std::min(cfg.capacity, MidiQueueConfig::maxCapacity)) - 1),
+          cells(new Cell[mask + 1]), account(memoryAccount) {
+        config.capacity = mask + 1;
+        for (size_t i = 0; i <= mask; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MidiMessageQueue(const MidiMessageQueue&) = delete;
+    MidiMessageQueue& operator=(const MidiMessageQueue&) = delete;
+
+    // Producer side: never blocks or allocates. Shared (SysEx) payloads are
+    // referenced, not copied.
+    void push(const MidiPacket& packet) {
+        if (packet.empty()) return;
+
+        if (packet.isShared()) {
+            size_t size = packet.size();
+            if (sysexBytes.fetch_add(size, std::memory_order_relaxed) + size > config.maxSysExBytes) {
+                sysexBytes.fetch_sub(size, std::memory_order_relaxed);
+                droppedSysEx.fetch_add(1, std::memory_order_relaxed);
+                recordDrop();
+                return;
+            }
+            if (account && !account->tryCharge(size)) {
+                sysexBytes.fetch_sub(size, std::memory_order_relaxed);
+                droppedOverBudget.fetch_add(1, std::memory_order_relaxed);
+                recordDrop();
+                return;
+            }
+        }
+
+        if (tryPush(packet)) {
+            notifyWaiters();
+            return;
+        }
+
+        if (config.overflowPolicy == QueueOverflowPolicy::DropOldest) {
+            // Make room by discarding from the head; retry a bounded number
+            // of times in case other producers refill the freed slot first.
+            for (int attempt = 0; attempt < 4; attempt++) {
+                MidiPacket oldest;
+                if (tryPop(oldest)) {
+                    release(oldest);
+                    recordDrop();
+                }
+                if (tryPush(packet)) {
+                    notifyWaiters();
+                    return;
+                }
+            }
+        }
+
+        release(packet);
+        recordDrop();
+    }
+
+    // Consumer side: removes and returns everything currently queued, oldest first.
+    std::vector<MidiPacket> drain() {
+        std::vector<MidiPacket> result;
+        MidiPacket packet;
+        while (tryPop(packet)) {
+            release(packet);
+            result.push_back(std::move(packet));
+        }
+        return result;
+    }
+
+    bool hasMessages() const {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    // Blocks until a message is queued, the timeout elapses or interruptWaiters()
+    // is called. Returns true if messages are available.
+    bool waitForMessages(std::chrono::milliseconds timeout) {
+        if (hasMessages()) return true;
+
+        std::unique_lock<std::mutex> lock(waitMutex);
+        waiters.fetch_add(1, std::memory_order_relaxed);
+        // Pairs with the fence in notifyWaiters(): either the producer sees
+        // our waiter count or we see its message
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        waitCv.wait_for(lock, timeout, [this] {
+            return hasMessages() || interrupted.load(std::memory_order_relaxed);
+        });
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+        return hasMessages();
+    }
+
+    // Wakes all waiting consumers permanently (port closing / server stopping)
+    void interruptWaiters() {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        interrupted = true;
+        waitCv.notify_all();
+    }
+
+    bool isInterrupted() const { return interrupted.load(std::memory_order_relaxed); }
+
+    // Number of messages dropped since the previous call (used by the Report policy)
+    uint64_t takeDroppedSinceLastPoll() {
+        return droppedSincePoll.exchange(0, std::memory_order_relaxed);
+    }
+
+    QueueOverflowPolicy getOverflowPolicy() const { return config.overflowPolicy; }
+
+    MidiQueueStats getStats() const {
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        MidiQueueStats stats;
+        stats.depth = tail >= head ? tail - head : 0;
+        stats.capacity = config.capacity;
+        stats.sysexBytes = sysexBytes.load(std::memory_order_relaxed);
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+        stats.droppedSysEx = droppedSysEx.load(std::memory_order_relaxed);
+        stats.droppedOverBudget = droppedOverBudget.load(std::memory_order_relaxed);
+        stats.reservedBytes = config.capacity * sizeof(Cell);
+        stats.overflowPolicy = config.overflowPolicy;
+        return stats;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        MidiPacket packet;
+    };
+
+    bool tryPush(const MidiPacket& packet) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.packet = packet;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(MidiPacket& out) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.packet);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns a shared payload's bytes to the SysEx cap and the memory account
+    void release(const MidiPacket& packet) {
+        if (packet.isShared()) {
+            sysexBytes.fetch_sub(packet.size(), std::memory_order_relaxed);
+            if (account) account->release(packet.size());
+        }
+    }
+
+    void notifyWaiters() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            waitCv.notify_all();
+        }
+    }
+
+    void recordDrop() {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        droppedSincePoll.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        size_t result = 2;
+        while (result < n) result <<= 1;
+        return result;
+    }
+
+    MidiQueueConfig config;
+    size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    MidiMemoryAccount* account;
+
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+
+    std::atomic<size_t> sysexBytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> droppedSysEx{0};
+    std::atomic<uint64_t> droppedOverBudget{0};
+    std::atomic<uint64_t> droppedSincePoll{0};
+
+    std::mutex waitMutex;
+    std::condition_variable waitCv;
+    std::atomic<int> waiters{0};
+    std::atomic<bool> interrupted{false};
+};
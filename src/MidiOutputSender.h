@@ -0,0 +1,224 @@
+/**
+ * MidiOutputSender - Dedicated sender thread for one MIDI output
+ *
+ * In async output mode MidiPort hands outgoing messages to this queue and
+ * returns immediately, so a slow interface never blocks the JUCE input
+ * callback (routed traffic) or an HTTP worker.
+ *
+ * Ordering on the sender thread:
+ * - System realtime messages (clock, start/stop, ...) go first, and are also
+ *   sent between the chunks of a SysEx dump in progress (legal on the wire)
+ * - Other short messages go ahead of SysEx that hasn't started yet, but wait
+ *   while a SysEx dump is mid-transfer
+ * - SysEx is sent in order, optionally split into sysexChunkBytes pieces with
+ *   sysexChunkDelay between them for hardware that needs pacing
+ * - A SysEx routed in fragments (streaming inputs) counts as mid-transfer
+ *   from its first fragment to the one ending in 0xF7; if the rest doesn't
+ *   arrive within maxSysExGap, short messages are let through again
+ *
+ * No JUCE dependency: bytes are handed to the emit callback.
+ */
+
+#pragma once
+
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Whether the OS MIDI output can be handed a SysEx in several sends.
+// CoreMIDI passes the bytes through as they are. The ALSA and WinMM outputs
+// take every send as a message of its own, so a piece without its 0xF0 or
+// 0xF7 is dropped or sent as garbage there.
+#if defined(__APPLE__)
+constexpr bool midiOutputTakesSysExInPieces = true;
+#else
+constexpr bool midiOutputTakesSysExInPieces = false;
+#endif
+
+struct MidiOutputConfig {
+    // Highest accepted chunk delay: short messages wait while a dump is open
+    static constexpr std::chrono::microseconds maxSysExChunkDelay{1000000};
+
+    bool async = false;                         // Send on a dedicated thread
+    size_t sysexChunkBytes = 0;                 // 0 = send SysEx in one piece
+    std::chrono::microseconds sysexChunkDelay{0};
+    size_t maxPendingMessages = 1024;           // Short messages waiting to be sent
+    size_t maxPendingSysExBytes = 4 * 1024 * 1024;
+};
+
+struct MidiOutputStats {
+    size_t pendingMessages;
+    size_t pendingSysExBytes;
+    uint64_t sent;
+    uint64_t dropped;
+};
+
+class MidiOutputSender
+{
+public:
+    static constexpr std::chrono::milliseconds maxSysExGap{1000};
+
+    // Called on the sender thread with a complete short message or one SysEx chunk
+    using EmitFunction = std::function<void(const uint8_t* data, size_t size)>;
+
+    // account: charged for queued SysEx payloads; nullptr = not counted
+    MidiOutputSender(EmitFunction emitFn, const MidiOutputConfig& cfg, MidiMemoryAccount* memoryAccount = nullptr)
+        : emit(std::move(emitFn)), config(cfg), account(memoryAccount) {
+        workerThread = std::thread([this]() { run(); });
+    }
+
+    // Pending messages are discarded; a SysEx dump in progress is cut short
+    // after its current chunk
+    ~MidiOutputSender() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            running = false;
+        }
+        cv.notify_one();
+        if (workerThread.joinable()) workerThread.join();
+        if (account) {
+            for (const auto& sysex : sysexQueue) account->release(MidiMemoryAccount::payloadBytes(sysex));
+        }
+    }
+
+    MidiOutputSender(const MidiOutputSender&) = delete;
+    MidiOutputSender& operator=(const MidiOutputSender&) = delete;
+
+    // Thread-safe, never blocks on the device. Expects a validated message.
+    // Returns false if it was dropped because the queue is full.
+    bool send(const MidiPacket& packet) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (packet.isSysEx() || packet.isPartialSysEx()) {
+                if (pendingSysExBytes + packet.size() > config.maxPendingSysExBytes ||
+                    (account && !account->tryCharge(MidiMemoryAccount::payloadBytes(packet)))) {
+                    dropped++;
+                    return false;
+                }
+                pendingSysExBytes += packet.size();
+                sysexQueue.push_back(packet);
+            } else {
+                if (realtimeQueue.size() + shortQueue.size() >= config.maxPendingMessages) {
+                    dropped++;
+                    return false;
+                }
+                (isRealtime(packet) ? realtimeQueue : shortQueue).push_back(packet);
+            }
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    MidiOutputStats getStats() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        MidiOutputStats stats;
+        stats.pendingMessages = realtimeQueue.size() + shortQueue.size() + sysexQueue.size();
+        stats.pendingSysExBytes = pendingSysExBytes;
+        stats.sent = sent;
+        stats.dropped = dropped;
+        return stats;
+    }
+
+private:
+    static bool isRealtime(const MidiPacket& packet) {
+        return packet.size() == 1 && packet[0] >= 0xF8;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        bool sysexOpen = false;   // Sent a SysEx fragment without its 0xF7 yet
+        while (true) {
+            auto ready = [this, &sysexOpen] {
+                return !running || !realtimeQueue.empty() || !sysexQueue.empty() ||
+                       (!sysexOpen && !shortQueue.empty());
+            };
+            if (!sysexOpen) {
+                cv.wait(lock, ready);
+            } else if (!cv.wait_for(lock, maxSysExGap, ready)) {
+                sysexOpen = false;   // The rest never came
+                continue;
+            }
+            if (!running) return;
+
+            sendRealtimeUnlocked(lock);
+
+            // Short messages overtake SysEx that hasn't started
+            while (!sysexOpen && !shortQueue.empty() && running) {
+                MidiPacket packet = std::move(shortQueue.front());
+                shortQueue.pop_front();
+                emitUnlocked(lock, packet.data(), packet.size());
+                sent++;
+                sendRealtimeUnlocked(lock);
+            }
+
+            if (!sysexQueue.empty() && running) {
+                MidiPacket sysex = std::move(sysexQueue.front());
+                sysexQueue.pop_front();
+                if (sendSysExUnlocked(lock, sysex)) sent++;
+                pendingSysExBytes -= sysex.size();
+                if (account) account->release(MidiMemoryAccount::payloadBytes(sysex));
+                sysexOpen = sysex.back() != 0xF7;
+            }
+        }
+    }
+
+    // Returns false if shutdown cut the dump short
+    bool sendSysExUnlocked(std::unique_lock<std::mutex>& lock, const MidiPacket& sysex) {
+        size_t chunk = config.sysexChunkBytes > 0 ? config.sysexChunkBytes : sysex.size();
+        for (size_t offset = 0; offset < sysex.size(); offset += chunk) {
+            if (!running) return false;
+            size_t length = std::min(chunk, sysex.size() - offset);
+            emitUnlocked(lock, sysex.data() + offset, length);
+            if (offset + length >= sysex.size()) break;
+
+            // Pace the next chunk; realtime messages arriving meanwhile go out now
+            auto deadline = std::chrono::steady_clock::now() + config.sysexChunkDelay;
+            while (running) {
+                sendRealtimeUnlocked(lock);
+                if (!cv.wait_until(lock, deadline, [this] { return !running || !realtimeQueue.empty(); })) break;
+            }
+        }
+        return true;
+    }
+
+    void sendRealtimeUnlocked(std::unique_lock<std::mutex>& lock) {
+        while (!realtimeQueue.empty() && running) {
+            MidiPacket packet = std::move(realtimeQueue.front());
+            realtimeQueue.pop_front();
+            emitUnlocked(lock, packet.data(), packet.size());
+            sent++;
+        }
+    }
+
+    // Emits without holding queueMutex so producers never wait on the device
+    void emitUnlocked(std::unique_lock<std::mutex>& lock, const uint8_t* data, size_t size) {
+        lock.unlock();
+        emit(data, size);
+        lock.lock();
+    }
+
+    EmitFunction emit;
+    MidiOutputConfig config;
+    MidiMemoryAccount* account;
+
+    std::deque<MidiPacket> realtimeQueue;
+    std::deque<MidiPacket> shortQueue;
+    std::deque<MidiPacket> sysexQueue;
+    size_t pendingSysExBytes = 0;
+    uint64_t sent = 0;
+    uint64_t dropped = 0;
+    bool running = true;
+
+    std::mutex queueMutex;
+    std::condition_variable cv;
+    std::thread workerThread;
+};
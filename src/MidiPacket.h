@@ -0,0 +1,116 @@
+/**
+ * MidiPacket - Small-buffer MIDI message shared across the routing hot path
+ *
+ * - Messages up to inlineCapacity bytes (all channel/system messages and short
+ *   SysEx) are stored inline: constructing or copying them never allocates
+ * - Longer messages (SysEx) live in immutable ref-counted storage, so copies
+ *   for queues and fan-out routes share one payload instead of duplicating it
+ *
+ * No JUCE dependency; used by MidiPort, VirtualMidiPort and RouteManager.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+class MidiPacket
+{
+public:
+    static constexpr size_t inlineCapacity = 12;
+
+    MidiPacket() = default;
+
+    MidiPacket(const uint8_t* bytes, size_t size) : length((uint32_t)size) {
+        if (size <= inlineCapacity) {
+            if (size > 0) std::memcpy(inlineBytes, bytes, size);
+        } else {
+            shared = std::make_shared<const std::vector<uint8_t>>(bytes, bytes + size);
+        }
+    }
+
+    MidiPacket(std::initializer_list<uint8_t> bytes)
+        : MidiPacket(bytes.begin(), bytes.size()) {}
+
+    explicit MidiPacket(const std::vector<uint8_t>& bytes)
+        : MidiPacket(bytes.data(), bytes.size()) {}
+
+    // Takes ownership of the buffer without copying when it needs shared storage
+    explicit MidiPacket(std::vector<uint8_t>&& bytes) : length((uint32_t)bytes.size()) {
+        if (bytes.size() <= inlineCapacity) {
+            if (!bytes.empty()) std::memcpy(inlineBytes, bytes.data(), bytes.size());
+        } else {
+            shared = std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
+        }
+    }
+
+    // Adopts storage that may have its own deleter (e.g. a pooled buffer)
+    explicit MidiPacket(std::shared_ptr<const std::vector<uint8_t>> storage)
+        : length((uint32_t)storage->size()) {
+        if (storage->size() <= inlineCapacity) {
+            if (!storage->empty()) std::memcpy(inlineBytes, storage->data(), storage->size());
+        } else {
+            shared = std::move(storage);
+        }
+    }
+
+    MidiPacket(const MidiPacket&) = default;
+    MidiPacket& operator=(const MidiPacket&) = default;
+
+    // Moved-from packets are left empty
+    MidiPacket(MidiPacket&& other) noexcept
+        : shared(std::move(other.shared)), length(other.length) {
+        std::memcpy(inlineBytes, other.inlineBytes, inlineCapacity);
+        other.length = 0;
+    }
+
+    MidiPacket& operator=(MidiPacket&& other) noexcept {
+        if (this != &other) {
+            shared = std::move(other.shared);
+            length = other.length;
+            std::memcpy(inlineBytes, other.inlineBytes, inlineCapacity);
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    const uint8_t* data() const { return shared ? shared->data() : inlineBytes; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    const uint8_t* begin() const { return data(); }
+    const uint8_t* end() const { return data() + length; }
+    uint8_t operator[](size_t i) const { return data()[i]; }
+    uint8_t front() const { return data()[0]; }
+    uint8_t back() const { return data()[length - 1]; }
+
+    bool isSysEx() const { return length > 0 && front() == 0xF0; }
+
+    // One fragment of a SysEx routed in parts (streaming inputs): the first,
+    // 0xF0 without the closing 0xF7, or data bytes that continue one,
+    // optionally ending in 0xF7
+    bool isPartialSysEx() const {
+        if (length == 0) return false;
+        const uint8_t* bytes = data();
+        size_t start = bytes[0] == 0xF0 ? 1 : 0;
+        for (size_t i = start; i < length; i++) {
+            if (bytes[i] < 0x80) continue;
+            if (bytes[i] != 0xF7 || i + 1 != length || start == 1) return false;
+        }
+        return true;
+    }
+
+    // True when the payload lives in shared storage (heap) rather than inline
+    bool isShared() const { return shared != nullptr; }
+
+    std::vector<uint8_t> toVector() const { return std::vector<uint8_t>(begin(), end()); }
+
+private:
+    std::shared_ptr<const std::vector<uint8_t>> shared;
+    uint32_t length = 0;
+    uint8_t inlineBytes[inlineCapacity] = {};
+};
@@ -2,34 +2,57 @@
  * MidiPort - Thread-safe MIDI port abstraction
  *
  * Wraps JUCE MIDI input/output with:
- * - Thread-safe message queuing for incoming messages
- * - SysEx fragment buffering (handles split messages)
- * - Simple send API for outgoing messages
+ * - Bounded lock-free message queuing for incoming messages
+ * - SysEx fragment buffering (handles split messages), capped and pooled,
+ *   optionally streaming fragments to routes as they arrive (MidiSysExAssembler)
+ * - Simple send API for outgoing messages, optionally on a dedicated sender
+ *   thread with SysEx pacing (MidiOutputSender)
  * - Callback support for native routing
+ * - disconnect()/reconnect() for devices that are unplugged and come back
  */
 
 #pragma once
 
 #include <juce_audio_devices/juce_audio_devices.h>
 
+#include "Metrics.h"
+#include "MidiDeviceRegistry.h"
+#include "MidiMessageQueue.h"
+#include "MidiOutputSender.h"
+#include "MidiPacket.h"
+#include "MidiSysExAssembler.h"
+
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <vector>
 
 // Callback type for message routing
 using MidiMessageCallback = std::function<void(const std::string& portId,
-                                               const std::vector<uint8_t>& data)>;
+                                               const MidiPacket& data,
+                                               MidiInputPart part)>;
 
 class MidiPort : public juce::MidiInputCallback
 {
 public:
-    MidiPort(const std::string& id, const std::string& name, bool isInput)
-        : portId(id), portName(name), isInputPort(isInput) {}
+    MidiPort(const std::string& id, const std::string& name, bool isInput,
+             const MidiQueueConfig& queueConfig = MidiQueueConfig(),
+             const MidiOutputConfig& outputCfg = MidiOutputConfig(),
+             const MidiSysExConfig& sysexConfig = MidiSysExConfig())
+        : portId(id), portName(name), isInputPort(isInput), messageQueue(queueConfig, &memoryAccount),
+          outputConfig(outputCfg), sysexAssembler(sysexConfig, &memoryAccount) {
+        if (outputConfig.sysexChunkBytes > 0 && !midiOutputTakesSysExInPieces) {
+            // Each chunk would go out as a message of its own and be mangled
+            std::cerr << "Warning: sysexChunkBytes is only supported on macOS; " << portName
+                      << " sends SysEx in one piece\n";
+            outputConfig.sysexChunkBytes = 0;
+        }
+    }
 
     // Set callback for incoming messages (for routing)
     void setMessageCallback(MidiMessageCallback callback) {
@@ -39,172 +62,241 @@ public:
 
     const std::string& getPortId() const { return portId; }
 
+    // The name or identifier the port was opened with
+    const std::string& getPortName() const { return portName; }
+
+    bool isInput() const { return isInputPort; }
+
     ~MidiPort() override { close(); }
 
-    bool open() {
-        if (isInputPort) {
-            auto devices = juce::MidiInput::getAvailableDevices();
-            for (const auto& device : devices) {
-                if (device.name.toStdString().find(portName) != std::string::npos) {
-                    input = juce::MidiInput::openDevice(device.identifier, this);
-                    if (input) {
-                        input->start();
-                        return true;
-                    }
-                }
-            }
-        } else {
-            auto devices = juce::MidiOutput::getAvailableDevices();
-            for (const auto& device : devices) {
-                if (device.name.toStdString().find(portName) != std::string::npos) {
-                    output = juce::MidiOutput::openDevice(device.identifier);
-                    return output != nullptr;
-                }
-            }
+    // Opens the device matching portName in a cached device list (see
+    // MidiDeviceList::resolve); no enumeration happens here
+    bool open(const MidiDeviceSnapshot& devices) {
+        std::lock_guard<std::mutex> lock(deviceMutex);
+        if (!attachDeviceUnlocked(devices)) return false;
+        if (!isInputPort && outputConfig.async) {
+            sender = std::make_unique<MidiOutputSender>(
+                [this](const uint8_t* bytes, size_t size) { emitNow(bytes, size); },
+                outputConfig, &memoryAccount);
         }
-        return false;
+        return true;
     }
 
     void close() {
+        std::lock_guard<std::mutex> lock(deviceMutex);
+        connected.store(false, std::memory_order_release);
+        if (input) {
+            input->stop();
+            input.reset();
+        }
+        sender.reset();  // Joins the sender thread before the device goes away
+        std::lock_guard<std::mutex> sendLock(sendMutex);
+        output.reset();
+    }
+
+    // The device was unplugged: releases it but keeps the port, its queue,
+    // routing callback and sender thread, so reconnect() resumes in place.
+    // Messages sent while disconnected are dropped.
+    void disconnect() {
+        std::lock_guard<std::mutex> lock(deviceMutex);
+        connected.store(false, std::memory_order_release);
         if (input) {
             input->stop();
             input.reset();
         }
+        // No input callbacks run after stop(), so a half-received SysEx is discarded here
+        sysexAssembler.reset();
+        std::lock_guard<std::mutex> sendLock(sendMutex);
         output.reset();
     }
 
-    void sendMessage(const std::vector<uint8_t>& data) {
-        if (!output) return;
+    // Reopens the device after disconnect(); false if it isn't back yet
+    bool reconnect(const MidiDeviceSnapshot& devices) {
+        std::lock_guard<std::mutex> lock(deviceMutex);
+        if (connected.load(std::memory_order_acquire)) return true;
+        return attachDeviceUnlocked(devices);
+    }
+
+    bool isConnected() const { return connected.load(std::memory_order_acquire); }
+
+    // Identifier of the device last opened, so a removal can be matched to this port
+    std::string getDeviceIdentifier() const {
+        std::lock_guard<std::mutex> lock(deviceMutex);
+        return deviceIdentifier;
+    }
+
+    // Thread-safe: routing threads and HTTP handlers may send concurrently.
+    // Only senders to this port contend for sendMutex. In async mode the
+    // message is queued for the sender thread and this returns immediately.
+    // Returns false if the message was refused: invalid, port disconnected,
+    // or the async queue full.
+    bool sendMessage(const MidiPacket& data) {
+        if (!connected.load(std::memory_order_acquire)) return false;
 
         if (data.empty()) {
             std::cerr << "Warning: Attempted to send empty MIDI message\n";
-            return;
+            return false;
         }
 
         if (data[0] == 0xF0) {
             // SysEx message - validate it ends with 0xF7
             if (data.back() != 0xF7) {
                 std::cerr << "Warning: Invalid SysEx message (missing 0xF7)\n";
-                return;
+                return false;
             }
 
-            // createSysExMessage expects data WITHOUT F0/F7 wrappers
-            if (data.size() > 2) {
-                output->sendMessageNow(
-                    juce::MidiMessage::createSysExMessage(
-                        data.data() + 1,      // Skip F0
-                        (int)data.size() - 2  // Exclude F0 and F7
-                    )
-                );
-            }
-        } else if (data.size() >= 1 && data.size() <= 3) {
-            // Valid short MIDI message (1-3 bytes)
-            output->sendMessageNow(
-                juce::MidiMessage(data.data(), (int)data.size())
-            );
-        } else {
+            if (data.size() <= 2) return true;
+        } else if (data.size() > 3) {
             std::cerr << "Warning: Invalid MIDI message length: " << data.size() << " bytes\n";
+            return false;
         }
+
+        return deliver(data);
     }
 
-    std::vector<std::vector<uint8_t>> getMessages() {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        std::vector<std::vector<uint8_t>> result;
-        while (!messageQueue.empty()) {
-            result.push_back(messageQueue.front());
-            messageQueue.pop();
+    // One piece of a SysEx routed from a streaming input (see
+    // MidiPacket::isPartialSysEx), which sendMessage refuses as incomplete.
+    // Only RouteManager's streaming path sends these.
+    bool sendFragment(const MidiPacket& data) {
+        if (!connected.load(std::memory_order_acquire)) return false;
+        if (!data.isPartialSysEx()) {
+            std::cerr << "Warning: Invalid SysEx fragment (" << data.size() << " bytes)\n";
+            return false;
         }
-        return result;
+        return deliver(data);
+    }
+
+    bool isAsyncOutput() const { return sender != nullptr; }
+
+    MidiOutputStats getOutputStats() const {
+        return sender ? sender->getStats() : MidiOutputStats{0, 0, 0, 0};
+    }
+
+    std::vector<MidiPacket> getMessages() {
+        return messageQueue.drain();
     }
 
+    // Messages dropped since the last poll (reported only under the Report policy)
+    uint64_t takeDroppedSinceLastPoll() { return messageQueue.takeDroppedSinceLastPoll(); }
+
+    QueueOverflowPolicy getOverflowPolicy() const { return messageQueue.getOverflowPolicy(); }
+
+    MidiQueueStats getQueueStats() const { return messageQueue.getStats(); }
+
+    MidiSysExStats getSysExStats() const { return sysexAssembler.getStats(); }
+
+    MidiMemoryStats getMemoryStats() const { return memoryAccount.getStats(); }
+
+    const PortMetrics& getMetrics() const { return metrics; }
+
+    // Blocks an HTTP thread until messages arrive (long-poll / streaming)
+    bool waitForMessages(std::chrono::milliseconds timeout) {
+        return messageQueue.waitForMessages(timeout);
+    }
+
+    // Releases any waiting pollers; called when the port is being removed
+    void interruptWaiters() { messageQueue.interruptWaiters(); }
+
+    bool isInterrupted() const { return messageQueue.isInterrupted(); }
+
     // MidiInputCallback interface
     void handleIncomingMidiMessage(juce::MidiInput* source,
                                    const juce::MidiMessage& message) override {
-        std::vector<uint8_t> data;
-        auto rawData = message.getRawData();
-        auto size = message.getRawDataSize();
+        // SysEx buffer state is only touched from the JUCE input callback thread;
+        // the queue itself is lock-free.
+        MidiPacket completedMessage;  // For queue and routing callback
+        MidiInputPart part;
+        if (!sysexAssembler.receive(message.getRawData(), (size_t)message.getRawDataSize(),
+                                    completedMessage, part, [this](const MidiPacket& chunk) {
+                                        route(chunk, MidiInputPart::SysExChunk);
+                                    })) {
+            return;
+        }
 
-        std::vector<uint8_t> completedMessage;  // For routing callback
+        // Queue for HTTP polling; SysEx payloads are shared with the routing path
+        metrics.recordIn(completedMessage.size());
+        messageQueue.push(completedMessage);
+        route(completedMessage, part);
+    }
 
+    // A SysEx still arriving; only used in streaming mode, where the bytes
+    // added since the last call are routed right away
+    void handlePartialSysexMessage(juce::MidiInput* source, const juce::uint8* messageData,
+                                   int numBytesSoFar, double timestamp) override {
+        sysexAssembler.receivePartial(messageData, (size_t)std::max(numBytesSoFar, 0),
+                                      [this](const MidiPacket& chunk) {
+                                          route(chunk, MidiInputPart::SysExChunk);
+                                      });
+    }
+
+private:
+    void route(const MidiPacket& packet, MidiInputPart part) {
+        MidiMessageCallback callback;
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
-
-            // Check if this is a SysEx fragment
-            bool startsWithF0 = (size > 0 && rawData[0] == 0xF0);
-            bool endsWithF7 = (size > 0 && rawData[size - 1] == 0xF7);
-            bool isSysExRelated = message.isSysEx() || startsWithF0 ||
-                                  (sysexBuffering && size > 0);
-
-            if (isSysExRelated) {
-                // Handle SysEx message or fragment
-                if (startsWithF0) {
-                    // Start of new SysEx - initialize buffer
-                    sysexBuffer.clear();
-                    sysexBuffer.insert(sysexBuffer.end(), rawData, rawData + size);
-                    sysexBuffering = true;
-
-                    // Check if it's a complete SysEx in one message
-                    if (endsWithF7) {
-                        messageQueue.push(sysexBuffer);
-                        completedMessage = sysexBuffer;
-                        sysexBuffer.clear();
-                        sysexBuffering = false;
-                    }
-                } else if (sysexBuffering) {
-                    // Continuation or end of SysEx
-                    sysexBuffer.insert(sysexBuffer.end(), rawData, rawData + size);
-
-                    if (endsWithF7) {
-                        // Complete SysEx received
-                        messageQueue.push(sysexBuffer);
-                        completedMessage = sysexBuffer;
-                        sysexBuffer.clear();
-                        sysexBuffering = false;
-                    }
-                    // Otherwise keep buffering
-                } else if (message.isSysEx()) {
-                    // JUCE already assembled complete SysEx
-                    auto sysexData = message.getSysExData();
-                    auto sysexSize = message.getSysExDataSize();
-                    data.push_back(0xF0);
-                    data.insert(data.end(), sysexData, sysexData + sysexSize);
-                    data.push_back(0xF7);
-                    messageQueue.push(data);
-                    completedMessage = data;
-                }
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            callback = messageCallback;
+        }
+        if (callback) {
+            callback(portId, packet, part);
+        }
+    }
+
+    // Opens the first device matching portName that will open
+    bool attachDeviceUnlocked(const MidiDeviceSnapshot& devices) {
+        for (const MidiDeviceEntry* device : devices.forDirection(isInputPort).resolveAll(portName)) {
+            if (isInputPort) {
+                input = juce::MidiInput::openDevice(device->identifier, this);
+                if (!input) continue;
+                input->start();
             } else {
-                // Regular MIDI message (non-SysEx)
-                data.insert(data.end(), rawData, rawData + size);
-                messageQueue.push(data);
-                completedMessage = data;
+                auto opened = juce::MidiOutput::openDevice(device->identifier);
+                if (!opened) continue;
+                std::lock_guard<std::mutex> sendLock(sendMutex);
+                output = std::move(opened);
             }
+            deviceIdentifier = device->identifier;
+            connected.store(true, std::memory_order_release);
+            return true;
         }
+        return false;
+    }
 
-        // Call routing callback if set (outside queue lock to avoid deadlock)
-        if (!completedMessage.empty()) {
-            MidiMessageCallback callback;
-            {
-                std::lock_guard<std::mutex> lock(callbackMutex);
-                callback = messageCallback;
-            }
-            if (callback) {
-                callback(portId, completedMessage);
-            }
+    // Sends a validated message, or queues it in async mode
+    bool deliver(const MidiPacket& data) {
+        metrics.recordOut(data.size());
+        if (sender) return sender->send(data);
+        emitNow(data.data(), data.size());
+        return true;
+    }
+
+    // Writes a short message, a whole SysEx or one SysEx chunk to the device.
+    // Built directly from the framed bytes: createSysExMessage would allocate
+    // an intermediate buffer just to re-add F0/F7. JUCE stores short messages inline.
+    void emitNow(const uint8_t* bytes, size_t size) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (output) {
+            output->sendMessageNow(juce::MidiMessage(bytes, (int)size));
         }
     }
 
-private:
     std::string portId;
     std::string portName;
     bool isInputPort;
+    // Device state; open/close/disconnect/reconnect are serialized by deviceMutex
+    mutable std::mutex deviceMutex;
     std::unique_ptr<juce::MidiInput> input;
     std::unique_ptr<juce::MidiOutput> output;
-    std::queue<std::vector<uint8_t>> messageQueue;
-    std::mutex queueMutex;
+    std::string deviceIdentifier;
+    std::atomic<bool> connected{false};
+    MidiMemoryAccount memoryAccount;   // Queues, async output and SysEx assembly
+    MidiMessageQueue messageQueue;
+    PortMetrics metrics;
+    std::mutex sendMutex;   // Serializes sendMessageNow calls on output
+    MidiOutputConfig outputConfig;
+    std::unique_ptr<MidiOutputSender> sender;   // Async output mode only
 
-    // SysEx buffering for fragmented messages
-    std::vector<uint8_t> sysexBuffer;
-    bool sysexBuffering = false;
+    // SysEx buffering for fragmented messages (input callback thread only)
+    MidiSysExAssembler sysexAssembler;
 
     // Callback for routing
     MidiMessageCallback messageCallback;
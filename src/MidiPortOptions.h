@@ -0,0 +1,123 @@
+/**
+ * MidiPortOptions - Optional settings in a POST /port/:id or /virtual/:id body
+ *
+ * {"name":"...","type":"output","queueCapacity":256,"overflowPolicy":"report",
+ *  "asyncOutput":true,"sysexChunkBytes":256,"sysexChunkDelayUs":2000,
+ *  "maxSysExMessageBytes":65536,"sysexStreaming":true}
+ *
+ * read() walks the body once with JsonReader and overwrites the settings it
+ * finds; the rest keep the values they had. Other members (name, type) and
+ * unknown keys are skipped whole, nested objects included, so an option is
+ * only taken from the top level. A size that isn't a positive integer or is
+ * above its limit, a negative or too long chunk delay, a flag that isn't a
+ * bool, an unknown policy name and a malformed body fail with a message for
+ * the 400 reply.
+ *
+ * No httplib or JUCE dependency, so it is tested on its own
+ * (midi-server-tests).
+ */
+
+#pragma once
+
+#include "JsonReader.h"
+#include "MidiMessageQueue.h"
+#include "MidiOutputSender.h"
+#include "MidiSysExAssembler.h"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+class MidiPortOptions
+{
+public:
+    MidiQueueConfig queue;
+    MidiOutputConfig output;   // Physical outputs only
+    MidiSysExConfig sysex;     // Inputs only
+
+    // Reads the options in body over the current settings; an empty body
+    // changes nothing. Returns false with error set if the body or a value
+    // is invalid.
+    bool read(const std::string& body, std::string& error) {
+        if (body.find_first_not_of(" \t\r\n") == std::string::npos) return true;
+
+        JsonReader reader(body);
+        std::string invalid;
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key == "queueCapacity") {
+                return readSize(reader, key, MidiQueueConfig::maxCapacity, queue.capacity, invalid);
+            }
+            if (key == "maxSysExBytes") {
+                return readSize(reader, key, MidiQueueConfig::maxSysExBytesLimit, queue.maxSysExBytes, invalid);
+            }
+            if (key == "overflowPolicy") return readPolicy(reader, invalid);
+            if (key == "asyncOutput") return readFlag(reader, key, output.async, invalid);
+            if (key == "sysexChunkBytes") return readChunkBytes(reader, invalid);
+            if (key == "sysexChunkDelayUs") return readChunkDelay(reader, invalid);
+            if (key == "maxSysExMessageBytes") {
+                return readSize(reader, key, MidiSysExConfig::maxMessageBytesLimit, sysex.maxMessageBytes, invalid);
+            }
+            if (key == "sysexStreaming") return readFlag(reader, key, sysex.streaming, invalid);
+            return reader.skipValue();
+        }) && reader.finish();
+        if (!parsed) error = invalid.empty() ? reader.error() : invalid;
+        return parsed;
+    }
+
+private:
+    // A positive integer no larger than limit
+    static bool readSize(JsonReader& reader, std::string_view key, size_t limit, size_t& out,
+                         std::string& invalid) {
+        long long value = 0;
+        if (!reader.readInteger(value) || value <= 0) {
+            invalid = std::string(key) + " must be a positive integer";
+            return false;
+        }
+        if ((unsigned long long)value > limit) {
+            invalid = std::string(key) + " must be at most " + std::to_string(limit);
+            return false;
+        }
+        out = (size_t)value;
+        return true;
+    }
+
+    static bool readFlag(JsonReader& reader, std::string_view key, bool& out, std::string& invalid) {
+        if (!reader.readBool(out)) {
+            invalid = std::string(key) + " must be true or false";
+            return false;
+        }
+        return true;
+    }
+
+    // 0 sends SysEx in one piece
+    bool readChunkBytes(JsonReader& reader, std::string& invalid) {
+        long long value = 0;
+        if (!reader.readInteger(value) || value < 0) {
+            invalid = "sysexChunkBytes must be a non-negative integer";
+            return false;
+        }
+        output.sysexChunkBytes = (size_t)value;
+        return true;
+    }
+
+    bool readChunkDelay(JsonReader& reader, std::string& invalid) {
+        const long long limit = MidiOutputConfig::maxSysExChunkDelay.count();
+        long long value = 0;
+        if (!reader.readInteger(value) || value < 0 || value > limit) {
+            invalid = "sysexChunkDelayUs must be an integer from 0 to " + std::to_string(limit);
+            return false;
+        }
+        output.sysexChunkDelay = std::chrono::microseconds(value);
+        return true;
+    }
+
+    bool readPolicy(JsonReader& reader, std::string& invalid) {
+        std::string name;
+        if (!reader.readString(name) || !parseOverflowPolicy(name, queue.overflowPolicy)) {
+            invalid = "overflowPolicy must be \"drop-oldest\", \"drop-newest\" or \"report\"";
+            return false;
+        }
+        return true;
+    }
+};
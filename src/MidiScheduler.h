@@ -0,0 +1,210 @@
+/**
+ * MidiScheduler - Releases timestamped messages to local ports at their due time
+ *
+ * Used for sends that carry a timestamp and for routes with a fixed latency.
+ * Delaying every message on a link by the same few milliseconds hides the
+ * network jitter in front of it: messages leave at capture time + latency
+ * rather than whenever they happened to arrive.
+ *
+ * One thread drains a min-heap ordered by due time (ties keep arrival order).
+ * It sleeps on a condition variable until shortly before the next due time,
+ * then yields until the exact moment, so release precision doesn't depend on
+ * the OS timer slack. Lateness (release time minus due time) is recorded per
+ * message for GET /metrics.
+ *
+ * Timestamps on the wire are Unix epoch microseconds. Cross-server latency
+ * routes therefore assume the hosts' clocks are synchronized (e.g. NTP).
+ *
+ * No JUCE dependency: messages are handed to the deliver callback by port id.
+ */
+
+#pragma once
+
+#include "Metrics.h"
+#include "MidiPacket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MidiSchedulerStats {
+    size_t pending;
+    uint64_t scheduled;
+    uint64_t released;
+    uint64_t dropped;
+    LatencyHistogram::Snapshot lateness;
+};
+
+class MidiScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Called on the scheduler thread with a route-style port id
+    // ("input-0", "virtual:abc123") when a message is due
+    using DeliverFunction = std::function<void(const std::string& portId, const MidiPacket& packet)>;
+
+    // Messages further ahead than this are refused
+    static constexpr std::chrono::milliseconds maxScheduleAhead{10000};
+    // Timestamps up to this far in the past are sent at once; older ones are
+    // refused (a clock that far off, or a corrupt value)
+    static constexpr std::chrono::milliseconds maxLateness{10000};
+
+    MidiScheduler(DeliverFunction deliverFn,
+                  size_t maxPendingMessages = 65536,
+                  std::chrono::microseconds spinWindow = std::chrono::microseconds(200))
+        : deliver(std::move(deliverFn)), maxPending(maxPendingMessages), spin(spinWindow) {
+        workerThread = std::thread([this]() { run(); });
+    }
+
+    // Pending messages are discarded
+    ~MidiScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            running = false;
+        }
+        cv.notify_one();
+        if (workerThread.joinable()) workerThread.join();
+    }
+
+    MidiScheduler(const MidiScheduler&) = delete;
+    MidiScheduler& operator=(const MidiScheduler&) = delete;
+
+    // Converts a Unix epoch timestamp (microseconds) to the local steady
+    // clock. Returns false for timestamps more than maxScheduleAhead ahead or
+    // maxLateness behind, which are checked before converting so an extreme
+    // value can't overflow into a due time in the past.
+    static bool fromUnixMicros(int64_t unixMicros, Clock::time_point& due) {
+        int64_t now = unixMicrosNow();
+        if (unixMicros > now + std::chrono::microseconds(maxScheduleAhead).count() ||
+            unixMicros < now - std::chrono::microseconds(maxLateness).count()) {
+            return false;
+        }
+        due = Clock::now() + std::chrono::microseconds(unixMicros - now);
+        return true;
+    }
+
+    static int64_t unixMicrosNow() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static bool isTooFarAhead(Clock::time_point due) {
+        return due > Clock::now() + maxScheduleAhead;
+    }
+
+    // schedule() for a Unix epoch timestamp; a timestamp fromUnixMicros()
+    // refuses counts as a drop
+    bool scheduleAt(int64_t unixMicros, const std::string& portId, const MidiPacket& packet) {
+        Clock::time_point due;
+        if (!fromUnixMicros(unixMicros, due)) {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            dropped++;
+            return false;
+        }
+        return schedule(due, portId, packet);
+    }
+
+    // Thread-safe. Delivers on the calling thread when the message is already
+    // due. Returns false (and counts a drop) if the queue is full or due is
+    // beyond maxScheduleAhead.
+    bool schedule(Clock::time_point due, const std::string& portId, const MidiPacket& packet) {
+        if (due <= Clock::now()) {
+            deliver(portId, packet);
+            return true;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (heap.size() >= maxPending || isTooFarAhead(due)) {
+                dropped++;
+                return false;
+            }
+            heap.push_back({due, nextSequence++, portId, packet});
+            std::push_heap(heap.begin(), heap.end(), later);
+            scheduled++;
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    MidiSchedulerStats getStats() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        MidiSchedulerStats stats;
+        stats.pending = heap.size();
+        stats.scheduled = scheduled;
+        stats.released = released;
+        stats.dropped = dropped;
+        stats.lateness = lateness.snapshot();
+        return stats;
+    }
+
+private:
+    struct Entry {
+        Clock::time_point due;
+        uint64_t sequence;
+        std::string portId;
+        MidiPacket packet;
+    };
+
+    // Heap comparator: the earliest (then first scheduled) entry is on top
+    static bool later(const Entry& a, const Entry& b) {
+        return a.due != b.due ? a.due > b.due : a.sequence > b.sequence;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        while (running) {
+            if (heap.empty()) {
+                cv.wait(lock, [this] { return !running || !heap.empty(); });
+                continue;
+            }
+
+            Clock::time_point due = heap.front().due;
+            if (due - Clock::now() > spin) {
+                // Re-checks on wake: a newer message may be due sooner
+                cv.wait_until(lock, due - spin);
+                continue;
+            }
+
+            // Within the spin window: yield until due without holding the lock
+            lock.unlock();
+            while (Clock::now() < due) std::this_thread::yield();
+            lock.lock();
+            if (!running || heap.empty() || heap.front().due > Clock::now()) continue;
+
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Entry entry = std::move(heap.back());
+            heap.pop_back();
+
+            lock.unlock();
+            lateness.recordSince(entry.due);
+            deliver(entry.portId, entry.packet);
+            lock.lock();
+            released++;
+        }
+    }
+
+    DeliverFunction deliver;
+    size_t maxPending;
+    std::chrono::microseconds spin;
+
+    std::vector<Entry> heap;
+    uint64_t nextSequence = 0;
+    uint64_t scheduled = 0;
+    uint64_t released = 0;
+    uint64_t dropped = 0;
+    bool running = true;
+
+    std::mutex queueMutex;
+    std::condition_variable cv;
+    std::thread workerThread;
+
+    LatencyHistogram lateness;   // Recorded by the worker thread
+};
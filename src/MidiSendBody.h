@@ -0,0 +1,81 @@
+/**
+ * MidiSendBody - Request bodies that carry one MIDI message
+ *
+ * POST /port/:id/send, /virtual/:id/send and /virtual/:id/inject take either
+ * {"message":[144,60,127]} with an optional "timestampUs", or, with
+ * Content-Type application/octet-stream, the raw MIDI bytes. readMessage()
+ * and readTimestamp() are also used for the elements of send-batch bodies.
+ *
+ * No httplib or JUCE dependency, so parsing is benchmarked on its own
+ * (midi-server-microbench).
+ */
+
+#pragma once
+
+#include "JsonReader.h"
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class MidiSendBody
+{
+public:
+    // Parses a /send or /inject body into message. With timestampUs, an
+    // optional "timestampUs" (Unix epoch µs) is read too.
+    static bool parse(const std::string& contentType, const std::string& body, MidiPacket& message,
+                      std::string& error, int64_t* timestampUs = nullptr) {
+        if (contentType.rfind("application/octet-stream", 0) == 0) {
+            message = MidiBufferPool::shared()->copy(reinterpret_cast<const uint8_t*>(body.data()), body.size());
+            return true;
+        }
+
+        JsonReader reader(body);
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key == "message") return readMessage(reader, message);
+            if (key == "timestampUs" && timestampUs) return readTimestamp(reader, *timestampUs);
+            return reader.skipValue();
+        }) && reader.finish();
+        if (!parsed) error = reader.error();
+        return parsed;
+    }
+
+    static bool readTimestamp(JsonReader& reader, int64_t& timestampUs) {
+        long long value = 0;
+        if (!reader.readInteger(value) || value < 0) return false;
+        timestampUs = value;
+        return true;
+    }
+
+    // Reads a byte array into message. Messages that fit MidiPacket's inline
+    // storage are parsed without allocating; longer SysEx spills into a
+    // MidiBufferPool buffer that the packet adopts.
+    static bool readMessage(JsonReader& reader, MidiPacket& message) {
+        uint8_t inlineBytes[MidiPacket::inlineCapacity];
+        size_t inlineCount = 0;
+        std::unique_ptr<std::vector<uint8_t>> spill;
+        bool parsed = reader.readByteArray([&](uint8_t byte) {
+            if (!spill && inlineCount < MidiPacket::inlineCapacity) {
+                inlineBytes[inlineCount++] = byte;
+                return;
+            }
+            if (!spill) {
+                spill = MidiBufferPool::shared()->acquire(256);
+                spill->assign(inlineBytes, inlineBytes + inlineCount);
+            }
+            spill->push_back(byte);
+        });
+        if (!parsed) {
+            if (spill) MidiBufferPool::shared()->release(std::move(spill));
+            return false;
+        }
+
+        message = spill ? MidiBufferPool::shared()->adopt(std::move(spill)) : MidiPacket(inlineBytes, inlineCount);
+        return true;
+    }
+};
@@ -0,0 +1,526 @@
+/**
+ * MidiStreamTransport - Persistent TCP stream between midi-server instances
+ *
+ * Used for routes whose destination serverUrl is "midi+tcp://host:port".
+ * Unlike the httplib request/response path, frames are pipelined: the sender
+ * never waits for a reply before writing the next frame, so throughput is not
+ * capped at one message per round-trip.
+ *
+ * Wire protocol (all integers big-endian):
+ *   client -> server, once:  "MIDS" | version (1 byte)
+ *   client -> server frames: u32 payloadLength | u64 sequence | payload
+ *   server -> client acks:   u64 sequence of the last frame delivered
+ *                            (a frame that doesn't decode is not acked)
+ *
+ * The payload is a MidiWireFormat batch body. Sequence numbers increase by one
+ * per frame for the lifetime of a client, so the receiver can log gaps (frames
+ * lost to a reconnect) and the sender can report how many frames are unacked.
+ *
+ * Handshake version 2 means the receiver accepts version 3 (running status)
+ * batch bodies. The server accepts both versions. A version 1 server closes
+ * the connection on a version 2 hello, so when a version 2 connection closes
+ * before any frame was acked, the next connection says version 1. Every
+ * other connection starts at version 2 again, so one dropped connection
+ * doesn't give up running status for good.
+ */
+
+#pragma once
+
+#include "httplib.h"
+#include "MidiWireFormat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#include <poll.h>
+#endif
+
+namespace midistream {
+
+constexpr const char* magic = "MIDS";
+constexpr uint8_t version = 2;
+constexpr uint8_t minVersion = 1;
+constexpr size_t frameHeaderSize = 12;
+constexpr uint32_t maxFrameBytes = 16 * 1024 * 1024;
+constexpr size_t maxConnections = 64;     // Further connections are closed on accept
+constexpr int connectTimeoutMs = 1000;    // Same as the HTTP transport
+constexpr int ioTimeoutMs = 2000;         // A send (or recv) making no progress this long drops the connection
+
+#if defined(MSG_NOSIGNAL)
+constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+constexpr int sendFlags = 0;
+#endif
+
+inline void putU32(uint8_t* p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) { p[i] = (uint8_t)(v & 0xFF); v >>= 8; }
+}
+
+inline void putU64(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) { p[i] = (uint8_t)(v & 0xFF); v >>= 8; }
+}
+
+inline uint32_t getU32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+inline void configureSocket(socket_t sock) {
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+    // A peer that stops reading fails the send instead of blocking it forever
+#ifdef _WIN32
+    DWORD timeout = ioTimeoutMs;
+#else
+    timeval timeout;
+    timeout.tv_sec = ioTimeoutMs / 1000;
+    timeout.tv_usec = (ioTimeoutMs % 1000) * 1000;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+// Waits up to timeoutMs for the socket to become readable (or writable).
+// poll rather than select, which can't take descriptors past FD_SETSIZE.
+inline bool waitSocket(socket_t sock, bool forWrite, int timeoutMs) {
+    pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = forWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+#ifdef _WIN32
+    int n = WSAPoll(&pfd, 1, timeoutMs);
+#else
+    int n = httplib::detail::handle_EINTR([&]() { return poll(&pfd, 1, timeoutMs); });
+#endif
+    return n > 0;
+}
+
+// connect() that gives up after connectTimeoutMs
+inline bool connectSocket(socket_t sock, const sockaddr* address, socklen_t length) {
+    httplib::detail::set_nonblocking(sock, true);
+    bool connected = connect(sock, address, (int)length) == 0;
+#ifdef _WIN32
+    bool pending = !connected && WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    bool pending = !connected && errno == EINPROGRESS;
+#endif
+    if (pending && waitSocket(sock, true, connectTimeoutMs)) {
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        connected = getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) == 0 && error == 0;
+    }
+    httplib::detail::set_nonblocking(sock, false);
+    return connected;
+}
+
+// False if the connection failed, or the peer took nothing for ioTimeoutMs
+// (SO_SNDTIMEO; see configureSocket)
+inline bool sendAll(socket_t sock, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        auto n = send(sock, (const char*)data, (int)std::min<size_t>(size, 1 << 20), sendFlags);
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Reads exactly size bytes, polling keepRunning between waitSocket() timeouts
+inline bool recvAll(socket_t sock, uint8_t* data, size_t size, const std::atomic<bool>& keepRunning) {
+    while (size > 0) {
+        if (!keepRunning.load()) return false;
+        if (!waitSocket(sock, false, 200)) continue;
+        auto n = recv(sock, (char*)data, (int)std::min<size_t>(size, 1 << 20), 0);
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+} // namespace midistream
+
+/**
+ * MidiStreamClient - Sending end of a stream connection (one per remote host).
+ *
+ * Not thread-safe: owned and driven by a single RemoteForwarder worker thread.
+ * Connects lazily and reconnects after failures, at most once per second.
+ * Connecting gives up after connectTimeoutMs and a send after ioTimeoutMs
+ * without progress, so an unreachable or stalled peer can't hold up the
+ * worker.
+ * The host's addresses are looked up once and reused for reconnects until
+ * none of them accepts a connection.
+ */
+class MidiStreamClient
+{
+public:
+    MidiStreamClient(const std::string& h, int p) : host(h), port(p) {}
+
+    ~MidiStreamClient() {
+        if (sock != INVALID_SOCKET) httplib::detail::close_socket(sock);
+    }
+
+    MidiStreamClient(const MidiStreamClient&) = delete;
+    MidiStreamClient& operator=(const MidiStreamClient&) = delete;
+
+    // Writes one frame of messageCount messages. Returns false if the frame
+    // could not be written.
+    bool sendFrame(const std::string& payload, size_t messageCount) {
+        if (sock == INVALID_SOCKET && !connectSocket()) return false;
+
+        uint8_t header[midistream::frameHeaderSize];
+        midistream::putU32(header, (uint32_t)payload.size());
+        midistream::putU64(header + 4, nextSequence);
+
+        if (!midistream::sendAll(sock, header, sizeof(header)) ||
+            !midistream::sendAll(sock, (const uint8_t*)payload.data(), payload.size())) {
+            std::cerr << "[MidiStream] Connection to " << host << ":" << port
+                      << " lost at frame " << nextSequence << std::endl;
+            disconnect();
+            return false;
+        }
+
+        unacked.push_back({nextSequence, messageCount});
+        nextSequence++;
+        drainAcks();
+        return true;
+    }
+
+    uint64_t getFramesSent() const { return nextSequence - 1; }
+    uint64_t getLastAcked() const { return lastAcked; }
+
+    // Messages in frames that were written but never acked before their
+    // connection closed, since the last call
+    uint64_t takeMessagesLost() {
+        uint64_t lost = messagesLost;
+        messagesLost = 0;
+        return lost;
+    }
+
+    // Whether frames may use MidiWireFormat version 3 (running status)
+    bool acceptsRunningStatus() const { return helloVersion >= 2; }
+
+    // Looks up the host's addresses (blocking); false if it has none
+    bool resolve() {
+        addresses.clear();
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            std::cerr << "[MidiStream] Cannot resolve " << host << std::endl;
+            return false;
+        }
+        for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+            Address address;
+            std::memcpy(&address.storage, ai->ai_addr, std::min(sizeof(address.storage), (size_t)ai->ai_addrlen));
+            address.length = (socklen_t)ai->ai_addrlen;
+            address.family = ai->ai_family;
+            address.protocol = ai->ai_protocol;
+            addresses.push_back(address);
+        }
+        freeaddrinfo(result);
+        return !addresses.empty();
+    }
+
+private:
+    struct Address {
+        sockaddr_storage storage;
+        socklen_t length;
+        int family;
+        int protocol;
+    };
+
+    bool connectSocket() {
+        auto now = std::chrono::steady_clock::now();
+        if (now < retryAfter) return false;
+        retryAfter = now + std::chrono::seconds(1);
+
+        if (addresses.empty() && !resolve()) return false;
+
+        for (const auto& address : addresses) {
+            socket_t s = socket(address.family, SOCK_STREAM, address.protocol);
+            if (s == INVALID_SOCKET) continue;
+            if (midistream::connectSocket(s, reinterpret_cast<const sockaddr*>(&address.storage), address.length)) {
+                sock = s;
+                break;
+            }
+            httplib::detail::close_socket(s);
+        }
+
+        if (sock == INVALID_SOCKET) {
+            std::cerr << "[MidiStream] Cannot connect to " << host << ":" << port << std::endl;
+            addresses.clear();  // Look the host up again next time
+            return false;
+        }
+
+        midistream::configureSocket(sock);
+        uint8_t hello[5];
+        std::memcpy(hello, midistream::magic, 4);
+        hello[4] = helloVersion;
+        if (!midistream::sendAll(sock, hello, sizeof(hello))) {
+            disconnect();
+            return false;
+        }
+
+        std::cout << "[MidiStream] Connected to " << host << ":" << port << std::endl;
+        ackLength = 0;
+        ackedSinceConnect = false;
+        return true;
+    }
+
+    // Reads whatever acks have arrived without blocking
+    void drainAcks() {
+        if (!readAcks()) disconnect();
+    }
+
+    // False once the connection is closed
+    bool readAcks() {
+        while (midistream::waitSocket(sock, false, 0)) {
+            auto n = recv(sock, (char*)ackBuffer + ackLength, (int)(sizeof(ackBuffer) - ackLength), 0);
+            if (n <= 0) return false;
+            ackLength += (size_t)n;
+            if (ackLength == sizeof(ackBuffer)) {
+                lastAcked = midistream::getU64(ackBuffer);
+                ackLength = 0;
+                ackedSinceConnect = true;
+                while (!unacked.empty() && unacked.front().sequence <= lastAcked) unacked.pop_front();
+            }
+        }
+        return true;
+    }
+
+    void disconnect() {
+        if (sock == INVALID_SOCKET) return;
+        readAcks();   // Acks that arrived before the connection closed
+        httplib::detail::close_socket(sock);
+        sock = INVALID_SOCKET;
+
+        for (const auto& frame : unacked) messagesLost += frame.messages;
+        if (!unacked.empty()) {
+            std::cerr << "[MidiStream] " << unacked.size() << " frames to " << host << ":" << port
+                      << " were not acked before the connection closed" << std::endl;
+        }
+        unacked.clear();
+
+        // Old servers close right after the hello, often before the first frame is written
+        bool rejected = !ackedSinceConnect && helloVersion > midistream::minVersion;
+        if (rejected) {
+            std::cerr << "[MidiStream] " << host << ":" << port
+                      << " closed the connection before acking; retrying with protocol version "
+                      << (int)midistream::minVersion << std::endl;
+        }
+        helloVersion = rejected ? midistream::minVersion : midistream::version;
+    }
+
+    std::string host;
+    int port;
+    std::vector<Address> addresses;
+    socket_t sock = INVALID_SOCKET;
+    uint64_t nextSequence = 1;
+    uint64_t lastAcked = 0;
+    uint8_t ackBuffer[8] = {};
+    size_t ackLength = 0;
+    uint8_t helloVersion = midistream::version;   // Of the current or next connection
+    bool ackedSinceConnect = false;
+    struct UnackedFrame {
+        uint64_t sequence;
+        size_t messages;
+    };
+    std::deque<UnackedFrame> unacked;   // Written on this connection, oldest first
+    uint64_t messagesLost = 0;
+    std::chrono::steady_clock::time_point retryAfter;
+};
+
+/**
+ * MidiStreamServer - Listener accepting stream connections from other servers.
+ *
+ * Runs next to the httplib server. One thread accepts; each connection gets a
+ * reader thread that decodes frames and hands every message to the handler
+ * (normally the same local delivery used by POST /batch). At most
+ * maxConnections are served at once.
+ */
+class MidiStreamServer
+{
+public:
+    explicit MidiStreamServer(MidiBatchDecoder::MessageHandler messageHandler)
+        : handler(std::move(messageHandler)) {}
+
+    ~MidiStreamServer() { stop(); }
+
+    MidiStreamServer(const MidiStreamServer&) = delete;
+    MidiStreamServer& operator=(const MidiStreamServer&) = delete;
+
+    // Binds and starts accepting. Returns the bound port (port 0 = any), or -1.
+    int start(const std::string& bindHost, int port) {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(bindHost.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+            return -1;
+        }
+
+        for (addrinfo* ai = result; ai; ai = ai->ai_next) {
+            socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (s == INVALID_SOCKET) continue;
+            int one = 1;
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+            if (bind(s, ai->ai_addr, (int)ai->ai_addrlen) == 0 && listen(s, 8) == 0) {
+                listenSocket = s;
+                break;
+            }
+            httplib::detail::close_socket(s);
+        }
+        freeaddrinfo(result);
+
+        if (listenSocket == INVALID_SOCKET) return -1;
+
+        sockaddr_storage addr;
+        socklen_t addrLen = sizeof(addr);
+        getsockname(listenSocket, (sockaddr*)&addr, &addrLen);
+        int boundPort = addr.ss_family == AF_INET6
+            ? ntohs(((sockaddr_in6*)&addr)->sin6_port)
+            : ntohs(((sockaddr_in*)&addr)->sin_port);
+
+        running = true;
+        acceptThread = std::thread([this]() { acceptLoop(); });
+        return boundPort;
+    }
+
+    void stop() {
+        running = false;
+        if (acceptThread.joinable()) acceptThread.join();
+        if (listenSocket != INVALID_SOCKET) {
+            httplib::detail::close_socket(listenSocket);
+            listenSocket = INVALID_SOCKET;
+        }
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto& conn : connections) {
+            if (conn->thread.joinable()) conn->thread.join();
+        }
+        connections.clear();
+    }
+
+private:
+    struct Connection {
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    void acceptLoop() {
+        while (running) {
+            reapFinishedConnections();
+            if (!midistream::waitSocket(listenSocket, false, 200)) continue;
+
+            socket_t client = accept(listenSocket, nullptr, nullptr);
+            if (client == INVALID_SOCKET) continue;
+
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            if (connections.size() >= midistream::maxConnections) {
+                std::cerr << "[MidiStream] Refused connection: already serving "
+                          << midistream::maxConnections << std::endl;
+                httplib::detail::close_socket(client);
+                continue;
+            }
+            midistream::configureSocket(client);
+            connections.push_back(std::make_unique<Connection>());
+            Connection* conn = connections.back().get();
+            conn->thread = std::thread([this, client, conn]() {
+                serveConnection(client);
+                httplib::detail::close_socket(client);
+                conn->finished = true;
+            });
+        }
+    }
+
+    void reapFinishedConnections() {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto it = connections.begin(); it != connections.end();) {
+            if ((*it)->finished) {
+                (*it)->thread.join();
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void serveConnection(socket_t sock) {
+        // A connection that never says hello would hold its slot forever
+        uint8_t hello[5];
+        if (!midistream::waitSocket(sock, false, midistream::ioTimeoutMs) ||
+            !midistream::recvAll(sock, hello, sizeof(hello), running) ||
+            std::memcmp(hello, midistream::magic, 4) != 0 ||
+            hello[4] < midistream::minVersion || hello[4] > midistream::version) {
+            std::cerr << "[MidiStream] Rejected connection with bad handshake" << std::endl;
+            return;
+        }
+
+        std::cout << "[MidiStream] Accepted stream connection" << std::endl;
+        std::string payload;
+        uint64_t expected = 0;
+        uint8_t header[midistream::frameHeaderSize];
+
+        while (midistream::recvAll(sock, header, sizeof(header), running)) {
+            uint32_t length = midistream::getU32(header);
+            uint64_t sequence = midistream::getU64(header + 4);
+            if (length > midistream::maxFrameBytes) {
+                std::cerr << "[MidiStream] Frame too large (" << length << " bytes)" << std::endl;
+                return;
+            }
+
+            payload.resize(length);
+            if (!midistream::recvAll(sock, (uint8_t*)&payload[0], length, running)) break;
+
+            if (expected != 0 && sequence != expected) {
+                std::cerr << "[MidiStream] Sequence gap: expected " << expected
+                          << ", got " << sequence << std::endl;
+            }
+            expected = sequence + 1;
+
+            if (!MidiBatchDecoder::decode(payload, handler)) {
+                std::cerr << "[MidiStream] Malformed frame " << sequence << std::endl;
+                continue;   // Not delivered, so not acked
+            }
+
+            uint8_t ack[8];
+            midistream::putU64(ack, sequence);
+            if (!midistream::sendAll(sock, ack, sizeof(ack))) break;
+        }
+        std::cout << "[MidiStream] Stream connection closed" << std::endl;
+    }
+
+    MidiBatchDecoder::MessageHandler handler;
+    socket_t listenSocket = INVALID_SOCKET;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+    std::list<std::unique_ptr<Connection>> connections;
+    std::mutex connectionsMutex;
+};
@@ -0,0 +1,272 @@
+/**
+ * MidiSysExAssembler - Joins SysEx fragments from an input callback
+ *
+ * Some drivers hand a long SysEx to the input callback in pieces: the first
+ * starts with 0xF0, the last ends with 0xF7, and the ones between are plain
+ * data bytes. feed() buffers them and returns the whole message once the
+ * 0xF7 arrives; anything else passes straight through.
+ *
+ * - A message longer than maxMessageBytes is discarded as soon as it passes
+ *   the cap, and the rest of its fragments are skipped
+ * - Real-time messages (0xF8-0xFF) between fragments pass through; any other
+ *   status byte ends the SysEx, which is discarded as incomplete
+ * - Buffers come from MidiBufferPool. The completed buffer becomes the
+ *   packet's shared payload without a copy and goes back to the pool when
+ *   the last queue entry or route holding it lets go, so regular dumps
+ *   reuse capacity instead of growing a new vector each time
+ * - A half-received message is charged to the port's MidiMemoryAccount; one
+ *   the memory budget can't hold is discarded like an oversize one
+ *
+ * In streaming mode receive() and receivePartial() also pass each new piece
+ * of a SysEx to the port's routing as it arrives (see MidiInputPart); the
+ * assembled message still goes to the poll queue and to destinations that
+ * can't take fragments. Pieces come from one of two places:
+ * - receivePartial(): JUCE reports a SysEx in progress through
+ *   handlePartialSysexMessage, as all bytes received so far, and delivers
+ *   the whole message to handleIncomingMidiMessage at the end. Only the
+ *   bytes added since the last report are routed.
+ * - receive(): drivers that hand the fragments themselves to the message
+ *   callback; each one is routed as it is.
+ * Either way a message that passes maxMessageBytes, or is cut off by another
+ * status byte, stops streaming and its destinations get a closing 0xF7, so
+ * no output is left holding an unterminated SysEx.
+ *
+ * Not thread-safe; owned by one port and fed from its MIDI input thread.
+ * No JUCE dependency, so it is benchmarked on its own (midi-server-microbench).
+ */
+
+#pragma once
+
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct MidiSysExConfig {
+    static constexpr size_t maxMessageBytesLimit = 256 * 1024 * 1024;   // Highest accepted setting
+
+    size_t maxMessageBytes = 4 * 1024 * 1024;   // Longer SysEx is discarded
+    bool streaming = false;                     // Route fragments as they arrive
+};
+
+struct MidiSysExStats {
+    uint64_t completed;             // Whole SysEx messages assembled
+    uint64_t discardedOversize;     // Longer than maxMessageBytes
+    uint64_t discardedIncomplete;   // Cut off by a new SysEx or another status byte
+    uint64_t discardedOverBudget;   // Didn't fit the memory budget (see MidiMemoryBudget)
+    uint64_t streamedChunks;        // Fragments routed in streaming mode
+};
+
+// What a packet handed to a port's routing callback is
+enum class MidiInputPart {
+    Message,          // A whole message
+    SysExChunk,       // Streaming mode: one SysEx fragment, as received
+    StreamedSysEx     // Streaming mode: a whole SysEx whose fragments were routed already
+};
+
+class MidiSysExAssembler
+{
+public:
+    // account: charged for the message being assembled; nullptr = not counted
+    explicit MidiSysExAssembler(const MidiSysExConfig& cfg = MidiSysExConfig(),
+                                MidiMemoryAccount* memoryAccount = nullptr,
+                                std::shared_ptr<MidiBufferPool> bufferPool = MidiBufferPool::shared())
+        : config(cfg), account(memoryAccount), pool(std::move(bufferPool)) {}
+
+    ~MidiSysExAssembler() { reset(); }
+
+    const MidiSysExConfig& getConfig() const { return config; }
+
+    // Whether feed() would take data as part of a SysEx: its start, or a
+    // continuation while one is open (including one being skipped)
+    bool isSysExFragment(const uint8_t* data, size_t size) const {
+        if (size == 0) return false;
+        return data[0] == 0xF0 || (state != State::Idle && isContinuation(data[0]));
+    }
+
+    // The input callback step: feeds data and, in streaming mode, passes
+    // routeChunk(const MidiPacket&) the SysEx pieces destinations should get
+    // now. Returns true when completed holds a message for the queue and
+    // routing, with part saying how to route it (Message or StreamedSysEx).
+    template <typename RouteChunk>
+    bool receive(const uint8_t* data, size_t size, MidiPacket& completed, MidiInputPart& part,
+                 RouteChunk&& routeChunk) {
+        part = MidiInputPart::Message;
+        if (size == 0) return false;
+        if (!config.streaming) return feed(data, size, completed);
+
+        bool realtime = data[0] >= 0xF8;
+        if (partialSeen > 0 && !realtime) {
+            // The whole message after receivePartial() reports, or whatever cut it off
+            bool completes = data[0] == 0xF0 && data[size - 1] == 0xF7 && size >= partialSeen;
+            if (completes && streamOpen) {
+                if (size > partialSeen) routeStreamed(data + partialSeen, size - partialSeen, routeChunk);
+                streamOpen = false;
+                part = MidiInputPart::StreamedSysEx;
+            } else if (!completes) {
+                discardedIncomplete.fetch_add(1, std::memory_order_relaxed);
+            }
+            closeStream(routeChunk);
+            partialSeen = 0;
+            partialCapped = false;
+            return feed(data, size, completed);
+        }
+
+        bool fragment = isSysExFragment(data, size) && !(data[0] == 0xF0 && data[size - 1] == 0xF7);
+        bool continues = fragment && data[0] != 0xF0 && state == State::Buffering;
+        if (!realtime && !continues) closeStream(routeChunk);   // Cut off, or a new SysEx
+
+        bool done = feed(data, size, completed);
+        if (fragment && (done || state == State::Buffering)) {
+            routeStreamed(data, size, routeChunk);
+            streamOpen = !done;
+            if (done) part = MidiInputPart::StreamedSysEx;
+        } else if (fragment) {
+            closeStream(routeChunk);   // Just went past maxMessageBytes or the budget
+        }
+        return done;
+    }
+
+    // handlePartialSysexMessage step (streaming only): soFar is the SysEx
+    // received so far, from its 0xF0. Routes the bytes added since the last
+    // call, up to maxMessageBytes.
+    template <typename RouteChunk>
+    void receivePartial(const uint8_t* soFar, size_t size, RouteChunk&& routeChunk) {
+        if (!config.streaming || size == 0 || soFar[0] != 0xF0) return;
+        if (size < partialSeen) {
+            // A new SysEx; the previous one never completed
+            discardedIncomplete.fetch_add(1, std::memory_order_relaxed);
+            closeStream(routeChunk);
+            partialCapped = false;
+            partialSeen = 0;
+        }
+        if (!partialCapped && size > config.maxMessageBytes) {
+            closeStream(routeChunk);
+            partialCapped = true;
+        }
+        if (!partialCapped && size > partialSeen) {
+            routeStreamed(soFar + partialSeen, size - partialSeen, routeChunk);
+            streamOpen = true;
+        }
+        partialSeen = size;
+    }
+
+    // Returns true and sets completed when data finishes a message: a
+    // non-SysEx message, a whole SysEx, or the last fragment of one
+    bool feed(const uint8_t* data, size_t size, MidiPacket& completed) {
+        if (size == 0) return false;
+
+        if (data[0] == 0xF0) {
+            // Start of a new SysEx; an unfinished one is discarded
+            if (state != State::Idle) abandon();
+            if (!buffer) buffer = pool->acquire();
+            state = State::Buffering;
+        } else if (state == State::Idle || !isContinuation(data[0])) {
+            if (state != State::Idle && data[0] < 0xF8) abandon();
+            // Regular MIDI message (non-SysEx) - stored inline, no allocation
+            completed = MidiPacket(data, size);
+            return true;
+        }
+
+        bool ends = data[size - 1] == 0xF7;
+        if (state == State::Buffering) {
+            if (buffer->size() + size > config.maxMessageBytes) {
+                discard(discardedOversize);
+            } else if (account && !account->tryCharge(size)) {
+                discard(discardedOverBudget);
+            } else {
+                buffer->insert(buffer->end(), data, data + size);
+            }
+        }
+        if (!ends) return false;  // Keep buffering
+
+        bool skipped = state == State::Skipping;
+        state = State::Idle;
+        if (skipped) return false;
+
+        // Complete SysEx received - hand the buffer over without copying
+        if (account) account->release(buffer->size());
+        completed = pool->adopt(std::move(buffer));
+        completedCount.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Drops a half-received SysEx (e.g. the device went away). Destinations
+    // of a streamed one are left to their own timeout (see MidiOutputSender).
+    void reset() {
+        clear();
+        partialSeen = 0;
+        partialCapped = false;
+        streamOpen = false;
+    }
+
+    bool isBuffering() const { return state == State::Buffering; }
+
+    // Safe to call from any thread
+    MidiSysExStats getStats() const {
+        return {completedCount.load(std::memory_order_relaxed),
+                discardedOversize.load(std::memory_order_relaxed),
+                discardedIncomplete.load(std::memory_order_relaxed),
+                discardedOverBudget.load(std::memory_order_relaxed),
+                streamedChunks.load(std::memory_order_relaxed)};
+    }
+
+private:
+    enum class State { Idle, Buffering, Skipping };
+
+    // Data bytes, or the 0xF7 that ends the message
+    static bool isContinuation(uint8_t first) { return first < 0x80 || first == 0xF7; }
+
+    void clear() {
+        if (buffer) {
+            if (account) account->release(buffer->size());
+            buffer->clear();
+        }
+        state = State::Idle;
+    }
+
+    // Drops what was buffered and skips the rest of the message
+    void discard(std::atomic<uint64_t>& counter) {
+        clear();
+        counter.fetch_add(1, std::memory_order_relaxed);
+        state = State::Skipping;
+    }
+
+    void abandon() {
+        if (state == State::Buffering) discardedIncomplete.fetch_add(1, std::memory_order_relaxed);
+        clear();
+    }
+
+    template <typename RouteChunk>
+    void routeStreamed(const uint8_t* data, size_t size, RouteChunk& routeChunk) {
+        streamedChunks.fetch_add(1, std::memory_order_relaxed);
+        routeChunk(pool->copy(data, size));
+    }
+
+    // Ends a streamed SysEx that won't complete
+    template <typename RouteChunk>
+    void closeStream(RouteChunk& routeChunk) {
+        if (!streamOpen) return;
+        streamOpen = false;
+        static const uint8_t endOfSysEx = 0xF7;
+        routeChunk(MidiPacket(&endOfSysEx, 1));
+    }
+
+    MidiSysExConfig config;
+    MidiMemoryAccount* account;
+    std::shared_ptr<MidiBufferPool> pool;
+    std::unique_ptr<std::vector<uint8_t>> buffer;
+    State state = State::Idle;
+    size_t partialSeen = 0;      // Bytes receivePartial() last reported; 0 = none in progress
+    bool partialCapped = false;  // That SysEx passed maxMessageBytes; stop routing it
+    bool streamOpen = false;     // Destinations got pieces of a SysEx but not its 0xF7
+    std::atomic<uint64_t> completedCount{0};
+    std::atomic<uint64_t> discardedOversize{0};
+    std::atomic<uint64_t> discardedIncomplete{0};
+    std::atomic<uint64_t> discardedOverBudget{0};
+    std::atomic<uint64_t> streamedChunks{0};
+};
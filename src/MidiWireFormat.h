@@ -0,0 +1,242 @@
+/**
+ * MidiWireFormat - Compact binary encoding for batched server-to-server MIDI
+ *
+ * Body of POST /batch (Content-Type: application/x-midi-batch):
+ *
+ *   "MIDB" | version (1 byte) | flags (1 byte)
+ *   then groups until the end of the body:
+ *     varint portIdLength | portId bytes | varint messageCount
+ *     messageCount x (varint length | message bytes)
+ *
+ * Varints are unsigned LEB128. Consecutive messages for the same destination
+ * port share one group, so a 3-byte note costs 4 bytes on the wire instead of
+ * a ~200 byte JSON request. Message order is preserved across groups.
+ *
+ * Version 2 batches carry a due time per message (routes with a fixed
+ * latency): each message's bytes are followed by a zigzag varint holding the
+ * difference from the previous message's Unix epoch microseconds (the first
+ * is relative to 0; a timestamp of 0 means "deliver now"). Batches without
+ * timestamps are still encoded as version 1, so older receivers keep working.
+ *
+ * Version 3 batches turn the flags byte into a feature set:
+ *   0x01  timestamps, encoded as in version 2
+ *   0x02  running status: a channel message whose status byte equals the
+ *         previous channel message's in the same group is sent without it
+ *         (a dense pitch-bend or CC stream costs 3 bytes per message, not 4).
+ *         SysEx and system common messages cancel running status; real-time
+ *         messages don't, as on a MIDI cable.
+ * Senders only use version 3 with receivers known to accept it.
+ *
+ * Decoded SysEx payloads go into MidiBufferPool buffers.
+ */
+
+#pragma once
+
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class MidiBatchEncoder
+{
+public:
+    static constexpr const char* contentType = "application/x-midi-batch";
+    static constexpr uint8_t version = 1;
+    static constexpr uint8_t timestampedVersion = 2;
+    static constexpr uint8_t flagsVersion = 3;
+
+    // Version 3 flags
+    static constexpr uint8_t timestampsFlag = 0x01;
+    static constexpr uint8_t runningStatusFlag = 0x02;
+
+    MidiBatchEncoder() { reset(); }
+
+    // timestamped: every add() carries a due time (version 2 body).
+    // runningStatus: omit repeated status bytes (version 3 body).
+    void reset(bool timestamped = false, bool runningStatus = false) {
+        body.clear();
+        body.append("MIDB", 4);
+        if (runningStatus) {
+            body.push_back((char)flagsVersion);
+            body.push_back((char)(runningStatusFlag | (timestamped ? timestampsFlag : 0)));
+        } else {
+            body.push_back((char)(timestamped ? timestampedVersion : version));
+            body.push_back(0);  // flags, reserved
+        }
+        currentPortId.clear();
+        countOffset = 0;
+        groupCount = 0;
+        messageCount = 0;
+        withTimestamps = timestamped;
+        withRunningStatus = runningStatus;
+        runningStatusByte = 0;
+        previousTimestamp = 0;
+    }
+
+    // timestampUs: Unix epoch microseconds, 0 = deliver on arrival. Ignored
+    // unless the encoder was reset() as timestamped.
+    void add(const std::string& portId, const MidiPacket& packet, int64_t timestampUs = 0) {
+        if (countOffset == 0 || portId != currentPortId) {
+            closeGroup();
+            appendVarint(portId.size());
+            body.append(portId);
+            currentPortId = portId;
+            // Count is patched in closeGroup(); reserve the maximum varint width
+            countOffset = body.size();
+            body.append(countWidth, '\0');
+            runningStatusByte = 0;
+        }
+        size_t skip = 0;
+        if (withRunningStatus && !packet.empty()) {
+            uint8_t status = packet[0];
+            if (status >= 0x80 && status < 0xF0) {
+                if (status == runningStatusByte && packet.size() > 1) skip = 1;
+                runningStatusByte = status;
+            } else if (status < 0xF8) {
+                runningStatusByte = 0;
+            }
+        }
+        appendVarint(packet.size() - skip);
+        body.append((const char*)packet.data() + skip, packet.size() - skip);
+        if (withTimestamps) {
+            int64_t delta = timestampUs - previousTimestamp;
+            appendVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            previousTimestamp = timestampUs;
+        }
+        groupCount++;
+        messageCount++;
+    }
+
+    size_t size() const { return messageCount; }
+    bool empty() const { return messageCount == 0; }
+
+    // Finalizes the batch and returns the encoded body
+    const std::string& finish() {
+        closeGroup();
+        return body;
+    }
+
+private:
+    // Fixed-width (padded) varint so the count can be written after the group
+    static constexpr size_t countWidth = 3;
+
+    void closeGroup() {
+        if (countOffset == 0) return;
+        size_t value = groupCount;
+        for (size_t i = 0; i < countWidth; i++) {
+            uint8_t byte = value & 0x7F;
+            value >>= 7;
+            if (i + 1 < countWidth) byte |= 0x80;
+            body[countOffset + i] = (char)byte;
+        }
+        countOffset = 0;
+        groupCount = 0;
+    }
+
+    void appendVarint(uint64_t value) {
+        while (value >= 0x80) {
+            body.push_back((char)((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        body.push_back((char)value);
+    }
+
+    std::string body;
+    std::string currentPortId;
+    size_t countOffset = 0;
+    size_t groupCount = 0;
+    size_t messageCount = 0;
+    bool withTimestamps = false;
+    bool withRunningStatus = false;
+    uint8_t runningStatusByte = 0;   // 0 = none in effect
+    int64_t previousTimestamp = 0;
+};
+
+class MidiBatchDecoder
+{
+public:
+    // timestampUs is the message's due time (Unix epoch microseconds), or 0
+    // for version 1 batches and messages to deliver on arrival
+    using MessageHandler = std::function<void(const std::string& portId, const MidiPacket& packet,
+                                              int64_t timestampUs)>;
+
+    // Decodes a batch body, invoking handler for each message in order.
+    // Returns false (after delivering any messages preceding the error) if
+    // the body is malformed.
+    static bool decode(const uint8_t* data, size_t size, const MessageHandler& handler) {
+        if (size < 6 || std::string((const char*)data, 4) != "MIDB" ||
+            data[4] < MidiBatchEncoder::version || data[4] > MidiBatchEncoder::flagsVersion) {
+            return false;
+        }
+        uint8_t flags = data[4] == MidiBatchEncoder::flagsVersion ? data[5] : 0;
+        if (flags & ~(MidiBatchEncoder::timestampsFlag | MidiBatchEncoder::runningStatusFlag)) {
+            return false;  // Features this decoder doesn't know
+        }
+        bool timestamped = data[4] == MidiBatchEncoder::timestampedVersion ||
+                           (flags & MidiBatchEncoder::timestampsFlag);
+        bool runningStatus = flags & MidiBatchEncoder::runningStatusFlag;
+        int64_t timestamp = 0;
+
+        size_t pos = 6;
+        std::string portId;
+        MidiBufferPool& pool = *MidiBufferPool::shared();
+        while (pos < size) {
+            uint64_t portIdLength, count;
+            if (!readVarint(data, size, pos, portIdLength) || portIdLength > size - pos) return false;
+            portId.assign((const char*)data + pos, (size_t)portIdLength);
+            pos += (size_t)portIdLength;
+
+            if (!readVarint(data, size, pos, count)) return false;
+            uint8_t runningStatusByte = 0;
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t length;
+                if (!readVarint(data, size, pos, length) || length == 0 || length > size - pos) return false;
+                MidiPacket packet;
+                uint8_t status = data[pos];
+                if (!runningStatus) {
+                    packet = pool.copy(data + pos, (size_t)length);
+                } else if (status < 0x80) {
+                    // Data bytes only: restore the status byte in effect
+                    if (runningStatusByte == 0 || length > 2) return false;
+                    uint8_t bytes[3] = {runningStatusByte, data[pos], length > 1 ? data[pos + 1] : (uint8_t)0};
+                    packet = MidiPacket(bytes, (size_t)length + 1);
+                } else {
+                    packet = pool.copy(data + pos, (size_t)length);
+                    if (status < 0xF0) runningStatusByte = status;
+                    else if (status < 0xF8) runningStatusByte = 0;
+                }
+                pos += (size_t)length;
+                if (timestamped) {
+                    uint64_t zigzag;
+                    if (!readVarint(data, size, pos, zigzag)) return false;
+                    // Summed unsigned so hostile deltas wrap instead of
+                    // overflowing; a negative total is malformed. Whether the
+                    // time is near enough to schedule is up to the receiver.
+                    timestamp = (int64_t)((uint64_t)timestamp + ((zigzag >> 1) ^ (0 - (zigzag & 1))));
+                    if (timestamp < 0) return false;
+                }
+                handler(portId, packet, timestamp);
+            }
+        }
+        return true;
+    }
+
+    static bool decode(const std::string& body, const MessageHandler& handler) {
+        return decode((const uint8_t*)body.data(), body.size(), handler);
+    }
+
+private:
+    static bool readVarint(const uint8_t* data, size_t size, size_t& pos, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= size) return false;
+            uint8_t byte = data[pos++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,204 @@
+/**
+ * NativeMidiThru - ALSA sequencer and CoreMIDI implementation (see NativeMidiThru.h)
+ */
+
+#include "NativeMidiThru.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <alsa/asoundlib.h>
+#elif defined(__APPLE__)
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreMIDI/CoreMIDI.h>
+#endif
+
+#if defined(__linux__)
+namespace {
+
+// "20-0" -> client 20, port 0
+bool parseAlsaAddress(const std::string& identifier, snd_seq_addr_t& address) {
+    const char* text = identifier.c_str();
+    char* end = nullptr;
+    long client = std::strtol(text, &end, 10);
+    if (end == text || *end != '-') return false;
+    const char* portText = end + 1;
+    long port = std::strtol(portText, &end, 10);
+    if (end == portText || *end != '\0' || client < 0 || client > 255 || port < 0 || port > 255) {
+        return false;
+    }
+    address.client = (unsigned char)client;
+    address.port = (unsigned char)port;
+    return true;
+}
+
+// Sequencer handle shared by the subscriptions it made, so it outlives them
+class AlsaClient
+{
+public:
+    explicit AlsaClient(snd_seq_t* handle) : seq(handle) {}
+    ~AlsaClient() { snd_seq_close(seq); }
+
+    AlsaClient(const AlsaClient&) = delete;
+    AlsaClient& operator=(const AlsaClient&) = delete;
+
+    static std::shared_ptr<AlsaClient> open(std::string& error) {
+        snd_seq_t* handle = nullptr;
+        int result = snd_seq_open(&handle, "default", SND_SEQ_OPEN_OUTPUT, 0);
+        if (result < 0) {
+            error = std::string("snd_seq_open failed: ") + snd_strerror(result);
+            return nullptr;
+        }
+        snd_seq_set_client_name(handle, "MIDI HTTP Server thru");
+        return std::make_shared<AlsaClient>(handle);
+    }
+
+    snd_seq_t* seq;
+};
+
+class AlsaConnection : public NativeMidiThru::Connection
+{
+public:
+    AlsaConnection(std::shared_ptr<AlsaClient> owner, const snd_seq_addr_t& sender,
+                   const snd_seq_addr_t& dest)
+        : client(std::move(owner)) {
+        snd_seq_port_subscribe_malloc(&subscription);
+        snd_seq_port_subscribe_set_sender(subscription, &sender);
+        snd_seq_port_subscribe_set_dest(subscription, &dest);
+    }
+
+    // Fails harmlessly if the device is gone: ALSA dropped the subscription with it
+    ~AlsaConnection() override {
+        if (created) snd_seq_unsubscribe_port(client->seq, subscription);
+        snd_seq_port_subscribe_free(subscription);
+    }
+
+    static std::unique_ptr<NativeMidiThru::Connection> subscribe(const std::shared_ptr<AlsaClient>& client,
+                                                                 const snd_seq_addr_t& sender,
+                                                                 const snd_seq_addr_t& dest,
+                                                                 std::string& error) {
+        auto connection = std::make_unique<AlsaConnection>(client, sender, dest);
+        int result = snd_seq_subscribe_port(client->seq, connection->subscription);
+        // -EBUSY: the ports are already connected (aconnect, or a run that
+        // crashed); use that subscription but don't remove it later
+        if (result < 0 && result != -EBUSY) {
+            error = std::string("snd_seq_subscribe_port failed: ") + snd_strerror(result);
+            return nullptr;
+        }
+        connection->created = result >= 0;
+        return connection;
+    }
+
+private:
+    std::shared_ptr<AlsaClient> client;
+    snd_seq_port_subscribe_t* subscription = nullptr;
+    bool created = false;   // Made by this process, so it is ours to remove
+};
+
+} // namespace
+
+struct NativeMidiThru::Backend {
+    std::shared_ptr<AlsaClient> alsa;
+};
+#elif defined(__APPLE__)
+namespace {
+
+MIDIEndpointRef findEndpoint(const std::string& identifier, MIDIObjectType wantedType) {
+    char* end = nullptr;
+    long uniqueId = std::strtol(identifier.c_str(), &end, 10);
+    if (end == identifier.c_str() || *end != '\0') return 0;
+    MIDIObjectRef object = 0;
+    MIDIObjectType type;
+    if (MIDIObjectFindByUniqueID((MIDIUniqueID)uniqueId, &object, &type) != noErr) return 0;
+    return type == wantedType ? (MIDIEndpointRef)object : 0;
+}
+
+class CoreMidiConnection : public NativeMidiThru::Connection
+{
+public:
+    explicit CoreMidiConnection(MIDIThruConnectionRef ref) : connection(ref) {}
+    ~CoreMidiConnection() override { MIDIThruConnectionDispose(connection); }
+
+    static std::unique_ptr<NativeMidiThru::Connection> create(MIDIEndpointRef source, MIDIEndpointRef destination,
+                                                              std::string& error) {
+        MIDIThruConnectionParams params;
+        MIDIThruConnectionParamsInitialize(&params);
+        params.numSources = 1;
+        params.sources[0].endpointRef = source;
+        params.numDestinations = 1;
+        params.destinations[0].endpointRef = destination;
+
+        CFDataRef data = CFDataCreate(nullptr, (const UInt8*)&params, MIDIThruConnectionParamsSize(&params));
+        MIDIThruConnectionRef ref = 0;
+        OSStatus status = MIDIThruConnectionCreate(nullptr, data, &ref);  // nullptr: not persistent
+        CFRelease(data);
+        if (status != noErr) {
+            error = "MIDIThruConnectionCreate failed: " + std::to_string((int)status);
+            return nullptr;
+        }
+        return std::make_unique<CoreMidiConnection>(ref);
+    }
+
+private:
+    MIDIThruConnectionRef connection;
+};
+
+} // namespace
+
+struct NativeMidiThru::Backend {};
+#else
+struct NativeMidiThru::Backend {};
+#endif
+
+NativeMidiThru::NativeMidiThru() : backend(std::make_unique<Backend>()) {}
+
+NativeMidiThru::~NativeMidiThru() = default;
+
+bool NativeMidiThru::isSupported() {
+#if defined(__linux__) || defined(__APPLE__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* NativeMidiThru::backendName() {
+#if defined(__linux__)
+    return "alsa-seq";
+#elif defined(__APPLE__)
+    return "coremidi";
+#else
+    return "none";
+#endif
+}
+
+std::unique_ptr<NativeMidiThru::Connection> NativeMidiThru::connect(const std::string& sourceIdentifier,
+                                                                     const std::string& destinationIdentifier,
+                                                                     std::string& error) {
+#if defined(__linux__)
+    snd_seq_addr_t sender, dest;
+    if (!parseAlsaAddress(sourceIdentifier, sender) || !parseAlsaAddress(destinationIdentifier, dest)) {
+        error = "Not an ALSA sequencer port: " + sourceIdentifier + " -> " + destinationIdentifier;
+        return nullptr;
+    }
+    if (!backend->alsa) {
+        backend->alsa = AlsaClient::open(error);
+        if (!backend->alsa) return nullptr;
+    }
+    return AlsaConnection::subscribe(backend->alsa, sender, dest, error);
+#elif defined(__APPLE__)
+    MIDIEndpointRef source = findEndpoint(sourceIdentifier, kMIDIObjectType_Source);
+    MIDIEndpointRef destination = findEndpoint(destinationIdentifier, kMIDIObjectType_Destination);
+    if (!source || !destination) {
+        error = "CoreMIDI endpoint not found: " + sourceIdentifier + " -> " + destinationIdentifier;
+        return nullptr;
+    }
+    return CoreMidiConnection::create(source, destination, error);
+#else
+    (void)sourceIdentifier;
+    (void)destinationIdentifier;
+    error = "Native thru is not available on this platform";
+    return nullptr;
+#endif
+}
@@ -0,0 +1,64 @@
+/**
+ * NativeMidiThru - OS-level connections from an input device to an output device
+ *
+ * For local port-to-port routes that need no transform, the OS can deliver
+ * messages itself instead of the input callback -> dispatch -> MidiOutput hop:
+ *
+ * - Linux: an ALSA sequencer subscription from the source port to the
+ *   destination port (what `aconnect` does). Events go sender -> receiver
+ *   inside the kernel sequencer. JUCE identifies ALSA devices as
+ *   "client-port", which is all a subscription needs.
+ * - macOS: a CoreMIDI thru connection (MIDIThruConnectionCreate) between the
+ *   source and destination endpoints, found by the unique ID JUCE uses as the
+ *   device identifier. Packet lists are forwarded by the MIDI server process.
+ *   The connection is not persistent, so it ends with this process.
+ * - Elsewhere isSupported() is false and connect() always fails.
+ *
+ * ALSA subscriptions belong to the two ports, not to the client that made
+ * them, so connections are removed explicitly when a Connection is destroyed.
+ * A subscription that already exists (made with `aconnect`, or left over by
+ * a run that crashed) is used as it is and left in place afterwards: only
+ * subscriptions this process made are removed.
+ *
+ * The OS calls live in NativeMidiThru.cpp, which only the server links, so
+ * the core (RouteManager takes a NativeThruConnector) needs neither ALSA nor
+ * CoreMIDI.
+ *
+ * Not thread-safe; RouteManager calls it with routesMutex held.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+class NativeMidiThru
+{
+public:
+    // One source -> destination link; removed on destruction
+    class Connection
+    {
+    public:
+        virtual ~Connection() = default;
+    };
+
+    NativeMidiThru();
+    ~NativeMidiThru();
+
+    NativeMidiThru(const NativeMidiThru&) = delete;
+    NativeMidiThru& operator=(const NativeMidiThru&) = delete;
+
+    static bool isSupported();
+    static const char* backendName();
+
+    // Identifiers are juce::MidiDeviceInfo::identifier values of an input
+    // device (source) and an output device (destination). Returns nullptr
+    // and sets error on failure.
+    std::unique_ptr<Connection> connect(const std::string& sourceIdentifier,
+                                        const std::string& destinationIdentifier,
+                                        std::string& error);
+
+private:
+    struct Backend;
+    std::unique_ptr<Backend> backend;   // OS handles, opened on first connect
+};
@@ -0,0 +1,119 @@
+/**
+ * PortRegistry - Open ports by id, readable without locking
+ *
+ * Same scheme as RouteManager's dispatch table: every open/close builds a new
+ * immutable map and publishes it with an atomic shared_ptr swap. Routing
+ * threads and HTTP handlers look ports up without taking any lock, and hold
+ * the returned shared_ptr while they use the port. Closing a port only
+ * unpublishes it; in-flight sends finish and the port is destroyed when its
+ * last user lets go.
+ *
+ * Writers are serialized by writeMutex, which is never held while a port is
+ * opened, sent to or destroyed.
+ *
+ * version() changes with every publish, for ETags on port listings.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+template <typename Port>
+class PortRegistry
+{
+public:
+    using PortPtr = std::shared_ptr<Port>;
+    using Map = std::map<std::string, PortPtr>;
+
+    // Versions count up from the startup time in milliseconds: an ETag a
+    // client kept across a server restart won't match by accident
+    PortRegistry()
+        : current(std::make_shared<const Map>()),
+          currentVersion((uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count()) {}
+
+    PortRegistry(const PortRegistry&) = delete;
+    PortRegistry& operator=(const PortRegistry&) = delete;
+
+    // Lock-free lookup; returns nullptr if the port isn't open
+    PortPtr find(const std::string& id) const {
+        auto map = snapshot();
+        auto it = map->find(id);
+        return it == map->end() ? nullptr : it->second;
+    }
+
+    bool contains(const std::string& id) const { return find(id) != nullptr; }
+
+    // Consistent view of all open ports, for listings and shutdown
+    std::shared_ptr<const Map> snapshot() const {
+        return std::atomic_load_explicit(&current, std::memory_order_acquire);
+    }
+
+    // Bumped after each publish: a reader that sees a version then takes a
+    // snapshot gets that map or a newer one, never an older one
+    uint64_t version() const { return currentVersion.load(std::memory_order_acquire); }
+
+    // Publishes port under id. Returns the port it replaced, if any, so the
+    // caller decides on which thread it is destroyed.
+    PortPtr insert(const std::string& id, PortPtr port) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto map = std::make_shared<Map>(*snapshot());
+        PortPtr previous;
+        auto it = map->find(id);
+        if (it != map->end()) previous = std::move(it->second);
+        (*map)[id] = std::move(port);
+        publishUnlocked(std::move(map));
+        return previous;
+    }
+
+    // Publishes port only if id is free. Returns false if another port won.
+    bool insertIfAbsent(const std::string& id, PortPtr port) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto existing = snapshot();
+        if (existing->count(id)) return false;
+        auto map = std::make_shared<Map>(*existing);
+        (*map)[id] = std::move(port);
+        publishUnlocked(std::move(map));
+        return true;
+    }
+
+    // Unpublishes id and returns the removed port (nullptr if not open)
+    PortPtr erase(const std::string& id) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto existing = snapshot();
+        auto it = existing->find(id);
+        if (it == existing->end()) return nullptr;
+        PortPtr removed = it->second;
+        auto map = std::make_shared<Map>(*existing);
+        map->erase(id);
+        publishUnlocked(std::move(map));
+        return removed;
+    }
+
+    // Unpublishes everything and returns the previous contents
+    std::shared_ptr<const Map> clear() {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto previous = snapshot();
+        publishUnlocked(std::make_shared<Map>());
+        return previous;
+    }
+
+private:
+    void publishUnlocked(std::shared_ptr<Map> map) {
+        std::atomic_store_explicit(&current, std::shared_ptr<const Map>(std::move(map)),
+                                   std::memory_order_release);
+        currentVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    // Only accessed through std::atomic_load/atomic_store
+    std::shared_ptr<const Map> current;
+    std::atomic<uint64_t> currentVersion;
+    std::mutex writeMutex;
+};
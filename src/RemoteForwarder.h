@@ -0,0 +1,671 @@
+/**
+ * RemoteForwarder - Persistent-connection forwarder for a single remote host.
+ *
+ * Maintains one connection and one worker thread per remote MIDI server.
+ * Messages are queued and sent in order, eliminating per-message TCP handshake
+ * overhead and preventing out-of-order delivery.
+ *
+ * In batching mode the worker drains the queue into one POST /batch request.
+ * If the remote server predates /batch (404), the forwarder falls back to
+ * per-message JSON requests for the rest of its lifetime. With the Stream
+ * transport every drain becomes one pipelined frame on a persistent TCP
+ * connection; the worker never waits for a response.
+ *
+ * The queue is bounded and applies each route's delivery policy:
+ * - messages older than the route's maxAgeMs are dropped instead of sent late
+ * - continuous controllers (CC, pitch bend, aftertouch) can be coalesced to the
+ *   latest value; a 14-bit CC's queued LSB is discarded with its superseded MSB
+ * - SysEx is never aged out, coalesced or count-dropped, and is re-queued if a
+ *   send fails; only the maxQueuedSysExBytes cap and the process-wide memory
+ *   budget (MidiMemoryBudget) can drop it
+ *
+ * Messages of fixed-latency routes carry a due time (Unix epoch µs). It's sent
+ * along as "timestampUs" or in a version 2 MidiWireFormat batch so the
+ * receiving server's MidiScheduler releases them on time.
+ *
+ * Batches use running status (MidiWireFormat version 3) unless the receiver
+ * predates it: an HTTP 400 for a version 3 batch, or a stream peer that only
+ * speaks handshake version 1, switches the forwarder to the older encoding.
+ *
+ * A circuit breaker stops sending to an unreachable host: after
+ * breakerFailureThreshold consecutive failures the worker waits out a cooldown
+ * (doubling up to breakerMaxCooldown) and then sends a single probe.
+ *
+ * The host name is resolved by the worker as soon as it starts, not when the
+ * first message is sent, and the address is reused for reconnects. After a
+ * failed send it is looked up again, in case the host moved.
+ */
+
+#pragma once
+
+#include "httplib.h"
+#include "Metrics.h"
+#include "MidiMemory.h"
+#include "MidiPacket.h"
+#include "MidiStreamTransport.h"
+#include "MidiWireFormat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Tuning for RemoteForwarder delivery, shared by all remote hosts
+struct RemoteForwarderConfig {
+    // Send everything queued for a host in one POST /batch request using the
+    // binary MidiWireFormat encoding instead of one JSON POST per message
+    bool batching = false;
+
+    // How long the worker may hold the first queued message while waiting for
+    // more to batch with it. 0 = never wait; batches form only from messages
+    // that queued up during the previous request.
+    std::chrono::microseconds maxBatchLatency{0};
+
+    size_t maxBatchMessages = 512;
+
+    // Queue bounds per remote host
+    size_t maxQueueMessages = 4096;
+    size_t maxQueuedSysExBytes = 8 * 1024 * 1024;
+
+    // Circuit breaker
+    int breakerFailureThreshold = 3;
+    std::chrono::milliseconds breakerInitialCooldown{1000};
+    std::chrono::milliseconds breakerMaxCooldown{30000};
+};
+
+// How a RemoteForwarder reaches its host, chosen by the serverUrl scheme
+enum class RemoteTransport {
+    Http,    // http://  - POST per message, or POST /batch when batching
+    Stream   // midi+tcp:// - pipelined frames over a persistent MidiStreamClient
+};
+
+// Per-route handling of messages queued for a remote destination
+struct RemoteDeliveryPolicy {
+    uint32_t maxAgeMs = 0;     // Drop non-SysEx messages queued longer than this; 0 = no limit
+    bool coalesce = false;     // Replace queued CC/pitch-bend/aftertouch values with newer ones
+
+    bool operator==(const RemoteDeliveryPolicy& other) const {
+        return maxAgeMs == other.maxAgeMs && coalesce == other.coalesce;
+    }
+};
+
+enum class CircuitBreakerState { Closed, Open, HalfOpen };
+
+inline const char* circuitBreakerStateName(CircuitBreakerState state) {
+    switch (state) {
+        case CircuitBreakerState::Closed: return "closed";
+        case CircuitBreakerState::Open: return "open";
+        case CircuitBreakerState::HalfOpen: return "half-open";
+    }
+    return "closed";
+}
+
+// A destination port on the remote server, made once per route: per
+// message, only a reference is queued, and the send path and coalescing
+// hash aren't rebuilt
+struct RemoteDestination {
+    std::string portId;
+    std::string sendPath;   // Single-message JSON endpoint
+    size_t portHash;
+};
+
+struct RemoteForwarderStats {
+    std::string target;            // e.g. "http://host:port"
+    size_t queueDepth;
+    size_t queuedSysExBytes;
+    uint64_t messagesSent;
+    uint64_t messagesFailed;       // Lost in failed sends, refused by the remote, or on a stream connection
+                                   // that closed before acking them (SysEx is re-queued after a transport failure)
+    uint64_t droppedOverflow;      // Dropped because the queue was full
+    uint64_t droppedOverBudget;    // SysEx dropped because the memory budget was exhausted
+    uint64_t droppedStale;         // Dropped because they exceeded the route's maxAgeMs
+    uint64_t coalesced;            // Superseded by a newer controller value
+    CircuitBreakerState breakerState;
+    int consecutiveFailures;
+    LatencyHistogram::Snapshot queueDelay;   // Enqueue to send attempt
+    LatencyHistogram::Snapshot roundTrip;    // HTTP request to response (not recorded for streams)
+    MidiMemoryStats memory;                  // Payload bytes in the queue
+};
+
+class RemoteForwarder {
+public:
+    RemoteForwarder(const std::string& remoteHost, int port,
+                    const RemoteForwarderConfig& cfg = RemoteForwarderConfig(),
+                    RemoteTransport transport = RemoteTransport::Http)
+        : host(remoteHost), config(cfg), running(true) {
+        target = (transport == RemoteTransport::Stream ? "midi+tcp://" : "http://")
+               + host + ":" + std::to_string(port);
+        if (transport == RemoteTransport::Stream) {
+            stream = std::make_unique<MidiStreamClient>(host, port);
+        } else {
+            client = std::make_unique<httplib::Client>(host, port);
+            client->set_connection_timeout(1, 0);
+            client->set_read_timeout(2, 0);
+            client->set_keep_alive(true);
+            // Headers and body are separate writes; with Nagle each POST
+            // waits for the receiver's delayed ACK (~40 ms)
+            client->set_tcp_nodelay(true);
+        }
+        breakerCooldown = config.breakerInitialCooldown;
+        workerThread = std::thread([this]() { run(); });
+    }
+
+    ~RemoteForwarder() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            running = false;
+        }
+        cv.notify_one();
+        if (workerThread.joinable()) workerThread.join();
+    }
+
+    // Thread-safe: enqueue a message for delivery to destination on the
+    // remote server (see makeDestination). Returns immediately; encoding
+    // happens on the worker thread.
+    // dueUnixUs: when the remote should release it (0 = on arrival).
+    void send(const std::shared_ptr<const RemoteDestination>& destination, const MidiPacket& data,
+              const RemoteDeliveryPolicy& policy = RemoteDeliveryPolicy(),
+              int64_t dueUnixUs = 0) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            enqueueUnlocked(destination, data, policy, dueUnixUs);
+        }
+        cv.notify_one();
+    }
+
+    static std::shared_ptr<const RemoteDestination> makeDestination(const std::string& destPortId) {
+        auto destination = std::make_shared<RemoteDestination>();
+        destination->portId = destPortId;
+        destination->sendPath = sendPath(destPortId);
+        destination->portHash = std::hash<std::string>()(destPortId);
+        return destination;
+    }
+
+    RemoteForwarderStats getStats() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        RemoteForwarderStats stats;
+        stats.target = target;
+        stats.queueDepth = pendingQueue.size();
+        stats.queuedSysExBytes = queuedSysExBytes;
+        stats.messagesSent = messagesSent;
+        stats.messagesFailed = messagesFailed;
+        stats.droppedOverflow = droppedOverflow;
+        stats.droppedOverBudget = droppedOverBudget;
+        stats.droppedStale = droppedStale;
+        stats.coalesced = coalesced;
+        stats.breakerState = breakerState;
+        stats.consecutiveFailures = consecutiveFailures;
+        stats.queueDelay = queueDelay.snapshot();
+        stats.roundTrip = roundTrip.snapshot();
+        stats.memory = memoryAccount.getStats();
+        return stats;
+    }
+
+    // Path of the single-message JSON endpoint for a destination port
+    static std::string sendPath(const std::string& destPortId) {
+        if (destPortId.rfind("virtual:", 0) == 0) {
+            // Virtual port: /virtual/{id}/send
+            return "/virtual/" + destPortId.substr(8) + "/send";
+        }
+        // Physical port: /port/{id}/send
+        return "/port/" + destPortId + "/send";
+    }
+
+    static std::string jsonBody(const MidiPacket& data, int64_t dueUnixUs = 0) {
+        std::string body = "{\"message\":[";
+        for (size_t i = 0; i < data.size(); i++) {
+            if (i > 0) body += ',';
+            body += std::to_string((int)data[i]);
+        }
+        body += ']';
+        if (dueUnixUs != 0) body += ",\"timestampUs\":" + std::to_string(dueUnixUs);
+        body += '}';
+        return body;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // After falling back from running status, how long until it is tried again
+    static constexpr std::chrono::seconds runningStatusRetryInterval{60};
+
+    struct PendingMessage {
+        std::shared_ptr<const RemoteDestination> destination;
+        MidiPacket data;        // Empty: a discarded 14-bit LSB, skipped (removing would shift sequences)
+        Clock::time_point enqueuedAt;
+        RemoteDeliveryPolicy policy;
+        uint64_t sequence;      // Position key for coalesceIndex
+        int64_t dueUnixUs;      // Remote release time, 0 = on arrival
+    };
+
+    // Rejected: the host answered with an HTTP error, so it is reachable but
+    // the messages were not delivered (e.g. port not open remotely)
+    enum class SendResult { Ok, Rejected, Failed, Unsupported };
+
+    // Messages whose values are superseded by later ones: CC, pitch bend,
+    // channel and poly aftertouch. Bank select, data entry and (N)RPN
+    // selection are sequences, and channel mode messages are discrete
+    // commands, so those are never coalesced.
+    static bool isCoalescable(const MidiPacket& data) {
+        uint8_t type = data.empty() ? 0 : data[0] & 0xF0;
+        if (type == 0xD0) return data.size() == 2;
+        if (data.size() != 3) return false;
+        if (type == 0xE0 || type == 0xA0) return true;
+        if (type != 0xB0) return false;
+        uint8_t cc = data[1];
+        return !(cc == 0 || cc == 32 || cc == 6 || cc == 38 || (cc >= 96 && cc <= 101) || cc >= 120);
+    }
+
+    // Controllers 1-31 are the MSBs of 14-bit pairs whose LSB is cc + 32
+    static bool isControllerMsb(const MidiPacket& data) {
+        return (data[0] & 0xF0) == 0xB0 && data[1] < 32;
+    }
+
+    static bool isControllerLsb(const MidiPacket& data) {
+        return (data[0] & 0xF0) == 0xB0 && data[1] >= 32 && data[1] < 64;
+    }
+
+    // CC is keyed by controller and poly aftertouch by note; pitch bend and
+    // channel aftertouch have one value per channel
+    static uint64_t coalesceKey(const RemoteDestination& destination, uint8_t status, uint8_t data1) {
+        uint8_t type = status & 0xF0;
+        uint64_t controller = (type == 0xB0 || type == 0xA0) ? data1 : 0xFF;
+        return ((uint64_t)destination.portHash << 16) ^ ((uint64_t)status << 8) ^ controller;
+    }
+
+    static uint64_t coalesceKey(const RemoteDestination& destination, const MidiPacket& data) {
+        return coalesceKey(destination, data[0], data.size() > 1 ? data[1] : 0);
+    }
+
+    // Routes to the same port have their own RemoteDestination
+    static bool samePort(const PendingMessage& queued, const RemoteDestination& destination) {
+        return queued.destination.get() == &destination || queued.destination->portId == destination.portId;
+    }
+
+    // The queued message coalesceIndex holds for key, if it's still queued
+    // and still the same port, status and controller
+    PendingMessage* findCoalescableUnlocked(uint64_t key, const RemoteDestination& destination,
+                                            uint8_t status, uint8_t data1) {
+        auto it = coalesceIndex.find(key);
+        if (it == coalesceIndex.end() || pendingQueue.empty() ||
+            it->second < pendingQueue.front().sequence || it->second > pendingQueue.back().sequence) {
+            return nullptr;
+        }
+        // Index entries can outlive their message; confirm the match
+        auto& queued = pendingQueue[it->second - pendingQueue.front().sequence];
+        if (!samePort(queued, destination) || !isCoalescable(queued.data) || queued.data[0] != status) {
+            return nullptr;
+        }
+        uint8_t type = status & 0xF0;
+        if ((type == 0xB0 || type == 0xA0) && queued.data[1] != data1) return nullptr;
+        return &queued;
+    }
+
+    // Replaces a queued value of the same controller in place. For 14-bit
+    // CCs the pair must stay consistent: a new MSB discards the queued LSB
+    // that followed the old MSB (the receiver resets the LSB on each MSB, and
+    // the new LSB queues behind), and an LSB never jumps ahead of a newer MSB.
+    bool coalesceUnlocked(const RemoteDestination& destination, const MidiPacket& data, int64_t dueUnixUs) {
+        uint64_t key = coalesceKey(destination, data);
+        PendingMessage* queued = findCoalescableUnlocked(key, destination, data[0], data[1]);
+        if (!queued) return false;
+
+        if (isControllerLsb(data)) {
+            uint8_t msb = (uint8_t)(data[1] - 32);
+            PendingMessage* newerMsb = findCoalescableUnlocked(coalesceKey(destination, data[0], msb),
+                                                               destination, data[0], msb);
+            if (newerMsb && newerMsb->sequence > queued->sequence) return false;
+        } else if (isControllerMsb(data)) {
+            uint8_t lsb = (uint8_t)(data[1] + 32);
+            uint64_t lsbKey = coalesceKey(destination, data[0], lsb);
+            PendingMessage* staleLsb = findCoalescableUnlocked(lsbKey, destination, data[0], lsb);
+            if (staleLsb && staleLsb->sequence > queued->sequence) {
+                staleLsb->data = MidiPacket();
+                coalesceIndex.erase(lsbKey);
+                coalesced++;
+            }
+        }
+
+        queued->data = data;  // Keeps its queue position and age
+        queued->dueUnixUs = dueUnixUs;
+        coalesced++;
+        return true;
+    }
+
+    void enqueueUnlocked(const std::shared_ptr<const RemoteDestination>& destination, const MidiPacket& data,
+                         const RemoteDeliveryPolicy& policy, int64_t dueUnixUs) {
+        bool sysex = data.isSysEx();
+
+        if (policy.coalesce && isCoalescable(data) && coalesceUnlocked(*destination, data, dueUnixUs)) {
+            return;
+        }
+
+        if (sysex) {
+            if (queuedSysExBytes + data.size() > config.maxQueuedSysExBytes) {
+                droppedOverflow++;
+                return;
+            }
+            if (!memoryAccount.tryCharge(MidiMemoryAccount::payloadBytes(data))) {
+                droppedOverBudget++;
+                return;
+            }
+        } else if (pendingQueue.size() >= config.maxQueueMessages) {
+            // Make room by dropping the oldest message unless it is SysEx
+            if (pendingQueue.front().data.isSysEx()) {
+                droppedOverflow++;
+                return;
+            }
+            pendingQueue.pop_front();
+            droppedOverflow++;
+        }
+
+        uint64_t sequence = pendingQueue.empty() ? nextSequence : pendingQueue.back().sequence + 1;
+        nextSequence = sequence + 1;
+        pendingQueue.push_back({destination, data, Clock::now(), policy, sequence, dueUnixUs});
+        if (sysex) queuedSysExBytes += data.size();
+        if (policy.coalesce && isCoalescable(data)) {
+            coalesceIndex[coalesceKey(*destination, data)] = sequence;
+        }
+    }
+
+    PendingMessage popFrontUnlocked() {
+        PendingMessage msg = std::move(pendingQueue.front());
+        pendingQueue.pop_front();
+        if (msg.data.isSysEx()) {
+            queuedSysExBytes -= msg.data.size();
+            memoryAccount.release(MidiMemoryAccount::payloadBytes(msg.data));
+        }
+        if (pendingQueue.empty()) coalesceIndex.clear();
+        return msg;
+    }
+
+    static bool isStale(const PendingMessage& msg, Clock::time_point now) {
+        return msg.policy.maxAgeMs > 0 && !msg.data.isSysEx() &&
+               now - msg.enqueuedAt > std::chrono::milliseconds(msg.policy.maxAgeMs);
+    }
+
+    void run() {
+        resolveHost();
+        std::vector<PendingMessage> batch;
+        while (true) {
+            bool probing = false;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                cv.wait(lock, [this] { return !pendingQueue.empty() || !running; });
+                if (!running && (pendingQueue.empty() || breakerState != CircuitBreakerState::Closed)) return;
+
+                if (breakerState == CircuitBreakerState::Open) {
+                    // Host unreachable: don't attempt sends until the cooldown ends
+                    cv.wait_until(lock, breakerRetryAt, [this] { return !running; });
+                    if (!running) return;
+                    breakerState = CircuitBreakerState::HalfOpen;
+                }
+                probing = breakerState == CircuitBreakerState::HalfOpen;
+
+                bool batching = stream || (config.batching && batchSupported);
+                if (batching && !probing && config.maxBatchLatency.count() > 0 &&
+                    pendingQueue.size() < config.maxBatchMessages) {
+                    // Hold the first message briefly so a burst goes out together
+                    auto deadline = Clock::now() + config.maxBatchLatency;
+                    cv.wait_until(lock, deadline, [this] {
+                        return pendingQueue.size() >= config.maxBatchMessages || !running;
+                    });
+                }
+
+                size_t limit = (batching && !probing) ? config.maxBatchMessages : 1;
+                auto now = Clock::now();
+                while (!pendingQueue.empty() && batch.size() < limit) {
+                    PendingMessage msg = popFrontUnlocked();
+                    if (msg.data.empty()) continue;  // Coalesced-away LSB
+                    if (isStale(msg, now)) {
+                        droppedStale++;
+                        continue;
+                    }
+                    queueDelay.record((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                        now - msg.enqueuedAt).count());
+                    batch.push_back(std::move(msg));
+                }
+            }
+
+            if (batch.empty()) continue;
+
+            if (resolveNeeded) resolveHost();
+            deliver(batch);
+            batch.clear();
+        }
+    }
+
+    void deliver(std::vector<PendingMessage>& batch) {
+        if (stream) {
+            recordResult(batch, 0, batch.size(), sendStreamFrame(batch));
+            recordStreamLosses();
+            return;
+        }
+
+        if (batch.size() > 1) {
+            SendResult result = postBatch(batch);
+            if (result != SendResult::Unsupported) {
+                recordResult(batch, 0, batch.size(), result);
+                return;
+            }
+        }
+
+        // Single message, or remote doesn't support /batch - deliver individually
+        for (size_t i = 0; i < batch.size(); i++) {
+            SendResult result = postSingle(batch[i]);
+            if (result == SendResult::Failed) {
+                // Host unreachable: the rest would only wait out the same timeout
+                recordResult(batch, i, batch.size(), result);
+                return;
+            }
+            recordResult(batch, i, i + 1, result);
+        }
+    }
+
+    // Updates counters and the circuit breaker after a delivery attempt of
+    // batch[begin, end). SysEx from a failed attempt goes back to the front
+    // of the queue; rejected messages are counted as failed and not retried.
+    void recordResult(std::vector<PendingMessage>& batch, size_t begin, size_t end, SendResult result) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (result != SendResult::Failed) {
+            if (result == SendResult::Ok) messagesSent += end - begin;
+            else messagesFailed += end - begin;
+            consecutiveFailures = 0;
+            if (breakerState != CircuitBreakerState::Closed) {
+                std::cout << "[RouteManager] " << target << " reachable again" << std::endl;
+            }
+            breakerState = CircuitBreakerState::Closed;
+            breakerCooldown = config.breakerInitialCooldown;
+            return;
+        }
+
+        resolveNeeded = true;
+        runningStatusSupported = true;   // The host may come back as a newer version
+        for (size_t i = end; i-- > begin;) {
+            PendingMessage& msg = batch[i];
+            if (msg.data.isSysEx() && running) {
+                msg.sequence = pendingQueue.empty() ? nextSequence++ : pendingQueue.front().sequence - 1;
+                queuedSysExBytes += msg.data.size();
+                memoryAccount.charge(MidiMemoryAccount::payloadBytes(msg.data));
+                pendingQueue.push_front(std::move(msg));
+            } else {
+                messagesFailed++;
+            }
+        }
+
+        consecutiveFailures++;
+        if (breakerState == CircuitBreakerState::HalfOpen ||
+            consecutiveFailures >= config.breakerFailureThreshold) {
+            if (breakerState != CircuitBreakerState::Open) {
+                std::cerr << "[RouteManager] " << target << " unreachable; pausing sends for "
+                          << breakerCooldown.count() << "ms" << std::endl;
+            }
+            breakerState = CircuitBreakerState::Open;
+            breakerRetryAt = Clock::now() + breakerCooldown;
+            breakerCooldown = std::min(breakerCooldown * 2, config.breakerMaxCooldown);
+        }
+    }
+
+    // Frames already counted as sent that their connection dropped unacked
+    void recordStreamLosses() {
+        uint64_t lost = stream->takeMessagesLost();
+        if (lost == 0) return;
+        std::lock_guard<std::mutex> lock(queueMutex);
+        lost = std::min(lost, messagesSent);
+        messagesSent -= lost;
+        messagesFailed += lost;
+    }
+
+    SendResult postSingle(const PendingMessage& msg) {
+        try {
+            auto start = Clock::now();
+            auto res = client->Post(msg.destination->sendPath, jsonBody(msg.data, msg.dueUnixUs),
+                                    "application/json");
+            if (res) roundTrip.recordSince(start);
+            if (!res || res->status != 200) {
+                std::cerr << "[RouteManager] Remote forward failed: "
+                          << (res ? std::to_string(res->status) : "connection failed")
+                          << std::endl;
+                // Only transport errors count towards the breaker; HTTP errors
+                // (e.g. port not open remotely) mean the host is reachable
+                return res ? SendResult::Rejected : SendResult::Failed;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "[RouteManager] Remote forward exception: " << e.what() << std::endl;
+            return SendResult::Failed;
+        }
+        return SendResult::Ok;
+    }
+
+    SendResult postBatch(const std::vector<PendingMessage>& batch) {
+        if (!runningStatusSupported && Clock::now() >= runningStatusRetryAt) runningStatusSupported = true;
+        encodeBatch(batch);
+
+        try {
+            auto start = Clock::now();
+            auto res = client->Post("/batch", encoder.finish(), MidiBatchEncoder::contentType);
+            if (res) roundTrip.recordSince(start);
+            if (res && res->status == 404) {
+                std::cerr << "[RouteManager] Remote server has no /batch endpoint; "
+                          << "falling back to per-message forwarding" << std::endl;
+                batchSupported = false;
+                return SendResult::Unsupported;
+            }
+            if (res && res->status == 400 && runningStatusSupported) {
+                // Receivers that predate version 3 reject the batch as malformed.
+                // Only a retry that goes through shows that; the previous
+                // encoding is then used for a while, or until the host drops out.
+                runningStatusSupported = false;
+                runningStatusRetryAt = Clock::now() + runningStatusRetryInterval;
+                SendResult retry = postBatch(batch);
+                if (retry == SendResult::Ok) {
+                    std::cerr << "[RouteManager] " << target << " rejected a running-status batch; "
+                              << "using the previous batch encoding" << std::endl;
+                } else {
+                    runningStatusSupported = true;
+                }
+                return retry;
+            }
+            if (!res || res->status != 200) {
+                std::cerr << "[RouteManager] Remote batch forward failed: "
+                          << (res ? std::to_string(res->status) : "connection failed")
+                          << " (" << batch.size() << " messages)" << std::endl;
+                return res ? SendResult::Rejected : SendResult::Failed;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "[RouteManager] Remote batch forward exception: " << e.what() << std::endl;
+            return SendResult::Failed;
+        }
+        return SendResult::Ok;
+    }
+
+    // Timestamps only when a message has a due time, and running status only
+    // for receivers known to accept it, so older receivers keep working
+    void encodeBatch(const std::vector<PendingMessage>& batch) {
+        bool timestamped = std::any_of(batch.begin(), batch.end(),
+                                       [](const PendingMessage& msg) { return msg.dueUnixUs != 0; });
+        bool runningStatus = stream ? stream->acceptsRunningStatus() : runningStatusSupported;
+        encoder.reset(timestamped, runningStatus);
+        for (const auto& msg : batch) encoder.add(msg.destination->portId, msg.data, msg.dueUnixUs);
+    }
+
+    SendResult sendStreamFrame(const std::vector<PendingMessage>& batch) {
+        encodeBatch(batch);
+        if (!stream->sendFrame(encoder.finish(), batch.size())) {
+            std::cerr << "[RouteManager] Remote stream forward failed ("
+                      << batch.size() << " messages)" << std::endl;
+            return SendResult::Failed;
+        }
+        return SendResult::Ok;
+    }
+
+    // Runs on the worker thread. A stream client keeps every address of the
+    // host to try in turn. An HTTP client is pinned to the address only when
+    // the name has just one, since httplib can't fall back from a pinned
+    // address (e.g. "localhost" to 127.0.0.1 when ::1 refuses).
+    void resolveHost() {
+        resolveNeeded = false;
+        if (stream) {
+            stream->resolve();
+            return;
+        }
+        std::vector<std::string> addresses;
+        httplib::hosted_at(host, addresses);
+        if (addresses.empty()) {
+            std::cerr << "[RouteManager] Cannot resolve " << host << std::endl;
+        }
+        std::map<std::string, std::string> pinned;
+        if (addresses.size() == 1 && addresses.front() != host) pinned[host] = addresses.front();
+        client->set_hostname_addr_map(std::move(pinned));
+    }
+
+    std::string host;
+    std::string target;
+    std::unique_ptr<httplib::Client> client;         // Http transport
+    std::unique_ptr<MidiStreamClient> stream;        // Stream transport
+    RemoteForwarderConfig config;
+
+    MidiMemoryAccount memoryAccount;   // Queued SysEx payloads
+
+    // Guarded by queueMutex
+    std::deque<PendingMessage> pendingQueue;
+    std::unordered_map<uint64_t, uint64_t> coalesceIndex;  // key -> sequence of latest queued value
+    uint64_t nextSequence = 1ull << 32;   // Headroom for re-queuing at the front
+    size_t queuedSysExBytes = 0;
+    uint64_t messagesSent = 0;
+    uint64_t messagesFailed = 0;
+    uint64_t droppedOverflow = 0;
+    uint64_t droppedOverBudget = 0;
+    uint64_t droppedStale = 0;
+    uint64_t coalesced = 0;
+    CircuitBreakerState breakerState = CircuitBreakerState::Closed;
+    int consecutiveFailures = 0;
+    Clock::time_point breakerRetryAt;
+    std::chrono::milliseconds breakerCooldown;
+
+    std::mutex queueMutex;
+    std::condition_variable cv;
+    std::thread workerThread;
+    bool running;
+
+    // Recorded by the worker thread, read by getStats()
+    LatencyHistogram queueDelay;
+    LatencyHistogram roundTrip;
+
+    // Worker-thread state
+    bool resolveNeeded = false;
+    bool batchSupported = true;
+    bool runningStatusSupported = true;   // Http transport; streams negotiate in the handshake
+    Clock::time_point runningStatusRetryAt;   // When to try running status again after a fallback
+    MidiBatchEncoder encoder;
+};
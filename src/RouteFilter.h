@@ -0,0 +1,337 @@
+/**
+ * RouteFilter - Per-route filtering and transformation of MIDI messages
+ *
+ * RouteFilter is the route's "filter" object as stored in routes.json and
+ * sent over HTTP. RouteFilterPipeline is the form the MIDI thread runs:
+ * bit masks and lookup tables built once per route edit, so processing a
+ * message is a couple of mask tests and table reads - no locks and no
+ * allocation.
+ *
+ * Stages, in order (channel-voice messages only, except the type mask):
+ * - message-type mask       drop e.g. active sensing or clock
+ * - channel mask            source channels 1-16 to let through
+ * - note range              source notes outside [min, max] are dropped
+ * - transpose               notes moved out of 0-127 are dropped
+ * - channel remap           source channel -> destination channel
+ * - CC remap                controller number -> controller number
+ * - velocity curve          note-on velocity -> min + (max - min) * (v/127)^curve
+ *
+ * Running on the source port's MIDI thread means filtered traffic never
+ * reaches a local destination or a RemoteForwarder queue.
+ */
+
+#pragma once
+
+#include "JsonBuilder.h"
+#include "JsonReader.h"
+#include "MidiPacket.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Message categories for the type mask; names are the JSON spelling
+enum class MidiMessageKind : uint8_t {
+    NoteOff, NoteOn, PolyPressure, ControlChange, ProgramChange, ChannelPressure, PitchBend,
+    SysEx, SystemCommon, Clock, Transport, ActiveSensing, Reset
+};
+
+constexpr size_t midiMessageKindCount = 13;
+
+inline const char* midiMessageKindName(MidiMessageKind kind) {
+    static const char* names[midiMessageKindCount] = {
+        "noteOff", "noteOn", "polyPressure", "controlChange", "programChange", "channelPressure",
+        "pitchBend", "sysex", "systemCommon", "clock", "transport", "activeSensing", "reset"};
+    return names[(size_t)kind];
+}
+
+// Note-on with velocity 0 counts as note-off. message[0] must be a status
+// byte (0x80 or above).
+inline MidiMessageKind classifyMidiMessage(const MidiPacket& message) {
+    uint8_t status = message[0];
+    if (status < 0xF0) {
+        uint8_t type = status >> 4;
+        if (type == 0x9 && message.size() >= 3 && message[2] == 0) return MidiMessageKind::NoteOff;
+        return (MidiMessageKind)(type - 0x8);
+    }
+    switch (status) {
+        case 0xF0: return MidiMessageKind::SysEx;
+        case 0xF8: return MidiMessageKind::Clock;
+        case 0xFA: case 0xFB: case 0xFC: return MidiMessageKind::Transport;
+        case 0xFE: return MidiMessageKind::ActiveSensing;
+        case 0xFF: return MidiMessageKind::Reset;
+        default: return MidiMessageKind::SystemCommon;
+    }
+}
+
+struct RouteFilter {
+    static constexpr uint16_t allChannels = 0xFFFF;
+    static constexpr uint16_t allKinds = (1u << midiMessageKindCount) - 1;
+
+    uint16_t channelMask = allChannels;   // Bit n = channel n + 1
+    uint16_t kindMask = allKinds;         // Bit n = MidiMessageKind n
+    uint8_t noteMin = 0;
+    uint8_t noteMax = 127;
+    int transpose = 0;
+    std::array<uint8_t, 16> channelMap = identityMap<16>();    // 0-based channels
+    std::array<uint8_t, 128> ccMap = identityMap<128>();
+    int velocityCurve = 100;              // Exponent in percent: <100 boosts soft notes
+    uint8_t velocityMin = 1;
+    uint8_t velocityMax = 127;
+
+    bool operator==(const RouteFilter& other) const {
+        return channelMask == other.channelMask && kindMask == other.kindMask &&
+               noteMin == other.noteMin && noteMax == other.noteMax && transpose == other.transpose &&
+               channelMap == other.channelMap && ccMap == other.ccMap &&
+               velocityCurve == other.velocityCurve && velocityMin == other.velocityMin &&
+               velocityMax == other.velocityMax;
+    }
+    bool operator!=(const RouteFilter& other) const { return !(*this == other); }
+
+    bool isPassThrough() const { return *this == RouteFilter(); }
+
+    // Reads a filter object; see README for the fields. On failure error says
+    // which field was out of range (or is empty for a JSON syntax error).
+    // Invalid values are still consumed, so the reader can carry on past a
+    // rejected filter (e.g. to the next route in routes.json).
+    bool read(JsonReader& reader, std::string& error) {
+        *this = RouteFilter();
+        error.clear();
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key == "channels") {
+                channelMask = 0;
+                return reader.readArray([&] {
+                    int channel;
+                    if (!readInt(reader, 1, 16, "channels", channel, error)) return false;
+                    channelMask |= (uint16_t)(1u << (channel - 1));
+                    return true;
+                });
+            }
+            if (key == "types" || key == "dropTypes") {
+                bool allow = key == "types";
+                uint16_t listed = 0;
+                std::string name;
+                bool typesRead = reader.readArray([&] {
+                    if (!reader.readString(name)) return false;
+                    for (size_t i = 0; i < midiMessageKindCount; i++) {
+                        if (name == midiMessageKindName((MidiMessageKind)i)) {
+                            listed |= (uint16_t)(1u << i);
+                            return true;
+                        }
+                    }
+                    setError(error, "unknown message type \"" + name + "\"");
+                    return true;
+                });
+                if (!typesRead) return false;
+                kindMask &= allow ? listed : (uint16_t)~listed;
+                return true;
+            }
+            if (key == "noteRange") {
+                int bounds[2];
+                int count = 0;
+                bool rangeRead = reader.readArray([&] {
+                    if (count == 2) {
+                        count++;
+                        return reader.skipValue();
+                    }
+                    return readInt(reader, 0, 127, "noteRange", bounds[count++], error);
+                });
+                if (!rangeRead) return false;
+                if (count != 2 || bounds[0] > bounds[1]) {
+                    setError(error, "noteRange must be [min, max]");
+                    return true;
+                }
+                noteMin = (uint8_t)bounds[0];
+                noteMax = (uint8_t)bounds[1];
+                return true;
+            }
+            if (key == "transpose") return readInt(reader, -127, 127, "transpose", transpose, error);
+            if (key == "channelMap") return readMap(reader, 1, 16, "channelMap", channelMap.data(), error);
+            if (key == "ccMap") return readMap(reader, 0, 127, "ccMap", ccMap.data(), error);
+            if (key == "velocity") {
+                return reader.readObject([&](std::string_view field) {
+                    int value;
+                    if (field == "min") {
+                        if (!readInt(reader, 1, 127, "velocity.min", value, error)) return false;
+                        velocityMin = (uint8_t)value;
+                        return true;
+                    }
+                    if (field == "max") {
+                        if (!readInt(reader, 1, 127, "velocity.max", value, error)) return false;
+                        velocityMax = (uint8_t)value;
+                        return true;
+                    }
+                    if (field == "curve") return readInt(reader, 10, 1000, "velocity.curve", velocityCurve, error);
+                    return reader.skipValue();
+                });
+            }
+            return reader.skipValue();
+        });
+        return parsed && error.empty();
+    }
+
+    // Writes only the fields that differ from pass-through ({} for none)
+    void write(JsonBuilder& json) const {
+        json.startObject();
+        if (channelMask != allChannels) {
+            json.key("channels").startArray();
+            for (int ch = 0; ch < 16; ch++) {
+                if (channelMask & (1u << ch)) json.arrayValue(ch + 1);
+            }
+            json.endArray();
+        }
+        if (kindMask != allKinds) {
+            // Whichever list is shorter: "dropTypes": ["activeSensing"] reads
+            // better than the twelve types it lets through
+            size_t allowed = 0;
+            for (size_t i = 0; i < midiMessageKindCount; i++) allowed += (kindMask >> i) & 1u;
+            bool listDropped = allowed > midiMessageKindCount / 2;
+            json.key(listDropped ? "dropTypes" : "types").startArray();
+            for (size_t i = 0; i < midiMessageKindCount; i++) {
+                bool isAllowed = (kindMask >> i) & 1u;
+                if (isAllowed != listDropped) json.arrayValue(std::string(midiMessageKindName((MidiMessageKind)i)));
+            }
+            json.endArray();
+        }
+        if (noteMin != 0 || noteMax != 127) {
+            json.key("noteRange").startArray().arrayValue(noteMin).arrayValue(noteMax).endArray();
+        }
+        if (transpose != 0) json.key("transpose").value(transpose);
+        writeMap(json, "channelMap", channelMap.data(), 16, 1);
+        writeMap(json, "ccMap", ccMap.data(), 128, 0);
+        if (velocityCurve != 100 || velocityMin != 1 || velocityMax != 127) {
+            json.key("velocity").startObject()
+                .key("curve").value(velocityCurve)
+                .key("min").value((int)velocityMin)
+                .key("max").value((int)velocityMax)
+                .endObject();
+        }
+        json.endObject();
+    }
+
+private:
+    template <size_t N>
+    static std::array<uint8_t, N> identityMap() {
+        std::array<uint8_t, N> map{};
+        for (size_t i = 0; i < N; i++) map[i] = (uint8_t)i;
+        return map;
+    }
+
+    // Keeps the first error
+    static void setError(std::string& error, const std::string& message) {
+        if (error.empty()) error = message;
+    }
+
+    // False only for a syntax error; an out-of-range value sets error and
+    // yields min
+    static bool readInt(JsonReader& reader, int min, int max, const char* field,
+                        int& out, std::string& error) {
+        long long value;
+        if (!reader.readInteger(value)) return false;
+        if (value < min || value > max) {
+            setError(error, std::string(field) + " must be between " + std::to_string(min) +
+                            " and " + std::to_string(max));
+            value = min;
+        }
+        out = (int)value;
+        return true;
+    }
+
+    // {"1": 2, ...}; base 1 for channels (stored 0-based), 0 for controllers
+    static bool readMap(JsonReader& reader, int min, int max, const char* field,
+                        uint8_t* map, std::string& error) {
+        return reader.readObject([&](std::string_view key) {
+            int from = 0;
+            bool numeric = !key.empty() && key.size() <= 3;
+            for (char c : key) {
+                if (c < '0' || c > '9') numeric = false;
+                else from = from * 10 + (c - '0');
+            }
+            if (!numeric || from < min || from > max) {
+                setError(error, std::string(field) + " keys must be between " + std::to_string(min) +
+                                " and " + std::to_string(max));
+                return reader.skipValue();
+            }
+            int to;
+            if (!readInt(reader, min, max, field, to, error)) return false;
+            map[from - min] = (uint8_t)(to - min);
+            return true;
+        });
+    }
+
+    static void writeMap(JsonBuilder& json, const char* field, const uint8_t* map,
+                         size_t size, int base) {
+        bool any = false;
+        for (size_t i = 0; i < size; i++) {
+            if (map[i] == i) continue;
+            if (!any) json.key(field).startObject();
+            any = true;
+            json.key(std::to_string(i + base)).value((int)map[i] + base);
+        }
+        if (any) json.endObject();
+    }
+};
+
+class RouteFilterPipeline
+{
+public:
+    RouteFilterPipeline() = default;
+
+    explicit RouteFilterPipeline(const RouteFilter& filter)
+        : config(filter), passThrough(filter.isPassThrough()) {
+        velocityTable[0] = 0;
+        for (int v = 1; v < 128; v++) {
+            double shaped = std::pow(v / 127.0, filter.velocityCurve / 100.0);
+            long scaled = std::lround(filter.velocityMin + (filter.velocityMax - filter.velocityMin) * shaped);
+            velocityTable[v] = (uint8_t)std::max(1L, std::min(127L, scaled));
+        }
+    }
+
+    bool isPassThrough() const { return passThrough; }
+
+    // Returns false if the message is filtered out; otherwise out holds the
+    // (possibly transformed) message. SysEx and system messages are only
+    // subject to the type mask and keep their shared payload.
+    bool process(const MidiPacket& in, MidiPacket& out) const {
+        // A data byte where the status should be has no kind to filter on
+        if (in.empty() || in[0] < 0x80) return false;
+        MidiMessageKind kind = classifyMidiMessage(in);
+        if (!(config.kindMask & (1u << (unsigned)kind))) return false;
+
+        uint8_t status = in[0];
+        if (status >= 0xF0 || in.size() > 3) {
+            out = in;
+            return true;
+        }
+
+        uint8_t channel = status & 0x0F;
+        if (!(config.channelMask & (1u << channel))) return false;
+
+        uint8_t bytes[3] = {0, 0, 0};
+        for (size_t i = 0; i < in.size(); i++) bytes[i] = in[i];
+        bytes[0] = (uint8_t)((status & 0xF0) | config.channelMap[channel]);
+
+        bool hasData1 = in.size() >= 2;
+        if (kind == MidiMessageKind::NoteOff || kind == MidiMessageKind::NoteOn ||
+            kind == MidiMessageKind::PolyPressure) {
+            if (!hasData1 || bytes[1] < config.noteMin || bytes[1] > config.noteMax) return false;
+            int note = bytes[1] + config.transpose;
+            if (note < 0 || note > 127) return false;
+            bytes[1] = (uint8_t)note;
+            if (kind == MidiMessageKind::NoteOn && in.size() == 3) bytes[2] = velocityTable[bytes[2] & 0x7F];
+        } else if (kind == MidiMessageKind::ControlChange && hasData1) {
+            bytes[1] = config.ccMap[bytes[1] & 0x7F];
+        }
+
+        out = MidiPacket(bytes, in.size());
+        return true;
+    }
+
+private:
+    RouteFilter config;
+    bool passThrough = true;
+    std::array<uint8_t, 128> velocityTable{};
+};
@@ -4,30 +4,88 @@
  * Manages MIDI routes in C++ for sub-millisecond local message forwarding
  * and HTTP-based forwarding for remote servers.
  *
- * Thread-safe: All operations are mutex-protected as callbacks
- * run on JUCE MIDI threads.
+ * Thread-safe: Route edits are mutex-protected and publish an immutable
+ * dispatch table; MIDI threads read that table without taking routesMutex.
+ *
+ * Persistence is asynchronous: an edit only marks the routes dirty. A
+ * background thread writes routes.json once edits pause for persistDebounce
+ * (at most persistMaxDelay after the first unsaved edit), snapshotting the
+ * routes under routesMutex and doing the I/O without it. The file is written
+ * to a temporary sibling and renamed over the old one, so a crash mid-write
+ * never leaves a truncated config.
+ *
+ * Fan-out (opt-in, setFanOutThreads): local immediate destinations are
+ * delivered by MidiFanOut lanes instead of one after another on the source's
+ * input thread. Once fan-out is on, every such destination always goes
+ * through its lane, even for a source with one destination: a route edit
+ * that switched a source between the inline and the lane path could let an
+ * inline send overtake messages still queued on the lane.
+ *
+ * Native thru (opt-in, setNativeThruResolver): enabled local device-to-device
+ * routes without filter or latency are handed to the connector (the server
+ * passes NativeMidiThru::connect), so the OS delivers them, and are left out
+ * of the dispatch table. Every other route, and any route the OS connection
+ * can't be made for, uses the dispatch path.
+ *
+ * SysEx streaming: a streaming input hands each SysEx fragment over as it
+ * arrives (MidiInputPart::SysExChunk). Only local, immediate, unfiltered
+ * routes take fragments, and only where the OS output can send SysEx in
+ * pieces (midiOutputTakesSysExInPieces); they go to the fragment forwarder,
+ * since a regular send refuses them. The rest get the assembled message
+ * when it is complete (StreamedSysEx), since filters, the scheduler and the
+ * wire format work on whole messages.
+ *
+ * Remote destinations are resolved when a route is added or loaded: its
+ * dispatch entry holds the host's RemoteForwarder and the destination's
+ * precomputed send path, so the MIDI thread neither parses serverUrl nor
+ * looks the forwarder up. A serverUrl that can't be parsed leaves the route
+ * without a forwarder (its messages are dropped). Forwarders no route refers
+ * to any more are torn down by the persist thread after the next save.
+ *
+ * Config versions: every change to a route (including its native status)
+ * stamps it with the next config version, and removals leave a tombstone,
+ * so getRouteChanges(since) returns just what a poller hasn't seen.
+ * Counters are not part of the config and don't change the version.
  */
 
 #pragma once
 
-#include "httplib.h"
-
+#include "JsonReader.h"
+#include "Metrics.h"
+#include "MidiFanOut.h"
+#include "MidiOutputSender.h"
+#include "MidiPacket.h"
+#include "MidiScheduler.h"
+#include "MidiSysExAssembler.h"
+#include "NativeMidiThru.h"
+#include "RemoteForwarder.h"
+#include "RouteFilter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <mutex>
-#include <queue>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
+#include <io.h>
 #include <shlobj.h>
 #include <windows.h>
 #else
@@ -37,140 +95,286 @@
 #endif
 
 struct RouteEndpoint {
-    std::string serverUrl;  // "local" for local server, or "http://host:port"
+    std::string serverUrl;  // "local", "http://host:port", or "midi+tcp://host:streamPort"
     std::string portId;     // e.g., "input-0", "virtual:abc123"
     std::string portName;   // Human-readable name
+
+    bool operator==(const RouteEndpoint& other) const {
+        return serverUrl == other.serverUrl && portId == other.portId && portName == other.portName;
+    }
+    bool operator!=(const RouteEndpoint& other) const { return !(*this == other); }
 };
 
 struct MidiRoute {
     std::string id;
-    bool enabled;
+    bool enabled = true;
     RouteEndpoint source;
     RouteEndpoint destination;
-    uint64_t messagesForwarded;
+    RemoteDeliveryPolicy delivery;   // Only applies to remote destinations
+    uint32_t latencyMs = 0;          // Fixed delay from capture to delivery; 0 = immediate
+    RouteFilter filter;              // Applied on the source's MIDI thread
+    uint64_t messagesForwarded = 0;
+    bool native = false;             // Live status, not saved: delivered by NativeMidiThru
+    uint64_t version = 0;            // Live, not saved: config version of the last change
+};
+
+// Routes changed after a config version, for GET /routes?since=
+struct RouteChanges {
+    uint64_t version = 0;             // Current config version
+    bool full = false;                // The whole route set: `since` was too old or unknown
+    std::vector<MidiRoute> routes;    // Added or changed; messagesForwarded is not filled in
+    std::vector<std::string> removed;
 };
 
 // Callback type for sending messages to local destination ports
 using LocalMessageForwarder = std::function<void(const std::string& destPortId,
-                                                  const std::vector<uint8_t>& data)>;
+                                                  const MidiPacket& data)>;
+
+// Resolves a route's endpoints to device identifiers for NativeMidiThru;
+// false keeps the route on the dispatch path
+using NativeThruResolver = std::function<bool(const MidiRoute& route,
+                                              std::string& sourceIdentifier,
+                                              std::string& destinationIdentifier)>;
+
+// Makes the OS link for a resolved device pair; nullptr, with error set, on failure
+using NativeThruConnector = std::function<std::unique_ptr<NativeMidiThru::Connection>(
+    const std::string& sourceIdentifier, const std::string& destinationIdentifier, std::string& error)>;
+
+// Callback type for sending to a local port at a later time (fixed-latency routes)
+using LocalMessageScheduler = std::function<void(std::chrono::steady_clock::time_point due,
+                                                  const std::string& destPortId,
+                                                  const MidiPacket& data)>;
 
 /**
- * RemoteForwarder - Persistent-connection HTTP forwarder for a single remote host.
+ * RouteDispatchEntry - Per-route state referenced from the dispatch table.
  *
- * Maintains one TCP connection and one worker thread per remote MIDI server.
- * Messages are queued and sent in order, eliminating per-message TCP handshake
- * overhead and preventing out-of-order delivery.
+ * One entry exists per route for the route's lifetime, so its counter
+ * survives dispatch table rebuilds (enable/disable, other routes changing).
  */
-class RemoteForwarder {
+struct RouteDispatchEntry {
+    std::string routeId;
+    RouteEndpoint destination;
+    RemoteDeliveryPolicy delivery;
+    uint32_t latencyMs = 0;
+    RouteFilter filter;
+    RouteFilterPipeline pipeline;
+    bool fansOut = false;        // Local and immediate: may be delivered by a fan-out lane
+    bool streamsSysEx = false;   // Local, immediate and unfiltered: takes SysEx fragments
+    size_t fanOutLane = 0;       // Fixed per destination port, which keeps its order
+    std::shared_ptr<RemoteForwarder> remote;   // Remote destination; null if local or serverUrl is invalid
+    std::shared_ptr<const RemoteDestination> remoteDestination;
+    std::atomic<uint64_t> messagesForwarded{0};
+    std::atomic<uint64_t> messagesFiltered{0};
+    std::atomic<uint64_t> bytesForwarded{0};
+    LatencyHistogram latency;   // Source callback to local send (done) / remote enqueue
+};
+
+// Point-in-time view of a route's counters for GET /metrics
+struct RouteMetricsSnapshot {
+    std::string routeId;
+    bool enabled;
+    bool native;   // Delivered by the OS; the counters below don't see its messages
+    uint64_t messagesForwarded;
+    uint64_t messagesFiltered;
+    uint64_t bytesForwarded;
+    LatencyHistogram::Snapshot latency;
+};
+
+/**
+ * RouteDispatchTable - Immutable snapshot of enabled routes keyed by source port.
+ *
+ * Rebuilt under routesMutex on every route edit and published with an atomic
+ * shared_ptr swap. MIDI threads load the current snapshot and iterate it
+ * without locking, allocating or copying routes; a snapshot stays alive until
+ * the last reader holding it returns.
+ */
+struct RouteDispatchTable {
+    struct SourceRoutes {
+        std::vector<std::shared_ptr<RouteDispatchEntry>> entries;
+        size_t fanOutCount = 0;   // Entries handed to fan-out lanes
+    };
+    std::unordered_map<std::string, SourceRoutes> routesBySource;
+    LocalMessageForwarder localForwarder;
+    LocalMessageForwarder localFragmentForwarder;   // SysEx fragments (see setLocalFragmentForwarder)
+    LocalMessageScheduler localScheduler;
+    MidiFanOut<RouteDispatchEntry>* fanOut = nullptr;  // Owned by RouteManager
+};
+
+class RouteManager {
 public:
-    RemoteForwarder(const std::string& host, int port)
-        : client(host, port), running(true) {
-        client.set_connection_timeout(1, 0);
-        client.set_read_timeout(2, 0);
-        client.set_keep_alive(true);
-        workerThread = std::thread([this]() { run(); });
-    }
+    // A burst of edits (e.g. restoring a session) is written once
+    static constexpr std::chrono::milliseconds persistDebounce{250};
+    static constexpr std::chrono::milliseconds persistMaxDelay{2000};
 
-    ~RemoteForwarder() {
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            running = false;
-        }
-        cv.notify_one();
-        if (workerThread.joinable()) workerThread.join();
+    // Tombstones kept for deltas; a poller further behind gets the full set
+    static constexpr size_t maxRemovedRoutes = 1024;
+
+    explicit RouteManager(const std::string& configPath = "")
+        : configFilePath(configPath.empty() ? getDefaultConfigPath() : configPath),
+          dispatchTable(std::make_shared<const RouteDispatchTable>()),
+          configVersion(initialConfigVersion()),
+          deltaFloor(configVersion.load()) {
+        loadFromDisk();
+        persistThread = std::thread([this]() { runPersistence(); });
     }
 
-    // Thread-safe: enqueue a message for delivery. Returns immediately.
-    void send(const std::string& path, const std::string& body) {
+    // Writes any unsaved edits before returning
+    ~RouteManager() {
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            pendingQueue.push({path, body});
+            std::lock_guard<std::mutex> lock(persistMutex);
+            persistRunning = false;
         }
-        cv.notify_one();
+        persistCv.notify_one();
+        if (persistThread.joinable()) persistThread.join();
     }
 
-private:
-    struct PendingMessage {
-        std::string path;
-        std::string body;
-    };
+    RouteManager(const RouteManager&) = delete;
+    RouteManager& operator=(const RouteManager&) = delete;
 
-    void run() {
-        while (true) {
-            PendingMessage msg;
+    // Recreates the forwarders of the routes loaded so far with the new
+    // config. Set once, before routing starts.
+    void setRemoteForwarderConfig(const RemoteForwarderConfig& config) {
+        {
+            std::lock_guard<std::mutex> lock(routesMutex);
             {
-                std::unique_lock<std::mutex> lock(queueMutex);
-                cv.wait(lock, [this] { return !pendingQueue.empty() || !running; });
-                if (!running && pendingQueue.empty()) return;
-                msg = std::move(pendingQueue.front());
-                pendingQueue.pop();
+                std::lock_guard<std::mutex> forwardersLock(forwardersMutex);
+                remoteConfig = config;
+                for (auto& [key, forwarder] : forwarders) retiredForwarders.push_back(std::move(forwarder));
+                forwarders.clear();
             }
-            try {
-                auto res = client.Post(msg.path, msg.body, "application/json");
-                if (!res || res->status != 200) {
-                    std::cerr << "[RouteManager] Remote forward failed: "
-                              << (res ? std::to_string(res->status) : "connection failed")
-                              << std::endl;
-                }
-            } catch (const std::exception& e) {
-                std::cerr << "[RouteManager] Remote forward exception: " << e.what() << std::endl;
+            // Published entries are read lock-free, so remote routes get new
+            // entries pointing at new forwarders rather than being re-pointed
+            for (const auto& [id, route] : routes) {
+                if (!isLocalDestination(route.destination.serverUrl)) createDispatchEntryUnlocked(route, true);
             }
+            rebuildDispatchTableUnlocked();
         }
+        releaseIdleForwarders();
     }
 
-    httplib::Client client;
-    std::queue<PendingMessage> pendingQueue;
-    std::mutex queueMutex;
-    std::condition_variable cv;
-    std::thread workerThread;
-    bool running;
-};
+    // Sends to several local destinations of one source in parallel on
+    // `threads` lanes (0 = inline, the default). Set once, before routing starts.
+    void setFanOutThreads(size_t threads) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        if (fanOut || threads == 0) return;
+        fanOut = std::make_unique<MidiFanOut<RouteDispatchEntry>>(
+            threads, [this](RouteDispatchEntry& entry, const MidiPacket& packet,
+                            std::chrono::steady_clock::time_point capturedAt, bool sysexFragment) {
+                deliverFannedOut(entry, packet, capturedAt, sysexFragment);
+            });
+        // Entries created so far have no lane yet; published ones are read
+        // lock-free, so they are replaced rather than given one
+        for (const auto& [id, route] : routes) {
+            auto entryIt = dispatchEntries.find(id);
+            if (entryIt != dispatchEntries.end() && entryIt->second->fansOut) createDispatchEntryUnlocked(route, true);
+        }
+        rebuildDispatchTableUnlocked();
+    }
 
-class RouteManager {
-public:
-    explicit RouteManager(const std::string& configPath = "")
-        : configFilePath(configPath.empty() ? getDefaultConfigPath() : configPath) {
-        loadFromDisk();
+    // Lanes, queue depth and spread; lanes == 0 when fan-out is off
+    MidiFanOutStats getFanOutStats() {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        return fanOut ? fanOut->getStats() : MidiFanOutStats{0, 0, 0, 0, 0, {}};
     }
 
     void setLocalMessageForwarder(LocalMessageForwarder forwarder) {
         std::lock_guard<std::mutex> lock(routesMutex);
         localForwarder = std::move(forwarder);
+        rebuildDispatchTableUnlocked();
     }
 
-    std::string addRoute(const RouteEndpoint& source,
-                         const RouteEndpoint& destination,
-                         bool enabled = true,
-                         const std::string& prespecifiedId = "") {
+    // Sends the SysEx fragments of streaming inputs, which a regular send
+    // refuses as incomplete. Without one, fragments are dropped and routes
+    // that would take them get the whole SysEx instead.
+    void setLocalFragmentForwarder(LocalMessageForwarder forwarder) {
         std::lock_guard<std::mutex> lock(routesMutex);
+        localFragmentForwarder = std::move(forwarder);
+        rebuildDispatchTableUnlocked();
+    }
 
-        MidiRoute route;
-        route.id = prespecifiedId.empty() ? generateRouteId() : prespecifiedId;
-        route.source = source;
-        route.destination = destination;
-        route.enabled = enabled;
-        route.messagesForwarded = 0;
+    // Without a scheduler, local destinations of latency routes get messages immediately
+    void setLocalMessageScheduler(LocalMessageScheduler scheduler) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        localScheduler = std::move(scheduler);
+        rebuildDispatchTableUnlocked();
+    }
 
-        routes[route.id] = route;
-        saveToDiskUnlocked();
+    // Opts in to native thru for the routes the resolver accepts, linked by
+    // connector (both called with routesMutex held, so they must not call
+    // back into RouteManager). An empty resolver turns native thru off again.
+    void setNativeThruResolver(NativeThruResolver resolver, NativeThruConnector connector) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        nativeResolver = std::move(resolver);
+        nativeConnector = std::move(connector);
+        nativeFailed.clear();
+        rebuildDispatchTableUnlocked();
+    }
 
-        std::cout << "[RouteManager] Added route " << route.id
-                  << ": " << source.serverUrl << ":" << source.portId
-                  << " -> " << destination.serverUrl << ":" << destination.portId << std::endl;
+    // Re-resolves native routes, e.g. after devices or output ports changed
+    void refreshNativeThru() {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        if (!nativeResolver && nativeLinks.empty()) return;
+        rebuildDispatchTableUnlocked();
+    }
 
-        return route.id;
+    // Adds the route, or replaces the one with the same id; returns the id
+    // (generated if route.id is empty). route.messagesForwarded is ignored.
+    std::string addRoute(const MidiRoute& route) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+
+        std::string id = upsertRouteUnlocked(route);
+        rebuildDispatchTableUnlocked();
+        requestSaveUnlocked();
+
+        std::cout << "[RouteManager] Added route " << id
+                  << ": " << route.source.serverUrl << ":" << route.source.portId
+                  << " -> " << route.destination.serverUrl << ":" << route.destination.portId << std::endl;
+
+        return id;
+    }
+
+    // Applies a batch of edits as one transaction: upserts (ids generated
+    // for routes without one and written back), then removals; with
+    // replaceAll every route not in upserts is removed instead. One dispatch
+    // table rebuild and one save, however many routes change. Returns the
+    // number of routes removed.
+    size_t applyRoutes(std::vector<MidiRoute>& upserts,
+                       const std::vector<std::string>& removeIds,
+                       bool replaceAll = false) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+
+        std::vector<std::string> removals = removeIds;
+        if (replaceAll) {
+            removals.clear();
+            for (const auto& [id, route] : routes) {
+                bool kept = std::any_of(upserts.begin(), upserts.end(),
+                                        [&](const MidiRoute& upsert) { return upsert.id == id; });
+                if (!kept) removals.push_back(id);
+            }
+        }
+        for (auto& route : upserts) route.id = upsertRouteUnlocked(route);
+
+        size_t removed = 0;
+        for (const auto& id : removals) {
+            if (eraseRouteUnlocked(id)) removed++;
+        }
+        rebuildDispatchTableUnlocked();
+        requestSaveUnlocked();
+
+        std::cout << "[RouteManager] Applied " << upserts.size() << " routes, removed "
+                  << removed << (replaceAll ? " (replace all)" : "") << std::endl;
+        return removed;
     }
 
     bool removeRoute(const std::string& routeId) {
         std::lock_guard<std::mutex> lock(routesMutex);
 
-        auto it = routes.find(routeId);
-        if (it == routes.end()) {
+        if (!eraseRouteUnlocked(routeId)) {
             return false;
         }
 
-        routes.erase(it);
-        saveToDiskUnlocked();
+        rebuildDispatchTableUnlocked();
+        requestSaveUnlocked();
 
         std::cout << "[RouteManager] Removed route " << routeId << std::endl;
         return true;
@@ -184,22 +388,26 @@ public:
             return false;
         }
 
-        it->second.enabled = enabled;
-        saveToDiskUnlocked();
+        if (it->second.enabled != enabled) {
+            it->second.enabled = enabled;
+            it->second.version = nextConfigVersionUnlocked();
+        }
+        rebuildDispatchTableUnlocked();
+        requestSaveUnlocked();
 
         std::cout << "[RouteManager] Route " << routeId
                   << " enabled=" << (enabled ? "true" : "false") << std::endl;
         return true;
     }
 
-    // Get all enabled routes for a given source - called from MIDI callback
+    // Get all enabled routes for a given source (copies; not used on the MIDI path)
     std::vector<MidiRoute> getRoutesForSource(const std::string& sourcePortId) {
         std::lock_guard<std::mutex> lock(routesMutex);
 
         std::vector<MidiRoute> result;
         for (const auto& [id, route] : routes) {
             if (route.enabled && route.source.portId == sourcePortId) {
-                result.push_back(route);
+                result.push_back(withCurrentCountUnlocked(route));
             }
         }
         return result;
@@ -211,11 +419,40 @@ public:
         std::vector<MidiRoute> result;
         result.reserve(routes.size());
         for (const auto& [id, route] : routes) {
-            result.push_back(route);
+            result.push_back(withCurrentCountUnlocked(route));
         }
         return result;
     }
 
+    // Incremented by every route change; readable without locking
+    uint64_t getConfigVersion() const { return configVersion.load(std::memory_order_acquire); }
+
+    // Routes added or changed after version `since` and the ids removed
+    // since then. Copies only those routes and reads no counters. If the
+    // tombstones no longer reach back to `since` (or it is from another
+    // run), the whole route set is returned with full = true.
+    RouteChanges getRouteChanges(uint64_t since) {
+        std::lock_guard<std::mutex> lock(routesMutex);
+
+        RouteChanges changes;
+        changes.version = configVersion.load(std::memory_order_relaxed);
+        changes.full = since < deltaFloor || since > changes.version;
+        for (const auto& [id, route] : routes) {
+            if (!changes.full && route.version <= since) continue;
+            MidiRoute copy = route;
+            copy.native = nativeLinks.count(id) > 0;
+            copy.messagesForwarded = 0;
+            changes.routes.push_back(std::move(copy));
+        }
+        if (!changes.full) {
+            for (const auto& [version, id] : removedRoutes) {
+                // A route removed and added again is in routes instead
+                if (version > since && !routes.count(id)) changes.removed.push_back(id);
+            }
+        }
+        return changes;
+    }
+
     MidiRoute* getRoute(const std::string& routeId) {
         std::lock_guard<std::mutex> lock(routesMutex);
 
@@ -223,132 +460,282 @@ public:
         if (it == routes.end()) {
             return nullptr;
         }
+        it->second = withCurrentCountUnlocked(it->second);
         return &it->second;
     }
 
-    // Called from MIDI input callback to forward message through routes
-    void forwardMessage(const std::string& sourcePortId,
-                        const std::vector<uint8_t>& data) {
-        // Get matching routes (lock acquired inside)
-        auto matchingRoutes = getRoutesForSource(sourcePortId);
+    std::vector<RouteMetricsSnapshot> getRouteMetrics() {
+        std::lock_guard<std::mutex> lock(routesMutex);
 
-        if (matchingRoutes.empty()) {
-            return;
+        std::vector<RouteMetricsSnapshot> result;
+        result.reserve(routes.size());
+        for (const auto& [id, route] : routes) {
+            RouteMetricsSnapshot snapshot{id, route.enabled, nativeLinks.count(id) > 0, 0, 0, 0, {}};
+            auto it = dispatchEntries.find(id);
+            if (it != dispatchEntries.end()) {
+                snapshot.messagesForwarded = it->second->messagesForwarded.load(std::memory_order_relaxed);
+                snapshot.messagesFiltered = it->second->messagesFiltered.load(std::memory_order_relaxed);
+                snapshot.bytesForwarded = it->second->bytesForwarded.load(std::memory_order_relaxed);
+                snapshot.latency = it->second->latency.snapshot();
+            }
+            result.push_back(std::move(snapshot));
         }
+        return result;
+    }
 
-        // Get local forwarder
-        LocalMessageForwarder forwarder;
-        {
-            std::lock_guard<std::mutex> lock(routesMutex);
-            forwarder = localForwarder;
+    // Queue and circuit breaker state of every remote forwarder (one per
+    // remote host that routes refer to)
+    std::vector<RemoteForwarderStats> getForwarderStats() {
+        std::lock_guard<std::mutex> lock(forwardersMutex);
+        std::vector<RemoteForwarderStats> result;
+        result.reserve(forwarders.size());
+        for (const auto& [key, forwarder] : forwarders) {
+            result.push_back(forwarder->getStats());
         }
+        return result;
+    }
+
+    // Called from MIDI input callback to forward message through routes.
+    // Lock-free: reads the published dispatch table snapshot only.
+    // part: a SysEx fragment goes only to routes that stream, and the whole
+    // SysEx after it only to those that don't.
+    void forwardMessage(const std::string& sourcePortId,
+                        const MidiPacket& data,
+                        MidiInputPart part = MidiInputPart::Message) {
+        auto table = std::atomic_load_explicit(&dispatchTable, std::memory_order_acquire);
 
-        // Forward to each destination
-        for (auto& route : matchingRoutes) {
-            forwardToDestination(route, data, forwarder);
+        auto it = table->routesBySource.find(sourcePortId);
+        if (it == table->routesBySource.end()) {
+            return;
+        }
 
-            // Update message count
-            {
-                std::lock_guard<std::mutex> lock(routesMutex);
-                auto it = routes.find(route.id);
-                if (it != routes.end()) {
-                    it->second.messagesForwarded++;
+        auto start = std::chrono::steady_clock::now();
+        int64_t startUnixUs = 0;  // Only read for remote latency routes
+        MidiPacket transformed;
+        const auto& source = it->second;
+        bool fanningOut = source.fanOutCount > 0;
+        bool fragment = part == MidiInputPart::SysExChunk;
+        bool fragmentsSent = static_cast<bool>(table->localFragmentForwarder);
+        size_t group = fanningOut ? table->fanOut->beginGroup(source.fanOutCount)
+                                  : MidiFanOut<RouteDispatchEntry>::noGroup;
+        for (const auto& entry : source.entries) {
+            bool toLane = fanningOut && entry->fansOut;
+            bool streams = entry->streamsSysEx && fragmentsSent;
+            if (part != MidiInputPart::Message && streams != fragment) {
+                if (toLane) table->fanOut->skip(group);
+                continue;
+            }
+            const MidiPacket* message = &data;
+            if (!entry->pipeline.isPassThrough()) {
+                if (!entry->pipeline.process(data, transformed)) {
+                    entry->messagesFiltered.fetch_add(1, std::memory_order_relaxed);
+                    if (toLane) table->fanOut->skip(group);
+                    continue;
                 }
+                message = &transformed;
+            }
+            // A streamed SysEx counts as one message, at its last fragment
+            if (!fragment || message->back() == 0xF7) {
+                entry->messagesForwarded.fetch_add(1, std::memory_order_relaxed);
+            }
+            entry->bytesForwarded.fetch_add(message->size(), std::memory_order_relaxed);
+            if (toLane) {
+                // The lane records the latency once the send is done
+                table->fanOut->submit(entry->fanOutLane, entry, *message, start, group, fragment);
+                continue;
+            }
+            if (fragment) {
+                table->localFragmentForwarder(entry->destination.portId, *message);
+            } else {
+                forwardToDestination(*entry, *message, *table, start, startUnixUs);
             }
+            entry->latency.recordSince(start);
         }
     }
 
     void loadFromDisk() {
         std::lock_guard<std::mutex> lock(routesMutex);
 
-        std::ifstream file(configFilePath);
+        std::ifstream file(configFilePath, std::ios::binary);
         if (!file.is_open()) {
             std::cout << "[RouteManager] No routes file found at "
                       << configFilePath << std::endl;
             return;
         }
 
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string content = buffer.str();
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
         file.close();
 
-        // Simple JSON parsing for routes array
-        routes.clear();
-
-        size_t routesStart = content.find("\"routes\"");
-        if (routesStart == std::string::npos) {
+        std::map<std::string, MidiRoute> loaded;
+        size_t skipped = 0;
+        JsonReader reader(content);
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key != "routes") return reader.skipValue();
+            return reader.readArray([&] {
+                MidiRoute route;
+                std::string error;
+                if (!readRoute(reader, route, error)) {
+                    if (error.empty()) return false;
+                    // Well-formed but unusable: drop just this route
+                    std::cerr << "[RouteManager] Skipping route " << route.id << ": " << error << std::endl;
+                    skipped++;
+                    return true;
+                }
+                if (route.id.empty()) {
+                    std::cerr << "[RouteManager] Skipping route without id" << std::endl;
+                    skipped++;
+                    return true;
+                }
+                std::string id = route.id;
+                loaded[id] = std::move(route);
+                return true;
+            });
+        }) && reader.finish();
+
+        if (!parsed) {
+            // Keep the file for inspection; the next save would overwrite it.
+            // None of its routes are used, not even those read before the
+            // error: the next save would write that partial set back.
+            std::string invalidPath = configFilePath + ".invalid";
+            std::rename(configFilePath.c_str(), invalidPath.c_str());
+            std::cerr << "[RouteManager] Cannot parse " << configFilePath << " (" << reader.error()
+                      << "); moved it to " << invalidPath << " and loaded no routes from it" << std::endl;
             return;
         }
-
-        size_t arrayStart = content.find('[', routesStart);
-        if (arrayStart == std::string::npos) {
-            return;
+        for (const auto& [id, route] : routes) {
+            if (!loaded.count(id)) recordRemovalUnlocked(id);
         }
+        for (auto& [id, route] : loaded) {
+            auto previous = routes.find(id);
+            route.version = previous != routes.end() && sameConfig(previous->second, route)
+                ? previous->second.version : nextConfigVersionUnlocked();
+        }
+        routes = std::move(loaded);
 
-        // Parse each route object
-        size_t pos = arrayStart;
-        while (true) {
-            size_t objStart = content.find('{', pos);
-            if (objStart == std::string::npos) break;
-
-            // Find matching closing brace (handle nested objects)
-            int braceCount = 1;
-            size_t objEnd = objStart + 1;
-            while (objEnd < content.length() && braceCount > 0) {
-                if (content[objEnd] == '{') braceCount++;
-                else if (content[objEnd] == '}') braceCount--;
-                objEnd++;
-            }
-            if (braceCount != 0) break;
-
-            std::string objStr = content.substr(objStart, objEnd - objStart);
-
-            MidiRoute route;
-            route.id = extractJsonString(objStr, "id");
-            route.enabled = extractJsonBool(objStr, "enabled");
-            route.messagesForwarded = 0;
-
-            // Parse source endpoint
-            size_t sourceStart = objStr.find("\"source\"");
-            if (sourceStart != std::string::npos) {
-                size_t srcObjStart = objStr.find('{', sourceStart);
-                size_t srcObjEnd = objStr.find('}', srcObjStart);
-                if (srcObjStart != std::string::npos && srcObjEnd != std::string::npos) {
-                    std::string srcStr = objStr.substr(srcObjStart, srcObjEnd - srcObjStart + 1);
-                    route.source.serverUrl = extractJsonString(srcStr, "serverUrl");
-                    route.source.portId = extractJsonString(srcStr, "portId");
-                    route.source.portName = extractJsonString(srcStr, "portName");
-                }
+        // Keep counters of routes that survive a reload; drop the rest
+        for (auto it = dispatchEntries.begin(); it != dispatchEntries.end();) {
+            it = routes.count(it->first) ? std::next(it) : dispatchEntries.erase(it);
+        }
+        for (const auto& [id, route] : routes) {
+            auto existing = dispatchEntries.find(id);
+            bool isNew = existing == dispatchEntries.end();
+            createDispatchEntryUnlocked(route);
+            if (isNew) {
+                // Resume the count saved by the previous run
+                dispatchEntries[id]->messagesForwarded.store(route.messagesForwarded, std::memory_order_relaxed);
             }
+        }
+        rebuildDispatchTableUnlocked();
+
+        std::cout << "[RouteManager] Loaded " << routes.size() << " routes from " << configFilePath;
+        if (skipped > 0) std::cout << " (" << skipped << " skipped)";
+        std::cout << std::endl;
+    }
 
-            // Parse destination endpoint
-            size_t destStart = objStr.find("\"destination\"");
-            if (destStart != std::string::npos) {
-                size_t destObjStart = objStr.find('{', destStart);
-                size_t destObjEnd = objStr.find('}', destObjStart);
-                if (destObjStart != std::string::npos && destObjEnd != std::string::npos) {
-                    std::string destStr = objStr.substr(destObjStart, destObjEnd - destObjStart + 1);
-                    route.destination.serverUrl = extractJsonString(destStr, "serverUrl");
-                    route.destination.portId = extractJsonString(destStr, "portId");
-                    route.destination.portName = extractJsonString(destStr, "portName");
+    // Reads one route object, as sent to POST /routes or stored in
+    // routes.json. Only source.portId and destination.portId are required.
+    // On failure error describes the problem, or is empty for a JSON syntax
+    // error (see reader.error()). Invalid values don't stop the reader, so
+    // a caller can skip the route and read on.
+    static bool readRoute(JsonReader& reader, MidiRoute& route, std::string& error) {
+        route = MidiRoute();
+        error.clear();
+        long long latencyMs = 0;
+        std::string filterError;
+        bool parsed = reader.readObject([&](std::string_view key) {
+            if (key == "id") return reader.readString(route.id);
+            if (key == "enabled") return reader.readBool(route.enabled);
+            if (key == "source") return readRouteEndpoint(reader, route.source);
+            if (key == "destination") return readRouteEndpoint(reader, route.destination);
+            if (key == "delivery") return readDeliveryPolicy(reader, route.delivery);
+            if (key == "latencyMs") {
+                if (!reader.readInteger(latencyMs)) return false;
+                if ((latencyMs < 0 || latencyMs >= MidiScheduler::maxScheduleAhead.count()) && error.empty()) {
+                    error = "latencyMs must be between 0 and " +
+                            std::to_string(MidiScheduler::maxScheduleAhead.count() - 1);
                 }
+                return true;
             }
-
-            if (!route.id.empty() && !route.source.portId.empty() && !route.destination.portId.empty()) {
-                routes[route.id] = route;
+            if (key == "filter") {
+                if (route.filter.read(reader, filterError)) return true;
+                if (reader.hasError()) return false;
+                if (error.empty()) error = "Invalid filter: " + filterError;
+                return true;
+            }
+            if (key == "messagesForwarded") {
+                long long count = 0;
+                if (!reader.readInteger(count)) return false;
+                route.messagesForwarded = (uint64_t)std::max(0LL, count);
+                return true;
             }
+            return reader.skipValue();
+        });
+        if (!parsed) {
+            error.clear();
+            return false;
+        }
+        if (error.empty() && (route.source.portId.empty() || route.destination.portId.empty())) {
+            error = "Missing source.portId or destination.portId";
+        }
+        std::string host;
+        int port = 0;
+        RemoteTransport transport;
+        if (error.empty() && !isLocalDestination(route.destination.serverUrl) &&
+            !parseRemoteUrl(route.destination.serverUrl, host, port, transport)) {
+            error = "Invalid destination.serverUrl: " + route.destination.serverUrl;
+        }
+        route.latencyMs = (uint32_t)latencyMs;
+        return error.empty();
+    }
 
-            pos = objEnd;
+    // Splits a remote serverUrl: "http://host:port", "http://host:port/path"
+    // or "midi+tcp://host:streamPort". Without a port, 80 is assumed. Returns
+    // false for an empty host or a port that isn't a number from 1 to 65535.
+    static bool parseRemoteUrl(const std::string& serverUrl, std::string& host, int& port,
+                               RemoteTransport& transport) {
+        std::string url = serverUrl;
+        transport = RemoteTransport::Http;
+
+        // Remove scheme prefix
+        if (url.rfind("http://", 0) == 0) {
+            url = url.substr(7);
+        } else if (url.rfind("midi+tcp://", 0) == 0) {
+            url = url.substr(11);
+            transport = RemoteTransport::Stream;
         }
 
-        std::cout << "[RouteManager] Loaded " << routes.size()
-                  << " routes from " << configFilePath << std::endl;
+        // Split host:port
+        port = 80;
+        size_t colonPos = url.find(':');
+        size_t slashPos = url.find('/');
+        if (colonPos != std::string::npos && slashPos != std::string::npos && slashPos < colonPos) {
+            colonPos = std::string::npos;   // A colon in the path
+        }
+
+        if (colonPos != std::string::npos) {
+            host = url.substr(0, colonPos);
+            size_t portEnd = (slashPos != std::string::npos) ? slashPos : url.length();
+            if (portEnd == colonPos + 1) return false;
+            port = 0;
+            for (size_t i = colonPos + 1; i < portEnd; i++) {
+                if (url[i] < '0' || url[i] > '9') return false;
+                port = port * 10 + (url[i] - '0');
+                if (port > 65535) return false;
+            }
+            if (port == 0) return false;
+        } else {
+            host = (slashPos != std::string::npos) ? url.substr(0, slashPos) : url;
+        }
+        return !host.empty();
     }
 
+    // Writes routes.json now (e.g. on shutdown, to keep route counters)
     void saveToDisk() {
-        std::lock_guard<std::mutex> lock(routesMutex);
-        saveToDiskUnlocked();
+        {
+            std::lock_guard<std::mutex> lock(persistMutex);
+            persistPending = false;
+        }
+        writeRoutesFile();
     }
 
 private:
@@ -356,117 +743,437 @@ private:
     std::map<std::string, MidiRoute> routes;
     std::mutex routesMutex;
     LocalMessageForwarder localForwarder;
+    LocalMessageForwarder localFragmentForwarder;
+    LocalMessageScheduler localScheduler;
+
+    // Per-route counters/destinations, and the snapshot MIDI threads read.
+    // dispatchTable is only accessed through std::atomic_load/atomic_store.
+    std::map<std::string, std::shared_ptr<RouteDispatchEntry>> dispatchEntries;
+    std::shared_ptr<const RouteDispatchTable> dispatchTable;
+
+    // Persistence; persistMutex is taken after routesMutex, never before it
+    std::mutex persistMutex;
+    std::condition_variable persistCv;
+    bool persistPending = false;
+    bool persistRunning = true;
+    std::chrono::steady_clock::time_point firstUnsavedAt;
+    std::chrono::steady_clock::time_point lastEditAt;
+    std::mutex fileMutex;        // Taken before routesMutex when writing
+    std::thread persistThread;
+
+    // Native thru, guarded by routesMutex
+    struct NativeThruLink {
+        std::string sourceIdentifier;
+        std::string destinationIdentifier;
+        std::unique_ptr<NativeMidiThru::Connection> connection;
+    };
+    NativeThruResolver nativeResolver;
+    NativeThruConnector nativeConnector;
+    std::map<std::string, NativeThruLink> nativeLinks;   // routeId -> OS connection
+    std::map<std::string, std::pair<std::string, std::string>> nativeFailed;  // routeId -> device pair
+
+    // Fan-out lanes, set up under routesMutex. Declared after dispatchTable,
+    // which the lanes read, so they are joined before it is destroyed.
+    std::map<std::string, size_t> fanOutLanes;   // destination portId -> lane
+    std::unique_ptr<MidiFanOut<RouteDispatchEntry>> fanOut;
+
+    // Config versioning, guarded by routesMutex; configVersion is also read
+    // without it. Removals are kept oldest first; deltas from before
+    // deltaFloor can't be answered any more.
+    std::atomic<uint64_t> configVersion;
+    std::deque<std::pair<uint64_t, std::string>> removedRoutes;
+    uint64_t deltaFloor;
+
+    // Starts at the wall clock in milliseconds, so a version handed out by
+    // a previous run is never mistaken for one of this run
+    static uint64_t initialConfigVersion() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t nextConfigVersionUnlocked() {
+        return configVersion.fetch_add(1, std::memory_order_acq_rel) + 1;
+    }
+
+    void recordRemovalUnlocked(const std::string& id) {
+        removedRoutes.emplace_back(nextConfigVersionUnlocked(), id);
+        if (removedRoutes.size() > maxRemovedRoutes) {
+            deltaFloor = removedRoutes.front().first;
+            removedRoutes.pop_front();
+        }
+    }
+
+    // Everything a client configures; not counters or live status
+    static bool sameConfig(const MidiRoute& a, const MidiRoute& b) {
+        return a.enabled == b.enabled && a.source == b.source && a.destination == b.destination &&
+               a.delivery == b.delivery && a.latencyMs == b.latencyMs && a.filter == b.filter;
+    }
+
+    std::string upsertRouteUnlocked(const MidiRoute& update) {
+        MidiRoute route = update;
+        if (route.id.empty()) route.id = generateRouteId();
+        route.messagesForwarded = 0;  // The live count is in the dispatch entry
+        std::string id = route.id;
+        createDispatchEntryUnlocked(route);
+        // Re-sending an unchanged route (e.g. replicating a full set) keeps its version
+        auto existing = routes.find(id);
+        route.version = existing != routes.end() && sameConfig(existing->second, route)
+            ? existing->second.version : nextConfigVersionUnlocked();
+        routes[id] = std::move(route);
+        return id;
+    }
+
+    bool eraseRouteUnlocked(const std::string& id) {
+        if (!routes.erase(id)) return false;
+        dispatchEntries.erase(id);
+        recordRemovalUnlocked(id);
+        return true;
+    }
+
+    // {"serverUrl":"...","portId":"...","portName":"..."}
+    static bool readRouteEndpoint(JsonReader& reader, RouteEndpoint& endpoint) {
+        return reader.readObject([&](std::string_view key) {
+            if (key == "serverUrl") return reader.readString(endpoint.serverUrl);
+            if (key == "portId") return reader.readString(endpoint.portId);
+            if (key == "portName") return reader.readString(endpoint.portName);
+            return reader.skipValue();
+        });
+    }
+
+    // {"maxAgeMs": N, "coalesce": bool}
+    static bool readDeliveryPolicy(JsonReader& reader, RemoteDeliveryPolicy& delivery) {
+        return reader.readObject([&](std::string_view key) {
+            if (key == "maxAgeMs") {
+                long long maxAge = 0;
+                if (!reader.readInteger(maxAge)) return false;
+                delivery.maxAgeMs = (uint32_t)std::clamp<long long>(maxAge, 0, UINT32_MAX);
+                return true;
+            }
+            if (key == "coalesce") return reader.readBool(delivery.coalesce);
+            return reader.skipValue();
+        });
+    }
+
+    // renew: replace the entry even if the route is unchanged (e.g. its
+    // forwarder was replaced)
+    void createDispatchEntryUnlocked(const MidiRoute& route, bool renew = false) {
+        auto& entry = dispatchEntries[route.id];
+        if (!renew && entry && entry->destination.portId == route.destination.portId &&
+            entry->destination.serverUrl == route.destination.serverUrl &&
+            entry->delivery == route.delivery && entry->latencyMs == route.latencyMs &&
+            entry->filter == route.filter) {
+            return;
+        }
+        // Entries are read lock-free, so changes get a new entry; the count
+        // carries over when only the delivery policy, latency or filter changed
+        uint64_t count = 0;
+        if (entry && entry->destination.portId == route.destination.portId &&
+            entry->destination.serverUrl == route.destination.serverUrl) {
+            count = entry->messagesForwarded.load(std::memory_order_relaxed);
+        }
+        entry = std::make_shared<RouteDispatchEntry>();
+        entry->routeId = route.id;
+        entry->destination = route.destination;
+        entry->delivery = route.delivery;
+        entry->latencyMs = route.latencyMs;
+        entry->filter = route.filter;
+        entry->pipeline = RouteFilterPipeline(route.filter);
+        entry->fansOut = isLocalDestination(route.destination.serverUrl) && route.latencyMs == 0;
+        entry->streamsSysEx = midiOutputTakesSysExInPieces && entry->fansOut && entry->pipeline.isPassThrough();
+        assignFanOutLaneUnlocked(*entry);
+        resolveRemoteUnlocked(*entry);
+        entry->messagesForwarded.store(count, std::memory_order_relaxed);
+    }
+
+    // Points a remote entry at its host's forwarder (or leaves it without one
+    // for an invalid serverUrl); called before the entry is published
+    void resolveRemoteUnlocked(RouteDispatchEntry& entry) {
+        const RouteEndpoint& dest = entry.destination;
+        if (isLocalDestination(dest.serverUrl)) return;
+        std::string host;
+        int port;
+        RemoteTransport transport;
+        if (!parseRemoteUrl(dest.serverUrl, host, port, transport)) {
+            std::cerr << "[RouteManager] Route " << entry.routeId << " has an invalid serverUrl \""
+                      << dest.serverUrl << "\"; its messages are dropped" << std::endl;
+            entry.remote.reset();
+            return;
+        }
+        entry.remote = getForwarder(host, port, transport);
+        if (!entry.remoteDestination) entry.remoteDestination = RemoteForwarder::makeDestination(dest.portId);
+    }
+
+    // Destinations get lanes round-robin in the order they are first seen
+    // and keep them, so no two lanes ever send to the same port
+    void assignFanOutLaneUnlocked(RouteDispatchEntry& entry) {
+        if (!fanOut || !entry.fansOut) return;
+        auto lane = fanOutLanes.emplace(entry.destination.portId, fanOutLanes.size() % fanOut->laneCount());
+        entry.fanOutLane = lane.first->second;
+    }
+
+    // Runs on a fan-out lane
+    void deliverFannedOut(RouteDispatchEntry& entry, const MidiPacket& packet,
+                          std::chrono::steady_clock::time_point capturedAt, bool sysexFragment) {
+        auto table = std::atomic_load_explicit(&dispatchTable, std::memory_order_acquire);
+        const auto& forwarder = sysexFragment ? table->localFragmentForwarder : table->localForwarder;
+        if (forwarder) forwarder(entry.destination.portId, packet);
+        entry.latency.recordSince(capturedAt);
+    }
+
+    // Builds a fresh snapshot from the current routes and publishes it.
+    // Must be called with routesMutex held after any route change.
+    void rebuildDispatchTableUnlocked() {
+        syncNativeThruUnlocked();
+
+        auto table = std::make_shared<RouteDispatchTable>();
+        table->localForwarder = localForwarder;
+        table->localFragmentForwarder = localFragmentForwarder;
+        table->localScheduler = localScheduler;
+        table->fanOut = fanOut.get();
+        for (const auto& [id, route] : routes) {
+            if (!route.enabled || nativeLinks.count(id)) continue;
+            auto entryIt = dispatchEntries.find(id);
+            if (entryIt == dispatchEntries.end()) continue;
+            auto& source = table->routesBySource[route.source.portId];
+            source.entries.push_back(entryIt->second);
+            if (fanOut && entryIt->second->fansOut) source.fanOutCount++;
+        }
+        std::atomic_store_explicit(&dispatchTable,
+                                   std::shared_ptr<const RouteDispatchTable>(std::move(table)),
+                                   std::memory_order_release);
+    }
+
+    bool wantsNativeThruUnlocked(const MidiRoute& route, std::string& sourceIdentifier,
+                                 std::string& destinationIdentifier) const {
+        return nativeResolver && nativeConnector && route.enabled && route.latencyMs == 0 &&
+               route.filter.isPassThrough() && isLocalDestination(route.destination.serverUrl) &&
+               nativeResolver(route, sourceIdentifier, destinationIdentifier);
+    }
+
+    // Brings the OS connections in line with the routes: drops links whose
+    // route is gone, no longer qualifies or now resolves to other devices,
+    // then connects qualifying routes. A device pair that failed is not
+    // retried until the route resolves to a different pair.
+    void syncNativeThruUnlocked() {
+        for (auto it = nativeLinks.begin(); it != nativeLinks.end();) {
+            auto route = routes.find(it->first);
+            std::string source, destination;
+            bool keep = route != routes.end() &&
+                        wantsNativeThruUnlocked(route->second, source, destination) &&
+                        source == it->second.sourceIdentifier &&
+                        destination == it->second.destinationIdentifier;
+            if (keep) {
+                ++it;
+                continue;
+            }
+            std::cout << "[RouteManager] Route " << it->first << " left native thru" << std::endl;
+            if (route != routes.end()) route->second.version = nextConfigVersionUnlocked();
+            it = nativeLinks.erase(it);
+        }
+
+        for (auto& [id, route] : routes) {
+            if (nativeLinks.count(id)) continue;
+            std::string source, destination;
+            if (!wantsNativeThruUnlocked(route, source, destination)) {
+                nativeFailed.erase(id);
+                continue;
+            }
+            auto failed = nativeFailed.find(id);
+            if (failed != nativeFailed.end() && failed->second == std::make_pair(source, destination)) continue;
+            // A second route between the same devices would share the OS
+            // link, and removing either would cut both
+            bool pairInUse = std::any_of(nativeLinks.begin(), nativeLinks.end(), [&](const auto& link) {
+                return link.second.sourceIdentifier == source && link.second.destinationIdentifier == destination;
+            });
+            if (pairInUse) continue;
+
+            std::string error;
+            auto connection = nativeConnector(source, destination, error);
+            if (!connection) {
+                std::cerr << "[RouteManager] Route " << id << " stays on the dispatch path: "
+                          << error << std::endl;
+                nativeFailed[id] = {source, destination};
+                continue;
+            }
+            nativeFailed.erase(id);
+            std::cout << "[RouteManager] Route " << id << " uses native thru: " << source << " -> "
+                      << destination << std::endl;
+            nativeLinks[id] = {source, destination, std::move(connection)};
+            route.version = nextConfigVersionUnlocked();
+        }
+    }
 
-    // Persistent forwarder per remote host:port — created on first use
-    std::map<std::string, std::unique_ptr<RemoteForwarder>> forwarders;
+    MidiRoute withCurrentCountUnlocked(const MidiRoute& route) const {
+        MidiRoute result = route;
+        result.native = nativeLinks.count(route.id) > 0;
+        auto it = dispatchEntries.find(route.id);
+        if (it != dispatchEntries.end()) {
+            result.messagesForwarded = it->second->messagesForwarded.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    // Persistent forwarder per remote host:port, created when the first route
+    // to it is resolved and shared by the dispatch entries of all routes to
+    // it. forwardersMutex is taken after routesMutex, never before it.
+    std::map<std::string, std::shared_ptr<RemoteForwarder>> forwarders;
+    std::vector<std::shared_ptr<RemoteForwarder>> retiredForwarders;   // Replaced by setRemoteForwarderConfig
     std::mutex forwardersMutex;
+    RemoteForwarderConfig remoteConfig;
 
-    RemoteForwarder& getForwarder(const std::string& host, int port) {
-        std::string key = host + ":" + std::to_string(port);
+    std::shared_ptr<RemoteForwarder> getForwarder(const std::string& host, int port, RemoteTransport transport) {
+        std::string key = (transport == RemoteTransport::Stream ? "midi+tcp://" : "http://")
+                        + host + ":" + std::to_string(port);
         std::lock_guard<std::mutex> lock(forwardersMutex);
-        auto it = forwarders.find(key);
-        if (it == forwarders.end()) {
-            forwarders[key] = std::make_unique<RemoteForwarder>(host, port);
-            std::cout << "[RouteManager] Created persistent forwarder to "
-                      << host << ":" << port << std::endl;
-            return *forwarders[key];
+        auto& forwarder = forwarders[key];
+        if (!forwarder) {
+            forwarder = std::make_shared<RemoteForwarder>(host, port, remoteConfig, transport);
+            std::cout << "[RouteManager] Created persistent forwarder to " << key << std::endl;
         }
-        return *it->second;
+        return forwarder;
     }
 
-    void forwardToDestination(const MidiRoute& route,
-                               const std::vector<uint8_t>& data,
-                               const LocalMessageForwarder& forwarder) {
-        const auto& dest = route.destination;
+    // Tears down forwarders only the map still holds: no dispatch entry
+    // refers to them and no table snapshot a MIDI thread may be reading, and
+    // new references are only handed out under forwardersMutex. One that a
+    // MIDI thread still holds is picked up after a later save. Joining the
+    // workers (which first send what is queued) happens without the lock,
+    // so a MIDI thread never drops the last reference and joins one itself.
+    void releaseIdleForwarders() {
+        std::vector<std::shared_ptr<RemoteForwarder>> idle;
+        {
+            std::lock_guard<std::mutex> lock(forwardersMutex);
+            for (auto it = retiredForwarders.begin(); it != retiredForwarders.end();) {
+                if (it->use_count() > 1) {
+                    ++it;
+                    continue;
+                }
+                idle.push_back(std::move(*it));
+                it = retiredForwarders.erase(it);
+            }
+            for (auto it = forwarders.begin(); it != forwarders.end();) {
+                if (it->second.use_count() > 1) {
+                    ++it;
+                    continue;
+                }
+                std::cout << "[RouteManager] Closing idle forwarder to " << it->first << std::endl;
+                idle.push_back(std::move(it->second));
+                it = forwarders.erase(it);
+            }
+        }
+    }
 
+    // capturedAt: when the source callback fired. capturedAtUnixUs is filled in
+    // on first use so fan-out to several remote latency routes reads the wall
+    // clock once.
+    void forwardToDestination(const RouteDispatchEntry& entry,
+                               const MidiPacket& data,
+                               const RouteDispatchTable& table,
+                               std::chrono::steady_clock::time_point capturedAt,
+                               int64_t& capturedAtUnixUs) {
+        const RouteEndpoint& dest = entry.destination;
         if (isLocalDestination(dest.serverUrl)) {
-            // Local forwarding - sub-millisecond
-            if (forwarder) {
-                forwarder(dest.portId, data);
+            if (entry.latencyMs > 0 && table.localScheduler) {
+                table.localScheduler(capturedAt + std::chrono::milliseconds(entry.latencyMs),
+                                     dest.portId, data);
+            } else if (table.localForwarder) {
+                // Local forwarding - sub-millisecond
+                table.localForwarder(dest.portId, data);
             } else {
                 std::cerr << "[RouteManager] No local forwarder set" << std::endl;
             }
         } else {
-            // Remote forwarding via HTTP
-            forwardToRemoteServer(dest, data);
+            // Remote forwarding via the per-host RemoteForwarder; the remote
+            // server releases latency-route messages at capture + latency
+            int64_t dueUnixUs = 0;
+            if (entry.latencyMs > 0) {
+                if (capturedAtUnixUs == 0) {
+                    capturedAtUnixUs = MidiScheduler::unixMicrosNow() -
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - capturedAt).count();
+                }
+                dueUnixUs = capturedAtUnixUs + (int64_t)entry.latencyMs * 1000;
+            }
+            // Non-blocking enqueue; the request is built on the worker thread
+            if (entry.remote) entry.remote->send(entry.remoteDestination, data, entry.delivery, dueUnixUs);
         }
     }
 
-    bool isLocalDestination(const std::string& serverUrl) {
+    static bool isLocalDestination(const std::string& serverUrl) {
         return serverUrl.empty() || serverUrl == "local";
     }
 
-    void forwardToRemoteServer(const RouteEndpoint& dest,
-                                const std::vector<uint8_t>& data) {
-        // Parse host and port from serverUrl
-        // Expected format: "http://host:port" or "http://host:port/path"
-        std::string url = dest.serverUrl;
-
-        // Remove http:// prefix
-        if (url.rfind("http://", 0) == 0) {
-            url = url.substr(7);
+    // Called with routesMutex held after an edit; the persist thread saves it
+    void requestSaveUnlocked() {
+        {
+            std::lock_guard<std::mutex> lock(persistMutex);
+            auto now = std::chrono::steady_clock::now();
+            if (!persistPending) firstUnsavedAt = now;
+            lastEditAt = now;
+            persistPending = true;
         }
+        persistCv.notify_one();
+    }
 
-        // Split host:port
-        std::string host;
-        int port = 80;
-        size_t colonPos = url.find(':');
-        size_t slashPos = url.find('/');
-
-        if (colonPos != std::string::npos) {
-            host = url.substr(0, colonPos);
-            size_t portEnd = (slashPos != std::string::npos) ? slashPos : url.length();
-            port = std::stoi(url.substr(colonPos + 1, portEnd - colonPos - 1));
-        } else {
-            host = (slashPos != std::string::npos) ? url.substr(0, slashPos) : url;
-        }
+    void runPersistence() {
+        std::unique_lock<std::mutex> lock(persistMutex);
+        while (true) {
+            persistCv.wait(lock, [this] { return persistPending || !persistRunning; });
+            if (!persistPending) return;
+
+            // Wait for edits to pause, unless shutting down
+            auto due = std::min(lastEditAt + persistDebounce, firstUnsavedAt + persistMaxDelay);
+            if (persistRunning && std::chrono::steady_clock::now() < due) {
+                persistCv.wait_until(lock, due, [this] { return !persistRunning; });
+                continue;  // Re-evaluate: more edits may have arrived
+            }
 
-        // Build the path based on whether it's a virtual port
-        std::string path;
-        if (dest.portId.rfind("virtual:", 0) == 0) {
-            // Virtual port: /virtual/{id}/send
-            std::string virtualId = dest.portId.substr(8);
-            path = "/virtual/" + virtualId + "/send";
-        } else {
-            // Physical port: /port/{id}/send
-            path = "/port/" + dest.portId + "/send";
+            persistPending = false;
+            lock.unlock();
+            writeRoutesFile();
+            releaseIdleForwarders();
+            lock.lock();
+            if (!persistRunning && !persistPending) return;
         }
+    }
 
-        // Build JSON body with message array
-        std::stringstream body;
-        body << "{\"message\":[";
-        for (size_t i = 0; i < data.size(); i++) {
-            if (i > 0) body << ",";
-            body << (int)data[i];
+    std::vector<MidiRoute> snapshotRoutes() {
+        std::lock_guard<std::mutex> lock(routesMutex);
+        std::vector<MidiRoute> snapshot;
+        snapshot.reserve(routes.size());
+        for (const auto& [id, route] : routes) {
+            snapshot.push_back(withCurrentCountUnlocked(route));
         }
-        body << "]}";
-
-        // Enqueue on the persistent per-destination forwarder (non-blocking)
-        getForwarder(host, port).send(path, body.str());
+        return snapshot;
     }
 
-    void saveToDiskUnlocked() {
-        // Ensure directory exists
-        ensureDirectoryExists(getDirectoryPath(configFilePath));
-
-        std::ofstream file(configFilePath);
-        if (!file.is_open()) {
+    // The snapshot is taken under fileMutex so a newer snapshot is never
+    // overwritten by an older one; serializing and I/O happen without routesMutex
+    void writeRoutesFile() {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        std::string contents = serializeRoutes(snapshotRoutes());
+        std::string error;
+        if (!ensureDirectoryExists(getDirectoryPath(configFilePath), error) ||
+            !writeFileAtomically(configFilePath, contents, error)) {
             std::cerr << "[RouteManager] Failed to save routes to "
-                      << configFilePath << std::endl;
-            return;
+                      << configFilePath << ": " << error << std::endl;
         }
+    }
 
-        // Build JSON manually
+    static std::string serializeRoutes(const std::vector<MidiRoute>& snapshot) {
+        std::ostringstream file;
         file << "{\n  \"routes\": [\n";
 
         bool first = true;
-        for (const auto& [id, route] : routes) {
+        for (const auto& route : snapshot) {
             if (!first) file << ",\n";
             first = false;
 
             file << "    {\n";
             file << "      \"id\": \"" << escapeJson(route.id) << "\",\n";
             file << "      \"enabled\": " << (route.enabled ? "true" : "false") << ",\n";
+            file << "      \"messagesForwarded\": " << route.messagesForwarded << ",\n";
+            file << "      \"latencyMs\": " << route.latencyMs << ",\n";
             file << "      \"source\": {\n";
             file << "        \"serverUrl\": \"" << escapeJson(route.source.serverUrl) << "\",\n";
             file << "        \"portId\": \"" << escapeJson(route.source.portId) << "\",\n";
@@ -476,12 +1183,53 @@ private:
             file << "        \"serverUrl\": \"" << escapeJson(route.destination.serverUrl) << "\",\n";
             file << "        \"portId\": \"" << escapeJson(route.destination.portId) << "\",\n";
             file << "        \"portName\": \"" << escapeJson(route.destination.portName) << "\"\n";
-            file << "      }\n";
+            file << "      },\n";
+            file << "      \"delivery\": {\n";
+            file << "        \"maxAgeMs\": " << route.delivery.maxAgeMs << ",\n";
+            file << "        \"coalesce\": " << (route.delivery.coalesce ? "true" : "false") << "\n";
+            file << "      },\n";
+            JsonBuilder filterJson;
+            route.filter.write(filterJson);
+            file << "      \"filter\": " << filterJson.str() << "\n";
             file << "    }";
         }
 
         file << "\n  ]\n}\n";
-        file.close();
+        return file.str();
+    }
+
+    // Writes path.tmp, flushes it to disk and renames it over path
+    static bool writeFileAtomically(const std::string& path, const std::string& contents,
+                                    std::string& error) {
+        std::string tempPath = path + ".tmp";
+        FILE* file = std::fopen(tempPath.c_str(), "wb");
+        if (!file) {
+            error = std::string("cannot create ") + tempPath + ": " + std::strerror(errno);
+            return false;
+        }
+        bool ok = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size() &&
+                  std::fflush(file) == 0;
+#ifdef _WIN32
+        ok = ok && _commit(_fileno(file)) == 0;
+#else
+        ok = ok && fsync(fileno(file)) == 0;
+#endif
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok) {
+            error = std::string("cannot write ") + tempPath + ": " + std::strerror(errno);
+            std::remove(tempPath.c_str());
+            return false;
+        }
+#ifdef _WIN32
+        ok = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+        if (!ok) {
+            error = std::string("cannot replace ") + path + ": " + std::strerror(errno);
+            std::remove(tempPath.c_str());
+        }
+        return ok;
     }
 
     static std::string escapeJson(const std::string& s) {
@@ -529,21 +1277,34 @@ private:
         return filePath.substr(0, pos);
     }
 
-    static void ensureDirectoryExists(const std::string& path) {
-#ifdef _WIN32
-        // Create directories recursively on Windows
+    // Creates path and any missing parents (like mkdir -p)
+    static bool ensureDirectoryExists(const std::string& path, std::string& error) {
         std::string current;
-        for (char c : path) {
-            current += c;
-            if (c == '/' || c == '\\') {
-                CreateDirectoryA(current.c_str(), NULL);
+        for (size_t i = 0; i <= path.size(); i++) {
+            if (i < path.size() && path[i] != '/' && path[i] != '\\') {
+                current += path[i];
+                continue;
             }
+            // Skip the root ("/", "C:") and repeated separators
+            if (!current.empty() && current.back() != ':' && !createDirectory(current)) {
+                error = "cannot create directory " + current + ": " + std::strerror(errno);
+                return false;
+            }
+            if (i < path.size()) current += path[i];
         }
-        CreateDirectoryA(path.c_str(), NULL);
+        return true;
+    }
+
+    // True if the directory was created or already exists
+    static bool createDirectory(const std::string& path) {
+#ifdef _WIN32
+        if (CreateDirectoryA(path.c_str(), NULL)) return true;
+        DWORD attributes = GetFileAttributesA(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
 #else
-        // Use mkdir with recursive flag
-        std::string cmd = "mkdir -p \"" + path + "\"";
-        system(cmd.c_str());
+        if (mkdir(path.c_str(), 0755) == 0) return true;
+        struct stat info;
+        return errno == EEXIST && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
 #endif
     }
 
@@ -560,41 +1321,4 @@ private:
 
         return ss.str();
     }
-
-    static std::string extractJsonString(const std::string& json, const std::string& key) {
-        std::string searchKey = "\"" + key + "\":";
-        size_t keyPos = json.find(searchKey);
-        if (keyPos == std::string::npos) {
-            // Try with space after colon
-            searchKey = "\"" + key + "\": ";
-            keyPos = json.find(searchKey);
-            if (keyPos == std::string::npos) return "";
-        }
-
-        size_t valueStart = json.find('"', keyPos + searchKey.length());
-        if (valueStart == std::string::npos) return "";
-
-        size_t valueEnd = json.find('"', valueStart + 1);
-        if (valueEnd == std::string::npos) return "";
-
-        return json.substr(valueStart + 1, valueEnd - valueStart - 1);
-    }
-
-    static bool extractJsonBool(const std::string& json, const std::string& key) {
-        std::string searchKey = "\"" + key + "\":";
-        size_t keyPos = json.find(searchKey);
-        if (keyPos == std::string::npos) {
-            searchKey = "\"" + key + "\": ";
-            keyPos = json.find(searchKey);
-            if (keyPos == std::string::npos) return false;
-        }
-
-        size_t valueStart = keyPos + searchKey.length();
-        // Skip whitespace
-        while (valueStart < json.length() && (json[valueStart] == ' ' || json[valueStart] == '\t')) {
-            valueStart++;
-        }
-
-        return json.substr(valueStart, 4) == "true";
-    }
 };
@@ -14,28 +14,37 @@
 
 #include <juce_audio_devices/juce_audio_devices.h>
 
+#include "Metrics.h"
+#include "MidiMessageQueue.h"
+#include "MidiPacket.h"
+#include "MidiSysExAssembler.h"
+
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <vector>
 
 // Callback type for message routing
 using VirtualMidiMessageCallback = std::function<void(const std::string& portId,
-                                                      const std::vector<uint8_t>& data)>;
+                                                      const MidiPacket& data,
+                                                      MidiInputPart part)>;
 
 class VirtualMidiPort : public juce::MidiInputCallback
 {
 public:
-    VirtualMidiPort(const std::string& id, const std::string& name, bool isInput)
-        : portId(id), portName(name), isInputPort(isInput) {}
+    VirtualMidiPort(const std::string& id, const std::string& name, bool isInput,
+                    const MidiQueueConfig& queueConfig = MidiQueueConfig(),
+                    const MidiSysExConfig& sysexConfig = MidiSysExConfig())
+        : portId(id), portName(name), isInputPort(isInput), messageQueue(queueConfig, &memoryAccount),
+          sysexAssembler(sysexConfig, &memoryAccount) {}
 
     // Legacy constructor for backward compatibility
     VirtualMidiPort(const std::string& name, bool isInput)
-        : portId("virtual:" + name), portName(name), isInputPort(isInput) {}
+        : VirtualMidiPort("virtual:" + name, name, isInput) {}
 
     // Set callback for incoming messages (for routing)
     void setMessageCallback(VirtualMidiMessageCallback callback) {
@@ -74,6 +83,7 @@ public:
             virtualInput->stop();
             virtualInput.reset();
         }
+        std::lock_guard<std::mutex> lock(sendMutex);
         virtualOutput.reset();
     }
 
@@ -81,29 +91,30 @@ public:
     // Emits via CoreMIDI so connected DAWs/WebMIDI receive it, AND queues
     // in the HTTP message queue so HTTP-polling clients (e.g. web editors)
     // can retrieve it via GET /virtual/:id/messages.
-    void sendMessage(const std::vector<uint8_t>& data) {
+    // Thread-safe; concurrent senders to this port are serialized by sendMutex,
+    // so the queue sees messages in the order they were emitted.
+    // Returns false if the message was refused (invalid or port not open).
+    bool sendMessage(const MidiPacket& data) {
+        std::lock_guard<std::mutex> lock(sendMutex);
         if (!virtualOutput) {
             std::cerr << "Cannot send: virtual output not open\n";
-            return;
+            return false;
         }
 
         if (data.empty()) {
             std::cerr << "Warning: Attempted to send empty MIDI message\n";
-            return;
+            return false;
         }
 
         if (data[0] == 0xF0) {
-            // SysEx message
+            // SysEx message - validate it ends with 0xF7
             if (data.back() != 0xF7) {
                 std::cerr << "Warning: Invalid SysEx message (missing 0xF7)\n";
-                return;
+                return false;
             }
             if (data.size() > 2) {
                 virtualOutput->sendMessageNow(
-                    juce::MidiMessage::createSysExMessage(
-                        data.data() + 1,
-                        (int)data.size() - 2
-                    )
+                    juce::MidiMessage(data.data(), (int)data.size())
                 );
             }
         } else if (data.size() >= 1 && data.size() <= 3) {
@@ -112,132 +123,138 @@ public:
             );
         } else {
             std::cerr << "Warning: Invalid MIDI message length: " << data.size() << " bytes\n";
-            return;
+            return false;
         }
 
-        // Also queue for HTTP polling (GET /virtual/:id/messages)
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            messageQueue.push(data);
+        // Also queue for HTTP polling (GET /virtual/:id/messages);
+        // shares the payload rather than copying it
+        metrics.recordOut(data.size());
+        messageQueue.push(data);
+        return true;
+    }
+
+    // One piece of a SysEx routed from a streaming input (see
+    // MidiPacket::isPartialSysEx), which sendMessage refuses as incomplete.
+    // Only RouteManager's streaming path sends these. Pieces are queued for
+    // HTTP polling as they are emitted.
+    bool sendFragment(const MidiPacket& data) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (!virtualOutput) {
+            std::cerr << "Cannot send: virtual output not open\n";
+            return false;
         }
+        if (!data.isPartialSysEx()) {
+            std::cerr << "Warning: Invalid SysEx fragment (" << data.size() << " bytes)\n";
+            return false;
+        }
+        virtualOutput->sendMessageNow(juce::MidiMessage(data.data(), (int)data.size()));
+        metrics.recordOut(data.size());
+        messageQueue.push(data);
+        return true;
     }
 
     // Inject a message into the virtual input port.
     // Queues for HTTP polling AND fires the routing callback, exactly as if
     // the message arrived from CoreMIDI. Used for automated testing.
-    void injectMessage(const std::vector<uint8_t>& data) {
+    void injectMessage(const MidiPacket& data) {
         if (!isInputPort) {
             std::cerr << "Cannot inject: not an input port\n";
             return;
         }
 
-        {
-            std::lock_guard<std::mutex> lock(queueMutex);
-            messageQueue.push(data);
-        }
+        metrics.recordIn(data.size());
+        messageQueue.push(data);
 
         // Fire routing callback so routes actually forward the message
-        VirtualMidiMessageCallback callback;
-        {
-            std::lock_guard<std::mutex> lock(callbackMutex);
-            callback = messageCallback;
-        }
-        if (callback) {
-            callback(portId, data);
-        }
+        route(data, MidiInputPart::Message);
     }
 
     // Get messages received by this virtual input port
-    std::vector<std::vector<uint8_t>> getMessages() {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        std::vector<std::vector<uint8_t>> result;
-        while (!messageQueue.empty()) {
-            result.push_back(messageQueue.front());
-            messageQueue.pop();
-        }
-        return result;
+    std::vector<MidiPacket> getMessages() {
+        return messageQueue.drain();
+    }
+
+    // Messages dropped since the last poll (reported only under the Report policy)
+    uint64_t takeDroppedSinceLastPoll() { return messageQueue.takeDroppedSinceLastPoll(); }
+
+    QueueOverflowPolicy getOverflowPolicy() const { return messageQueue.getOverflowPolicy(); }
+
+    MidiQueueStats getQueueStats() const { return messageQueue.getStats(); }
+
+    const PortMetrics& getMetrics() const { return metrics; }
+
+    // Blocks an HTTP thread until messages arrive (long-poll / streaming)
+    bool waitForMessages(std::chrono::milliseconds timeout) {
+        return messageQueue.waitForMessages(timeout);
     }
 
+    // Releases any waiting pollers; called when the port is being removed
+    void interruptWaiters() { messageQueue.interruptWaiters(); }
+
+    bool isInterrupted() const { return messageQueue.isInterrupted(); }
+
     const std::string& getName() const { return portName; }
     bool isInput() const { return isInputPort; }
 
+    // Virtual ports have no device that can go away
+    bool isConnected() const { return true; }
+
+    MidiSysExStats getSysExStats() const { return sysexAssembler.getStats(); }
+
+    MidiMemoryStats getMemoryStats() const { return memoryAccount.getStats(); }
+
     // MidiInputCallback interface - receives messages sent TO this virtual input
     void handleIncomingMidiMessage(juce::MidiInput* source,
                                    const juce::MidiMessage& message) override {
-        std::vector<uint8_t> data;
-        auto rawData = message.getRawData();
-        auto size = message.getRawDataSize();
+        // SysEx buffer state is only touched from the JUCE input callback thread
+        MidiPacket completedMessage;  // For queue and routing callback
+        MidiInputPart part;
+        if (!sysexAssembler.receive(message.getRawData(), (size_t)message.getRawDataSize(),
+                                    completedMessage, part, [this](const MidiPacket& chunk) {
+                                        route(chunk, MidiInputPart::SysExChunk);
+                                    })) {
+            return;
+        }
 
-        std::vector<uint8_t> completedMessage;  // For routing callback
+        metrics.recordIn(completedMessage.size());
+        messageQueue.push(completedMessage);
+        route(completedMessage, part);
+    }
 
+    // A SysEx still arriving; only used in streaming mode, where the bytes
+    // added since the last call are routed right away
+    void handlePartialSysexMessage(juce::MidiInput* source, const juce::uint8* messageData,
+                                   int numBytesSoFar, double timestamp) override {
+        sysexAssembler.receivePartial(messageData, (size_t)std::max(numBytesSoFar, 0),
+                                      [this](const MidiPacket& chunk) {
+                                          route(chunk, MidiInputPart::SysExChunk);
+                                      });
+    }
+
+private:
+    void route(const MidiPacket& packet, MidiInputPart part) {
+        VirtualMidiMessageCallback callback;
         {
-            std::lock_guard<std::mutex> lock(queueMutex);
-
-            // Handle SysEx
-            bool startsWithF0 = (size > 0 && rawData[0] == 0xF0);
-            bool endsWithF7 = (size > 0 && rawData[size - 1] == 0xF7);
-
-            if (message.isSysEx() || startsWithF0) {
-                if (startsWithF0) {
-                    sysexBuffer.clear();
-                    sysexBuffer.insert(sysexBuffer.end(), rawData, rawData + size);
-                    sysexBuffering = true;
-
-                    if (endsWithF7) {
-                        messageQueue.push(sysexBuffer);
-                        completedMessage = sysexBuffer;
-                        sysexBuffer.clear();
-                        sysexBuffering = false;
-                    }
-                } else if (sysexBuffering) {
-                    sysexBuffer.insert(sysexBuffer.end(), rawData, rawData + size);
-                    if (endsWithF7) {
-                        messageQueue.push(sysexBuffer);
-                        completedMessage = sysexBuffer;
-                        sysexBuffer.clear();
-                        sysexBuffering = false;
-                    }
-                } else if (message.isSysEx()) {
-                    auto sysexData = message.getSysExData();
-                    auto sysexSize = message.getSysExDataSize();
-                    data.push_back(0xF0);
-                    data.insert(data.end(), sysexData, sysexData + sysexSize);
-                    data.push_back(0xF7);
-                    messageQueue.push(data);
-                    completedMessage = data;
-                }
-            } else {
-                data.insert(data.end(), rawData, rawData + size);
-                messageQueue.push(data);
-                completedMessage = data;
-            }
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            callback = messageCallback;
         }
-
-        // Call routing callback if set (outside queue lock to avoid deadlock)
-        if (!completedMessage.empty()) {
-            VirtualMidiMessageCallback callback;
-            {
-                std::lock_guard<std::mutex> lock(callbackMutex);
-                callback = messageCallback;
-            }
-            if (callback) {
-                callback(portId, completedMessage);
-            }
+        if (callback) {
+            callback(portId, packet, part);
         }
     }
 
-private:
     std::string portId;
     std::string portName;
     bool isInputPort;
     std::unique_ptr<juce::MidiInput> virtualInput;
     std::unique_ptr<juce::MidiOutput> virtualOutput;
-    std::queue<std::vector<uint8_t>> messageQueue;
-    std::mutex queueMutex;
+    MidiMemoryAccount memoryAccount;   // Queue and SysEx assembly
+    MidiMessageQueue messageQueue;
+    PortMetrics metrics;
+    std::mutex sendMutex;   // Serializes sendMessageNow calls on virtualOutput
 
-    // SysEx buffering
-    std::vector<uint8_t> sysexBuffer;
-    bool sysexBuffering = false;
+    // SysEx buffering for fragmented messages (input callback thread only)
+    MidiSysExAssembler sysexAssembler;
 
     // Callback for routing
     VirtualMidiMessageCallback messageCallback;